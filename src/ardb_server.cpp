@@ -112,11 +112,35 @@ namespace ardb
         {
             cfg.backup_redis_format = true;
         }
+        conf_get_int64(props, "dump-threads", cfg.dump_threads);
+        if (cfg.dump_threads <= 0)
+        {
+            cfg.dump_threads = available_processors();
+        }
 
         conf_get_string(props, "zookeeper-servers", cfg.zookeeper_servers);
 
         conf_get_string(props, "loglevel", cfg.loglevel);
         conf_get_string(props, "logfile", cfg.logfile);
+        conf_get_bool(props, "log-async", cfg.log_options.async);
+        int64 log_buffer_size = cfg.log_options.buffer_size;
+        conf_get_int64(props, "log-buffer-size", log_buffer_size);
+        if (log_buffer_size > 0)
+        {
+            cfg.log_options.buffer_size = log_buffer_size;
+        }
+        std::string log_buffer_full_policy;
+        conf_get_string(props, "log-buffer-full-policy", log_buffer_full_policy);
+        if (!strcasecmp(log_buffer_full_policy.c_str(), "block"))
+        {
+            cfg.log_options.block_on_full = true;
+        }
+        int64 log_rotate_size = cfg.log_options.rotate_size;
+        conf_get_int64(props, "log-rotate-size", log_rotate_size);
+        cfg.log_options.rotate_size = log_rotate_size > 0 ? log_rotate_size : 0;
+        int64 log_rotate_interval = 0;
+        conf_get_int64(props, "log-rotate-interval", log_rotate_interval);
+        cfg.log_options.rotate_interval = log_rotate_interval > 0 ? log_rotate_interval : 0;
         conf_get_bool(props, "daemonize", cfg.daemonize);
 
         conf_get_int64(props, "thread-pool-size", cfg.worker_count);
@@ -128,6 +152,12 @@ namespace ardb
         conf_get_int64(props, "repl-backlog-size", cfg.repl_backlog_size);
         conf_get_int64(props, "repl-ping-slave-period", cfg.repl_ping_slave_period);
         conf_get_int64(props, "repl-timeout", cfg.repl_timeout);
+        conf_get_int64(props, "repl-apply-threads", cfg.repl_apply_threads);
+        conf_get_int64(props, "repl-diskless-sync-delay", cfg.repl_diskless_sync_delay);
+        if (cfg.repl_apply_threads <= 0)
+        {
+            cfg.repl_apply_threads = available_processors();
+        }
         conf_get_int64(props, "repl-state-persist-period", cfg.repl_state_persist_period);
         conf_get_int64(props, "repl-backlog-ttl", cfg.repl_backlog_time_limit);
         conf_get_int64(props, "lua-time-limit", cfg.lua_time_limit);
@@ -138,17 +168,31 @@ namespace ardb
         conf_get_int64(props, "set-max-ziplist-value", cfg.db_cfg.set_max_ziplist_value);
         conf_get_int64(props, "list-max-ziplist-entries", cfg.db_cfg.list_max_ziplist_entries);
         conf_get_int64(props, "list-max-ziplist-value", cfg.db_cfg.list_max_ziplist_value);
+        conf_get_int64(props, "list-segment-max-entries", cfg.db_cfg.list_max_segment_entries);
+        conf_get_int64(props, "list-segment-max-size", cfg.db_cfg.list_max_segment_size);
+        conf_get_bool(props, "bitset-compress-chunks", cfg.db_cfg.bitset_compress_chunks);
         conf_get_int64(props, "zset-max-ziplist-entries", cfg.db_cfg.zset_max_ziplist_entries);
         conf_get_int64(props, "zset_max_ziplist_value", cfg.db_cfg.zset_max_ziplist_value);
 
         conf_get_int64(props, "L1-cache-max-memory", cfg.db_cfg.L1_cache_memory_limit);
+        conf_get_int64(props, "meta-cache-max-memory", cfg.db_cfg.meta_cache_memory_limit);
         conf_get_bool(props, "zset-write-fill-cache", cfg.db_cfg.zset_write_fill_cache);
         conf_get_bool(props, "zset-read-load-cache", cfg.db_cfg.zset_read_load_cache);
+        conf_get_bool(props, "hash-write-fill-cache", cfg.db_cfg.hash_write_fill_cache);
+        conf_get_bool(props, "hash-read-load-cache", cfg.db_cfg.hash_read_load_cache);
+        conf_get_bool(props, "set-write-fill-cache", cfg.db_cfg.set_write_fill_cache);
+        conf_get_bool(props, "set-read-load-cache", cfg.db_cfg.set_read_load_cache);
+        conf_get_bool(props, "string-write-fill-cache", cfg.db_cfg.string_write_fill_cache);
+        conf_get_bool(props, "string-read-load-cache", cfg.db_cfg.string_read_load_cache);
         conf_get_bool(props, "read-fill-cache", cfg.db_cfg.read_fill_cache);
 
         conf_get_int64(props, "hll-sparse-max-bytes", cfg.db_cfg.hll_sparse_max_bytes);
         conf_get_int64(props, "area-mesh-geohash-step", cfg.db_cfg.area_geohash_step);
 
+        conf_get_bool(props, "lazyfree", cfg.db_cfg.lazy_free);
+        conf_get_int64(props, "lazyfree-min-elements", cfg.db_cfg.lazy_free_min_elements);
+        conf_get_int64(props, "lazyfree-max-deletes-per-sec", cfg.db_cfg.lazy_free_max_deletes_per_sec);
+
         conf_get_bool(props, "slave-read-only", cfg.slave_readonly);
         conf_get_bool(props, "slave-serve-stale-data", cfg.slave_serve_stale_data);
         conf_get_int64(props, "slave-priority", cfg.slave_priority);
@@ -199,6 +243,11 @@ namespace ardb
         }
         make_dir(cfg.data_base_path);
         cfg.data_base_path = real_path(cfg.data_base_path);
+        conf_get_string(props, "restore-checkpoint", cfg.restore_checkpoint);
+        if (!cfg.restore_checkpoint.empty() && is_dir_exist(cfg.restore_checkpoint))
+        {
+            cfg.restore_checkpoint = real_path(cfg.restore_checkpoint);
+        }
 
         conf_get_string(props, "additional-misc-info", cfg.additional_misc_info);
 
@@ -269,7 +318,7 @@ namespace ardb
 
     ArdbServer::ArdbServer(KeyValueEngineFactory& engine) :
             m_service(NULL), m_db(NULL), m_engine(engine), m_slowlog_handler(m_cfg), m_master_serv(this), m_slave_client(
-                    this), m_watch_mutex(
+                    this), m_backup(this), m_watch_mutex(
             PTHREAD_MUTEX_RECURSIVE), m_ctx_local(false)
     {
         struct RedisCommandHandlerSetting settingTable[] =
@@ -290,6 +339,7 @@ namespace ardb
                 { "bgsave", REDIS_CMD_BGSAVE, &ArdbServer::BGSave, 0, 0, "ar", 0 },
                 { "import", REDIS_CMD_IMPORT, &ArdbServer::Import, 0, 1, "ars", 0 },
                 { "lastsave", REDIS_CMD_LASTSAVE, &ArdbServer::LastSave, 0, 0, "r", 0 },
+                { "backup", REDIS_CMD_BACKUP, &ArdbServer::BackupCheckpoint, 0, 1, "ars", 0 },
                 { "slowlog", REDIS_CMD_SLOWLOG, &ArdbServer::SlowLog, 1, 2, "r", 0 },
                 { "dbsize", REDIS_CMD_DBSIZE, &ArdbServer::DBSize, 0, 0, "r", 0 },
                 { "config", REDIS_CMD_CONFIG, &ArdbServer::Config, 1, 3, "ar", 0 },
@@ -308,56 +358,56 @@ namespace ardb
                 { "psync", REDIS_CMD_PSYNC, &ArdbServer::PSync, 2, 2, "ars", 0 },
                 { "apsync", REDIS_CMD_PSYNC, &ArdbServer::PSync, 2, -1, "ars", 0 },
                 { "select", REDIS_CMD_SELECT, &ArdbServer::Select, 1, 1, "r", 0 },
-                { "append", REDIS_CMD_APPEND, &ArdbServer::Append, 2, 2, "w", 0 },
+                { "append", REDIS_CMD_APPEND, &ArdbServer::Append, 2, 2, "wK", 0 },
                 { "get", REDIS_CMD_GET, &ArdbServer::Get, 1, 1, "r", 0 },
-                { "set", REDIS_CMD_SET, &ArdbServer::Set, 2, 7, "w", 0 },
+                { "set", REDIS_CMD_SET, &ArdbServer::Set, 2, 7, "wK", 0 },
                 { "del", REDIS_CMD_DEL, &ArdbServer::Del, 1, -1, "w", 0 },
                 { "exists", REDIS_CMD_EXISTS, &ArdbServer::Exists, 1, 1, "r", 0 },
-                { "expire", REDIS_CMD_EXPIRE, &ArdbServer::Expire, 2, 2, "w", 0 },
-                { "pexpire", REDIS_CMD_PEXPIRE, &ArdbServer::PExpire, 2, 2, "w", 0 },
-                { "expireat", REDIS_CMD_EXPIREAT, &ArdbServer::Expireat, 2, 2, "w", 0 },
-                { "pexpireat", REDIS_CMD_PEXPIREAT, &ArdbServer::PExpireat, 2, 2, "w", 0 },
-                { "persist", REDIS_CMD_PERSIST, &ArdbServer::Persist, 1, 1, "w", 1 },
+                { "expire", REDIS_CMD_EXPIRE, &ArdbServer::Expire, 2, 2, "wK", 0 },
+                { "pexpire", REDIS_CMD_PEXPIRE, &ArdbServer::PExpire, 2, 2, "wK", 0 },
+                { "expireat", REDIS_CMD_EXPIREAT, &ArdbServer::Expireat, 2, 2, "wK", 0 },
+                { "pexpireat", REDIS_CMD_PEXPIREAT, &ArdbServer::PExpireat, 2, 2, "wK", 0 },
+                { "persist", REDIS_CMD_PERSIST, &ArdbServer::Persist, 1, 1, "wK", 1 },
                 { "ttl", REDIS_CMD_TTL, &ArdbServer::TTL, 1, 1, "r", 0 },
                 { "pttl", REDIS_CMD_PTTL, &ArdbServer::PTTL, 1, 1, "r", 0 },
                 { "type", REDIS_CMD_TYPE, &ArdbServer::Type, 1, 1, "r", 0 },
                 { "bitcount", REDIS_CMD_BITCOUNT, &ArdbServer::Bitcount, 1, 3, "r", 0 },
                 { "bitop", REDIS_CMD_BITOP, &ArdbServer::Bitop, 3, -1, "w", 1 },
                 { "bitopcount", REDIS_CMD_BITOPCUNT, &ArdbServer::BitopCount, 2, -1, "w", 0 },
-                { "decr", REDIS_CMD_DECR, &ArdbServer::Decr, 1, 1, "w", 1 },
-                { "decrby", REDIS_CMD_DECRBY, &ArdbServer::Decrby, 2, 2, "w", 1 },
+                { "decr", REDIS_CMD_DECR, &ArdbServer::Decr, 1, 1, "wK", 1 },
+                { "decrby", REDIS_CMD_DECRBY, &ArdbServer::Decrby, 2, 2, "wK", 1 },
                 { "getbit", REDIS_CMD_GETBIT, &ArdbServer::GetBit, 2, 2, "r", 0 },
                 { "getrange", REDIS_CMD_GETRANGE, &ArdbServer::GetRange, 3, 3, "r", 0 },
-                { "getset", REDIS_CMD_GETSET, &ArdbServer::GetSet, 2, 2, "w", 1 },
-                { "incr", REDIS_CMD_INCR, &ArdbServer::Incr, 1, 1, "w", 1 },
-                { "incrby", REDIS_CMD_INCRBY, &ArdbServer::Incrby, 2, 2, "w", 1 },
-                { "incrbyfloat", REDIS_CMD_INCRBYFLOAT, &ArdbServer::IncrbyFloat, 2, 2, "w", 0 },
+                { "getset", REDIS_CMD_GETSET, &ArdbServer::GetSet, 2, 2, "wK", 1 },
+                { "incr", REDIS_CMD_INCR, &ArdbServer::Incr, 1, 1, "wK", 1 },
+                { "incrby", REDIS_CMD_INCRBY, &ArdbServer::Incrby, 2, 2, "wK", 1 },
+                { "incrbyfloat", REDIS_CMD_INCRBYFLOAT, &ArdbServer::IncrbyFloat, 2, 2, "wK", 0 },
                 { "mget", REDIS_CMD_MGET, &ArdbServer::MGet, 1, -1, "w", 0 },
                 { "mset", REDIS_CMD_MSET, &ArdbServer::MSet, 2, -1, "w", 0 },
                 { "msetnx", REDIS_CMD_MSETNX, &ArdbServer::MSetNX, 2, -1, "w", 0 },
-                { "psetex", REDIS_CMD_PSETEX, &ArdbServer::MSetNX, 3, 3, "w", 0 },
-                { "setbit", REDIS_CMD_SETBIT, &ArdbServer::SetBit, 3, 3, "w", 0 },
-                { "setex", REDIS_CMD_SETEX, &ArdbServer::SetEX, 3, 3, "w", 0 },
-                { "setnx", REDIS_CMD_SETNX, &ArdbServer::SetNX, 2, 2, "w", 0 },
-                { "setrange", REDIS_CMD_SETEANGE, &ArdbServer::SetRange, 3, 3, "w", 0 },
+                { "psetex", REDIS_CMD_PSETEX, &ArdbServer::MSetNX, 3, 3, "wK", 0 },
+                { "setbit", REDIS_CMD_SETBIT, &ArdbServer::SetBit, 3, 3, "wK", 0 },
+                { "setex", REDIS_CMD_SETEX, &ArdbServer::SetEX, 3, 3, "wK", 0 },
+                { "setnx", REDIS_CMD_SETNX, &ArdbServer::SetNX, 2, 2, "wK", 0 },
+                { "setrange", REDIS_CMD_SETEANGE, &ArdbServer::SetRange, 3, 3, "wK", 0 },
                 { "strlen", REDIS_CMD_STRLEN, &ArdbServer::Strlen, 1, 1, "r", 0 },
-                { "hdel", REDIS_CMD_HDEL, &ArdbServer::HDel, 2, -1, "w", 0 },
+                { "hdel", REDIS_CMD_HDEL, &ArdbServer::HDel, 2, -1, "wK", 0 },
                 { "hexists", REDIS_CMD_HEXISTS, &ArdbServer::HExists, 2, 2, "r", 0 },
                 { "hget", REDIS_CMD_HGET, &ArdbServer::HGet, 2, 2, "r", 0 },
                 { "hgetall", REDIS_CMD_HGETALL, &ArdbServer::HGetAll, 1, 1, "r", 0 },
-                { "hincrby", REDIS_CMD_HINCR, &ArdbServer::HIncrby, 3, 3, "w", 0 },
+                { "hincrby", REDIS_CMD_HINCR, &ArdbServer::HIncrby, 3, 3, "wK", 0 },
                 { "hmincrby", REDIS_CMD_HMINCRBY, &ArdbServer::HMIncrby, 3, -1, "w", 0 },
-                { "hincrbyfloat", REDIS_CMD_HINCRBYFLOAT, &ArdbServer::HIncrbyFloat, 3, 3, "w", 0 },
+                { "hincrbyfloat", REDIS_CMD_HINCRBYFLOAT, &ArdbServer::HIncrbyFloat, 3, 3, "wK", 0 },
                 { "hkeys", REDIS_CMD_HKEYS, &ArdbServer::HKeys, 1, 1, "r", 0 },
                 { "hlen", REDIS_CMD_HLEN, &ArdbServer::HLen, 1, 1, "r", 0 },
                 { "hvals", REDIS_CMD_HVALS, &ArdbServer::HVals, 1, 1, "r", 0 },
                 { "hmget", REDIS_CMD_HMGET, &ArdbServer::HMGet, 2, -1, "r", 0 },
-                { "hset", REDIS_CMD_HSET, &ArdbServer::HSet, 3, 3, "w", 0 },
-                { "hsetnx", REDIS_CMD_HSETNX, &ArdbServer::HSetNX, 3, 3, "w", 0 },
-                { "hmset", REDIS_CMD_HMSET, &ArdbServer::HMSet, 3, -1, "w", 0 },
+                { "hset", REDIS_CMD_HSET, &ArdbServer::HSet, 3, 3, "wK", 0 },
+                { "hsetnx", REDIS_CMD_HSETNX, &ArdbServer::HSetNX, 3, 3, "wK", 0 },
+                { "hmset", REDIS_CMD_HMSET, &ArdbServer::HMSet, 3, -1, "wK", 0 },
                 { "hscan", REDIS_CMD_HSCAN, &ArdbServer::HScan, 2, 6, "r", 0 },
                 { "scard", REDIS_CMD_SCARD, &ArdbServer::SCard, 1, 1, "r", 0 },
-                { "sadd", REDIS_CMD_SADD, &ArdbServer::SAdd, 2, -1, "w", 0 },
+                { "sadd", REDIS_CMD_SADD, &ArdbServer::SAdd, 2, -1, "wK", 0 },
                 { "sdiff", REDIS_CMD_SDIFF, &ArdbServer::SDiff, 2, -1, "r", 0 },
                 { "sdiffcount", REDIS_CMD_SDIFFCOUNT, &ArdbServer::SDiffCount, 2, -1, "r", 0 },
                 { "sdiffstore", REDIS_CMD_SDIFFSTORE, &ArdbServer::SDiffStore, 3, -1, "w", 0 },
@@ -365,27 +415,29 @@ namespace ardb
                 { "sintercount", REDIS_CMD_SINTERCOUNT, &ArdbServer::SInterCount, 2, -1, "r", 0 },
                 { "sinterstore", REDIS_CMD_SINTERSTORE, &ArdbServer::SInterStore, 3, -1, "r", 0 },
                 { "sismember", REDIS_CMD_SISMEMBER, &ArdbServer::SIsMember, 2, 2, "r", 0 },
+                { "smismember", REDIS_CMD_SMISMEMBER, &ArdbServer::SMIsMember, 2, -1, "r", 0 },
+                { "scheck", REDIS_CMD_SCHECK, &ArdbServer::SCheck, 1, 2, "w", 0 },
                 { "smembers", REDIS_CMD_SMEMBERS, &ArdbServer::SMembers, 1, 1, "r", 0 },
                 { "smove", REDIS_CMD_SMOVE, &ArdbServer::SMove, 3, 3, "w", 0 },
-                { "spop", REDIS_CMD_SPOP, &ArdbServer::SPop, 1, 1, "w", 0 },
+                { "spop", REDIS_CMD_SPOP, &ArdbServer::SPop, 1, 1, "wK", 0 },
                 { "srandmember", REDIS_CMD_SRANMEMEBER, &ArdbServer::SRandMember, 1, 2, "r", 0 },
-                { "srem", REDIS_CMD_SREM, &ArdbServer::SRem, 2, -1, "w", 1 },
+                { "srem", REDIS_CMD_SREM, &ArdbServer::SRem, 2, -1, "wK", 1 },
                 { "sunion", REDIS_CMD_SUNION, &ArdbServer::SUnion, 2, -1, "r", 0 },
                 { "sunionstore", REDIS_CMD_SUNIONSTORE, &ArdbServer::SUnionStore, 3, -1, "r", 0 },
                 { "sunioncount", REDIS_CMD_SUNIONCOUNT, &ArdbServer::SUnionCount, 2, -1, "r", 0 },
                 { "sscan", REDIS_CMD_SSCAN, &ArdbServer::SScan, 2, 6, "r", 0 },
-                { "zadd", REDIS_CMD_ZADD, &ArdbServer::ZAdd, 3, -1, "w", 0 },
+                { "zadd", REDIS_CMD_ZADD, &ArdbServer::ZAdd, 3, -1, "wK", 0 },
                 { "zcard", REDIS_CMD_ZCARD, &ArdbServer::ZCard, 1, 1, "r", 0 },
                 { "zcount", REDIS_CMD_ZCOUNT, &ArdbServer::ZCount, 3, 3, "r", 0 },
-                { "zincrby", REDIS_CMD_ZINCRBY, &ArdbServer::ZIncrby, 3, 3, "w", 0 },
+                { "zincrby", REDIS_CMD_ZINCRBY, &ArdbServer::ZIncrby, 3, 3, "wK", 0 },
                 { "zrange", REDIS_CMD_ZRANGE, &ArdbServer::ZRange, 3, 4, "r", 0 },
                 { "zrangebyscore", REDIS_CMD_ZRANGEBYSCORE, &ArdbServer::ZRangeByScore, 3, 7, "r", 0 },
                 { "zrank", REDIS_CMD_ZRANK, &ArdbServer::ZRank, 2, 2, "r", 0 },
-                { "zrem", REDIS_CMD_ZREM, &ArdbServer::ZRem, 2, -1, "w", 0 },
+                { "zrem", REDIS_CMD_ZREM, &ArdbServer::ZRem, 2, -1, "wK", 0 },
                 { "zpop", REDIS_CMD_ZPOP, &ArdbServer::ZPop, 1, 2, "w", 0 },
                 { "zrpop", REDIS_CMD_ZRPOP, &ArdbServer::ZPop, 2, 2, "w", 0 },
-                { "zremrangebyrank", REDIS_CMD_ZREMRANGEBYRANK, &ArdbServer::ZRemRangeByRank, 3, 3, "w", 0 },
-                { "zremrangebyscore", REDIS_CMD_ZREMRANGEBYSCORE, &ArdbServer::ZRemRangeByScore, 3, 3, "w", 0 },
+                { "zremrangebyrank", REDIS_CMD_ZREMRANGEBYRANK, &ArdbServer::ZRemRangeByRank, 3, 3, "wK", 0 },
+                { "zremrangebyscore", REDIS_CMD_ZREMRANGEBYSCORE, &ArdbServer::ZRemRangeByScore, 3, 3, "wK", 0 },
                 { "zrevrange", REDIS_CMD_ZREVRANGE, &ArdbServer::ZRevRange, 3, 4, "r", 0 },
                 { "zrevrangebyscore", REDIS_CMD_ZREVRANGEBYSCORE, &ArdbServer::ZRevRangeByScore, 3, 7, "r", 0 },
                 { "zinterstore", REDIS_CMD_ZINTERSTORE, &ArdbServer::ZInterStore, 3, -1, "w", 0 },
@@ -396,20 +448,20 @@ namespace ardb
                 { "zlexcount", REDIS_CMD_ZLEXCOUNT, &ArdbServer::ZLexCount, 3, 3, "r", 0 },
                 { "zrangebylex", REDIS_CMD_ZRANGEBYLEX, &ArdbServer::ZRangeByLex, 3, 6, "r", 0 },
                 { "zrevrangebylex", REDIS_CMD_ZREVRANGEBYLEX, &ArdbServer::ZRangeByLex, 3, 6, "r", 0 },
-                { "zremrangebylex", REDIS_CMD_ZREMRANGEBYLEX, &ArdbServer::ZRemRangeByLex, 3, 3, "w", 0 },
+                { "zremrangebylex", REDIS_CMD_ZREMRANGEBYLEX, &ArdbServer::ZRemRangeByLex, 3, 3, "wK", 0 },
                 { "lindex", REDIS_CMD_LINDEX, &ArdbServer::LIndex, 2, 2, "r", 0 },
-                { "linsert", REDIS_CMD_LINSERT, &ArdbServer::LInsert, 4, 4, "w", 0 },
+                { "linsert", REDIS_CMD_LINSERT, &ArdbServer::LInsert, 4, 4, "wK", 0 },
                 { "llen", REDIS_CMD_LLEN, &ArdbServer::LLen, 1, 1, "r", 0 },
-                { "lpop", REDIS_CMD_LPOP, &ArdbServer::LPop, 1, 1, "w", 0 },
-                { "lpush", REDIS_CMD_LPUSH, &ArdbServer::LPush, 2, -1, "w", 0 },
-                { "lpushx", REDIS_CMD_LPUSHX, &ArdbServer::LPushx, 2, 2, "w", 0 },
+                { "lpop", REDIS_CMD_LPOP, &ArdbServer::LPop, 1, 1, "wK", 0 },
+                { "lpush", REDIS_CMD_LPUSH, &ArdbServer::LPush, 2, -1, "wK", 0 },
+                { "lpushx", REDIS_CMD_LPUSHX, &ArdbServer::LPushx, 2, 2, "wK", 0 },
                 { "lrange", REDIS_CMD_LRANGE, &ArdbServer::LRange, 3, 3, "r", 0 },
-                { "lrem", REDIS_CMD_LREM, &ArdbServer::LRem, 3, 3, "w", 0 },
-                { "lset", REDIS_CMD_LSET, &ArdbServer::LSet, 3, 3, "w", 0 },
-                { "ltrim", REDIS_CMD_LTRIM, &ArdbServer::LTrim, 3, 3, "w", 0 },
-                { "rpop", REDIS_CMD_RPOP, &ArdbServer::RPop, 1, 1, "w", 0 },
-                { "rpush", REDIS_CMD_RPUSH, &ArdbServer::RPush, 2, -1, "w", 0 },
-                { "rpushx", REDIS_CMD_RPUSHX, &ArdbServer::RPushx, 2, 2, "w", 0 },
+                { "lrem", REDIS_CMD_LREM, &ArdbServer::LRem, 3, 3, "wK", 0 },
+                { "lset", REDIS_CMD_LSET, &ArdbServer::LSet, 3, 3, "wK", 0 },
+                { "ltrim", REDIS_CMD_LTRIM, &ArdbServer::LTrim, 3, 3, "wK", 0 },
+                { "rpop", REDIS_CMD_RPOP, &ArdbServer::RPop, 1, 1, "wK", 0 },
+                { "rpush", REDIS_CMD_RPUSH, &ArdbServer::RPush, 2, -1, "wK", 0 },
+                { "rpushx", REDIS_CMD_RPUSHX, &ArdbServer::RPushx, 2, 2, "wK", 0 },
                 { "rpoplpush", REDIS_CMD_RPOPLPUSH, &ArdbServer::RPopLPush, 2, 2, "w", 0 },
                 { "blpop", REDIS_CMD_BLPOP, &ArdbServer::BLPop, 2, -1, "w", 0 },
                 { "brpop", REDIS_CMD_BRPOP, &ArdbServer::BRPop, 2, -1, "w", 0 },
@@ -472,6 +524,9 @@ namespace ardb
                     case 'R':
                         settingTable[i].flags |= ARDB_CMD_RANDOM;
                         break;
+                    case 'K':
+                        settingTable[i].flags |= ARDB_CMD_SINGLE_KEY;
+                        break;
                     default:
                         break;
                 }
@@ -482,7 +537,7 @@ namespace ardb
     }
     ArdbServer::~ArdbServer()
     {
-
+        DELETE(m_db);
     }
 
     LUAInterpreter*
@@ -495,28 +550,48 @@ namespace ardb
     ArdbServer::RedisCommandHandlerSetting *
     ArdbServer::FindRedisCommandHandlerSetting(const std::string & cmd)
     {
-        RedisCommandHandlerSettingTable::iterator found = m_handler_table.find(cmd);
-        if (found != m_handler_table.end())
+        int32 id = m_command_ids.Find(cmd);
+        if (id < 0)
         {
-            return &(found->second);
+            return NULL;
         }
-        return NULL;
+        return m_handler_array[id];
+    }
+
+    ArdbServer::RedisCommandHandlerSetting *
+    ArdbServer::FindRedisCommandHandlerSetting(RedisCommandFrame& cmd)
+    {
+        int32 id = cmd.GetCommandId();
+        if (id < 0)
+        {
+            /*
+             * Frames built internally(lua, replication, transaction) are not
+             * resolved by the decoder.
+             */
+            id = m_command_ids.Find(cmd.GetCommand());
+            if (id < 0)
+            {
+                return NULL;
+            }
+            cmd.SetCommandId(id);
+        }
+        return m_handler_array[id];
     }
 
     int ArdbServer::ProcessRedisCommand(ArdbConnContext& ctx, RedisCommandFrame& args, int flags)
     {
         m_ctx_local.SetValue(&ctx);
-        if (m_cfg.timeout > 0)
+        if (m_cfg.timeout > 0 && NULL != ctx.conn)
         {
             TouchIdleConn(ctx.conn);
         }
-        std::string& cmd = args.GetMutableCommand();
-        lower_string(cmd);
-        RedisCommandHandlerSetting* setting = FindRedisCommandHandlerSetting(cmd);
+        const std::string& cmd = args.GetCommand();
+        RedisCommandHandlerSetting* setting = FindRedisCommandHandlerSetting(args);
         DEBUG_LOG("Process recved cmd:%s with flags:%d", args.ToString().c_str(), flags);
         ServerStat::GetSingleton().IncRecvCommands();
 
         int ret = 0;
+        bool write_paused_locked = false;
         if (NULL != setting)
         {
             args.SetType(setting->type);
@@ -558,14 +633,25 @@ namespace ardb
                     flags |= ARDB_PROCESS_WITHOUT_REPLICATION;
                 }
             }
+            /*
+             * Pause for a checkpoint between commands, scripts & transactions are not interrupted.
+             */
+            if (!ctx.write_paused_locked
+                    && ((setting->flags & ARDB_CMD_WRITE) || setting->type == REDIS_CMD_EXEC
+                            || setting->type == REDIS_CMD_EVAL || setting->type == REDIS_CMD_EVALSHA))
+            {
+                m_write_pause_lock.Lock(READ_LOCK);
+                ctx.write_paused_locked = true;
+                write_paused_locked = true;
+            }
             bool valid_cmd = true;
             if (setting->min_arity > 0)
             {
-                valid_cmd = args.GetArguments().size() >= (uint32) setting->min_arity;
+                valid_cmd = args.GetArgumentCount() >= (uint32) setting->min_arity;
             }
             if (setting->max_arity >= 0 && valid_cmd)
             {
-                valid_cmd = args.GetArguments().size() <= (uint32) setting->max_arity;
+                valid_cmd = args.GetArgumentCount() <= (uint32) setting->max_arity;
             }
 
             if (!valid_cmd)
@@ -574,14 +660,17 @@ namespace ardb
             }
             else
             {
-                if (ctx.IsInTransaction() && (cmd != "multi" && cmd != "exec" && cmd != "discard" && cmd != "quit"))
+                if (ctx.IsInTransaction()
+                        && (setting->type != REDIS_CMD_MULTI && setting->type != REDIS_CMD_EXEC
+                                && setting->type != REDIS_CMD_DISCARD && setting->type != REDIS_CMD_QUIT))
                 {
                     ctx.GetTransc().transaction_cmds.push_back(args);
                     fill_status_reply(ctx.reply, "QUEUED");
                 }
                 else if (ctx.IsSubscribedConn()
-                        && (cmd != "subscribe" && cmd != "psubscribe" && cmd != "unsubscribe" && cmd != "punsubscribe"
-                                && cmd != "quit"))
+                        && (setting->type != REDIS_CMD_SUBSCRIBE && setting->type != REDIS_CMD_PSUBSCRIBE
+                                && setting->type != REDIS_CMD_UNSUBSCRIBE && setting->type != REDIS_CMD_PUNSUBSCRIBE
+                                && setting->type != REDIS_CMD_QUIT))
                 {
                     fill_error_reply(ctx.reply, "only (P)SUBSCRIBE / (P)UNSUBSCRIBE / QUIT allowed in this context");
                 }
@@ -589,7 +678,13 @@ namespace ardb
                 {
                     if (!(flags & ARDB_PROCESS_FEED_REPLICATION_ONLY))
                     {
+                        /*
+                         * commands called by a script on this context still need their replies
+                         */
+                        bool reply_discarded = ctx.reply_discarded;
+                        ctx.reply_discarded = (flags & ARDB_PROCESS_DISCARD_REPLY) != 0;
                         ret = DoRedisCommand(ctx, setting, args);
+                        ctx.reply_discarded = reply_discarded;
                     }
                 }
             }
@@ -647,18 +742,53 @@ namespace ardb
             }
         }
 
-        db_ctx.Clear();
+        m_db->ClearDBContext();
         if (args.GetType() == REDIS_CMD_EXEC)
         {
             ctx.ClearTransaction();
         }
+        if (write_paused_locked)
+        {
+            ctx.write_paused_locked = false;
+            m_write_pause_lock.Unlock(READ_LOCK);
+        }
         return ret;
     }
 
+    /*
+     * Read a run of pipelined GETs by one MultiGet, every GET of the run is still processed
+     * as a normal command and takes its result from the connection's prefetched queue.
+     */
+    void ArdbServer::PrefetchGets(ArdbConnContext& ctx, const ArgumentArray& keys)
+    {
+        ctx.prefetched_gets.clear();
+        if (!ctx.authenticated || ctx.IsInTransaction() || ctx.IsSubscribedConn())
+        {
+            return;
+        }
+        SliceArray ks;
+        for (uint32 i = 0; i < keys.size(); i++)
+        {
+            ks.push_back(keys[i]);
+        }
+        StringArray values;
+        std::vector<int> errs;
+        m_db->MGet(ctx.currentDB, ks, values, errs);
+        for (uint32 i = 0; i < keys.size(); i++)
+        {
+            ctx.prefetched_gets.push_back(PrefetchedGet());
+            PrefetchedGet& pget = ctx.prefetched_gets.back();
+            pget.db = ctx.currentDB;
+            pget.key = keys[i];
+            pget.value.swap(values[i]);
+            pget.err = errs[i];
+        }
+    }
+
     int ArdbServer::DoRedisCommand(ArdbConnContext& ctx, RedisCommandHandlerSetting* setting, RedisCommandFrame& args)
     {
         const std::string& cmd = args.GetCommand();
-        if (m_clients_holder.IsStatEnable())
+        if (m_clients_holder.IsStatEnable() && NULL != ctx.conn)
         {
             m_clients_holder.TouchConn(ctx.conn, cmd);
         }
@@ -677,9 +807,10 @@ namespace ardb
     static void conn_pipeline_init(ChannelPipeline* pipeline, void* data)
     {
         ArdbServer* serv = (ArdbServer*) data;
-        pipeline->AddLast("decoder", new RedisCommandDecoder);
+        RedisCommandDecoder* decoder = new RedisCommandDecoder(true, &serv->GetCommandIds(), true);
+        pipeline->AddLast("decoder", decoder);
         pipeline->AddLast("encoder", new RedisReplyEncoder);
-        pipeline->AddLast("handler", new RedisRequestHandler(serv));
+        pipeline->AddLast("handler", new RedisRequestHandler(serv, decoder));
     }
 
     static void conn_pipeline_finallize(ChannelPipeline* pipeline, void* data)
@@ -707,6 +838,15 @@ namespace ardb
         RedisCommandFrame* cmd = e.GetMessage();
         ChannelService& serv = ardbctx.conn->GetService();
         uint32 channel_id = ardbctx.conn_id;
+        if (strcasecmp(cmd->GetCommand().c_str(), "get"))
+        {
+            ardbctx.prefetched_gets.clear();
+        }
+        else if (NULL != decoder && !decoder->GetPipelinedGetKeys().empty())
+        {
+            server->PrefetchGets(ardbctx, decoder->GetPipelinedGetKeys());
+            decoder->GetPipelinedGetKeys().clear();
+        }
         int ret = server->ProcessRedisCommand(ardbctx, *cmd, 0);
         if (ret >= 0 && ardbctx.reply.type != 0)
         {
@@ -808,7 +948,20 @@ namespace ardb
         }
     }
 
-    int ArdbServer::Start(const Properties& props)
+    void ArdbServer::IndexCommands()
+    {
+        m_handler_array.clear();
+        m_command_ids.Clear();
+        RedisCommandHandlerSettingTable::iterator it = m_handler_table.begin();
+        while (it != m_handler_table.end())
+        {
+            m_command_ids.Add(it->first, (int32) m_handler_array.size());
+            m_handler_array.push_back(&(it->second));
+            it++;
+        }
+    }
+
+    int ArdbServer::Init(const Properties& props)
     {
         m_cfg_props = props;
         if (ParseConfig(props, m_cfg) < 0)
@@ -835,13 +988,29 @@ namespace ardb
         }
 
         RenameCommand();
+        IndexCommands();
 
+        if (!m_cfg.restore_checkpoint.empty()
+                && 0 != Backup::Restore(m_cfg.restore_checkpoint, m_cfg.data_base_path, m_engine.GetName()))
+        {
+            ERROR_LOG("Failed to restore checkpoint:%s", m_cfg.restore_checkpoint.c_str());
+            return -1;
+        }
         m_db = new Ardb(&m_engine, (uint32) m_cfg.worker_count);
         if (!m_db->Init(m_cfg.db_cfg))
         {
             ERROR_LOG("Failed to init DB.");
             return -1;
         }
+        return 0;
+    }
+
+    int ArdbServer::Start(const Properties& props)
+    {
+        if (0 != Init(props))
+        {
+            return -1;
+        }
         DBCrons::GetSingleton().Init(this);
 
         m_service = new ChannelService(m_cfg.max_clients + 32);
@@ -902,12 +1071,17 @@ namespace ardb
             server->SetChannelPipelineFinalizer(conn_pipeline_finallize, NULL);
             chmod(m_cfg.listen_unix_path.c_str(), m_cfg.unixsocketperm);
         }
-        ArdbLogger::InitDefaultLogger(m_cfg.loglevel, m_cfg.logfile);
+        ArdbLogger::InitDefaultLogger(m_cfg.loglevel, m_cfg.logfile, m_cfg.log_options);
 
         m_rdb.Init(m_db);
+        m_rdb.SetSegments(m_cfg.dump_threads);
         m_redis_rdb.Init(m_db);
         if (0 == m_repl_backlog.Init(this))
         {
+            if (!m_cfg.restore_checkpoint.empty())
+            {
+                Backup::RestoreReplState(m_cfg.restore_checkpoint, m_repl_backlog);
+            }
             if (0 != m_master_serv.Init())
             {
                 goto sexit;
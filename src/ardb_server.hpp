@@ -34,9 +34,13 @@
 #include "util/config_helper.hpp"
 #include "util/thread/thread_local.hpp"
 #include "util/redis_helper.hpp"
+#include "util/glob_trie.hpp"
+#include "util/thread/spin_rwlock.hpp"
+#include "util/thread/striped_rwlock.hpp"
 #include "db.hpp"
 #include "replication/slave.hpp"
 #include "replication/master.hpp"
+#include "replication/backup.hpp"
 #include "ha/agent.hpp"
 #include "lua_scripting.hpp"
 #include "stat.hpp"
@@ -56,11 +60,13 @@
 //#define ARDB_CMD_STALE 1024                /* "t" flag */
 //#define ARDB_CMD_SKIP_MONITOR 2048         /* "M" flag */
 //#define ARDB_CMD_ASKING 4096               /* "k" flag */
+#define ARDB_CMD_SINGLE_KEY 8192           /* "K" flag, writes nothing but the key of the first argument */
 
 #define ARDB_PROCESS_WITHOUT_REPLICATION 1
 #define ARDB_PROCESS_REPL_WRITE 2
 #define ARDB_PROCESS_FORCE_REPLICATION 4
 #define ARDB_PROCESS_FEED_REPLICATION_ONLY 8
+#define ARDB_PROCESS_DISCARD_REPLY 16
 
 #define ARDB_AUTHPASS_MAX_LEN 512
 
@@ -113,6 +119,8 @@ namespace ardb
             std::string repl_data_dir;
             std::string backup_dir;
             bool backup_redis_format;
+            int64 dump_threads;
+            std::string restore_checkpoint;
 
             int64 repl_ping_slave_period;
             int64 repl_timeout;
@@ -123,6 +131,8 @@ namespace ardb
             bool slave_readonly;
             bool slave_serve_stale_data;
             int64 slave_priority;
+            int64 repl_apply_threads;
+            int64 repl_diskless_sync_delay;
 
             int64 lua_time_limit;
 
@@ -135,6 +145,7 @@ namespace ardb
             int64 worker_count;
             std::string loglevel;
             std::string logfile;
+            LoggerOptions log_options;
 
             std::string pidfile;
 
@@ -154,9 +165,9 @@ namespace ardb
             ArdbServerConfig() :
                     daemonize(false), unixsocketperm(755), max_clients(10000), tcp_keepalive(0), timeout(0), slowlog_log_slower_than(
                             10000), slowlog_max_len(128), repl_data_dir("./repl"), backup_dir("./backup"), backup_redis_format(
-                            false), repl_ping_slave_period(10), repl_timeout(60), repl_backlog_size(100 * 1024 * 1024), repl_state_persist_period(
+                            false), dump_threads(1), repl_ping_slave_period(10), repl_timeout(60), repl_backlog_size(100 * 1024 * 1024), repl_state_persist_period(
                             1), repl_backlog_time_limit(3600), slave_cleardb_before_fullresync(true), slave_readonly(
-                            true), slave_serve_stale_data(true), slave_priority(100), lua_time_limit(0), master_port(0), worker_count(
+                            true), slave_serve_stale_data(true), slave_priority(100), repl_apply_threads(1), repl_diskless_sync_delay(0), lua_time_limit(0), master_port(0), worker_count(
                             1), loglevel("INFO"),compact_min_interval(1200),compact_max_interval(7200),compact_enable(true)
             {
             }
@@ -339,12 +350,29 @@ namespace ardb
             }
     };
 
+    struct PrefetchedGet
+    {
+            DBID db;
+            std::string key;
+            std::string value;
+            int err;
+    };
+    typedef std::deque<PrefetchedGet> PrefetchedGetArray;
+
     struct ArdbConnContext
     {
             DBID currentDB;
             Channel* conn;
             RedisReply reply;
             bool is_slave_conn;
+            /*
+             * Nobody reads the reply of the running command, write commands may skip computing it
+             */
+            bool reply_discarded;
+            /*
+             * The running command holds the server's write pause lock, commands called by its script don't take it again
+             */
+            bool write_paused_locked;
             TransactionContext* transc;
             PubSubContext* pubsub;
             LUAConnContext* lua;
@@ -352,11 +380,14 @@ namespace ardb
 
             bool authenticated;
             uint32 conn_id;
+            /*
+             * Results of a pipelined GET run read ahead by one MultiGet, consumed in order by GET
+             */
+            PrefetchedGetArray prefetched_gets;
 
             ArdbConnContext() :
-                    currentDB(0), conn(NULL), is_slave_conn(false), transc(NULL), pubsub(
-                    NULL), lua(
-                    NULL), block(NULL), authenticated(true), conn_id(0)
+                    currentDB(0), conn(NULL), is_slave_conn(false), reply_discarded(false), write_paused_locked(
+                            false), transc(NULL), pubsub(NULL), lua(NULL), block(NULL), authenticated(true), conn_id(0)
             {
             }
             LUAConnContext& GetLua()
@@ -438,14 +469,15 @@ namespace ardb
     struct RedisRequestHandler: public ChannelUpstreamHandler<RedisCommandFrame>
     {
             ArdbServer* server;
+            RedisCommandDecoder* decoder;
             ArdbConnContext ardbctx;
             bool processing;
             bool delete_after_processing;
             void MessageReceived(ChannelHandlerContext& ctx, MessageEvent<RedisCommandFrame>& e);
             void ChannelClosed(ChannelHandlerContext& ctx, ChannelStateEvent& e);
             void ChannelConnected(ChannelHandlerContext& ctx, ChannelStateEvent& e);
-            RedisRequestHandler(ArdbServer* s) :
-                    server(s), processing(false), delete_after_processing(false)
+            RedisRequestHandler(ArdbServer* s, RedisCommandDecoder* d = NULL) :
+                    server(s), decoder(d), processing(false), delete_after_processing(false)
             {
             }
     };
@@ -493,6 +525,12 @@ namespace ardb
             };
 
             RedisCommandHandlerSettingTable m_handler_table;
+            /*
+             * Dense command id -> handler setting, ids are resolved by the
+             * decoder through m_command_ids. Built once in Start after renaming.
+             */
+            std::vector<RedisCommandHandlerSetting*> m_handler_array;
+            RedisCommandIdTable m_command_ids;
             SlowLogHandler m_slowlog_handler;
             ClientConnHolder m_clients_holder;
             ReplBacklog m_repl_backlog;
@@ -500,14 +538,32 @@ namespace ardb
             Slave m_slave_client;
             ArdbDumpFile m_rdb;
             RedisDumpFile m_redis_rdb;
+            Backup m_backup;
+            /*
+             * Writes & their feeding to the backlog hold their thread's stripe shared, a checkpoint holds
+             * all stripes while fixing its data and marking the backlog position it matches.
+             */
+            StripedRWLock m_write_pause_lock;
 
             ZKAgent m_ha_agent;
 
             WatchKeyContextTable m_watch_context_table;
             ThreadMutex m_watch_mutex;
-            PubSubContextTable m_pubsub_context_table;
+            /*
+             * Channel subscriptions are sharded by channel name, pattern subscriptions are indexed by their
+             * literal prefix. PUBLISH only takes read locks and leaves the writes to the subscribers' own
+             * channel services.
+             */
+            struct PubSubShard
+            {
+                    PubSubContextTable table;
+                    SpinRWLock lock;
+            };
+            static const uint32 kPubSubShardCount = 16;
+            PubSubShard m_pubsub_shards[kPubSubShardCount];
             PubSubContextTable m_pattern_pubsub_context_table;
-            ThreadMutex m_pubsub_mutex;
+            GlobTrie m_pattern_index;
+            SpinRWLock m_pattern_pubsub_lock;
             BlockContextTable m_blocking_conns;
             ThreadMutex m_block_mutex;
 
@@ -515,6 +571,7 @@ namespace ardb
             ThreadLocal<LUAInterpreter> m_ctx_lua;
 
             RedisCommandHandlerSetting* FindRedisCommandHandlerSetting(const std::string& cmd);
+            RedisCommandHandlerSetting* FindRedisCommandHandlerSetting(RedisCommandFrame& cmd);
             int DoRedisCommand(ArdbConnContext& ctx, RedisCommandHandlerSetting* setting, RedisCommandFrame& cmd);
             int ProcessRedisCommand(ArdbConnContext& ctx, RedisCommandFrame& cmd, int flags);
 
@@ -528,6 +585,7 @@ namespace ardb
             friend class Master;
             friend class Backup;
             friend class ReplBacklog;
+            friend class ReplApplier;
             friend class LUAInterpreter;
             friend class ZKAgent;
 
@@ -537,9 +595,14 @@ namespace ardb
             //int OnAllKeyDeleted(const DBID& dbid);
             void ClearWatchKeys(ArdbConnContext& ctx);
             void ClearSubscribes(ArdbConnContext& ctx);
+            PubSubShard& GetPubSubShard(const std::string& channel);
+            void AddSubscriber(ArdbConnContext& ctx, const std::string& channel, bool is_pattern);
+            void RemoveSubscriber(ArdbConnContext& ctx, const std::string& channel, bool is_pattern);
+            void UnSubscribeChannels(ArdbConnContext& ctx, const ArgumentArray& cmd, bool is_pattern);
             void ClearClosedConnContext(ArdbConnContext& ctx);
 
             void TouchIdleConn(Channel* ch);
+            void PrefetchGets(ArdbConnContext& ctx, const ArgumentArray& keys);
             void BlockConn(ArdbConnContext& ctx, uint32 timeout);
             void UnblockConn(ArdbConnContext& ctx);
             void CheckBlockingConnectionsByListKey(const WatchKey& key);
@@ -553,6 +616,7 @@ namespace ardb
             int LastSave(ArdbConnContext& ctx, RedisCommandFrame& cmd);
             int BGSave(ArdbConnContext& ctx, RedisCommandFrame& cmd);
             int Import(ArdbConnContext& ctx, RedisCommandFrame& cmd);
+            int BackupCheckpoint(ArdbConnContext& ctx, RedisCommandFrame& cmd);
             int Info(ArdbConnContext& ctx, RedisCommandFrame& cmd);
             int DBSize(ArdbConnContext& ctx, RedisCommandFrame& cmd);
             int Config(ArdbConnContext& ctx, RedisCommandFrame& cmd);
@@ -656,6 +720,8 @@ namespace ardb
             int SInter(ArdbConnContext& ctx, RedisCommandFrame& cmd);
             int SInterStore(ArdbConnContext& ctx, RedisCommandFrame& cmd);
             int SIsMember(ArdbConnContext& ctx, RedisCommandFrame& cmd);
+            int SMIsMember(ArdbConnContext& ctx, RedisCommandFrame& cmd);
+            int SCheck(ArdbConnContext& ctx, RedisCommandFrame& cmd);
             int SMembers(ArdbConnContext& ctx, RedisCommandFrame& cmd);
             int SMove(ArdbConnContext& ctx, RedisCommandFrame& cmd);
             int SPop(ArdbConnContext& ctx, RedisCommandFrame& cmd);
@@ -734,6 +800,7 @@ namespace ardb
 
             static void ServerEventCallback(ChannelService* serv, uint32 ev, void* data);
             void RenameCommand();
+            void IndexCommands();
         public:
             static int ParseConfig(const Properties& props, ArdbServerConfig& cfg);
             ArdbServer(KeyValueEngineFactory& engine);
@@ -745,12 +812,20 @@ namespace ardb
             {
                 return m_ctx_local.GetValue();
             }
+            /*
+             * Parse the configs and open the DB, Start does it before serving.
+             */
+            int Init(const Properties& props);
             int Start(const Properties& props);
 
             Master& GetMaster()
             {
                 return m_master_serv;
             }
+            StripedRWLock& GetWritePauseLock()
+            {
+                return m_write_pause_lock;
+            }
             Ardb& GetDB()
             {
                 return *m_db;
@@ -759,6 +834,10 @@ namespace ardb
             {
                 return m_cfg;
             }
+            const RedisCommandIdTable& GetCommandIds()
+            {
+                return m_command_ids;
+            }
             ~ArdbServer();
     };
 }
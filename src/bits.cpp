@@ -29,6 +29,7 @@
 
 #include "db.hpp"
 #include "ardb_server.hpp"
+#include "util/bitops.hpp"
 
 namespace ardb
 {
@@ -37,54 +38,8 @@ namespace ardb
     static const unsigned long BITOP_XOR = 2;
     static const unsigned long BITOP_NOT = 3;
 
-    static const uint32 BIT_SUBSET_SIZE = 4096;
-    static const uint32 BIT_SUBSET_BYTES_SIZE = BIT_SUBSET_SIZE >> 3;
-    //copy from redis
-    static long popcount(const void *s, long count)
-    {
-        long bits = 0;
-        unsigned char *p;
-        const uint32_t* p4 = (const uint32_t*) s;
-        static const unsigned char bitsinbyte[256] =
-            { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 1, 2, 2,
-                    3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 1, 2, 2, 3,
-                    2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 2, 3, 3, 4, 3,
-                    4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 1, 2, 2, 3, 2, 3,
-                    3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 2, 3, 3, 4, 3, 4, 4,
-                    5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 2, 3, 3, 4, 3, 4, 4, 5,
-                    3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 3, 4, 4, 5, 4, 5, 5, 6, 4,
-                    5, 5, 6, 5, 6, 6, 7, 4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8 };
-
-        /* Count bits 16 bytes at a time */
-        while (count >= 16)
-        {
-            uint32_t aux1, aux2, aux3, aux4;
-
-            aux1 = *p4++;
-            aux2 = *p4++;
-            aux3 = *p4++;
-            aux4 = *p4++;
-            count -= 16;
-
-            aux1 = aux1 - ((aux1 >> 1) & 0x55555555);
-            aux1 = (aux1 & 0x33333333) + ((aux1 >> 2) & 0x33333333);
-            aux2 = aux2 - ((aux2 >> 1) & 0x55555555);
-            aux2 = (aux2 & 0x33333333) + ((aux2 >> 2) & 0x33333333);
-            aux3 = aux3 - ((aux3 >> 1) & 0x55555555);
-            aux3 = (aux3 & 0x33333333) + ((aux3 >> 2) & 0x33333333);
-            aux4 = aux4 - ((aux4 >> 1) & 0x55555555);
-            aux4 = (aux4 & 0x33333333) + ((aux4 >> 2) & 0x33333333);
-            bits += ((((aux1 + (aux1 >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24)
-                    + ((((aux2 + (aux2 >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24)
-                    + ((((aux3 + (aux3 >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24)
-                    + ((((aux4 + (aux4 >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
-        }
-        /* Count the remaining bytes */
-        p = (unsigned char*) p4;
-        while (count--)
-            bits += bitsinbyte[*p++];
-        return bits;
-    }
+    static const uint32 BIT_SUBSET_SIZE = BitSetElementValue::kBits;
+    static const uint32 BIT_SUBSET_BYTES_SIZE = BitSetElementValue::kBytes;
 
     int Ardb::SetBit(const DBID& db, const Slice& key, uint64 bitoffset, uint8 value)
     {
@@ -136,7 +91,7 @@ namespace ardb
             bitvalue.vals.append(tmp, tmpsize);
         }
 
-        if (bitvalue.limit < bitoffset)
+        if (bitvalue.limit < bitoffset + 1)
         {
             bitvalue.limit = bitoffset + 1;
             element_changed = true;
@@ -287,45 +242,74 @@ namespace ardb
         }
 
         memcpy(dst + bytestart, v1.vals.c_str() + bytestart, byteend - bytestart + 1);
-        uint64* lres = (uint64*) dst;
-        const uint64* lp = (const uint64*) (v2.vals.c_str());
-        uint32 xst = bytestart >> 3;
-        uint32 xet = byteend >> 3;
-        while (xst <= xet)
+        uint32 xst = (bytestart >> 3) << 3;
+        uint32 len = ((byteend >> 3) << 3) + 8 - xst;
+        switch (op)
         {
-            switch (op)
+            case BITOP_AND:
             {
-                case BITOP_AND:
-                {
-                    lres[xst] &= lp[xst];
-                    break;
-                }
-                case BITOP_OR:
-                {
-                    lres[xst] |= lp[xst];
-                    break;
-                }
-                case BITOP_XOR:
-                {
-                    lres[xst] ^= lp[xst];
-                    break;
-                }
-                case BITOP_NOT:
-                {
-                    lres[xst] = ~lres[xst];
-                    break;
-                }
-                default:
-                {
-                    return;
-                }
+                bits_and(dst + xst, v2.vals.c_str() + xst, len);
+                break;
+            }
+            case BITOP_OR:
+            {
+                bits_or(dst + xst, v2.vals.c_str() + xst, len);
+                break;
+            }
+            case BITOP_XOR:
+            {
+                bits_xor(dst + xst, v2.vals.c_str() + xst, len);
+                break;
+            }
+            case BITOP_NOT:
+            {
+                bits_not(dst + xst, len);
+                break;
+            }
+            default:
+            {
+                return;
             }
-            xst++;
         }
-        res.vals.assign(dst, 0, BIT_SUBSET_BYTES_SIZE);
+        res.vals.assign(dst, BIT_SUBSET_BYTES_SIZE);
         res.limit = et;
         res.start = st;
-        res.bitcount = popcount(dst + bytestart, byteend - bytestart + 1);
+        res.bitcount = bits_popcount(dst + bytestart, byteend - bytestart + 1);
+    }
+
+    /*
+     * OR/XOR 'src' into 'dst' in place, folding many keys this way spares the bitmap copies of BitSetElementOp.
+     */
+    static void BitSetElementMerge(uint32 op, BitSetElementValue& dst, BitSetElementValue& src)
+    {
+        if (src.vals.empty())
+        {
+            return;
+        }
+        if (dst.vals.empty())
+        {
+            dst.vals.swap(src.vals);
+            dst.start = src.start;
+            dst.limit = src.limit;
+            dst.bitcount = src.bitcount;
+            return;
+        }
+        uint32 st = dst.start < src.start ? dst.start : src.start;
+        uint32 et = dst.limit < src.limit ? src.limit : dst.limit;
+        uint32 bytestart = st > 0 ? ((st - 1) >> 3) : 0;
+        uint32 byteend = et > 0 ? ((et - 1) >> 3) : 0;
+        char* d = &(dst.vals[0]);
+        if (op == BITOP_XOR)
+        {
+            bits_xor(d + bytestart, src.vals.data() + bytestart, byteend - bytestart + 1);
+        }
+        else
+        {
+            bits_or(d + bytestart, src.vals.data() + bytestart, byteend - bytestart + 1);
+        }
+        dst.start = st;
+        dst.limit = et;
+        dst.bitcount = bits_popcount(d + bytestart, byteend - bytestart + 1);
     }
 
     int Ardb::BitsOr(const DBID& db, SliceArray& keys, BitSetElementValueMap*& result, bool isXor)
@@ -339,21 +323,9 @@ namespace ardb
                 {
                     BitSetKeyObject* bk = (BitSetKeyObject*) k;
                     BitSetElementValue* element = (BitSetElementValue*) v;
-                    BitSetElementValueMap::iterator found = res.find(bk->index);
-                    BitSetElementValue result;
-                    if (found != res.end())
-                    {
-                        BitSetElementOp(isxor ? BITOP_XOR : BITOP_OR, found->second, *element, result);
-                    }
-                    else
-                    {
-                        BitSetElementOp(isxor ? BITOP_XOR : BITOP_OR, result, *element, result);
-                    }
-                    if (result.bitcount > 0)
-                    {
-                        res[bk->index] = result;
-                    }
-                    else
+                    BitSetElementValue& result = res[bk->index];
+                    BitSetElementMerge(isxor ? BITOP_XOR : BITOP_OR, result, *element);
+                    if (result.bitcount == 0)
                     {
                         res.erase(bk->index);
                     }
@@ -449,10 +421,11 @@ namespace ardb
                 BitSetElementValueMap* ptmp = tmpres;
                 tmpres = tmpcmp;
                 tmpcmp = ptmp;
-                tmpcmp->clear();
+                tmpres->clear();
             }
         }
         result = tmpres;
+        tmp = tmpcmp;
         tmp->clear();
         return 0;
     }
@@ -687,7 +660,7 @@ namespace ardb
                             {
                                 uint32 s = st >> 3;
                                 uint32 e = et >> 3;
-                                count += popcount(element->vals.c_str() + s, e - s);
+                                count += bits_popcount(element->vals.c_str() + s, e - s);
                             }
                         }
                     }
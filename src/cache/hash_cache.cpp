@@ -0,0 +1,98 @@
+/*
+ *Copyright (c) 2013-2013, yinqiwen <yinqiwen@gmail.com>
+ *All rights reserved.
+ *
+ *Redistribution and use in source and binary forms, with or without
+ *modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Redis nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ *BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ *THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "level1_cache.hpp"
+#include "db.hpp"
+
+namespace ardb
+{
+    static inline uint32 SizeOfValueData(const ValueData& v)
+    {
+        return sizeof(ValueData) + v.bytes_value.size();
+    }
+
+    HashCache::HashCache() :
+            CacheItem((uint8) HASH_META)
+    {
+        m_estimate_mem_size = sizeof(HashCache);
+    }
+
+    int HashCache::Set(const ValueData& field, const ValueData& value)
+    {
+        CacheWriteLockGuard guard(m_lock);
+        HashFieldMap::iterator found = m_cache.find(field);
+        if (found != m_cache.end())
+        {
+            SubEstimateMemSize(SizeOfValueData(found->second));
+            found->second = value;
+            AddEstimateMemSize(SizeOfValueData(value));
+            return 0;
+        }
+        m_cache.insert(HashFieldMap::value_type(field, value));
+        uint32 delta = SizeOfValueData(field) + SizeOfValueData(value);
+        delta += (uint32) (HashFieldMap::average_bytes_per_value() + 0.5);
+        AddEstimateMemSize(delta);
+        return 1;
+    }
+
+    int HashCache::Get(const ValueData& field, ValueData& value)
+    {
+        CacheReadLockGuard guard(m_lock);
+        HashFieldMap::iterator found = m_cache.find(field);
+        if (found != m_cache.end())
+        {
+            value = found->second;
+            return 0;
+        }
+        return ERR_NOT_EXIST;
+    }
+
+    /*
+     * Visits fields & values alternately like Ardb::HIterate
+     */
+    uint32 HashCache::Visit(ValueVisitCallback* cb, void* cbdata)
+    {
+        CacheReadLockGuard guard(m_lock);
+        int cursor = 0;
+        HashFieldMap::iterator it = m_cache.begin();
+        while (it != m_cache.end())
+        {
+            cb(it->first, cursor++, cbdata);
+            cb(it->second, cursor++, cbdata);
+            it++;
+        }
+        return m_cache.size();
+    }
+
+    uint32 HashCache::Size()
+    {
+        CacheReadLockGuard guard(m_lock);
+        return m_cache.size();
+    }
+}
@@ -43,11 +43,12 @@ namespace ardb
     }
 
     L1Cache::L1Cache(Ardb* db) :
-            m_db(db), m_estimate_mem_size(0), m_signal_notifier(NULL)
+            m_db(db), m_estimate_mem_size(0), m_signal_notifier(NULL), m_evict_shard(0)
     {
         m_signal_notifier = m_serv.NewSoftSignalChannel();
         m_signal_notifier->Register(kCacheSignal, this);
-        m_cache.SetMaxCacheSize(UINT_MAX);
+        memset((void*) m_hits, 0, sizeof(m_hits));
+        memset((void*) m_misses, 0, sizeof(m_misses));
     }
 
     L1Cache::~L1Cache()
@@ -98,20 +99,37 @@ namespace ardb
         }
     }
 
+    L1Cache::CacheShard& L1Cache::GetShard(const DBItemKey& key)
+    {
+        return m_shards[(DBItemKeyHash()(key) >> 24) % kCacheShardCount];
+    }
+
+    /*
+     * Shards are visited round robin, each visit evicts the next victim of the shard's CLOCK hand.
+     */
     void L1Cache::CheckMemory(CacheItem* exclude_item)
     {
-        while (m_estimate_mem_size > (uint64) m_db->m_config.L1_cache_memory_limit && m_cache.Size() > 1)
+        uint32 misses = 0;
+        while (m_estimate_mem_size > (uint64) m_db->m_config.L1_cache_memory_limit && GetEntrySize() > 1
+                && misses < kCacheShardCount * 2)
         {
-            LRUCache<DBItemKey, CacheItem*>::CacheEntry entry;
-            CacheLockGuard guard(m_cache_mutex);
-            if (m_cache.PeekFront(entry) && entry.second != exclude_item)
+            CacheShard& shard = m_shards[m_evict_shard++ % kCacheShardCount];
+            L1CacheTable::CacheEntry entry;
+            CacheLockGuard guard(shard.mutex);
+            if (!shard.table.PeekVictim(entry))
+            {
+                misses++;
+                continue;
+            }
+            if (entry.second == exclude_item)
             {
-                m_estimate_mem_size -= SizeOfDBItemKey(entry.first);
-                m_estimate_mem_size -= entry.second->GetEstimateMemorySize();
-                m_estimate_mem_size -= L1CacheTable::AverageBytesPerValue();
-                entry.second->DecRef();
-                m_cache.PopFront();
+                //give the excluded item a second chance
+                shard.table.Get(entry.first, entry.second);
+                misses++;
+                continue;
             }
+            misses = 0;
+            EraseEntry(shard, entry.first, entry.second);
         }
     }
 
@@ -167,10 +185,90 @@ namespace ardb
         //WARN_LOG("zset bytes used:%u %u", item->m_cache.bytes_used(), item->m_cache_score_dict.bytes_used());
     }
 
-    CacheItem* L1Cache::DoCreateCacheEntry(const DBID& dbid, const Slice& key, KeyType type)
+    /*
+     * Keys with an expire time are not cached since entries never expire by themselves.
+     */
+    static int CheckCacheMeta(CommonMetaValue* meta, KeyType type)
     {
-        DBItemKey cache_key(dbid, key);
-        if (m_cache.Contains(cache_key))
+        if (NULL == meta)
+        {
+            return ERR_NOT_EXIST;
+        }
+        if (meta->header.type != type || meta->header.expireat > 0)
+        {
+            return ERR_INVALID_TYPE;
+        }
+        return 0;
+    }
+
+    static int HashStoreCallback(const ValueData& value, int cursor, void* cb)
+    {
+        HashCacheLoadContext* ctx = (HashCacheLoadContext*) cb;
+        if (cursor % 2 == 0)
+        {
+            ctx->field = value;
+        }
+        else
+        {
+            ctx->cache->Set(ctx->field, value);
+        }
+        return 0;
+    }
+
+    int L1Cache::LoadHashCache(const DBItemKey& key, HashCache* item)
+    {
+        CommonMetaValue* meta = m_db->GetMeta(key.db, key.key, true);
+        int err = CheckCacheMeta(meta, HASH_META);
+        DELETE(meta);
+        if (0 != err)
+        {
+            return err;
+        }
+        HashCacheLoadContext ctx;
+        ctx.cache = item;
+        return m_db->HIterate(key.db, key.key, HashStoreCallback, &ctx);
+    }
+
+    int L1Cache::LoadSetCache(const DBItemKey& key, SetCache* item)
+    {
+        CommonMetaValue* meta = m_db->GetMeta(key.db, key.key, true);
+        int err = CheckCacheMeta(meta, SET_META);
+        DELETE(meta);
+        if (0 != err)
+        {
+            return err;
+        }
+        ValueDataArray members;
+        err = m_db->SMembers(key.db, key.key, members);
+        if (0 != err)
+        {
+            return err;
+        }
+        while (!members.empty())
+        {
+            item->Add(members.front());
+            members.pop_front();
+        }
+        return 0;
+    }
+
+    int L1Cache::LoadStringCache(const DBItemKey& key, StringCache* item)
+    {
+        CommonMetaValue* meta = m_db->GetMeta(key.db, key.key, false);
+        int err = CheckCacheMeta(meta, STRING_META);
+        if (0 == err)
+        {
+            std::string value;
+            ((StringMetaValue*) meta)->value.ToString(value);
+            item->Set(value);
+        }
+        DELETE(meta);
+        return err;
+    }
+
+    CacheItem* L1Cache::DoCreateCacheEntry(CacheShard& shard, const DBItemKey& cache_key, KeyType type)
+    {
+        if (shard.table.Contains(cache_key))
         {
             return NULL;
         }
@@ -182,6 +280,21 @@ namespace ardb
                 NEW(item, ZSetCache);
                 break;
             }
+            case HASH_META:
+            {
+                NEW(item, HashCache);
+                break;
+            }
+            case SET_META:
+            {
+                NEW(item, SetCache);
+                break;
+            }
+            case STRING_META:
+            {
+                NEW(item, StringCache);
+                break;
+            }
             default:
             {
                 return NULL;
@@ -190,19 +303,18 @@ namespace ardb
         item->SetStatus(L1_CACHE_LOADED);
         item->IncRef();
         item->m_total_mem_size_ref = &m_estimate_mem_size;
-        LRUCache<DBItemKey, CacheItem*>::CacheEntry entry;
-        //insert never pop items
-        m_cache.Insert(cache_key, item, entry);
-        m_estimate_mem_size += item->GetEstimateMemorySize();
-        m_estimate_mem_size += SizeOfDBItemKey(cache_key);
-        m_estimate_mem_size += L1CacheTable::AverageBytesPerValue();
+        shard.table.Insert(cache_key, item);
+        atomic_add_uint64(&m_estimate_mem_size,
+                item->GetEstimateMemorySize() + SizeOfDBItemKey(cache_key) + L1CacheTable::AverageBytesPerValue());
         return item;
     }
 
     CacheItem* L1Cache::CreateCacheEntry(const DBID& dbid, const Slice& key, KeyType type)
     {
-        CacheLockGuard guard(m_cache_mutex);
-        return DoCreateCacheEntry(dbid, key, type);
+        DBItemKey cache_key(dbid, key);
+        CacheShard& shard = GetShard(cache_key);
+        CacheLockGuard guard(shard.mutex);
+        return DoCreateCacheEntry(shard, cache_key, type);
 
     }
     void L1Cache::PushInst(const CacheInstruction& inst)
@@ -210,34 +322,130 @@ namespace ardb
         m_inst_queue.Push(inst);
         m_signal_notifier->FireSoftSignal(kCacheSignal, 0);
     }
+    /*
+     * Must be called with the shard's mutex held, the entry is only erased if it is 'expected' when that is given.
+     * The item's own size is released by its destructor once the last reference is gone.
+     */
+    int L1Cache::EraseEntry(CacheShard& shard, const DBItemKey& cache_key, CacheItem* expected)
+    {
+        CacheItem* item = NULL;
+        if (!shard.table.Peek(cache_key, item) || (NULL != expected && item != expected))
+        {
+            return -1;
+        }
+        shard.table.Erase(cache_key, item);
+        atomic_sub_uint64(&m_estimate_mem_size, SizeOfDBItemKey(cache_key) + L1CacheTable::AverageBytesPerValue());
+        item->SetStatus(L1_CACHE_INVALID);
+        item->DecRef();
+        return 0;
+    }
+
     int L1Cache::DoEvict(const DBID& dbid, const Slice& key)
     {
         DBItemKey cache_key(dbid, key);
-        CacheLockGuard guard(m_cache_mutex);
+        CacheShard& shard = GetShard(cache_key);
+        CacheLockGuard guard(shard.mutex);
+        return EraseEntry(shard, cache_key, NULL);
+    }
+
+    int L1Cache::Invalidate(const DBID& dbid, const Slice& key, bool keep_zset)
+    {
+        DBItemKey cache_key(dbid, key);
+        CacheShard& shard = GetShard(cache_key);
+        CacheLockGuard guard(shard.mutex);
         CacheItem* item = NULL;
-        m_cache.Erase(cache_key, item);
-        if (NULL != item)
+        if (!shard.table.Peek(cache_key, item) || (keep_zset && item->GetType() == ZSET_META))
         {
-            m_estimate_mem_size -= SizeOfDBItemKey(cache_key);
-            m_estimate_mem_size -= L1CacheTable::AverageBytesPerValue();
-            item->SetStatus(L1_CACHE_INVALID);
-            item->DecRef();
-            return 0;
+            return -1;
         }
-        return -1;
+        return EraseEntry(shard, cache_key, item);
     }
 
-    int L1Cache::DoLoad(const DBID& dbid, const Slice& key, KeyType key_type)
+    void L1Cache::EvictDB(const DBID& dbid)
     {
-        if (key_type != ZSET_META)
+        for (uint32 i = 0; i < kCacheShardCount; i++)
         {
-            return -1;
+            CacheShard& shard = m_shards[i];
+            CacheLockGuard guard(shard.mutex);
+            std::vector<DBItemKey> keys;
+            shard.table.GetKeys(keys);
+            for (uint32 j = 0; j < keys.size(); j++)
+            {
+                if (keys[j].db == dbid)
+                {
+                    EraseEntry(shard, keys[j], NULL);
+                }
+            }
+        }
+    }
+
+    void L1Cache::EvictAll()
+    {
+        for (uint32 i = 0; i < kCacheShardCount; i++)
+        {
+            CacheShard& shard = m_shards[i];
+            CacheLockGuard guard(shard.mutex);
+            std::vector<DBItemKey> keys;
+            shard.table.GetKeys(keys);
+            for (uint32 j = 0; j < keys.size(); j++)
+            {
+                EraseEntry(shard, keys[j], NULL);
+            }
+        }
+    }
+
+    uint32 L1Cache::GetEntrySize()
+    {
+        uint32 size = 0;
+        for (uint32 i = 0; i < kCacheShardCount; i++)
+        {
+            size += m_shards[i].table.Size();
+        }
+        return size;
+    }
+
+    uint64 L1Cache::GetTableMemorySize()
+    {
+        uint64 size = 0;
+        for (uint32 i = 0; i < kCacheShardCount; i++)
+        {
+            CacheLockGuard guard(m_shards[i].mutex);
+            size += m_shards[i].table.TableBytes();
+        }
+        return size;
+    }
+
+    int L1Cache::DoLoadValue(const DBItemKey& cache_key, CacheItem* item)
+    {
+        switch (item->GetType())
+        {
+            case HASH_META:
+            {
+                return LoadHashCache(cache_key, (HashCache*) item);
+            }
+            case SET_META:
+            {
+                return LoadSetCache(cache_key, (SetCache*) item);
+            }
+            case STRING_META:
+            {
+                return LoadStringCache(cache_key, (StringCache*) item);
+            }
+            default:
+            {
+                return ERR_INVALID_TYPE;
+            }
         }
+    }
+
+    int L1Cache::DoLoad(const DBID& dbid, const Slice& key, KeyType key_type)
+    {
         CacheItem* item = NULL;
         DBItemKey cache_key(dbid, key);
+        CacheShard& shard = GetShard(cache_key);
         {
-            CacheLockGuard guard(m_cache_mutex);
-            m_cache.Peek(cache_key, item);
+            CacheLockGuard guard(shard.mutex);
+            shard.table.Peek(cache_key, item);
             if (NULL == item || L1_CACHE_LOADING != item->GetStatus())
             {
                 return -1;
@@ -245,36 +453,62 @@ namespace ardb
             item->IncRef();
         }
         uint64 start = get_current_epoch_millis();
-        LRUCache<DBItemKey, CacheItem*>::CacheEntry entry;
-        switch (key_type)
+        int err = 0;
+        if (key_type == ZSET_META)
         {
-            case ZSET_META:
+            LoadZSetCache(cache_key, (ZSetCache*) item);
+        }
+        else
+        {
+            /*
+             * Writers of the key wait until the entry is published, and writes made by this thread while
+             * loading(e.g. a meta size fix) must not invalidate the entry being loaded.
+             */
+            Ardb::KeyLockerGuard keyguard(m_db->m_key_locker, dbid, key);
+            L1CacheSyncGuard sync_guard(m_db->GetDBContext());
+            err = DoLoadValue(cache_key, item);
+            if (0 == err && item->GetEstimateMemorySize() > (uint64) m_db->m_config.L1_cache_memory_limit)
             {
-                LoadZSetCache(cache_key, (ZSetCache*) item);
-                break;
+                err = ERR_TOO_LARGE_RESPONSE;
             }
-            default:
+            CacheLockGuard guard(shard.mutex);
+            if (0 != err)
             {
-                return -1;
+                EraseEntry(shard, cache_key, item);
+            }
+            else if (item->GetStatus() == L1_CACHE_LOADING)
+            {
+                item->SetStatus(L1_CACHE_LOADED);
             }
         }
 
         uint64 end = get_current_epoch_millis();
-        INFO_LOG("Cost %llums to load cache %u:%s", (end - start), cache_key.db, cache_key.key.c_str());
-        if (item->GetStatus() == L1_CACHE_LOADING)
+        if (0 != err)
+        {
+            WARN_LOG("Failed to load cache %u:%s for reason:%d", cache_key.db, cache_key.key.c_str(), err);
+        }
+        else
+        {
+            INFO_LOG("Cost %llums to load cache %u:%s", (end - start), cache_key.db, cache_key.key.c_str());
+        }
+        if (key_type == ZSET_META && item->GetStatus() == L1_CACHE_LOADING)
         {
             item->SetStatus(L1_CACHE_LOADED);
+        }
+        if (0 == err)
+        {
             CheckMemory(item);
         }
         item->DecRef();
-        return 0;
+        return err;
     }
 
     bool L1Cache::IsInCache(const DBID& dbid, const Slice& key)
     {
         DBItemKey cache_key(dbid, key);
-        CacheLockGuard guard(m_cache_mutex);
-        return m_cache.Contains(cache_key);
+        CacheShard& shard = GetShard(cache_key);
+        CacheLockGuard guard(shard.mutex);
+        return shard.table.Contains(cache_key);
     }
 
     int L1Cache::Evict(const DBID& dbid, const Slice& key)
@@ -300,10 +534,16 @@ namespace ardb
         {
             return 0;
         }
-        int type = m_db->Type(dbid, key);
-        if (type != ZSET_META)
+        CommonMetaValue* meta = m_db->GetMeta(dbid, key, true);
+        if (NULL == meta)
+        {
+            return ERR_NOT_EXIST;
+        }
+        int type = meta->header.type;
+        bool volatile_key = meta->header.expireat > 0;
+        DELETE(meta);
+        if (type != ZSET_META && (volatile_key || (type != HASH_META && type != SET_META && type != STRING_META)))
         {
-            //only zset supported now
             return ERR_INVALID_TYPE;
         }
         CacheItem* item = CreateCacheEntry(dbid, key, (KeyType) type);
@@ -335,19 +575,21 @@ namespace ardb
         {
             return ret;
         }
-        while (!IsCached(dbid, key))
+        uint8 status = L1_CACHE_LOADING;
+        while (0 == PeekCacheStatus(dbid, key, status) && status == L1_CACHE_LOADING)
         {
             Thread::Sleep(10, MILLIS);
         }
-        return 0;
+        return status == L1_CACHE_LOADED ? 0 : -1;
     }
 
     int L1Cache::PeekCacheStatus(const DBID& dbid, const Slice& key, uint8& status)
     {
         DBItemKey cache_key(dbid, key);
-        CacheLockGuard guard(m_cache_mutex);
+        CacheShard& shard = GetShard(cache_key);
+        CacheLockGuard guard(shard.mutex);
         CacheItem* item = NULL;
-        m_cache.Peek(cache_key, item);
+        shard.table.Peek(cache_key, item);
         if (NULL == item)
         {
             return -1;
@@ -364,13 +606,17 @@ namespace ardb
     CacheItem* L1Cache::Get(const DBID& dbid, const Slice& key, KeyType type, bool createIfNoExist)
     {
         DBItemKey cache_key(dbid, key);
-        CacheLockGuard guard(m_cache_mutex);
+        CacheShard& shard = GetShard(cache_key);
+        CacheLockGuard guard(shard.mutex);
         CacheItem* item = NULL;
-        m_cache.Get(cache_key, item);
+        shard.table.Get(cache_key, item);
         if (NULL == item && createIfNoExist)
         {
-            item = DoCreateCacheEntry(dbid, key, type);
-            item->DecRef();
+            item = DoCreateCacheEntry(shard, cache_key, type);
+            if (NULL != item)
+            {
+                item->DecRef();
+            }
         }
         if (NULL != item && item->GetType() == type)
         {
@@ -33,7 +33,7 @@
 #include "common.hpp"
 #include "data_format.hpp"
 #include "util/atomic.hpp"
-#include "util/lru.hpp"
+#include "util/clock_cache.hpp"
 #include "util/thread/thread_mutex.hpp"
 #include "util/thread/thread_mutex_lock.hpp"
 #include "util/thread/spin_rwlock.hpp"
@@ -180,6 +180,62 @@ namespace ardb
 
     };
 
+    /*
+     * Hash fields are keyed by the same ValueData a HashKeyObject holds for them.
+     */
+    class HashCache: public CacheItem
+    {
+        private:
+            HashFieldMap m_cache;
+            friend class L1Cache;
+        public:
+            HashCache();
+            /*
+             * return 0:field value overwritten  1:new field
+             */
+            int Set(const ValueData& field, const ValueData& value);
+            int Get(const ValueData& field, ValueData& value);
+            uint32 Visit(ValueVisitCallback* cb, void* cbdata);
+            uint32 Size();
+    };
+
+    class SetCache: public CacheItem
+    {
+        private:
+            ValueSet m_cache;
+            friend class L1Cache;
+        public:
+            SetCache();
+            /*
+             * return 0:element exists  1:new element
+             */
+            int Add(const ValueData& value);
+            bool Contains(const ValueData& value);
+            void Members(ValueDataArray& values);
+            uint32 Size();
+    };
+
+    class StringCache: public CacheItem
+    {
+        private:
+            std::string m_value;
+            friend class L1Cache;
+        public:
+            StringCache();
+            void Set(const Slice& value);
+            void Get(std::string& value);
+    };
+
+    struct HashCacheLoadContext
+    {
+            HashCache* cache;
+            ValueData field;
+            HashCacheLoadContext() :
+                    cache(NULL)
+            {
+            }
+    };
+
     struct ZSetCacheLoadContext
     {
             ZSetCache* cache;
@@ -193,7 +249,9 @@ namespace ardb
     };
 
     /*
-     * Only zset cache supported now
+     * Caches whole zset, hash, set and string values of hot keys, keys with an expire time are never cached.
+     * Zset entries are kept in sync by the zset commands, entries of other types are updated in place by
+     * HSET/HMSET/SADD/SET and invalidated by any other write of the key.
      */
     class Ardb;
     class L1Cache: public Thread, public SoftSignalHandler
@@ -205,23 +263,46 @@ namespace ardb
 
             SoftSignalChannel* m_signal_notifier;
             MPSCQueue<CacheInstruction> m_inst_queue;
-            typedef LRUCache<DBItemKey, CacheItem*> L1CacheTable;
-            L1CacheTable m_cache;
-            SpinMutexLock m_cache_mutex;
+            /*
+             * Entries are sharded by key hash, each shard is a CLOCK evicted hash table with its own lock
+             */
+            typedef ClockCache<DBItemKey, CacheItem*, DBItemKeyHash> L1CacheTable;
+            static const uint32 kCacheShardCount = 16;
+            struct CacheShard
+            {
+                    L1CacheTable table;
+                    SpinMutexLock mutex;
+            };
+            CacheShard m_shards[kCacheShardCount];
+            uint32 m_evict_shard;
             typedef LockGuard<SpinMutexLock> CacheLockGuard;
+            CacheShard& GetShard(const DBItemKey& key);
+            volatile uint64 m_hits[LIST_META + 1];
+            volatile uint64 m_misses[LIST_META + 1];
             void LoadZSetCache(const DBItemKey& key, ZSetCache* item);
+            int LoadHashCache(const DBItemKey& key, HashCache* item);
+            int LoadSetCache(const DBItemKey& key, SetCache* item);
+            int LoadStringCache(const DBItemKey& key, StringCache* item);
             void Run();
             void CheckInstQueue();
             void OnSoftSignal(uint32 soft_signo, uint32 appendinfo);
             void PushInst(const CacheInstruction& inst);
             int DoLoad(const DBID& dbid, const Slice& key, KeyType key_type);
             int DoEvict(const DBID& dbid, const Slice& key);
+            int EraseEntry(CacheShard& shard, const DBItemKey& cache_key, CacheItem* expected);
+            int DoLoadValue(const DBItemKey& cache_key, CacheItem* item);
             void CheckMemory(CacheItem* exclude_item = NULL);
             bool IsInCache(const DBID& dbid, const Slice& key);
-            CacheItem* DoCreateCacheEntry(const DBID& dbid, const Slice& key, KeyType type);
+            CacheItem* DoCreateCacheEntry(CacheShard& shard, const DBItemKey& cache_key, KeyType type);
         public:
             L1Cache(Ardb* db);
             int Evict(const DBID& dbid, const Slice& key);
+            /*
+             * Synchronously drops the entry of a key, zset entries are kept if 'keep_zset' is set.
+             */
+            int Invalidate(const DBID& dbid, const Slice& key, bool keep_zset);
+            void EvictDB(const DBID& dbid);
+            void EvictAll();
             int Load(const DBID& dbid, const Slice& key);
             int PeekCacheStatus(const DBID& dbid, const Slice& key, uint8& status);
             CacheItem* CreateCacheEntry(const DBID& dbid, const Slice& key, KeyType type);
@@ -238,9 +319,25 @@ namespace ardb
             {
                 return m_estimate_mem_size;
             }
-            uint32 GetEntrySize()
+            uint32 GetEntrySize();
+            /*
+             * Memory taken by the hash tables themselves, excluding keys & cached values
+             */
+            uint64 GetTableMemorySize();
+            void Stat(KeyType type, bool hit)
+            {
+                if (type <= LIST_META)
+                {
+                    atomic_add_uint64(hit ? &m_hits[type] : &m_misses[type], 1);
+                }
+            }
+            uint64 GetHits(KeyType type)
+            {
+                return type <= LIST_META ? m_hits[type] : 0;
+            }
+            uint64 GetMisses(KeyType type)
             {
-                return m_cache.Size();
+                return type <= LIST_META ? m_misses[type] : 0;
             }
 
             void StopSelf();
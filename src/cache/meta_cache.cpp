@@ -0,0 +1,198 @@
+/*
+ *Copyright (c) 2013-2013, yinqiwen <yinqiwen@gmail.com>
+ *All rights reserved.
+ *
+ *Redistribution and use in source and binary forms, with or without
+ *modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Redis nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ *BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ *THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "meta_cache.hpp"
+
+namespace ardb
+{
+    MetaCache::MetaCache(uint64 max_memory) :
+            m_max_memory(max_memory), m_hits(0), m_misses(0)
+    {
+    }
+
+    void MetaCache::SetMaxMemory(uint64 max_memory)
+    {
+        m_max_memory = max_memory;
+    }
+
+    MetaCache::MetaCacheShard& MetaCache::GetShard(const DBItemKey& key)
+    {
+        return m_shards[(DBItemKeyHash()(key) >> 24) % kMetaCacheShardCount];
+    }
+
+    uint64 MetaCache::EntryBytes(const DBItemKey& key, const std::string& value)
+    {
+        return key.key.size() + value.size() + MetaCacheTable::AverageBytesPerValue();
+    }
+
+    void MetaCache::Remove(MetaCacheShard& shard, const DBItemKey& key)
+    {
+        std::string old;
+        if (shard.table.Erase(key, old))
+        {
+            shard.bytes -= EntryBytes(key, old);
+        }
+    }
+
+    /*
+     * Called with the shard locked, a meta too large for the shard is dropped instead of cached.
+     */
+    void MetaCache::Store(MetaCacheShard& shard, const DBItemKey& key, const Slice& raw)
+    {
+        uint64 limit = m_max_memory / kMetaCacheShardCount;
+        std::string value(raw.data(), raw.size());
+        if (EntryBytes(key, value) > limit / 4)
+        {
+            Remove(shard, key);
+            return;
+        }
+        std::string old;
+        if (shard.table.Update(key, value, old))
+        {
+            shard.bytes = shard.bytes + value.size() - old.size();
+        }
+        else
+        {
+            shard.table.Insert(key, value);
+            shard.bytes += EntryBytes(key, value);
+        }
+        /*
+         * the stored entry is never its own victim, an eviction also invalidates pending fills of the shard
+         */
+        MetaCacheTable::CacheEntry victim;
+        while (shard.bytes > limit && shard.table.PeekVictim(victim))
+        {
+            if (victim.first == key)
+            {
+                shard.table.Get(key, value);
+                continue;
+            }
+            shard.table.PopVictim(victim);
+            shard.bytes -= EntryBytes(victim.first, victim.second);
+            shard.version++;
+        }
+    }
+
+    bool MetaCache::Get(const DBID& db, const Slice& key, std::string& raw, uint64& version)
+    {
+        DBItemKey cache_key(db, key);
+        MetaCacheShard& shard = GetShard(cache_key);
+        MetaCacheLockGuard guard(shard.mutex);
+        if (shard.table.Get(cache_key, raw))
+        {
+            atomic_add_uint64(&m_hits, 1);
+            return true;
+        }
+        atomic_add_uint64(&m_misses, 1);
+        version = shard.version;
+        return false;
+    }
+
+    void MetaCache::Fill(const DBID& db, const Slice& key, const Slice& raw, uint64 version)
+    {
+        DBItemKey cache_key(db, key);
+        MetaCacheShard& shard = GetShard(cache_key);
+        MetaCacheLockGuard guard(shard.mutex);
+        if (shard.version != version || shard.table.Contains(cache_key))
+        {
+            return;
+        }
+        Store(shard, cache_key, raw);
+    }
+
+    void MetaCache::Put(const DBID& db, const Slice& key, const Slice& raw)
+    {
+        DBItemKey cache_key(db, key);
+        MetaCacheShard& shard = GetShard(cache_key);
+        MetaCacheLockGuard guard(shard.mutex);
+        shard.version++;
+        Store(shard, cache_key, raw);
+    }
+
+    void MetaCache::Erase(const DBID& db, const Slice& key)
+    {
+        DBItemKey cache_key(db, key);
+        MetaCacheShard& shard = GetShard(cache_key);
+        MetaCacheLockGuard guard(shard.mutex);
+        shard.version++;
+        Remove(shard, cache_key);
+    }
+
+    void MetaCache::EraseDB(const DBID& db)
+    {
+        for (uint32 i = 0; i < kMetaCacheShardCount; i++)
+        {
+            MetaCacheShard& shard = m_shards[i];
+            MetaCacheLockGuard guard(shard.mutex);
+            shard.version++;
+            std::vector<DBItemKey> keys;
+            shard.table.GetKeys(keys);
+            for (uint32 j = 0; j < keys.size(); j++)
+            {
+                if (keys[j].db == db)
+                {
+                    Remove(shard, keys[j]);
+                }
+            }
+        }
+    }
+
+    void MetaCache::Clear()
+    {
+        for (uint32 i = 0; i < kMetaCacheShardCount; i++)
+        {
+            MetaCacheShard& shard = m_shards[i];
+            MetaCacheLockGuard guard(shard.mutex);
+            shard.version++;
+            shard.table.Clear();
+            shard.bytes = 0;
+        }
+    }
+
+    uint64 MetaCache::GetEntrySize()
+    {
+        uint64 size = 0;
+        for (uint32 i = 0; i < kMetaCacheShardCount; i++)
+        {
+            MetaCacheLockGuard guard(m_shards[i].mutex);
+            size += m_shards[i].table.Size();
+        }
+        return size;
+    }
+
+    uint64 MetaCache::GetMemorySize()
+    {
+        uint64 size = 0;
+        for (uint32 i = 0; i < kMetaCacheShardCount; i++)
+        {
+            MetaCacheLockGuard guard(m_shards[i].mutex);
+            size += m_shards[i].bytes;
+        }
+        return size;
+    }
+}
@@ -0,0 +1,98 @@
+/*
+ *Copyright (c) 2013-2013, yinqiwen <yinqiwen@gmail.com>
+ *All rights reserved.
+ *
+ *Redistribution and use in source and binary forms, with or without
+ *modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Redis nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ *BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ *THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef META_CACHE_HPP_
+#define META_CACHE_HPP_
+
+#include "common.hpp"
+#include "data_format.hpp"
+#include "util/atomic.hpp"
+#include "util/clock_cache.hpp"
+#include "util/thread/spin_mutex_lock.hpp"
+#include "util/thread/lock_guard.hpp"
+
+namespace ardb
+{
+    /*
+     * Bounded cache of encoded meta values keyed by (db, key), entries are sharded by key hash and
+     * evicted by CLOCK. Writers update it through SetMeta/DelValue while holding the key lock, a deleted
+     * key is cached as an empty value. Readers fill a missed key only if its shard was not modified since
+     * the miss, so a slow engine read could never overwrite a newer meta.
+     */
+    class MetaCache
+    {
+        private:
+            typedef ClockCache<DBItemKey, std::string, DBItemKeyHash> MetaCacheTable;
+            static const uint32 kMetaCacheShardCount = 16;
+            struct MetaCacheShard
+            {
+                    MetaCacheTable table;
+                    uint64 bytes;
+                    uint64 version;
+                    SpinMutexLock mutex;
+                    MetaCacheShard() :
+                            bytes(0), version(0)
+                    {
+                    }
+            };
+            typedef LockGuard<SpinMutexLock> MetaCacheLockGuard;
+            MetaCacheShard m_shards[kMetaCacheShardCount];
+            uint64 m_max_memory;
+            volatile uint64 m_hits;
+            volatile uint64 m_misses;
+            MetaCacheShard& GetShard(const DBItemKey& key);
+            uint64 EntryBytes(const DBItemKey& key, const std::string& value);
+            void Store(MetaCacheShard& shard, const DBItemKey& key, const Slice& raw);
+            void Remove(MetaCacheShard& shard, const DBItemKey& key);
+        public:
+            MetaCache(uint64 max_memory);
+            void SetMaxMemory(uint64 max_memory);
+            /*
+             * A miss returns the version of the key's shard, which should be passed to Fill
+             */
+            bool Get(const DBID& db, const Slice& key, std::string& raw, uint64& version);
+            void Fill(const DBID& db, const Slice& key, const Slice& raw, uint64 version);
+            void Put(const DBID& db, const Slice& key, const Slice& raw);
+            void Erase(const DBID& db, const Slice& key);
+            void EraseDB(const DBID& db);
+            void Clear();
+            uint64 GetHits()
+            {
+                return m_hits;
+            }
+            uint64 GetMisses()
+            {
+                return m_misses;
+            }
+            uint64 GetEntrySize();
+            uint64 GetMemorySize();
+    };
+}
+
+#endif /* META_CACHE_HPP_ */
@@ -364,6 +364,32 @@ int32 Channel::WriteNow(Buffer* buffer)
     }
 }
 
+int32 Channel::WriteNow(const struct iovec* iov, int iovcnt)
+{
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        total += iov[i].iov_len;
+    }
+    Buffer buffer(total);
+    for (int i = 0; i < iovcnt; i++)
+    {
+        buffer.Write(iov[i].iov_base, iov[i].iov_len);
+    }
+    return WriteNow(&buffer);
+}
+
+bool Channel::WriteVector(const struct iovec* iov, int iovcnt)
+{
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        total += iov[i].iov_len;
+    }
+    int32 ret = WriteNow(iov, iovcnt);
+    return ret >= 0 ? (total == (size_t) ret) : false;
+}
+
 bool Channel::DoConfigure(const ChannelOptions& options)
 {
     if (options.user_write_buffer_water_mark > 0)
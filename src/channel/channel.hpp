@@ -36,6 +36,8 @@
 #include "util/helpers.hpp"
 #include <map>
 
+struct iovec;
+
 /* delayed ack (quick_ack) */
 #ifndef HAVE_TCP_QUICKACK
 #ifdef __linux__
@@ -196,6 +198,10 @@ namespace ardb
             virtual bool DoClose();
             virtual bool DoFlush();
             virtual int32 WriteNow(Buffer* buffer);
+            /*
+             * Gather write, default implementation copies the vector into one buffer.
+             */
+            virtual int32 WriteNow(const struct iovec* iov, int iovcnt);
             virtual int32 ReadNow(Buffer* buffer);
             virtual int32 HandleExceptionEvent(int32 event);
             int HandleIOError(int err);
@@ -324,6 +330,11 @@ namespace ardb
             }
 
             int SendFile(const SendFileSetting& setting);
+            /*
+             * Write the data referenced by iov, it must stay valid only until this returns,
+             * any part not written immediately is copied into the output buffer.
+             */
+            bool WriteVector(const struct iovec* iov, int iovcnt);
 
             bool Flush();
             virtual const Address* GetLocalAddress()
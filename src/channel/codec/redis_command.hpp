@@ -32,6 +32,8 @@
 
 #include <deque>
 #include <string>
+#include <vector>
+#include "slice.hpp"
 
 namespace ardb
 {
@@ -216,6 +218,9 @@ namespace ardb
             REDIS_CMD_AREA_DEL = 176,
             REDIS_CMD_AREA_CLEAR = 177,
             REDIS_CMD_AREA_LOCATE = 178,
+            REDIS_CMD_SMISMEMBER = 179,
+            REDIS_CMD_SCHECK = 180,
+            REDIS_CMD_BACKUP = 181,
 
         };
 
@@ -225,10 +230,22 @@ namespace ardb
         {
             private:
                 RedisCommandType type;
+                /*
+                 * Dense id assigned by the server's command id table, -1 if not resolved yet
+                 */
+                int32 m_cmd_id;
                 bool m_is_inline;
                 bool m_cmd_seted;
+                /*
+                 * Zero copy mode: arguments are slices into the decoder's read buffer
+                 * which stays untouched until the frame is dispatched. Any copy of the
+                 * frame, or any access through GetArguments, materializes them into m_args.
+                 */
+                bool m_borrow_args;
+                mutable bool m_args_borrowed;
                 std::string m_cmd;
-                ArgumentArray m_args;
+                mutable ArgumentArray m_args;
+                std::vector<Slice> m_arg_slices;
                 /*
                  * Used to identify the received protocol data size
                  */
@@ -239,7 +256,15 @@ namespace ardb
                     buf.AdvanceReadIndex(len);
                     if (m_cmd_seted)
                     {
-                        m_args.push_back(std::string(str, len));
+                        if (m_borrow_args)
+                        {
+                            m_arg_slices.push_back(Slice(str, len));
+                            m_args_borrowed = true;
+                        }
+                        else
+                        {
+                            m_args.push_back(std::string(str, len));
+                        }
                     }
                     else
                     {
@@ -247,21 +272,63 @@ namespace ardb
                         m_cmd_seted = true;
                     }
                 }
+                inline void MaterializeArguments() const
+                {
+                    if (m_args_borrowed)
+                    {
+                        for (uint32 i = 0; i < m_arg_slices.size(); i++)
+                        {
+                            m_args.push_back(m_arg_slices[i].ToString());
+                        }
+                        m_args_borrowed = false;
+                    }
+                }
+                inline void CopyFrom(const RedisCommandFrame& other)
+                {
+                    type = other.type;
+                    m_cmd_id = other.m_cmd_id;
+                    m_is_inline = other.m_is_inline;
+                    m_cmd_seted = other.m_cmd_seted;
+                    m_borrow_args = false;
+                    m_args_borrowed = false;
+                    m_cmd = other.m_cmd;
+                    other.MaterializeArguments();
+                    m_args = other.m_args;
+                    m_arg_slices.clear();
+                    m_raw_data_size = other.m_raw_data_size;
+                }
                 friend class RedisCommandDecoder;
             public:
                 RedisCommandFrame() :
-                        type(REDIS_CMD_INVALID), m_is_inline(false), m_cmd_seted(false), m_raw_data_size(0)
+                        type(REDIS_CMD_INVALID), m_cmd_id(-1), m_is_inline(false), m_cmd_seted(false), m_borrow_args(
+                                false), m_args_borrowed(false), m_raw_data_size(0)
                 {
                 }
+                RedisCommandFrame(const RedisCommandFrame& other) :
+                        type(REDIS_CMD_INVALID), m_cmd_id(-1), m_is_inline(false), m_cmd_seted(false), m_borrow_args(
+                                false), m_args_borrowed(false), m_raw_data_size(0)
+                {
+                    CopyFrom(other);
+                }
+                RedisCommandFrame& operator=(const RedisCommandFrame& other)
+                {
+                    if (this != &other)
+                    {
+                        CopyFrom(other);
+                    }
+                    return *this;
+                }
                 RedisCommandFrame(ArgumentArray& cmd) :
-                        type(REDIS_CMD_INVALID), m_is_inline(false), m_cmd_seted(false), m_raw_data_size(0)
+                        type(REDIS_CMD_INVALID), m_cmd_id(-1), m_is_inline(false), m_cmd_seted(false), m_borrow_args(
+                                false), m_args_borrowed(false), m_raw_data_size(0)
                 {
                     m_cmd = cmd.front();
                     cmd.pop_front();
                     m_args = cmd;
                 }
                 RedisCommandFrame(const char* fmt, ...) :
-                        type(REDIS_CMD_INVALID), m_is_inline(false), m_cmd_seted(false), m_raw_data_size(0)
+                        type(REDIS_CMD_INVALID), m_cmd_id(-1), m_is_inline(false), m_cmd_seted(false), m_borrow_args(
+                                false), m_args_borrowed(false), m_raw_data_size(0)
                 {
                     va_list ap;
                     va_start(ap, fmt);
@@ -291,18 +358,39 @@ namespace ardb
                 {
                     return this->type;
                 }
+                inline void SetCommandId(int32 id)
+                {
+                    m_cmd_id = id;
+                }
+                inline int32 GetCommandId() const
+                {
+                    return m_cmd_id;
+                }
                 bool IsInLine() const
                 {
                     return m_is_inline;
                 }
                 const ArgumentArray& GetArguments() const
                 {
+                    MaterializeArguments();
                     return m_args;
                 }
                 ArgumentArray& GetMutableArguments()
                 {
+                    MaterializeArguments();
                     return m_args;
                 }
+                /*
+                 * Copy free argument access, valid until the frame is destroyed.
+                 */
+                uint32 GetArgumentCount() const
+                {
+                    return m_args_borrowed ? m_arg_slices.size() : m_args.size();
+                }
+                Slice GetArgumentSlice(uint32 index) const
+                {
+                    return m_args_borrowed ? m_arg_slices[index] : Slice(m_args[index]);
+                }
                 const std::string& GetCommand() const
                 {
                     return m_cmd;
@@ -314,9 +402,11 @@ namespace ardb
                 void SetCommand(const std::string& cmd)
                 {
                     m_cmd = cmd;
+                    m_cmd_id = -1;
                 }
                 const std::string* GetArgument(uint32 index) const
                 {
+                    MaterializeArguments();
                     if (index >= m_args.size())
                     {
                         return NULL;
@@ -325,6 +415,7 @@ namespace ardb
                 }
                 std::string ToString() const
                 {
+                    MaterializeArguments();
                     std::string cmd;
                     cmd.append(m_cmd).append(" ");
                     for (uint32 i = 0; i < m_args.size(); i++)
@@ -339,9 +430,12 @@ namespace ardb
                 }
                 void Clear()
                 {
+                    m_cmd_id = -1;
                     m_cmd_seted = false;
+                    m_args_borrowed = false;
                     m_cmd.clear();
                     m_args.clear();
+                    m_arg_slices.clear();
                 }
                 ~RedisCommandFrame()
                 {
@@ -31,8 +31,11 @@
 #include "channel/all_includes.hpp"
 #include "redis_command_codec.hpp"
 #include "util/exception/api_exception.hpp"
+#include "util/string_helper.hpp"
 
 #include <limits.h>
+#include <strings.h>
+#include <ctype.h>
 
 using ardb::BufferHelper;
 using namespace ardb::codec;
@@ -220,23 +223,148 @@ bool RedisCommandDecoder::Decode(Channel* channel,Buffer& buffer, RedisCommandFr
     return false;
 }
 
+uint32 RedisCommandIdTable::Hash(const char* name, size_t len)
+{
+    //FNV-1a over the lower case name
+    uint32 hash = 2166136261U;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ (uint8) tolower(name[i])) * 16777619U;
+    }
+    return hash;
+}
+
+void RedisCommandIdTable::Rehash(uint32 capacity)
+{
+    std::vector<Slot> old;
+    old.swap(m_slots);
+    m_slots.resize(capacity);
+    m_size = 0;
+    for (uint32 i = 0; i < old.size(); i++)
+    {
+        if (old[i].id >= 0)
+        {
+            Add(old[i].name, old[i].id);
+        }
+    }
+}
+
+void RedisCommandIdTable::Add(const std::string& name, int32 id)
+{
+    if ((m_size + 1) * 2 > m_slots.size())
+    {
+        Rehash(m_slots.empty() ? 64 : m_slots.size() * 2);
+    }
+    uint32 mask = m_slots.size() - 1;
+    uint32 idx = Hash(name.data(), name.size()) & mask;
+    while (m_slots[idx].id >= 0)
+    {
+        if (m_slots[idx].name.size() == name.size()
+                && !strncasecmp(m_slots[idx].name.data(), name.data(), name.size()))
+        {
+            m_slots[idx].id = id;
+            return;
+        }
+        idx = (idx + 1) & mask;
+    }
+    m_slots[idx].name = name;
+    lower_string(m_slots[idx].name);
+    m_slots[idx].id = id;
+    m_size++;
+}
+
+void RedisCommandIdTable::Clear()
+{
+    m_slots.clear();
+    m_size = 0;
+}
+
+int32 RedisCommandIdTable::Find(const char* name, size_t len) const
+{
+    if (m_slots.empty())
+    {
+        return -1;
+    }
+    uint32 mask = m_slots.size() - 1;
+    uint32 idx = Hash(name, len) & mask;
+    while (m_slots[idx].id >= 0)
+    {
+        if (m_slots[idx].name.size() == len && !strncasecmp(m_slots[idx].name.data(), name, len))
+        {
+            return m_slots[idx].id;
+        }
+        idx = (idx + 1) & mask;
+    }
+    return -1;
+}
+
+static bool is_single_get(const RedisCommandFrame& frame)
+{
+    return frame.GetArgumentCount() == 1 && !strcasecmp(frame.GetCommand().c_str(), "get");
+}
+
+void RedisCommandDecoder::LookaheadGets(Buffer& buffer, const RedisCommandFrame& msg)
+{
+    static const uint32 kMaxPipelinedGets = 256;
+    m_pipelined_get_keys.clear();
+    if (m_lookahead_skip > 0)
+    {
+        //already counted in a previous run
+        m_lookahead_skip--;
+        return;
+    }
+    if (!is_single_get(msg))
+    {
+        return;
+    }
+    size_t mark_read_index = buffer.GetReadIndex();
+    while (m_pipelined_get_keys.size() < kMaxPipelinedGets && buffer.Readable())
+    {
+        RedisCommandFrame next;
+        if (!Decode(NULL, buffer, next) || !is_single_get(next))
+        {
+            break;
+        }
+        m_pipelined_get_keys.push_back(next.GetArgumentSlice(0).ToString());
+    }
+    buffer.SetReadIndex(mark_read_index);
+    if (!m_pipelined_get_keys.empty())
+    {
+        m_lookahead_skip = m_pipelined_get_keys.size();
+        m_pipelined_get_keys.push_front(msg.GetArgumentSlice(0).ToString());
+    }
+}
+
 bool RedisCommandDecoder::Decode(ChannelHandlerContext& ctx, Channel* channel, Buffer& buffer, RedisCommandFrame& msg)
 {
-    return Decode(channel, buffer, msg);
+    msg.m_borrow_args = m_zero_copy;
+    if (!Decode(channel, buffer, msg))
+    {
+        return false;
+    }
+    if (NULL != m_command_ids)
+    {
+        msg.SetCommandId(m_command_ids->Find(msg.GetCommand()));
+    }
+    if (m_lookahead_get)
+    {
+        LookaheadGets(buffer, msg);
+    }
+    return true;
 }
 
 //===================================encoder==============================
 bool RedisCommandEncoder::Encode(Buffer& buf, const RedisCommandFrame& cmd)
 {
-    buf.Printf("*%d\r\n", cmd.GetArguments().size() + 1);
+    buf.Printf("*%d\r\n", cmd.GetArgumentCount() + 1);
     buf.Printf("$%d\r\n", cmd.GetCommand().size());
     buf.Write(cmd.GetCommand().data(), cmd.GetCommand().size());
     buf.Write("\r\n", 2);
-    for (uint32 i = 0; i < cmd.GetArguments().size(); i++)
+    for (uint32 i = 0; i < cmd.GetArgumentCount(); i++)
     {
-        const std::string* arg = cmd.GetArgument(i);
-        buf.Printf("$%d\r\n", arg->size());
-        buf.Write(arg->data(), arg->size());
+        Slice arg = cmd.GetArgumentSlice(i);
+        buf.Printf("$%d\r\n", arg.size());
+        buf.Write(arg.data(), arg.size());
         buf.Write("\r\n", 2);
     }
     return true;
@@ -32,11 +32,46 @@
 
 #include "channel/codec/stack_frame_decoder.hpp"
 #include "redis_command.hpp"
+#include <vector>
 
 namespace ardb
 {
     namespace codec
     {
+        /*
+         * Case insensitive open addressing table from command name to a dense command id.
+         * It is filled once before serving, lookups afterwards are read only.
+         */
+        class RedisCommandIdTable
+        {
+            private:
+                struct Slot
+                {
+                        std::string name;
+                        int32 id;
+                        Slot() :
+                                id(-1)
+                        {
+                        }
+                };
+                std::vector<Slot> m_slots;
+                uint32 m_size;
+                static uint32 Hash(const char* name, size_t len);
+                void Rehash(uint32 capacity);
+            public:
+                RedisCommandIdTable() :
+                        m_size(0)
+                {
+                }
+                void Add(const std::string& name, int32 id);
+                void Clear();
+                int32 Find(const char* name, size_t len) const;
+                int32 Find(const std::string& name) const
+                {
+                    return Find(name.data(), name.size());
+                }
+        };
+
         class RedisMessageDecoder;
         class RedisCommandDecoder: public StackFrameDecoder<RedisCommandFrame>
         {
@@ -44,12 +79,33 @@ namespace ardb
                 static int ProcessInlineBuffer(Buffer& buffer, RedisCommandFrame& frame);
                 static int ProcessMultibulkBuffer(Channel* ch, Buffer& buffer, RedisCommandFrame& frame);
                 bool Decode(ChannelHandlerContext& ctx, Channel* channel, Buffer& buffer, RedisCommandFrame& msg);
+                void LookaheadGets(Buffer& buffer, const RedisCommandFrame& msg);
                 friend class RedisMessageDecoder;
+
+                bool m_lookahead_get;
+                uint32 m_lookahead_skip;
+                ArgumentArray m_pipelined_get_keys;
+                const RedisCommandIdTable* m_command_ids;
+                bool m_zero_copy;
             public:
-                RedisCommandDecoder()
+                /*
+                 * With zero_copy the decoded frames keep their arguments as slices into the
+                 * read buffer, so handlers must be done with them before the frame event returns.
+                 */
+                RedisCommandDecoder(bool lookahead_get = false, const RedisCommandIdTable* ids = NULL,
+                        bool zero_copy = false) :
+                        m_lookahead_get(lookahead_get), m_lookahead_skip(0), m_command_ids(ids), m_zero_copy(zero_copy)
                 {
                 }
                 static bool Decode(Channel* ch, Buffer& buffer, RedisCommandFrame& msg);
+                /*
+                 * Keys of the pipelined GET run beginning at the frame just decoded (that frame's key first),
+                 * empty if the frame does not begin a run of at least two GETs already in the read buffer.
+                 */
+                ArgumentArray& GetPipelinedGetKeys()
+                {
+                    return m_pipelined_get_keys;
+                }
         };
 
         class RedisCommandEncoder: public ChannelDownstreamHandler<RedisCommandFrame>
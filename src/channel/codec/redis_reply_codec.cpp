@@ -106,16 +106,100 @@ bool RedisReplyEncoder::Encode(Buffer& buf, RedisReply& reply)
     return true;
 }
 
+void RedisReplyVector::Reference(const char* ref, size_t len)
+{
+    size_t offset = data.GetWriteIndex();
+    if (offset > m_pending_offset)
+    {
+        Segment inline_seg;
+        inline_seg.ref = NULL;
+        inline_seg.offset = m_pending_offset;
+        inline_seg.len = offset - m_pending_offset;
+        m_segments.push_back(inline_seg);
+    }
+    Segment seg;
+    seg.ref = ref;
+    seg.offset = 0;
+    seg.len = len;
+    m_segments.push_back(seg);
+    m_pending_offset = offset;
+}
+
+void RedisReplyVector::ToIOVec(std::vector<struct iovec>& iov)
+{
+    iov.resize(m_segments.size() + 1);
+    size_t i = 0;
+    for (; i < m_segments.size(); i++)
+    {
+        const Segment& seg = m_segments[i];
+        iov[i].iov_base = (void*) (NULL != seg.ref ? seg.ref : data.GetRawBuffer() + seg.offset);
+        iov[i].iov_len = seg.len;
+    }
+    if (data.GetWriteIndex() > m_pending_offset)
+    {
+        iov[i].iov_base = (void*) (data.GetRawBuffer() + m_pending_offset);
+        iov[i].iov_len = data.GetWriteIndex() - m_pending_offset;
+        i++;
+    }
+    iov.resize(i);
+}
+
+bool RedisReplyEncoder::Encode(RedisReplyVector& vec, RedisReply& reply)
+{
+    switch (reply.type)
+    {
+        case REDIS_REPLY_STRING:
+        {
+            if (reply.str.size() < RedisReplyVector::kRefThreshold)
+            {
+                return Encode(vec.data, reply);
+            }
+            vec.data.Printf("$%d\r\n", reply.str.size());
+            vec.Reference(reply.str.data(), reply.str.size());
+            vec.data.Write("\r\n", 2);
+            break;
+        }
+        case REDIS_REPLY_ARRAY:
+        {
+            vec.data.Printf("*%d\r\n", reply.elements.size());
+            size_t i = 0;
+            while (i < reply.elements.size())
+            {
+                if (!RedisReplyEncoder::Encode(vec, reply.elements[i]))
+                {
+                    return false;
+                }
+                i++;
+            }
+            break;
+        }
+        default:
+        {
+            return Encode(vec.data, reply);
+        }
+    }
+    return true;
+}
+
 bool RedisReplyEncoder::WriteRequested(ChannelHandlerContext& ctx,
         MessageEvent<RedisReply>& e)
 {
     RedisReply* msg = e.GetMessage();
-    Buffer buffer(1024);
-    if (Encode(buffer, *msg))
+    RedisReplyVector vec;
+    if (!Encode(vec, *msg))
+    {
+        return false;
+    }
+    if (!vec.HasReference())
     {
-        return ctx.GetChannel()->Write(buffer);
+        return ctx.GetChannel()->Write(vec.data);
     }
-    return false;
+    /*
+     * Large values are written straight from the reply, which lives until this returns.
+     */
+    std::vector<struct iovec> iov;
+    vec.ToIOVec(iov);
+    return ctx.GetChannel()->WriteVector(&iov[0], iov.size());
 }
 
 //==================================Decoder==========================================
@@ -32,6 +32,8 @@
 #include "channel/codec/stack_frame_decoder.hpp"
 #include <deque>
 #include <string>
+#include <vector>
+#include <sys/uio.h>
 #include "redis_reply.hpp"
 
 namespace ardb
@@ -60,12 +62,46 @@ namespace ardb
 				}
 		};
 
+		/*
+		 * Scatter/gather form of an encoded reply, protocol headers and small values
+		 * are packed into 'data', large string values are referenced in place.
+		 */
+		class RedisReplyVector
+		{
+			private:
+				struct Segment
+				{
+						const char* ref; //NULL means [offset, offset+len) of 'data'
+						size_t offset;
+						size_t len;
+				};
+				std::vector<Segment> m_segments;
+				size_t m_pending_offset;
+			public:
+				static const size_t kRefThreshold = 1024;
+				Buffer data;
+				RedisReplyVector() :
+						m_pending_offset(0), data(1024)
+				{
+				}
+				void Reference(const char* ref, size_t len);
+				/*
+				 * False if every byte is already in 'data'.
+				 */
+				bool HasReference()
+				{
+					return !m_segments.empty();
+				}
+				void ToIOVec(std::vector<struct iovec>& iov);
+		};
+
 		class RedisReplyEncoder: public ChannelDownstreamHandler<RedisReply>
 		{
 			private:
 				bool WriteRequested(ChannelHandlerContext& ctx, MessageEvent<RedisReply>& e);
 			public:
 				static bool Encode(Buffer& buf, RedisReply& reply);
+				static bool Encode(RedisReplyVector& vec, RedisReply& reply);
 		};
 
 		class NullRedisReplyEncoder: public ChannelDownstreamHandler<RedisReply>
@@ -320,6 +320,88 @@ int SocketChannel::GetSocketFD(int domain)
 	return m_fd;
 }
 
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/*
+ * writev the vector directly while nothing is pending in the output buffer,
+ * only the unwritten tail is copied into the output buffer on a short write.
+ */
+int32 SocketChannel::WriteNow(const struct iovec* iov, int iovcnt)
+{
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        total += iov[i].iov_len;
+    }
+    if (NULL != m_file_sending || m_outputBuffer.Readable() || IsEnableWriting()
+            || total < m_options.user_write_buffer_water_mark || GetWriteFD() < 0)
+    {
+        return Channel::WriteNow(iov, iovcnt);
+    }
+    std::vector<struct iovec> vec(iov, iov + iovcnt);
+    size_t idx = 0;
+    size_t written = 0;
+    while (idx < vec.size())
+    {
+        int cnt = vec.size() - idx > IOV_MAX ? IOV_MAX : vec.size() - idx;
+        size_t batch_len = 0;
+        for (int i = 0; i < cnt; i++)
+        {
+            batch_len += vec[idx + i].iov_len;
+        }
+        ssize_t n = ::writev(GetWriteFD(), &vec[idx], cnt);
+        if (n < 0)
+        {
+            int err = errno;
+            if (IO_ERR_RW_RETRIABLE(err))
+            {
+                break;
+            }
+            return HandleIOError(err);
+        }
+        else if (n == 0)
+        {
+            return HandleExceptionEvent(CHANNEL_EVENT_EOF);
+        }
+        written += n;
+        size_t left = n;
+        while (left > 0 && idx < vec.size())
+        {
+            if (left >= vec[idx].iov_len)
+            {
+                left -= vec[idx].iov_len;
+                idx++;
+            }
+            else
+            {
+                vec[idx].iov_base = (char*) vec[idx].iov_base + left;
+                vec[idx].iov_len -= left;
+                left = 0;
+            }
+        }
+        if ((size_t) n < batch_len)
+        {
+            break;
+        }
+    }
+    if (idx < vec.size())
+    {
+        if (0 == written && m_options.max_write_buffer_size == 0)
+        {
+            //no write buffer allowed
+            return 0;
+        }
+        for (; idx < vec.size(); idx++)
+        {
+            m_outputBuffer.Write(vec[idx].iov_base, vec[idx].iov_len);
+        }
+        EnableWriting();
+    }
+    return total;
+}
+
 void SocketChannel::OnWrite()
 {
         //DEBUG_LOG("############st is %d", m_state);
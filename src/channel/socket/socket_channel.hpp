@@ -31,6 +31,7 @@
 #define NOVA_SOCKETCHANNEL_HPP_
 #include "channel/channel.hpp"
 #include "util/socket_address.hpp"
+#include <sys/uio.h>
 
 
 namespace ardb
@@ -68,6 +69,7 @@ namespace ardb
 			virtual bool DoConfigure(const ChannelOptions& options);
 			virtual int32 HandleExceptionEvent(int32 event);
 			void OnWrite();
+			int32 WriteNow(const struct iovec* iov, int iovcnt);
 
 			void OnAccepted();
 			friend class ChannelService;
@@ -32,7 +32,7 @@ namespace ardb
 {
     DBCrons* DBCrons::g_crons = NULL;
     DBCrons::DBCrons() :
-            m_db_server(NULL), m_expire_check(NULL), m_gc(NULL)
+            m_db_server(NULL), m_expire_check(NULL), m_lazy_free_reaper(NULL), m_gc(NULL)
     {
     }
 
@@ -56,6 +56,7 @@ namespace ardb
         if (NULL != server)
         {
             NEW(m_expire_check, ExpireCheck(server));
+            NEW(m_lazy_free_reaper, LazyFreeReaper(server));
             NEW(m_gc, CompactGC(server));
         }
         return 0;
@@ -67,6 +68,10 @@ namespace ardb
         {
             m_serv.GetTimer().ScheduleHeapTask(m_expire_check, 100, 100, MILLIS);
         }
+        if (NULL != m_lazy_free_reaper)
+        {
+            m_serv.GetTimer().ScheduleHeapTask(m_lazy_free_reaper, 100, 100, MILLIS);
+        }
         if (NULL != m_gc)
         {
             m_serv.GetTimer().ScheduleHeapTask(m_gc, 10, 10, SECONDS);
@@ -46,17 +46,31 @@
 namespace ardb
 {
 
+    /*
+     * Deletes expired keys from the expire wheel of the db, the time spent each run grows with the
+     * number of expired keys waiting.
+     */
     class ExpireCheck: public Runnable
     {
         private:
-            DBID m_checking_db;
             ArdbServer* m_server;
             void Run();
-            static void ExpireCheckCallback(const DBID& db, const Slice& key, void* data);
+            static void ExpireCheckCallback(const DBID& db, const SliceArray& keys, void* data);
         public:
             ExpireCheck(ArdbServer* serv);
     };
 
+    /*
+     * Reaps elements of lazily deleted keys, at most 'lazyfree-max-deletes-per-sec' per second.
+     */
+    class LazyFreeReaper: public Runnable
+    {
+        private:
+            ArdbServer* m_server;
+            void Run();
+        public:
+            LazyFreeReaper(ArdbServer* serv);
+    };
 
     class CompactGC:public Runnable
     {
@@ -91,6 +105,7 @@ namespace ardb
             ChannelService m_serv;
             ArdbServer* m_db_server;
             ExpireCheck* m_expire_check;
+            LazyFreeReaper* m_lazy_free_reaper;
             CompactGC* m_gc;
             void Run();
             DBCrons();
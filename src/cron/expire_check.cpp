@@ -30,17 +30,30 @@
 
 namespace ardb
 {
+    /*
+     * Runs every 100ms, 10ms for an expire batch of 256 keys & up to 80ms when there is a backlog of more batches.
+     */
+    static const uint32 kExpireBatchSize = 256;
+    static const uint64 kExpireMinExecTime = 10;
+    static const uint64 kExpireMaxExecTime = 80;
+
     ExpireCheck::ExpireCheck(ArdbServer* serv) :
-            m_checking_db(0), m_server(serv)
+            m_server(serv)
     {
     }
 
-    void ExpireCheck::ExpireCheckCallback(const DBID& db, const Slice& key, void* data)
+    /*
+     * One 'del' with all keys of a batch per DB for the slaves
+     */
+    void ExpireCheck::ExpireCheckCallback(const DBID& db, const SliceArray& keys, void* data)
     {
         ExpireCheck* e = (ExpireCheck*) data;
         ArgumentArray args;
         args.push_back("del");
-        args.push_back(std::string(key.data(), key.size()));
+        for (uint32 i = 0; i < keys.size(); i++)
+        {
+            args.push_back(std::string(keys[i].data(), keys[i].size()));
+        }
         RedisCommandFrame cmd(args);
         e->m_server->GetMaster().FeedSlaves(NULL, db, cmd);
     }
@@ -55,28 +68,13 @@ namespace ardb
             return;
         }
         Ardb& db = m_server->GetDB();
-        uint64 start = get_current_epoch_millis();
-        while (m_checking_db < ARDB_GLOBAL_DB)
+        uint64 batches = db.GetExpireBacklog() / kExpireBatchSize;
+        uint64 maxexec = kExpireMinExecTime * (1 + batches);
+        if (maxexec > kExpireMaxExecTime)
         {
-            uint64 now = get_current_epoch_millis();
-            if (now - start >= 500)
-            {
-                return;
-            }
-            DBID nexdb = 0;
-            if (!db.DBExist(m_checking_db, nexdb))
-            {
-                if (nexdb == m_checking_db || nexdb == ARDB_GLOBAL_DB)
-                {
-                    m_checking_db = 0;
-                    return;
-                }
-                m_checking_db = nexdb;
-            }
-            db.CheckExpireKey(m_checking_db, 50, 10000, ExpireCheckCallback, this);
-            m_checking_db++;
+            maxexec = kExpireMaxExecTime;
         }
-        m_checking_db = 0;
+        ReadLockGuard<StripedRWLock> guard(m_server->GetWritePauseLock());
+        db.ExpireKeys(kExpireBatchSize, maxexec, ExpireCheckCallback, this);
     }
 }
-
@@ -34,7 +34,10 @@
  */
 #include "data_format.hpp"
 #include "geo/geohash_helper.hpp"
+#include "util/file_helper.hpp"
+#include "util/bitops.hpp"
 #include <cmath>
+#include <algorithm>
 
 #define  GET_KEY_TYPE(KEY, TYPE)   do{ \
 		Iterator* iter = FindValue(KEY, true);  \
@@ -429,6 +432,306 @@ namespace ardb
         value.SetValue(v, true);
     }
 
+    static uint8 g_key_format = ARDB_KEY_FORMAT_LEGACY;
+
+    void set_key_format(uint8 format)
+    {
+        g_key_format = format;
+    }
+
+    uint8 get_key_format()
+    {
+        return g_key_format;
+    }
+
+    static bool g_bitset_chunk_compress = true;
+
+    void set_bitset_chunk_compress(bool enable)
+    {
+        g_bitset_chunk_compress = enable;
+    }
+
+    /*
+     * A data dir created before key format versioning has no KEY_FORMAT file, but
+     * contains the engine's own files(probe_file), so it must be in legacy format.
+     */
+    uint8 detect_key_format(const std::string& dir, const std::string& probe_file)
+    {
+        std::string format_file = dir + "/" + ARDB_KEY_FORMAT_FILE;
+        if (is_file_exist(format_file))
+        {
+            Buffer content;
+            int64 format = ARDB_KEY_FORMAT_LEGACY;
+            if (0 == file_read_full(format_file, content)
+                    && raw_toint64(content.GetRawReadBuffer(), content.ReadableBytes(), format))
+            {
+                return (uint8) format;
+            }
+            ERROR_LOG("Invalid key format file:%s", format_file.c_str());
+            return ARDB_KEY_FORMAT_LEGACY;
+        }
+        if (is_file_exist(dir + "/" + probe_file))
+        {
+            return ARDB_KEY_FORMAT_LEGACY;
+        }
+        return ARDB_KEY_FORMAT_LATEST;
+    }
+
+    int save_key_format(const std::string& dir, uint8 format)
+    {
+        return file_write_content(dir + "/" + ARDB_KEY_FORMAT_FILE, stringfromll(format));
+    }
+
+    /*
+     * Memcomparable encoding helpers.
+     * Bytes are escaped as 0x00->0x00 0xFF and terminated by 0x00 0x01, numbers are
+     * written big endian with the sign bit flipped, so memcmp gives the same order as
+     * ardb_compare_keys on the legacy layout.
+     */
+    static void encode_ordered_bytes(Buffer& buf, const char* data, size_t size)
+    {
+        const char* end = data + size;
+        while (data < end)
+        {
+            const char* zero = (const char*) memchr(data, 0, end - data);
+            if (NULL == zero)
+            {
+                buf.Write(data, end - data);
+                break;
+            }
+            buf.Write(data, zero - data);
+            buf.WriteByte(0);
+            buf.WriteByte((char) 0xFF);
+            data = zero + 1;
+        }
+        buf.WriteByte(0);
+        buf.WriteByte(1);
+    }
+
+    /*
+     * 'value' points into 'buf' if there is no escaped byte, otherwise into 'storage'.
+     */
+    static bool decode_ordered_bytes(Buffer& buf, Slice& value, std::string& storage)
+    {
+        const char* start = buf.GetRawReadBuffer();
+        const char* end = start + buf.ReadableBytes();
+        const char* data = start;
+        bool escaped = false;
+        while (true)
+        {
+            const char* zero = (const char*) memchr(data, 0, end - data);
+            if (NULL == zero || zero + 1 >= end)
+            {
+                return false;
+            }
+            if ((uint8) zero[1] == 1)
+            {
+                if (escaped)
+                {
+                    storage.append(data, zero - data);
+                    value = Slice(storage.data(), storage.size());
+                }
+                else
+                {
+                    value = Slice(start, zero - start);
+                }
+                buf.AdvanceReadIndex(zero + 2 - start);
+                return true;
+            }
+            if ((uint8) zero[1] != 0xFF)
+            {
+                return false;
+            }
+            if (!escaped)
+            {
+                storage.clear();
+                escaped = true;
+            }
+            storage.append(data, zero - data);
+            storage.push_back(0);
+            data = zero + 2;
+        }
+    }
+
+    static void encode_ordered_int64(Buffer& buf, int64 v)
+    {
+        BufferHelper::WriteFixUInt64(buf, ((uint64) v) ^ 0x8000000000000000ULL, true);
+    }
+
+    static bool decode_ordered_int64(Buffer& buf, int64& v)
+    {
+        uint64 u;
+        if (!BufferHelper::ReadFixUInt64(buf, u, true))
+        {
+            return false;
+        }
+        v = (int64) (u ^ 0x8000000000000000ULL);
+        return true;
+    }
+
+    static void encode_ordered_double(Buffer& buf, double v)
+    {
+        if (v == 0 || v != v)
+        {
+            /*
+             * -0.0 equals 0.0, NaN is ordered as the legacy comparator does: before anything
+             */
+            v = v == 0 ? 0 : -INFINITY;
+        }
+        union
+        {
+                double d;
+                uint64 u;
+        } x;
+        x.d = v;
+        if (x.u & 0x8000000000000000ULL)
+        {
+            x.u = ~x.u;
+        }
+        else
+        {
+            x.u |= 0x8000000000000000ULL;
+        }
+        BufferHelper::WriteFixUInt64(buf, x.u, true);
+    }
+
+    static bool decode_ordered_double(Buffer& buf, double& v)
+    {
+        union
+        {
+                double d;
+                uint64 u;
+        } x;
+        if (!BufferHelper::ReadFixUInt64(buf, x.u, true))
+        {
+            return false;
+        }
+        if (x.u & 0x8000000000000000ULL)
+        {
+            x.u &= ~0x8000000000000000ULL;
+        }
+        else
+        {
+            x.u = ~x.u;
+        }
+        v = x.d;
+        return true;
+    }
+
+    /*
+     * Same order as ValueData::Compare: type first, then value
+     */
+    static void encode_ordered_value(Buffer& buf, const ValueData& value)
+    {
+        BufferHelper::WriteFixUInt8(buf, value.type);
+        switch (value.type)
+        {
+            case INTEGER_VALUE:
+            {
+                encode_ordered_int64(buf, value.integer_value);
+                break;
+            }
+            case DOUBLE_VALUE:
+            {
+                encode_ordered_double(buf, value.double_value);
+                break;
+            }
+            case BYTES_VALUE:
+            {
+                encode_ordered_bytes(buf, value.bytes_value.data(), value.bytes_value.size());
+                break;
+            }
+            default:
+            {
+                break;
+            }
+        }
+    }
+
+    static bool decode_ordered_value(Buffer& buf, ValueData& value)
+    {
+        if (!BufferHelper::ReadFixUInt8(buf, value.type))
+        {
+            return false;
+        }
+        switch (value.type)
+        {
+            case INTEGER_VALUE:
+            {
+                return decode_ordered_int64(buf, value.integer_value);
+            }
+            case DOUBLE_VALUE:
+            {
+                return decode_ordered_double(buf, value.double_value);
+            }
+            case BYTES_VALUE:
+            {
+                Slice tmp;
+                std::string storage;
+                if (!decode_ordered_bytes(buf, tmp, storage))
+                {
+                    return false;
+                }
+                value.bytes_value.assign(tmp.data(), tmp.size());
+                return true;
+            }
+            case EMPTY_VALUE:
+            case MAX_VALUE_TYPE:
+            {
+                return true;
+            }
+            default:
+            {
+                return false;
+            }
+        }
+    }
+
+    /*
+     * List/zset scores are ordered by number value only, the original value type is kept
+     * in a suffix(after all ordered fields) so that decoded scores equal the written ones.
+     */
+    static void encode_ordered_score(Buffer& buf, const ValueData& score)
+    {
+        encode_ordered_double(buf, score.NumberValue());
+    }
+
+    static void encode_score_suffix(Buffer& buf, const ValueData& score)
+    {
+        BufferHelper::WriteFixUInt8(buf, score.type);
+        if (score.type == INTEGER_VALUE)
+        {
+            encode_ordered_int64(buf, score.integer_value);
+        }
+    }
+
+    static bool decode_score_suffix(Buffer& buf, double number, ValueData& score)
+    {
+        uint8 type;
+        if (!BufferHelper::ReadFixUInt8(buf, type))
+        {
+            return false;
+        }
+        score.Clear();
+        switch (type)
+        {
+            case INTEGER_VALUE:
+            {
+                score.type = INTEGER_VALUE;
+                return decode_ordered_int64(buf, score.integer_value);
+            }
+            case DOUBLE_VALUE:
+            {
+                score.SetDoubleValue(number);
+                return true;
+            }
+            default:
+            {
+                return true;
+            }
+        }
+    }
+
     int ardb_compare_keys(const char* akbuf, size_t aksiz, const char* bkbuf, size_t bksiz)
     {
         Buffer ak_buf(const_cast<char*>(akbuf), 0, aksiz);
@@ -468,6 +771,8 @@ namespace ardb
                 break;
             }
             case LIST_ELEMENT:
+            case LIST_SEGMENT:
+            case LIST_SEGMENT_INDEX:
             {
                 ValueData av, bv;
                 found_a = decode_value(ak_buf, av, true);
@@ -538,7 +843,138 @@ namespace ardb
         return ret;
     }
 
-    void encode_key(Buffer& buf, const KeyObject& key)
+    /*
+     * Shorten 'str' to a string in [str, limit) by Slice::compare order, same as leveldb's bytewise comparator.
+     */
+    static bool shorten_bytes_separator(std::string& str, const Slice& limit)
+    {
+        size_t min_length = str.size() < limit.size() ? str.size() : limit.size();
+        size_t diff_index = 0;
+        while (diff_index < min_length && str[diff_index] == limit.data()[diff_index])
+        {
+            diff_index++;
+        }
+        if (diff_index >= min_length)
+        {
+            return false;
+        }
+        uint8 diff_byte = (uint8) str[diff_index];
+        if (diff_byte < 0xFF && diff_byte + 1 < (uint8) limit.data()[diff_index])
+        {
+            str[diff_index]++;
+            str.resize(diff_index + 1);
+            return true;
+        }
+        return false;
+    }
+
+    static bool shorten_bytes_successor(std::string& str)
+    {
+        for (size_t i = 0; i < str.size(); i++)
+        {
+            if ((uint8) str[i] != 0xFF)
+            {
+                str[i]++;
+                str.resize(i + 1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+     * Separator & successor for the legacy key layout, used by the engines' index blocks.
+     * A key with a shortened user key sorts after every element of the original user key,
+     * elements of one big hash/set/zset are shortened by their bytes field/member.
+     */
+    void ardb_shortest_separator(std::string* start, const Slice& limit)
+    {
+        Buffer sbuf(const_cast<char*>(start->data()), 0, start->size());
+        Buffer lbuf(const_cast<char*>(limit.data()), 0, limit.size());
+        uint32 sheader, lheader;
+        Slice skey, lkey;
+        if (!BufferHelper::ReadFixUInt32(sbuf, sheader) || !BufferHelper::ReadFixUInt32(lbuf, lheader)
+                || !BufferHelper::ReadVarSlice(sbuf, skey) || !BufferHelper::ReadVarSlice(lbuf, lkey))
+        {
+            return;
+        }
+        uint8 type = sheader & 0xFF;
+        if (type == KEY_EXPIRATION_ELEMENT)
+        {
+            return;
+        }
+        Buffer result(start->size());
+        BufferHelper::WriteFixUInt32(result, sheader);
+        std::string key(skey.data(), skey.size());
+        if (sheader != lheader ? shorten_bytes_successor(key) : shorten_bytes_separator(key, lkey))
+        {
+            BufferHelper::WriteVarString(result, key);
+        }
+        else if (sheader == lheader && skey == lkey)
+        {
+            BufferHelper::WriteVarSlice(result, skey);
+            ValueData sfield, lfield;
+            if (type == ZSET_ELEMENT)
+            {
+                ValueData sscore, lscore;
+                if (!decode_value(sbuf, sscore, true) || !decode_value(lbuf, lscore, true)
+                        || sscore.NumberValue() != lscore.NumberValue())
+                {
+                    return;
+                }
+                encode_value(result, sscore);
+            }
+            else if (type != HASH_FIELD && type != SET_ELEMENT && type != ZSET_ELEMENT_NODE)
+            {
+                return;
+            }
+            if (!decode_value(sbuf, sfield, true) || !decode_value(lbuf, lfield, true) || sfield.type != BYTES_VALUE
+                    || lfield.type != BYTES_VALUE)
+            {
+                return;
+            }
+            sfield.bytes_value.assign(sfield.slice_value.data(), sfield.slice_value.size());
+            if (!shorten_bytes_separator(sfield.bytes_value, lfield.slice_value))
+            {
+                return;
+            }
+            encode_value(result, sfield);
+        }
+        else
+        {
+            return;
+        }
+        if (result.ReadableBytes() < start->size())
+        {
+            start->assign(result.GetRawReadBuffer(), result.ReadableBytes());
+        }
+    }
+
+    void ardb_short_successor(std::string* key)
+    {
+        Buffer buf(const_cast<char*>(key->data()), 0, key->size());
+        uint32 header;
+        Slice userkey;
+        if (!BufferHelper::ReadFixUInt32(buf, header) || !BufferHelper::ReadVarSlice(buf, userkey)
+                || (header & 0xFF) == KEY_EXPIRATION_ELEMENT)
+        {
+            return;
+        }
+        std::string successor(userkey.data(), userkey.size());
+        if (!shorten_bytes_successor(successor))
+        {
+            return;
+        }
+        Buffer result(key->size());
+        BufferHelper::WriteFixUInt32(result, header);
+        BufferHelper::WriteVarString(result, successor);
+        if (result.ReadableBytes() < key->size())
+        {
+            key->assign(result.GetRawReadBuffer(), result.ReadableBytes());
+        }
+    }
+
+    static void encode_legacy_key(Buffer& buf, const KeyObject& key)
     {
         uint32 header = (uint32) (key.db << 8) + key.type;
         BufferHelper::WriteFixUInt32(buf, header);
@@ -552,6 +988,8 @@ namespace ardb
                 break;
             }
             case LIST_ELEMENT:
+            case LIST_SEGMENT:
+            case LIST_SEGMENT_INDEX:
             {
                 const ListKeyObject& lk = (const ListKeyObject&) key;
                 encode_value(buf, lk.score);
@@ -605,7 +1043,7 @@ namespace ardb
     {
         Buffer buf(const_cast<char*>(key.data()), 0, key.size());
         uint32 header;
-        if (!BufferHelper::ReadFixUInt32(buf, header))
+        if (!BufferHelper::ReadFixUInt32(buf, header, g_key_format != ARDB_KEY_FORMAT_LEGACY))
         {
             return false;
         }
@@ -614,7 +1052,7 @@ namespace ardb
         return true;
     }
 
-    KeyObject* decode_key(const Slice& key, KeyObject* expected)
+    static KeyObject* decode_legacy_key(const Slice& key, KeyObject* expected)
     {
         Buffer buf(const_cast<char*>(key.data()), 0, key.size());
         uint32 header;
@@ -656,8 +1094,11 @@ namespace ardb
                 return hk;
             }
             case LIST_ELEMENT:
+            case LIST_SEGMENT:
+            case LIST_SEGMENT_INDEX:
             {
                 ListKeyObject* hk = new ListKeyObject(keystr, ValueData((int64) 0), db);
+                hk->type = (KeyType) type;
                 if (!decode_value(buf, hk->score))
                 {
                     DELETE(hk);
@@ -727,51 +1168,324 @@ namespace ardb
         }
     }
 
-    void encode_meta(Buffer& buf, CommonMetaValue& meta)
+    static void encode_memcmp_key(Buffer& buf, const KeyObject& key)
     {
-        BufferHelper::WriteFixUInt8(buf, meta.header.version);
-        BufferHelper::WriteFixUInt8(buf, meta.header.type);
-        BufferHelper::WriteVarUInt64(buf, meta.header.expireat);
-        switch (meta.header.type)
+        uint32 header = (uint32) (key.db << 8) + key.type;
+        BufferHelper::WriteFixUInt32(buf, header, true);
+        if (key.type == KEY_EXPIRATION_ELEMENT)
+        {
+            /*
+             * expiration index is ordered by expire time first
+             */
+            const ExpireKeyObject& ek = (const ExpireKeyObject&) key;
+            BufferHelper::WriteFixUInt64(buf, ek.expireat, true);
+            encode_ordered_bytes(buf, key.key.data(), key.key.size());
+            return;
+        }
+        encode_ordered_bytes(buf, key.key.data(), key.key.size());
+        switch (key.type)
         {
-            case STRING_META:
+            case HASH_FIELD:
             {
-                StringMetaValue& bmeta = (StringMetaValue&) meta;
-                bmeta.Encode(buf);
+                const HashKeyObject& hk = (const HashKeyObject&) key;
+                encode_ordered_value(buf, hk.field);
                 break;
             }
-            case BITSET_META:
+            case LIST_ELEMENT:
+            case LIST_SEGMENT:
+            case LIST_SEGMENT_INDEX:
             {
-                BitSetMetaValue& bmeta = (BitSetMetaValue&) meta;
-                bmeta.Encode(buf);
+                const ListKeyObject& lk = (const ListKeyObject&) key;
+                encode_ordered_score(buf, lk.score);
+                encode_score_suffix(buf, lk.score);
                 break;
             }
-            case HASH_META:
+            case SET_ELEMENT:
             {
-                HashMetaValue & bmeta = (HashMetaValue&) meta;
-                bmeta.Encode(buf);
+                const SetKeyObject& sk = (const SetKeyObject&) key;
+                encode_ordered_value(buf, sk.value);
                 break;
             }
-            case LIST_META:
+            case ZSET_ELEMENT:
             {
-                ListMetaValue & bmeta = (ListMetaValue&) meta;
-                bmeta.Encode(buf);
+                const ZSetKeyObject& sk = (const ZSetKeyObject&) key;
+                encode_ordered_score(buf, sk.score);
+                encode_ordered_value(buf, sk.value);
+                encode_score_suffix(buf, sk.score);
                 break;
             }
-            case ZSET_META:
+            case ZSET_ELEMENT_NODE:
             {
-                ZSetMetaValue & bmeta = (ZSetMetaValue&) meta;
-                bmeta.Encode(buf);
+                const ZSetNodeKeyObject& zk = (const ZSetNodeKeyObject&) key;
+                encode_ordered_value(buf, zk.value);
                 break;
             }
-            case SET_META:
+            case BITSET_ELEMENT:
             {
-                SetMetaValue & bmeta = (SetMetaValue&) meta;
-                if (bmeta.ziped || bmeta.dirty)
+                const BitSetKeyObject& bk = (const BitSetKeyObject&) key;
+                BufferHelper::WriteFixUInt64(buf, bk.index, true);
+                break;
+            }
+            default:
+            {
+                break;
+            }
+        }
+    }
+
+    static KeyObject* attach_key_storage(KeyObject* key, std::string& storage)
+    {
+        if (!storage.empty())
+        {
+            key->key_buf.swap(storage);
+            key->key = Slice(key->key_buf.data(), key->key_buf.size());
+        }
+        return key;
+    }
+
+    static KeyObject* decode_memcmp_key(const Slice& key, KeyObject* expected)
+    {
+        Buffer buf(const_cast<char*>(key.data()), 0, key.size());
+        uint32 header;
+        if (!BufferHelper::ReadFixUInt32(buf, header, true))
+        {
+            return NULL;
+        }
+        uint8 type = header & 0xFF;
+        uint32 db = header >> 8;
+        if (NULL != expected)
+        {
+            if (type != expected->type || db != expected->db)
+            {
+                return NULL;
+            }
+        }
+        uint64 expireat = 0;
+        if (type == KEY_EXPIRATION_ELEMENT && !BufferHelper::ReadFixUInt64(buf, expireat, true))
+        {
+            return NULL;
+        }
+        Slice keystr;
+        std::string storage;
+        if (!decode_ordered_bytes(buf, keystr, storage))
+        {
+            return NULL;
+        }
+        if (NULL != expected)
+        {
+            if (keystr != expected->key)
+            {
+                return NULL;
+            }
+        }
+        switch (type)
+        {
+            case HASH_FIELD:
+            {
+                HashKeyObject* hk = new HashKeyObject(keystr, Slice(), db);
+                if (!decode_ordered_value(buf, hk->field))
+                {
+                    DELETE(hk);
+                    return NULL;
+                }
+                return attach_key_storage(hk, storage);
+            }
+            case LIST_ELEMENT:
+            case LIST_SEGMENT:
+            case LIST_SEGMENT_INDEX:
+            {
+                ListKeyObject* lk = new ListKeyObject(keystr, ValueData((int64) 0), db);
+                lk->type = (KeyType) type;
+                double score;
+                if (!decode_ordered_double(buf, score) || !decode_score_suffix(buf, score, lk->score))
+                {
+                    DELETE(lk);
+                    return NULL;
+                }
+                return attach_key_storage(lk, storage);
+            }
+            case SET_ELEMENT:
+            {
+                SetKeyObject* sk = new SetKeyObject(keystr, Slice(), db);
+                if (!decode_ordered_value(buf, sk->value))
+                {
+                    DELETE(sk);
+                    return NULL;
+                }
+                return attach_key_storage(sk, storage);
+            }
+            case ZSET_ELEMENT:
+            {
+                ZSetKeyObject* zsk = new ZSetKeyObject(keystr, Slice(), ValueData((int64) 0), db);
+                double score;
+                if (!decode_ordered_double(buf, score) || !decode_ordered_value(buf, zsk->value)
+                        || !decode_score_suffix(buf, score, zsk->score))
+                {
+                    DELETE(zsk);
+                    return NULL;
+                }
+                return attach_key_storage(zsk, storage);
+            }
+            case ZSET_ELEMENT_NODE:
+            {
+                ZSetNodeKeyObject* zsk = new ZSetNodeKeyObject(keystr, Slice(), db);
+                if (!decode_ordered_value(buf, zsk->value))
+                {
+                    DELETE(zsk);
+                    return NULL;
+                }
+                return attach_key_storage(zsk, storage);
+            }
+            case BITSET_ELEMENT:
+            {
+                uint64 index;
+                if (!BufferHelper::ReadFixUInt64(buf, index, true))
+                {
+                    return NULL;
+                }
+                return attach_key_storage(new BitSetKeyObject(keystr, index, db), storage);
+            }
+            case KEY_EXPIRATION_ELEMENT:
+            {
+                return attach_key_storage(new ExpireKeyObject(keystr, expireat, db), storage);
+            }
+            default:
+            {
+                return attach_key_storage(new KeyObject(keystr, (KeyType) type, db), storage);
+            }
+        }
+    }
+
+    void encode_key(Buffer& buf, const KeyObject& key, uint8 format)
+    {
+        if (format == ARDB_KEY_FORMAT_LEGACY)
+        {
+            encode_legacy_key(buf, key);
+        }
+        else
+        {
+            encode_memcmp_key(buf, key);
+        }
+    }
+
+    void encode_key(Buffer& buf, const KeyObject& key)
+    {
+        encode_key(buf, key, g_key_format);
+    }
+
+    KeyObject* decode_key(const Slice& key, KeyObject* expected, uint8 format)
+    {
+        if (format == ARDB_KEY_FORMAT_LEGACY)
+        {
+            return decode_legacy_key(key, expected);
+        }
+        return decode_memcmp_key(key, expected);
+    }
+
+    KeyObject* decode_key(const Slice& key, KeyObject* expected)
+    {
+        return decode_key(key, expected, g_key_format);
+    }
+
+    /*
+     * Zipped entries are written by hand instead of the codec macros to record the offset of every entry,
+     * the offsets are appended after the entries as fixed size integers, decoders unaware of the index
+     * just stop reading before it.
+     */
+    static void encode_zip_entry(Buffer& buf, const ValueData& member)
+    {
+        member.Encode(buf);
+    }
+
+    static void encode_zip_entry(Buffer& buf, const std::pair<const ValueData, ValueData>& field)
+    {
+        field.first.Encode(buf);
+        field.second.Encode(buf);
+    }
+
+    template<typename Iter>
+    static void encode_zip_entries(Buffer& buf, size_t base, uint32 count, Iter begin, Iter end)
+    {
+        std::vector<uint32> offsets;
+        offsets.reserve(count);
+        BufferHelper::WriteVarUInt32(buf, count);
+        for (Iter it = begin; it != end; it++)
+        {
+            offsets.push_back(buf.ReadableBytes() - base);
+            encode_zip_entry(buf, *it);
+        }
+        for (uint32 i = 0; i < offsets.size(); i++)
+        {
+            BufferHelper::WriteFixUInt32(buf, offsets[i]);
+        }
+    }
+
+    void encode_meta(Buffer& buf, CommonMetaValue& meta)
+    {
+        size_t base = buf.ReadableBytes();
+        bool zip_index = (meta.header.type == HASH_META && ((HashMetaValue&) meta).ziped)
+                || (meta.header.type == SET_META && ((SetMetaValue&) meta).ziped);
+        BufferHelper::WriteFixUInt8(buf, zip_index ? ARDB_META_VERSION_ZIP_INDEX : ARDB_META_VERSION);
+        BufferHelper::WriteFixUInt8(buf, meta.header.type);
+        BufferHelper::WriteVarUInt64(buf, meta.header.expireat);
+        switch (meta.header.type)
+        {
+            case STRING_META:
+            {
+                StringMetaValue& bmeta = (StringMetaValue&) meta;
+                bmeta.Encode(buf);
+                break;
+            }
+            case BITSET_META:
+            {
+                BitSetMetaValue& bmeta = (BitSetMetaValue&) meta;
+                bmeta.Encode(buf);
+                break;
+            }
+            case HASH_META:
+            {
+                HashMetaValue & bmeta = (HashMetaValue&) meta;
+                if (zip_index)
+                {
+                    BufferHelper::WriteBool(buf, bmeta.ziped);
+                    BufferHelper::WriteBool(buf, bmeta.dirty);
+                    BufferHelper::WriteVarUInt32(buf, bmeta.size);
+                    encode_zip_entries(buf, base, bmeta.values.size(), bmeta.values.begin(), bmeta.values.end());
+                    break;
+                }
+                bmeta.Encode(buf);
+                break;
+            }
+            case LIST_META:
+            {
+                ListMetaValue & bmeta = (ListMetaValue&) meta;
+                bmeta.Encode(buf);
+                break;
+            }
+            case ZSET_META:
+            {
+                ZSetMetaValue & bmeta = (ZSetMetaValue&) meta;
+                bmeta.Encode(buf);
+                break;
+            }
+            case SET_META:
+            {
+                SetMetaValue & bmeta = (SetMetaValue&) meta;
+                if (bmeta.ziped || bmeta.dirty)
                 {
                     bmeta.max.Clear();
                     bmeta.min.Clear();
                 }
+                if (zip_index)
+                {
+                    BufferHelper::WriteVarUInt32(buf, bmeta.size);
+                    BufferHelper::WriteBool(buf, bmeta.ziped);
+                    BufferHelper::WriteBool(buf, bmeta.dirty);
+                    bmeta.min.Encode(buf);
+                    bmeta.max.Encode(buf);
+                    encode_zip_entries(buf, base, bmeta.zipvs.size(), bmeta.zipvs.begin(), bmeta.zipvs.end());
+                    break;
+                }
                 bmeta.Encode(buf);
                 break;
             }
@@ -783,15 +1497,24 @@ namespace ardb
         }
     }
 
+    bool decode_meta_header(Buffer& buf, MetaValueHeader& header)
+    {
+        uint8 type;
+        if (BufferHelper::ReadFixUInt8(buf, header.version) && BufferHelper::ReadFixUInt8(buf, type)
+                && BufferHelper::ReadVarUInt64(buf, header.expireat))
+        {
+            header.type = (KeyType) type;
+            return true;
+        }
+        return false;
+    }
+
     CommonMetaValue* decode_meta(const char* data, size_t size, bool only_head)
     {
         MetaValueHeader header;
         Buffer msgbuf(const_cast<char*>(data), 0, size);
-        uint8 type;
-        if (BufferHelper::ReadFixUInt8(msgbuf, header.version) && BufferHelper::ReadFixUInt8(msgbuf, type)
-                && BufferHelper::ReadVarUInt64(msgbuf, header.expireat))
+        if (decode_meta_header(msgbuf, header))
         {
-            header.type = (KeyType) type;
             if (only_head)
             {
                 CommonMetaValue* meta = NULL;
@@ -887,87 +1610,796 @@ namespace ardb
         return meta;
     }
 
-    ValueObject* decode_value_obj(KeyType type, const char* data, size_t size)
+    /*
+     * Same order as ValueData::Compare, the entry is decoded as slice.
+     */
+    static int compare_zip_entry(const ValueData& entry, const ValueData& key)
     {
-        Buffer buffer(const_cast<char*>(data), 0, size);
-        switch (type)
+        if (entry.type != key.type)
         {
-            case KEY_META:
-            {
-                return decode_meta(data, size, false);
-            }
-            case ZSET_ELEMENT_NODE:
+            return COMPARE_NUMBER(entry.type, key.type);
+        }
+        switch (entry.type)
+        {
+            case EMPTY_VALUE:
             {
-                ZSetNodeValueObject* obj = new ZSetNodeValueObject;
-                obj->Decode(buffer);
-                return obj;
-                break;
+                return 0;
             }
-            case HASH_FIELD:
-            case LIST_ELEMENT:
-            case ZSET_ELEMENT:
-            case SCRIPT:
+            case INTEGER_VALUE:
             {
-                CommonValueObject* obj = new CommonValueObject;
-                obj->Decode(buffer);
-                return obj;
+                return COMPARE_NUMBER(entry.integer_value, key.integer_value);
             }
-            case BITSET_ELEMENT:
+            case DOUBLE_VALUE:
             {
-                BitSetElementValue* obj = new BitSetElementValue;
-                obj->Decode(buffer);
-                return obj;
+                return COMPARE_NUMBER(entry.double_value, key.double_value);
             }
-            case KEY_EXPIRATION_ELEMENT:
-            case SET_ELEMENT:
             default:
             {
-                return new EmptyValueObject;
+                if (key.bytes_value.empty())
+                {
+                    return entry.slice_value.compare(key.slice_value);
+                }
+                return entry.slice_value.compare(Slice(key.bytes_value));
             }
         }
     }
 
-    void encode_value(Buffer& buf, const ValueData& value)
-    {
-        value.Encode(buf);
-    }
-
-    bool decode_value(Buffer& buf, ValueData& value, bool to_slice)
-    {
-        return value.Decode(buf, to_slice);
-    }
-
-    bool decode_value_by_string(const std::string& str, ValueData& value)
+    ZipMetaView::ZipMetaView() :
+            m_data(NULL), m_size(0), m_ziped(false), m_count(0), m_size_offset(0), m_size_end(0), m_count_offset(
+                    0), m_entries_begin(0), m_entries_end(0), m_indexed(false)
     {
-        Buffer buf(const_cast<char*>(str.data()), 0, str.size());
-        return decode_value(buf, value);
     }
 
-    void next_key(const Slice& key, std::string& next)
+    bool ZipMetaView::Parse(const Slice& raw)
     {
-        next.assign(key.data(), key.size());
-        for (uint32 i = next.size(); i > 0; i--)
+        m_data = raw.data();
+        m_size = raw.size();
+        m_ziped = false;
+        m_indexed = false;
+        m_count = 0;
+        Buffer buf(const_cast<char*>(m_data), 0, m_size);
+        if (!decode_meta_header(buf, m_header))
         {
-            if (next[i - 1] < 0x7F)
+            return false;
+        }
+        bool dirty;
+        uint32 size;
+        if (m_header.type == HASH_META)
+        {
+            if (!BufferHelper::ReadBool(buf, m_ziped) || !BufferHelper::ReadBool(buf, dirty)
+                    || !BufferHelper::ReadVarUInt32(buf, size))
             {
-                next[i - 1] = next[i - 1] + 1;
-                return;
+                return false;
             }
         }
-        next.append("\0", 1);
-    }
-
-    SetKeyObject::SetKeyObject(const Slice& k, const ValueData& v, DBID id) :
-            KeyObject(k, SET_ELEMENT, id), value(v)
-    {
-
-    }
-    SetKeyObject::SetKeyObject(const Slice& k, const Slice& v, DBID id) :
-            KeyObject(k, SET_ELEMENT, id)
-    {
+        else if (m_header.type == SET_META)
+        {
+            ValueData min, max;
+            m_size_offset = buf.GetReadIndex();
+            if (!BufferHelper::ReadVarUInt32(buf, size))
+            {
+                return false;
+            }
+            m_size_end = buf.GetReadIndex();
+            if (!BufferHelper::ReadBool(buf, m_ziped) || !BufferHelper::ReadBool(buf, dirty) || !min.Decode(buf, true)
+                    || !max.Decode(buf, true))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            return true;
+        }
+        if (!m_ziped)
+        {
+            return true;
+        }
+        m_count_offset = buf.GetReadIndex();
+        if (!BufferHelper::ReadVarUInt32(buf, m_count))
+        {
+            return false;
+        }
+        m_entries_begin = buf.GetReadIndex();
+        m_entries_end = m_size;
+        if (m_header.version == ARDB_META_VERSION_ZIP_INDEX)
+        {
+            if ((uint64) m_count * sizeof(uint32) > m_size - m_entries_begin)
+            {
+                return false;
+            }
+            m_entries_end = m_size - m_count * sizeof(uint32);
+            m_indexed = true;
+        }
+        return true;
+    }
+
+    size_t ZipMetaView::EntryOffset(uint32 idx) const
+    {
+        uint32 offset = 0;
+        Buffer buf(const_cast<char*>(m_data), m_entries_end + idx * sizeof(uint32), m_size);
+        BufferHelper::ReadFixUInt32(buf, offset);
+        return offset;
+    }
+
+    size_t ZipMetaView::EntryEnd(uint32 idx) const
+    {
+        return idx + 1 < m_count ? EntryOffset(idx + 1) : m_entries_end;
+    }
+
+    /*
+     * Binary search the first entry not less than the key, 'value_offset' is the position right after
+     * the key of that entry.
+     */
+    bool ZipMetaView::LowerBound(const ValueData& key, uint32& idx, size_t& value_offset) const
+    {
+        uint32 low = 0;
+        uint32 high = m_count;
+        bool found = false;
+        while (low < high)
+        {
+            uint32 mid = low + (high - low) / 2;
+            Buffer buf(const_cast<char*>(m_data), EntryOffset(mid), m_entries_end);
+            ValueData entry;
+            if (!entry.Decode(buf, true))
+            {
+                ERROR_LOG("Invalid zipped entry at %u", mid);
+                break;
+            }
+            int cmp = compare_zip_entry(entry, key);
+            if (cmp < 0)
+            {
+                low = mid + 1;
+            }
+            else
+            {
+                if (0 == cmp)
+                {
+                    found = true;
+                    value_offset = buf.GetReadIndex();
+                }
+                high = mid;
+            }
+        }
+        idx = low;
+        return found;
+    }
+
+    bool ZipMetaView::Find(const ValueData& key, ValueData* value) const
+    {
+        if (!m_ziped)
+        {
+            return false;
+        }
+        size_t value_offset = 0;
+        if (m_indexed)
+        {
+            uint32 idx;
+            if (!LowerBound(key, idx, value_offset))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            /*
+             * metas written before the index, the entries are still sorted, scan them without copying
+             */
+            Buffer buf(const_cast<char*>(m_data), m_entries_begin, m_entries_end);
+            bool found = false;
+            for (uint32 i = 0; i < m_count && !found; i++)
+            {
+                ValueData entry, entry_value;
+                if (!entry.Decode(buf, true))
+                {
+                    return false;
+                }
+                int cmp = compare_zip_entry(entry, key);
+                if (cmp > 0)
+                {
+                    return false;
+                }
+                found = (0 == cmp);
+                value_offset = buf.GetReadIndex();
+                if (m_header.type == HASH_META && !entry_value.Decode(buf, true))
+                {
+                    return false;
+                }
+            }
+            if (!found)
+            {
+                return false;
+            }
+        }
+        if (NULL != value && m_header.type == HASH_META)
+        {
+            Buffer buf(const_cast<char*>(m_data), value_offset, m_entries_end);
+            if (!value->Decode(buf))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+     * Splice a hash field(value not NULL) or a set member into an indexed zipped meta, the entries around
+     * it are copied as raw bytes and only the offsets after the splice point are shifted.
+     * 'result' is left empty if nothing changed.
+     */
+    bool ZipMetaView::Upsert(const ValueData& key, const ValueData* value, std::string& result, bool& inserted) const
+    {
+        result.clear();
+        inserted = false;
+        if (!m_indexed || (m_header.type == HASH_META) != (NULL != value))
+        {
+            return false;
+        }
+        uint32 idx = 0;
+        size_t value_offset = 0;
+        bool found = LowerBound(key, idx, value_offset);
+        if (found && NULL == value)
+        {
+            return true;
+        }
+        Buffer entry;
+        if (!found)
+        {
+            key.Encode(entry);
+        }
+        if (NULL != value)
+        {
+            value->Encode(entry);
+        }
+        size_t splice_begin, splice_end;
+        if (found)
+        {
+            splice_begin = value_offset;
+            splice_end = EntryEnd(idx);
+        }
+        else
+        {
+            splice_begin = idx < m_count ? EntryOffset(idx) : m_entries_end;
+            splice_end = splice_begin;
+        }
+        uint32 count = found ? m_count : m_count + 1;
+        Buffer out(m_size + entry.ReadableBytes() + 16);
+        if (m_header.type == SET_META)
+        {
+            out.Write(m_data, m_size_offset);
+            BufferHelper::WriteVarUInt32(out, count);
+            out.Write(m_data + m_size_end, m_count_offset - m_size_end);
+        }
+        else
+        {
+            out.Write(m_data, m_count_offset);
+        }
+        BufferHelper::WriteVarUInt32(out, count);
+        int64 shift = (int64) out.ReadableBytes() - (int64) m_entries_begin;
+        int64 delta = (int64) entry.ReadableBytes() - (int64) (splice_end - splice_begin);
+        out.Write(m_data + m_entries_begin, splice_begin - m_entries_begin);
+        out.Write(entry.GetRawReadBuffer(), entry.ReadableBytes());
+        out.Write(m_data + splice_end, m_entries_end - splice_end);
+        for (uint32 i = 0; i <= m_count; i++)
+        {
+            if (!found && i == idx)
+            {
+                BufferHelper::WriteFixUInt32(out, splice_begin + shift);
+            }
+            if (i == m_count)
+            {
+                break;
+            }
+            size_t offset = EntryOffset(i);
+            BufferHelper::WriteFixUInt32(out, offset + shift + (offset >= splice_end ? delta : 0));
+        }
+        result.assign(out.GetRawReadBuffer(), out.ReadableBytes());
+        inserted = !found;
+        return true;
+    }
+
+    ValueObject* decode_value_obj(KeyType type, const char* data, size_t size)
+    {
+        Buffer buffer(const_cast<char*>(data), 0, size);
+        switch (type)
+        {
+            case KEY_META:
+            {
+                return decode_meta(data, size, false);
+            }
+            case ZSET_ELEMENT_NODE:
+            {
+                ZSetNodeValueObject* obj = new ZSetNodeValueObject;
+                obj->Decode(buffer);
+                return obj;
+                break;
+            }
+            case HASH_FIELD:
+            case LIST_ELEMENT:
+            case ZSET_ELEMENT:
+            case SCRIPT:
+            case KEY_TOMBSTONE:
+            {
+                CommonValueObject* obj = new CommonValueObject;
+                obj->Decode(buffer);
+                return obj;
+            }
+            case LIST_SEGMENT:
+            {
+                ListSegmentValue* obj = new ListSegmentValue;
+                obj->Decode(buffer);
+                return obj;
+            }
+            case LIST_SEGMENT_INDEX:
+            {
+                ListIndexChunkValue* obj = new ListIndexChunkValue;
+                obj->Decode(buffer);
+                return obj;
+            }
+            case BITSET_ELEMENT:
+            {
+                BitSetElementValue* obj = new BitSetElementValue;
+                obj->Decode(buffer);
+                return obj;
+            }
+            case KEY_EXPIRATION_ELEMENT:
+            case SET_ELEMENT:
+            default:
+            {
+                return new EmptyValueObject;
+            }
+        }
+    }
+
+    void encode_value(Buffer& buf, const ValueData& value)
+    {
+        value.Encode(buf);
+    }
+
+    bool decode_value(Buffer& buf, ValueData& value, bool to_slice)
+    {
+        return value.Decode(buf, to_slice);
+    }
+
+    bool decode_value_by_string(const std::string& str, ValueData& value)
+    {
+        Buffer buf(const_cast<char*>(str.data()), 0, str.size());
+        return decode_value(buf, value);
+    }
+
+    void encode_merge_operand(Buffer& buf, uint8 op, const ValueData& arg)
+    {
+        BufferHelper::WriteFixUInt8(buf, op);
+        arg.Encode(buf);
+    }
+
+    static bool decode_merge_operand(const Slice& operand, uint8& op, ValueData& arg)
+    {
+        Buffer buf(const_cast<char*>(operand.data()), 0, operand.size());
+        return BufferHelper::ReadFixUInt8(buf, op) && arg.Decode(buf);
+    }
+
+    /*
+     * Apply merge operands in order to the existing value (NULL if none). An operand which does not
+     * apply to the value (another key type, non numeric value) leaves it unchanged, the same result the
+     * failed command would have. Returns false only for undecodable input.
+     */
+    bool ardb_merge_value(const Slice* existing, const std::vector<Slice>& operands, std::string& result)
+    {
+        uint8 op = 0;
+        ValueData arg;
+        if (operands.empty() || !decode_merge_operand(operands[0], op, arg))
+        {
+            return false;
+        }
+        Buffer buf;
+        if (op == ARDB_MERGE_VALUE_INCRBY)
+        {
+            CommonValueObject v;
+            bool exist = false;
+            if (NULL != existing)
+            {
+                Buffer valuebuf(const_cast<char*>(existing->data()), 0, existing->size());
+                if (!v.Decode(valuebuf))
+                {
+                    return false;
+                }
+                exist = true;
+            }
+            for (uint32 i = 0; i < operands.size(); i++)
+            {
+                if ((i > 0 && !decode_merge_operand(operands[i], op, arg)) || op != ARDB_MERGE_VALUE_INCRBY)
+                {
+                    return false;
+                }
+                if (!exist)
+                {
+                    v.data.SetIntValue(arg.integer_value);
+                    exist = true;
+                }
+                else if (v.data.type == INTEGER_VALUE)
+                {
+                    v.data.Incrby(arg.integer_value);
+                }
+            }
+            v.Encode(buf);
+        }
+        else
+        {
+            StringMetaValue* smeta = NULL;
+            if (NULL != existing)
+            {
+                CommonMetaValue* meta = decode_meta(existing->data(), existing->size(), false);
+                if (NULL == meta)
+                {
+                    return false;
+                }
+                if (meta->header.type != STRING_META)
+                {
+                    DELETE(meta);
+                    result.assign(existing->data(), existing->size());
+                    return true;
+                }
+                smeta = (StringMetaValue*) meta;
+            }
+            else
+            {
+                NEW(smeta, StringMetaValue);
+            }
+            for (uint32 i = 0; i < operands.size(); i++)
+            {
+                if (i > 0 && !decode_merge_operand(operands[i], op, arg))
+                {
+                    DELETE(smeta);
+                    return false;
+                }
+                if (op == ARDB_MERGE_STRING_INCRBY)
+                {
+                    smeta->value.ToNumber();
+                    if (smeta->value.type != BYTES_VALUE)
+                    {
+                        smeta->value.Incrby(arg.integer_value);
+                    }
+                }
+                else if (op == ARDB_MERGE_STRING_APPEND)
+                {
+                    /*
+                     * same as Append, which rewrites the key by Set without expire time
+                     */
+                    std::string str, tail;
+                    smeta->value.ToString(str);
+                    str.append(arg.ToString(tail));
+                    smeta->value.SetValue(str, false);
+                    smeta->header.expireat = 0;
+                }
+                else
+                {
+                    DELETE(smeta);
+                    return false;
+                }
+            }
+            encode_meta(buf, *smeta);
+            DELETE(smeta);
+        }
+        result.assign(buf.GetRawReadBuffer(), buf.ReadableBytes());
+        return true;
+    }
+
+    /*
+     * Combine two adjacent operands of the same operation into one, false if they can not be combined.
+     */
+    bool ardb_merge_operands(const Slice& left, const Slice& right, std::string& result)
+    {
+        uint8 lop = 0, rop = 0;
+        ValueData larg, rarg;
+        if (!decode_merge_operand(left, lop, larg) || !decode_merge_operand(right, rop, rarg) || lop != rop)
+        {
+            return false;
+        }
+        switch (lop)
+        {
+            case ARDB_MERGE_STRING_INCRBY:
+            case ARDB_MERGE_VALUE_INCRBY:
+            {
+                larg.SetIntValue(larg.integer_value + rarg.integer_value);
+                break;
+            }
+            case ARDB_MERGE_STRING_APPEND:
+            {
+                std::string str, tail;
+                larg.ToString(str);
+                str.append(rarg.ToString(tail));
+                larg.SetValue(str, false);
+                break;
+            }
+            default:
+            {
+                return false;
+            }
+        }
+        Buffer buf;
+        encode_merge_operand(buf, lop, larg);
+        result.assign(buf.GetRawReadBuffer(), buf.ReadableBytes());
+        return true;
+    }
+
+    int compare_encoded_keys(const Slice& a, const Slice& b)
+    {
+        if (g_key_format == ARDB_KEY_FORMAT_LEGACY)
+        {
+            return ardb_compare_keys(a.data(), a.size(), b.data(), b.size());
+        }
+        return a.compare(b);
+    }
+
+    void encode_key_boundary(Buffer& buf, const DBID& db, uint8 type, const Slice& prefix)
+    {
+        uint32 header = (uint32) (db << 8) + type;
+        if (g_key_format == ARDB_KEY_FORMAT_LEGACY)
+        {
+            BufferHelper::WriteFixUInt32(buf, header);
+            if (!prefix.empty())
+            {
+                BufferHelper::WriteVarSlice(buf, prefix);
+            }
+            return;
+        }
+        /*
+         * The unterminated prefix sorts before every escaped key starting with it
+         */
+        BufferHelper::WriteFixUInt32(buf, header, true);
+        buf.Write(prefix.data(), prefix.size());
+    }
+
+    void next_key(const Slice& key, std::string& next)
+    {
+        next.assign(key.data(), key.size());
+        for (uint32 i = next.size(); i > 0; i--)
+        {
+            if (next[i - 1] < 0x7F)
+            {
+                next[i - 1] = next[i - 1] + 1;
+                return;
+            }
+        }
+        next.append("\0", 1);
+    }
+
+    SetKeyObject::SetKeyObject(const Slice& k, const ValueData& v, DBID id) :
+            KeyObject(k, SET_ELEMENT, id), value(v)
+    {
+
+    }
+    SetKeyObject::SetKeyObject(const Slice& k, const Slice& v, DBID id) :
+            KeyObject(k, SET_ELEMENT, id)
+    {
         value.SetValue(v, true);
     }
 
+    void ListSegmentRefs::Reindex()
+    {
+        prefix.resize(refs.size() + 1);
+        prefix[0] = 0;
+        for (size_t i = 0; i < refs.size(); i++)
+        {
+            prefix[i + 1] = prefix[i] + refs[i].count;
+        }
+    }
+
+    bool ListSegmentRefs::Locate(uint32 index, size_t& pos, uint32& offset) const
+    {
+        if (index >= Count())
+        {
+            return false;
+        }
+        pos = std::upper_bound(prefix.begin(), prefix.end(), index) - prefix.begin() - 1;
+        offset = index - prefix[pos];
+        return true;
+    }
+
+    void ListSegmentRefs::Encode(Buffer& buf) const
+    {
+        BufferHelper::WriteVarUInt32(buf, refs.size());
+        for (size_t i = 0; i < refs.size(); i++)
+        {
+            BufferHelper::WriteVarUInt64(buf, refs[i].id);
+            BufferHelper::WriteVarUInt32(buf, refs[i].count);
+        }
+    }
+
+    bool ListSegmentRefs::Decode(Buffer& buf)
+    {
+        uint32 count;
+        if (!BufferHelper::ReadVarUInt32(buf, count))
+        {
+            return false;
+        }
+        refs.resize(count);
+        for (uint32 i = 0; i < count; i++)
+        {
+            if (!BufferHelper::ReadVarUInt64(buf, refs[i].id) || !BufferHelper::ReadVarUInt32(buf, refs[i].count))
+            {
+                return false;
+            }
+        }
+        Reindex();
+        return true;
+    }
+
+    /*
+     * The index chunks are appended after the fields of the score layout, metas written before
+     * segments simply end there.
+     */
+    bool ListMetaValue::Encode(Buffer& buf)
+    {
+        encode_arg(buf, size, ziped, min_score, max_score, zipvs);
+        if (next_segment_id > 0)
+        {
+            BufferHelper::WriteVarUInt64(buf, next_segment_id);
+            chunks.Encode(buf);
+        }
+        return true;
+    }
+
+    bool ListMetaValue::Decode(Buffer& buf)
+    {
+        if (!decode_arg(buf, size, ziped, min_score, max_score, zipvs))
+        {
+            return false;
+        }
+        chunks.refs.clear();
+        chunks.Reindex();
+        next_segment_id = 0;
+        if (buf.ReadableBytes() == 0)
+        {
+            return true;
+        }
+        return BufferHelper::ReadVarUInt64(buf, next_segment_id) && chunks.Decode(buf);
+    }
+
+    static void append_uint16(std::string& str, uint32 v)
+    {
+        str.push_back((char) (v >> 8));
+        str.push_back((char) (v & 0xFF));
+    }
+
+    static uint32 read_uint16(const std::string& str, size_t pos)
+    {
+        return ((uint32) (uint8) str[pos] << 8) | (uint8) str[pos + 1];
+    }
+
+    /*
+     * Pack the raw bitmap into the smaller of the array and runs encodings, returns the encoding or
+     * ARDB_BITSET_CHUNK_RAW if neither is smaller than the bitmap itself.
+     */
+    static uint8 pack_bitset_chunk(const std::string& bitmap, std::string& packed)
+    {
+        const uint8* p = (const uint8*) bitmap.data();
+        uint32 bits = bits_popcount(p, bitmap.size());
+        uint32 runs = 0;
+        bool prev = false;
+        for (uint32 i = 0; i < bitmap.size(); i++)
+        {
+            if (p[i] == 0 || p[i] == 0xFF)
+            {
+                runs += (p[i] == 0xFF && !prev) ? 1 : 0;
+                prev = p[i] == 0xFF;
+                continue;
+            }
+            for (uint32 j = 0; j < 8; j++)
+            {
+                bool bit = (p[i] & (0x80 >> j)) != 0;
+                runs += (bit && !prev) ? 1 : 0;
+                prev = bit;
+            }
+        }
+        uint32 array_size = 2 * bits;
+        uint32 runs_size = 4 * runs;
+        if (bits == 0 || (array_size >= bitmap.size() && runs_size >= bitmap.size()))
+        {
+            return ARDB_BITSET_CHUNK_RAW;
+        }
+        bool use_array = array_size <= runs_size;
+        packed.clear();
+        packed.reserve(use_array ? array_size : runs_size);
+        uint32 total = bitmap.size() << 3;
+        uint32 run_start = 0;
+        prev = false;
+        for (uint32 i = 0; i <= total; i++)
+        {
+            bool bit = i < total && (p[i >> 3] & (0x80 >> (i & 7))) != 0;
+            if (i < total && (i & 7) == 0 && (p[i >> 3] == 0 || p[i >> 3] == 0xFF) && bit == prev)
+            {
+                if (bit && use_array)
+                {
+                    for (uint32 j = 0; j < 8; j++)
+                    {
+                        append_uint16(packed, i + j);
+                    }
+                }
+                i += 7;
+                continue;
+            }
+            if (use_array)
+            {
+                if (bit)
+                {
+                    append_uint16(packed, i);
+                }
+            }
+            else if (bit && !prev)
+            {
+                run_start = i;
+            }
+            else if (!bit && prev)
+            {
+                append_uint16(packed, run_start);
+                append_uint16(packed, i - run_start - 1);
+            }
+            prev = bit;
+        }
+        return use_array ? ARDB_BITSET_CHUNK_ARRAY : ARDB_BITSET_CHUNK_RUNS;
+    }
+
+    static bool unpack_bitset_chunk(uint8 encoding, const std::string& packed, std::string& bitmap)
+    {
+        std::string raw(BitSetElementValue::kBytes, 0);
+        uint8* p = (uint8*) &raw[0];
+        uint32 step = encoding == ARDB_BITSET_CHUNK_ARRAY ? 2 : 4;
+        if ((encoding != ARDB_BITSET_CHUNK_ARRAY && encoding != ARDB_BITSET_CHUNK_RUNS)
+                || packed.size() % step != 0)
+        {
+            return false;
+        }
+        for (size_t pos = 0; pos < packed.size(); pos += step)
+        {
+            uint32 first = read_uint16(packed, pos);
+            uint32 last = step == 2 ? first : first + read_uint16(packed, pos + 2);
+            if (last >= BitSetElementValue::kBits)
+            {
+                return false;
+            }
+            for (uint32 i = first; i <= last; i++)
+            {
+                p[i >> 3] |= (0x80 >> (i & 7));
+            }
+        }
+        bitmap.swap(raw);
+        return true;
+    }
+
+    bool BitSetElementValue::Encode(Buffer& buf)
+    {
+        encode_arg(buf, bitcount, start, limit);
+        std::string packed;
+        uint8 encoding = ARDB_BITSET_CHUNK_RAW;
+        if (g_bitset_chunk_compress && vals.size() == kBytes)
+        {
+            encoding = pack_bitset_chunk(vals, packed);
+        }
+        BufferHelper::WriteVarString(buf, encoding == ARDB_BITSET_CHUNK_RAW ? vals : packed);
+        buf.WriteByte((char) encoding);
+        return true;
+    }
+
+    bool BitSetElementValue::Decode(Buffer& buf)
+    {
+        if (!decode_arg(buf, bitcount, start, limit, vals))
+        {
+            return false;
+        }
+        char encoding = ARDB_BITSET_CHUNK_RAW;
+        if (buf.Readable() && !buf.ReadByte(encoding))
+        {
+            return false;
+        }
+        if (encoding != ARDB_BITSET_CHUNK_RAW)
+        {
+            return unpack_bitset_chunk((uint8) encoding, vals, vals);
+        }
+        return true;
+    }
+
     int GeoAddOptions::Parse(const StringArray& args, std::string& err, uint32 off)
     {
         if (!strcasecmp(args[off].c_str(), "wgs84"))
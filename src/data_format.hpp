@@ -49,9 +49,47 @@
 #include "util/helpers.hpp"
 
 #define ARDB_META_VERSION 0
+/*
+ * Zipped hash/set metas of this version are followed by a fixed size offset index of their sorted entries.
+ */
+#define ARDB_META_VERSION_ZIP_INDEX 1
+
+/*
+ * On-disk key layout versions:
+ * 0: varint length prefixed key & ValueData, only ardb_compare_keys could order these keys.
+ * 1: memcomparable layout, keys are ordered by the engine's builtin bytewise comparator.
+ */
+#define ARDB_KEY_FORMAT_LEGACY 0
+#define ARDB_KEY_FORMAT_MEMCMP 1
+#define ARDB_KEY_FORMAT_LATEST ARDB_KEY_FORMAT_MEMCMP
+#define ARDB_KEY_FORMAT_FILE "KEY_FORMAT"
+
+/*
+ * Operations of merge operands written to engines supporting merge, an operand is the operation
+ * byte followed by the encoded ValueData argument.
+ * STRING ops apply to a string meta value, VALUE ops to a CommonValueObject (hash field).
+ */
+#define ARDB_MERGE_STRING_INCRBY 1
+#define ARDB_MERGE_STRING_APPEND 2
+#define ARDB_MERGE_VALUE_INCRBY 3
+
+/*
+ * Encodings of a bitset element, tagged by a byte after the chunk. The compact ones are written in place
+ * of the raw bitmap when smaller, elements written without the tag are raw.
+ * ARRAY: big endian uint16 positions of the set bits.
+ * RUNS: big endian uint16 pairs of run start and run length minus one.
+ */
+#define ARDB_BITSET_CHUNK_RAW 0
+#define ARDB_BITSET_CHUNK_ARRAY 1
+#define ARDB_BITSET_CHUNK_RUNS 2
 
 #define ARDB_GLOBAL_DB 0xFFFFFF
 
+/*
+ * Max segments in one index chunk of a list
+ */
+#define LIST_INDEX_CHUNK_SEGMENTS 128
+
 #define COMPARE_NUMBER(a, b)  (a == b?0:(a>b?1:-1))
 
 //#define COMPARE_SLICE(a, b)  (a.size() == b.size()?(a.compare(b)):(a.size()>b.size()?1:-1))
@@ -91,11 +129,15 @@ namespace ardb
 
         HASH_FIELD = 40,
 
-        LIST_ELEMENT = 50,
+        LIST_ELEMENT = 50, LIST_SEGMENT = 51, LIST_SEGMENT_INDEX = 52,
 
         BITSET_ELEMENT = 70,
 
         KEY_EXPIRATION_ELEMENT = 100, SCRIPT = 102,
+        /*
+         * Lazily deleted keys waiting for their elements to be reaped, stored in the global db.
+         */
+        KEY_TOMBSTONE = 103,
 
         KEY_END = 255, /* max value for 1byte */
     };
@@ -124,6 +166,25 @@ namespace ardb
                 }
                 return true;
             }
+            bool operator==(const DBItemKey& other) const
+            {
+                return db == other.db && key == other.key;
+            }
+    };
+
+    struct DBItemKeyHash
+    {
+            uint32 operator()(const DBItemKey& key) const
+            {
+                //FNV-1a
+                uint32 hash = 2166136261U;
+                hash = (hash ^ key.db) * 16777619U;
+                for (size_t i = 0; i < key.key.size(); i++)
+                {
+                    hash = (hash ^ (uint8) key.key[i]) * 16777619U;
+                }
+                return hash;
+            }
     };
 
     struct DBItemStackKey
@@ -153,6 +214,10 @@ namespace ardb
             DBID db;
             KeyType type;
             Slice key;
+            /*
+             * Holds the unescaped key when a memcomparable key contains '\0' bytes
+             */
+            std::string key_buf;
 
             KeyObject(const Slice& k, KeyType t, DBID id) :
                     db(id), type(t), key(k)
@@ -453,6 +518,11 @@ namespace ardb
                 header.type = ZSET_META;
             }
     };
+    /*
+     * 'size' is exact, every mutation keeps it up to date. 'dirty' is only found in sets written by older
+     * versions whose size was not maintained, they are recounted once. For non ziped sets 'min'/'max'
+     * are bounds of the members which removals do not tighten.
+     */
     struct SetMetaValue: public CommonMetaValue
     {
             bool ziped;
@@ -494,19 +564,93 @@ namespace ardb
                 header.type = BITSET_META;
             }
     };
+    struct ListSegmentRef
+    {
+            uint64 id;
+            uint32 count;
+            ListSegmentRef(uint64 i = 0, uint32 c = 0) :
+                    id(i), count(c)
+            {
+            }
+    };
+    typedef std::vector<ListSegmentRef> ListSegmentArray;
+
+    /*
+     * Ids in list order with their element counts, 'prefix[i]' is the number of elements before
+     * 'refs[i]' so the ref holding an index is found by a binary search. Reindex after changing refs.
+     */
+    struct ListSegmentRefs
+    {
+            ListSegmentArray refs;
+            std::vector<uint32> prefix;
+            void Reindex();
+            uint32 Count() const
+            {
+                return prefix.empty() ? 0 : prefix.back();
+            }
+            /*
+             * Finds the ref holding the element at 'index', 'offset' is the index within the ref
+             */
+            bool Locate(uint32 index, size_t& pos, uint32& offset) const;
+            void Encode(Buffer& buf) const;
+            bool Decode(Buffer& buf);
+    };
+
+    /*
+     * A chunk of the segment index of a list(LIST_SEGMENT_INDEX key), up to LIST_INDEX_CHUNK_SEGMENTS
+     * segments in list order with their element counts.
+     */
+    struct ListIndexChunkValue: public ValueObject
+    {
+            ListSegmentRefs segments;
+            bool Encode(Buffer& buf)
+            {
+                segments.Encode(buf);
+                return true;
+            }
+            bool Decode(Buffer& buf)
+            {
+                return segments.Decode(buf);
+            }
+    };
+
+    /*
+     * Non ziped lists store their elements in segments(LIST_SEGMENT keys) holding up to
+     * 'list-segment-max-entries' elements each. The segment ids in list order with their element
+     * counts are kept in index chunks(LIST_SEGMENT_INDEX keys), the meta only keeps the chunk ids with
+     * their element counts. A positional access binary searches the chunks in the meta, then the
+     * segments in one chunk, and reads the one segment covering the index; a push or pop rewrites one
+     * segment & one chunk besides the meta.
+     * Segments & chunks are never renumbered, a new one simply takes 'next_segment_id'.
+     * Lists written before segments keep elements keyed by a double score(LIST_ELEMENT), they are
+     * converted on first access.
+     */
     struct ListMetaValue: public CommonMetaValue
     {
             uint32_t size;
             bool ziped;
             ValueData min_score;
             ValueData max_score;
-            ValueDataDeque zipvs;CODEC_DEFINE(size,ziped,min_score,max_score,zipvs)
-            ;
+            ValueDataDeque zipvs;
+            ListSegmentRefs chunks;
+            uint64 next_segment_id;
             ListMetaValue() :
-                    size(0), ziped(false), min_score((int64) 0), max_score((int64) 0)
+                    size(0), ziped(false), min_score((int64) 0), max_score((int64) 0), next_segment_id(0)
             {
                 header.type = LIST_META;
             }
+            bool IsScoreLayout() const
+            {
+                return !ziped && size > 0 && next_segment_id == 0;
+            }
+            bool Encode(Buffer& buf);
+            bool Decode(Buffer& buf);
+    };
+
+    struct ListSegmentValue: public ValueObject
+    {
+            ValueDataDeque values;CODEC_DEFINE(values)
+            ;
     };
 
     struct SetKeyObject: public KeyObject
@@ -525,17 +669,24 @@ namespace ardb
             }
     };
 
+    /*
+     * In memory 'vals' is the raw bitmap of the element(or empty), on disk it is replaced by the array or
+     * runs encoding of the set bits when that takes fewer bytes, which is recognized by its size.
+     */
     struct BitSetElementValue: public ValueObject
     {
+            static const uint32 kBits = 4096;
+            static const uint32 kBytes = kBits >> 3;
             uint32 bitcount;
             uint32 start;
             uint32 limit;
-            std::string vals;CODEC_DEFINE(bitcount,start,limit,vals)
-            ;
+            std::string vals;
             BitSetElementValue() :
                     bitcount(0), start(0), limit(0)
             {
             }
+            bool Encode(Buffer& buf);
+            bool Decode(Buffer& buf);
     };
 
     struct HashKeyObject: public KeyObject
@@ -568,6 +719,24 @@ namespace ardb
             }
     };
 
+    struct ListSegmentKeyObject: public ListKeyObject
+    {
+            ListSegmentKeyObject(const Slice& k, uint64 segment_id, DBID id) :
+                    ListKeyObject(k, (int64) segment_id, id)
+            {
+                type = LIST_SEGMENT;
+            }
+    };
+
+    struct ListIndexKeyObject: public ListKeyObject
+    {
+            ListIndexKeyObject(const Slice& k, uint64 chunk_id, DBID id) :
+                    ListKeyObject(k, (int64) chunk_id, id)
+            {
+                type = LIST_SEGMENT_INDEX;
+            }
+    };
+
     /*
      * All key expiratat value would be stored together for checking
      */
@@ -827,17 +996,85 @@ namespace ardb
         }
     }
 
+    /*
+     * Read only view over the raw engine value of a zipped hash or set meta.
+     * The entries are encoded in sorted order, metas written with ARDB_META_VERSION_ZIP_INDEX
+     * also carry the offset of every entry, so a field/member could be binary searched in place,
+     * and a single field update could be spliced into the raw value without rebuilding the container.
+     */
+    class ZipMetaView
+    {
+        private:
+            const char* m_data;
+            size_t m_size;
+            MetaValueHeader m_header;
+            bool m_ziped;
+            uint32 m_count;
+            size_t m_size_offset;
+            size_t m_size_end;
+            size_t m_count_offset;
+            size_t m_entries_begin;
+            size_t m_entries_end;
+            bool m_indexed;
+            size_t EntryOffset(uint32 idx) const;
+            size_t EntryEnd(uint32 idx) const;
+            bool LowerBound(const ValueData& key, uint32& idx, size_t& value_offset) const;
+        public:
+            ZipMetaView();
+            bool Parse(const Slice& raw);
+            const MetaValueHeader& Header() const
+            {
+                return m_header;
+            }
+            bool IsZiped() const
+            {
+                return m_ziped;
+            }
+            bool IsIndexed() const
+            {
+                return m_indexed;
+            }
+            uint32 Count() const
+            {
+                return m_count;
+            }
+            bool Find(const ValueData& key, ValueData* value) const;
+            bool Upsert(const ValueData& key, const ValueData* value, std::string& result, bool& inserted) const;
+    };
+
+    void set_key_format(uint8 format);
+    uint8 get_key_format();
+    void set_bitset_chunk_compress(bool enable);
+    uint8 detect_key_format(const std::string& dir, const std::string& probe_file);
+    int save_key_format(const std::string& dir, uint8 format);
+
     void encode_key(Buffer& buf, const KeyObject& key);
+    void encode_key(Buffer& buf, const KeyObject& key, uint8 format);
     KeyObject* decode_key(const Slice& key, KeyObject* expected);
+    KeyObject* decode_key(const Slice& key, KeyObject* expected, uint8 format);
+    bool decode_meta_header(Buffer& buf, MetaValueHeader& header);
     CommonMetaValue* decode_meta(const char* data, size_t size, bool only_head);
     void encode_meta(Buffer& buf, CommonMetaValue& meta);
     ValueObject* decode_value_obj(KeyType type, const char* data, size_t size);
     bool decode_value(Buffer& buf, ValueData& value, bool to_slice = false);
     bool decode_value_by_string(const std::string& str, ValueData& value);
     void encode_value(Buffer& buf, const ValueData& value);
+    void encode_merge_operand(Buffer& buf, uint8 op, const ValueData& arg);
+    bool ardb_merge_value(const Slice* existing, const std::vector<Slice>& operands, std::string& result);
+    bool ardb_merge_operands(const Slice& left, const Slice& right, std::string& result);
     bool peek_dbkey_header(const Slice& key, DBID& db, KeyType& type);
     void next_key(const Slice& key, std::string& next);
     int ardb_compare_keys(const char* akbuf, size_t aksiz, const char* bkbuf, size_t bksiz);
+    /*
+     * Compare two encoded keys in the order of the current key format.
+     */
+    int compare_encoded_keys(const Slice& a, const Slice& b);
+    /*
+     * Smallest encoded key of (db, type) whose key starts with prefix, prefix must not contain '\0'.
+     */
+    void encode_key_boundary(Buffer& buf, const DBID& db, uint8 type, const Slice& prefix);
+    void ardb_shortest_separator(std::string* start, const Slice& limit);
+    void ardb_short_successor(std::string* key);
 
 }
 
@@ -30,6 +30,7 @@
 #include "db.hpp"
 #include <string.h>
 #include <sstream>
+#include "util/bitops.hpp"
 #include "util/thread/thread.hpp"
 #include "cron/db_crons.hpp"
 
@@ -67,8 +68,118 @@ namespace ardb
         return value;
     }
 
+    Ardb::KeyLocker::KeyLocker(uint32 thread_num) :
+            m_stripes(NULL), m_stripe_mask(0), m_enable(thread_num > 1)
+    {
+        if (m_enable)
+        {
+            /*
+             * 16 stripes per worker keeps the chance of two hot keys sharing a stripe low
+             */
+            uint32 stripe_num = upper_power_of_two(thread_num * 16);
+            m_stripes = new Stripe[stripe_num];
+            m_stripe_mask = stripe_num - 1;
+        }
+    }
+
+    Ardb::KeyLocker::~KeyLocker()
+    {
+        delete[] m_stripes;
+    }
+
+    Ardb::KeyLocker::Stripe& Ardb::KeyLocker::GetStripe(const DBID& db, const Slice& key)
+    {
+        //FNV-1a
+        uint32 hash = 2166136261U;
+        hash = (hash ^ db) * 16777619U;
+        const char* p = key.data();
+        for (size_t i = 0; i < key.size(); i++)
+        {
+            hash = (hash ^ (uint8) p[i]) * 16777619U;
+        }
+        return m_stripes[hash & m_stripe_mask];
+    }
+
+    bool Ardb::KeyLocker::Lock(const DBID& db, const Slice& key)
+    {
+        if (!m_enable)
+        {
+            return false;
+        }
+        Stripe& stripe = GetStripe(db, key);
+        pthread_t self = pthread_self();
+        uint64 start = get_current_epoch_micros();
+        uint64 acquired = start;
+        bool waited = false;
+        {
+            LockGuard<ThreadMutexLock> guard(stripe);
+            while (true)
+            {
+                /*
+                 * Merge find/insert operations into one 'insert' invocation
+                 */
+                std::pair<LockEntryTable::iterator, bool> insert = stripe.entries.insert(
+                        std::make_pair(DBItemStackKey(db, key), LockEntry()));
+                LockEntry& entry = insert.first->second;
+                if (insert.second)
+                {
+                    if (waited)
+                    {
+                        acquired = get_current_epoch_micros();
+                    }
+                    entry.owner = self;
+                    entry.depth = 1;
+                    entry.hold_start = acquired;
+                    break;
+                }
+                if (pthread_equal(entry.owner, self))
+                {
+                    entry.depth++;
+                    return true;
+                }
+                waited = true;
+                stripe.waiters++;
+                stripe.Wait();
+                stripe.waiters--;
+            }
+        }
+        m_wait_hist.Add(acquired - start);
+        return true;
+    }
+
+    void Ardb::KeyLocker::Unlock(const DBID& db, const Slice& key)
+    {
+        if (!m_enable)
+        {
+            return;
+        }
+        Stripe& stripe = GetStripe(db, key);
+        uint64 hold_start = 0;
+        {
+            LockGuard<ThreadMutexLock> guard(stripe);
+            LockEntryTable::iterator found = stripe.entries.find(DBItemStackKey(db, key));
+            if (found == stripe.entries.end())
+            {
+                return;
+            }
+            found->second.depth--;
+            if (found->second.depth > 0)
+            {
+                return;
+            }
+            hold_start = found->second.hold_start;
+            stripe.entries.erase(found);
+            if (stripe.waiters > 0)
+            {
+                stripe.NotifyAll();
+            }
+        }
+        m_hold_hist.Add(get_current_epoch_micros() - hold_start);
+    }
+
     Ardb::Ardb(KeyValueEngineFactory* engine, uint32 multi_thread_num) :
-            m_engine_factory(engine), m_engine(NULL), m_key_locker(multi_thread_num), m_level1_cahce(NULL)
+            m_engine_factory(engine), m_engine(NULL), m_key_locker(multi_thread_num), m_level1_cahce(NULL), m_meta_cache(NULL), m_lazy_free_key_count(
+                    0), m_expire_wheel(get_current_epoch_millis()), m_expire_horizon(0), m_expire_lag(0), m_expired_keys(0)
     {
     }
 
@@ -85,17 +196,38 @@ namespace ardb
             }
             if (NULL != m_engine)
             {
+                set_key_format(m_engine->GetKeyFormat());
+                INFO_LOG("Storage engine key format version:%u", m_engine->GetKeyFormat());
+                set_bitset_chunk_compress(m_config.bitset_compress_chunks);
+                INFO_LOG("Bitset kernels:%s", bits_kernel_name());
                 if (m_config.L1_cache_memory_limit > 0)
                 {
                     NEW(m_level1_cahce, L1Cache(this));
                     m_level1_cahce->Start();
                 }
+                LoadLazyFreeKeys();
                 INFO_LOG("Init storage engine success.");
             }
         }
+        if (m_config.meta_cache_memory_limit > 0)
+        {
+            if (NULL == m_meta_cache)
+            {
+                NEW(m_meta_cache, MetaCache(m_config.meta_cache_memory_limit));
+            }
+            m_meta_cache->SetMaxMemory(m_config.meta_cache_memory_limit);
+        }
         return m_engine != NULL;
     }
 
+    void Ardb::ClearMetaCache()
+    {
+        if (NULL != m_meta_cache)
+        {
+            m_meta_cache->Clear();
+        }
+    }
+
     Ardb::~Ardb()
     {
         if (NULL != m_level1_cahce)
@@ -103,6 +235,7 @@ namespace ardb
             m_level1_cahce->StopSelf();
             DELETE(m_level1_cahce);
         }
+        DELETE(m_meta_cache);
 
         if (NULL != m_engine)
         {
@@ -174,6 +307,21 @@ namespace ardb
         int ret = GetEngine()->Put(key, value);
         uint64 end = get_current_epoch_micros();
         DBCrons::GetSingleton().GetCompactGC().StatWriteLatency(end - start);
+        DBID db;
+        KeyType type;
+        if (0 == ret && peek_dbkey_header(key, db, type) && type == KEY_EXPIRATION_ELEMENT)
+        {
+            /*
+             * Loaded dumps & full resyncs may write index entries below the horizon
+             */
+            KeyObject* k = decode_key(key, NULL);
+            if (NULL != k && k->type == KEY_EXPIRATION_ELEMENT)
+            {
+                ExpireKeyObject* ek = (ExpireKeyObject*) k;
+                AddExpireWheelKey(ek->db, ek->key, ek->expireat);
+            }
+            DELETE(k);
+        }
         return ret;
     }
     int Ardb::RawDel(const Slice& key)
@@ -370,7 +518,10 @@ namespace ardb
             }
             else
             {
-                if (next == ARDB_GLOBAL_DB)
+                /*
+                 * DBExist leaves 'next' unchanged when there is no db after 'current'
+                 */
+                if (next == ARDB_GLOBAL_DB || next == current)
                 {
                     break;
                 }
@@ -451,11 +602,25 @@ namespace ardb
                     adb->RawDel(key);
                     return 0;
                 }
+                void EvictCache()
+                {
+                    if (NULL != adb->m_level1_cahce)
+                    {
+                        adb->m_level1_cahce->EvictDB(dbid);
+                    }
+                    if (NULL != adb->m_meta_cache)
+                    {
+                        adb->m_meta_cache->EraseDB(dbid);
+                    }
+                }
                 void Run()
                 {
+                    EvictCache();
                     adb->GetEngine()->BeginBatchWrite();
                     adb->VisitDB(dbid, this);
                     adb->GetEngine()->CommitBatchWrite();
+                    adb->ResetExpireWheel();
+                    EvictCache();
                     KeyObject start(Slice(), KEY_META, dbid);
                     KeyObject end(Slice(), KEY_META, dbid + 1);
                     Buffer sbuf, ebuf;
@@ -487,11 +652,22 @@ namespace ardb
                     db->RawDel(key);
                     return 0;
                 }
+                void EvictCache()
+                {
+                    if (NULL != db->m_level1_cahce)
+                    {
+                        db->m_level1_cahce->EvictAll();
+                    }
+                    db->ClearMetaCache();
+                }
                 void Run()
                 {
+                    EvictCache();
                     db->GetEngine()->BeginBatchWrite();
                     db->VisitAllDB(this);
                     db->GetEngine()->CommitBatchWrite();
+                    db->ResetExpireWheel();
+                    EvictCache();
                     db->GetEngine()->CompactRange(Slice(), Slice());
                     delete this;
                 }
@@ -544,6 +720,34 @@ namespace ardb
         return ERR_NOT_EXIST;
     }
 
+    int Ardb::GetRawValues(const std::vector<const KeyObject*>& keys, std::vector<std::string>& values,
+            std::vector<int>& errs)
+    {
+        Buffer keybuf;
+        std::vector<uint32> offsets(keys.size() + 1);
+        for (uint32 i = 0; i < keys.size(); i++)
+        {
+            offsets[i] = keybuf.ReadableBytes();
+            encode_key(keybuf, *(keys[i]));
+        }
+        offsets[keys.size()] = keybuf.ReadableBytes();
+        std::vector<Slice> ks(keys.size());
+        for (uint32 i = 0; i < keys.size(); i++)
+        {
+            ks[i] = Slice(keybuf.GetRawReadBuffer() + offsets[i], offsets[i + 1] - offsets[i]);
+        }
+        bool fill_cache = true;
+        uint64 start = get_current_epoch_micros();
+        int ret = GetEngine()->MultiGet(ks, &values, &errs, fill_cache);
+        uint64 end = get_current_epoch_micros();
+        DBCrons::GetSingleton().GetCompactGC().StatReadLatency(end - start);
+        for (uint32 i = 0; i < errs.size(); i++)
+        {
+            errs[i] = errs[i] == 0 ? ARDB_OK : ERR_NOT_EXIST;
+        }
+        return ret;
+    }
+
     int Ardb::SetRawValue(KeyObject& key, Buffer& value)
     {
         DBContext& watcher = m_db_ctx.GetValue();
@@ -552,12 +756,18 @@ namespace ardb
         {
             watcher.on_key_update(key.db, key.key, watcher.on_key_update_data);
         }
+        InvalidateL1Cache(key.db, key.key);
+        CheckLazyFreeKey(key);
         Buffer keybuf;
         keybuf.EnsureWritableBytes(key.key.size() + 16);
         encode_key(keybuf, key);
         Slice k(keybuf.GetRawReadBuffer(), keybuf.ReadableBytes());
         Slice v(value.GetRawReadBuffer(), value.ReadableBytes());
         int ret = RawSet(k, v);
+        if (key.type == KEY_META)
+        {
+            UpdateMetaCache(key, 0 == ret ? &v : NULL);
+        }
         return ret;
     }
 
@@ -578,6 +788,18 @@ namespace ardb
         return SetMeta(metakey, meta);
     }
     int Ardb::SetMeta(KeyObject& key, CommonMetaValue& meta)
+    {
+        Buffer valuebuf;
+        valuebuf.EnsureWritableBytes(64);
+        encode_meta(valuebuf, meta);
+        Slice v(valuebuf.GetRawReadBuffer(), valuebuf.ReadableBytes());
+        return SetRawMeta(key, v);
+    }
+
+    /*
+     * Write an already encoded meta value, used by the zipped hash/set paths which patch the raw value in place.
+     */
+    int Ardb::SetRawMeta(KeyObject& key, const Slice& raw)
     {
         DBContext& watcher = m_db_ctx.GetValue();
         watcher.data_changed = true;
@@ -585,15 +807,59 @@ namespace ardb
         {
             watcher.on_key_update(key.db, key.key, watcher.on_key_update_data);
         }
+        InvalidateL1Cache(key.db, key.key);
         Buffer keybuf;
         keybuf.EnsureWritableBytes(key.key.size() + 16);
         encode_key(keybuf, key);
-        Buffer valuebuf;
-        valuebuf.EnsureWritableBytes(64);
-        encode_meta(valuebuf, meta);
         Slice k(keybuf.GetRawReadBuffer(), keybuf.ReadableBytes());
-        Slice v(valuebuf.GetRawReadBuffer(), valuebuf.ReadableBytes());
-        return RawSet(k, v);
+        int ret = RawSet(k, raw);
+        UpdateMetaCache(key, 0 == ret ? &raw : NULL);
+        return ret;
+    }
+
+    /*
+     * Write a merge operand for the key, the merged meta is only known to the engine so the cached
+     * meta of the key is dropped.
+     */
+    int Ardb::MergeRawValue(KeyObject& key, const Slice& operand)
+    {
+        DBContext& watcher = m_db_ctx.GetValue();
+        watcher.data_changed = true;
+        if (watcher.on_key_update != NULL)
+        {
+            watcher.on_key_update(key.db, key.key, watcher.on_key_update_data);
+        }
+        InvalidateL1Cache(key.db, key.key);
+        Buffer keybuf;
+        keybuf.EnsureWritableBytes(key.key.size() + 16);
+        encode_key(keybuf, key);
+        Slice k(keybuf.GetRawReadBuffer(), keybuf.ReadableBytes());
+        int ret = GetEngine()->Merge(k, operand);
+        if (key.type == KEY_META)
+        {
+            UpdateMetaCache(key, NULL);
+        }
+        return ret;
+    }
+
+    /*
+     * Write through the meta cache after a meta write, an empty value records a deleted key and a NULL
+     * value (failed write) drops the cached entry.
+     */
+    void Ardb::UpdateMetaCache(const KeyObject& key, const Slice* raw)
+    {
+        if (NULL == m_meta_cache)
+        {
+            return;
+        }
+        if (NULL != raw)
+        {
+            m_meta_cache->Put(key.db, key.key, *raw);
+        }
+        else
+        {
+            m_meta_cache->Erase(key.db, key.key);
+        }
     }
 
     int Ardb::DelMeta(const DBID& db, const Slice& key, CommonMetaValue* meta)
@@ -618,37 +884,82 @@ namespace ardb
         return 0;
     }
 
-    CommonMetaValue* Ardb::GetMeta(const DBID& db, const Slice& key, bool onlyHead)
+    /*
+     * Fetch the raw meta value of a key from the meta cache or the engine, expired keys are deleted here
+     * and reported as not exist unless 'check_expire' is false.
+     */
+    int Ardb::GetRawMeta(const DBID& db, const Slice& key, std::string& raw, bool check_expire)
     {
-        KeyObject verkey(key, KEY_META, db);
-        std::string v;
-        if (0 == GetRawValue(verkey, v) && v.size() > 1)
+        uint64 cache_version = 0;
+        if (NULL != m_meta_cache && m_meta_cache->Get(db, key, raw, cache_version))
         {
-            CommonMetaValue* meta = decode_meta(v.data(), v.size(), onlyHead);
-            if (NULL != meta)
+            if (raw.empty())
             {
-                if (meta->header.expireat > 0)
-                {
-                    if (meta->header.expireat < get_current_epoch_millis())
-                    {
-                        //expired
-                        Del(db, key);
-                        ArgumentArray args;
-                        args.push_back("del");
-                        args.push_back(std::string(key.data(), key.size()));
-                        RedisCommandFrame cmd(args);
-                        GetDBContext().propagate_cmds.push_back(cmd);
-                        DELETE(meta);
-                        return NULL;
-                    }
-                }
+                return ERR_NOT_EXIST;
             }
-            return meta;
         }
         else
         {
-            return NULL;
+            KeyObject verkey(key, KEY_META, db);
+            if (0 != GetRawValue(verkey, raw) || raw.size() <= 1)
+            {
+                return ERR_NOT_EXIST;
+            }
+            if (NULL != m_meta_cache)
+            {
+                m_meta_cache->Fill(db, key, raw, cache_version);
+            }
         }
+        MetaValueHeader header;
+        Buffer buf(const_cast<char*>(raw.data()), 0, raw.size());
+        DBContext& ctx = GetDBContext();
+        if (check_expire && !ctx.deleting_expired && decode_meta_header(buf, header) && header.expireat > 0
+                && header.expireat < get_current_epoch_micros())
+        {
+            //expired
+            ctx.deleting_expired = true;
+            Del(db, key);
+            ctx.deleting_expired = false;
+            ArgumentArray args;
+            args.push_back("del");
+            args.push_back(std::string(key.data(), key.size()));
+            RedisCommandFrame cmd(args);
+            GetDBContext().propagate_cmds.push_back(cmd);
+            return ERR_NOT_EXIST;
+        }
+        return 0;
+    }
+
+    CommonMetaValue* Ardb::GetMeta(const DBID& db, const Slice& key, bool onlyHead, bool check_expire)
+    {
+        std::string v;
+        if (0 == GetRawMeta(db, key, v, check_expire))
+        {
+            return decode_meta(v.data(), v.size(), onlyHead);
+        }
+        return NULL;
+    }
+
+    /*
+     * Fetch the meta of a hash/set as a zipped view over the raw value, 'raw' must outlive 'view'.
+     */
+    int Ardb::GetZipMeta(const DBID& db, const Slice& key, KeyType type, std::string& raw, ZipMetaView& view)
+    {
+        int err = GetRawMeta(db, key, raw);
+        if (0 != err)
+        {
+            return err;
+        }
+        if (!view.Parse(raw))
+        {
+            ERROR_LOG("Decode %s meta failed.", type == HASH_META ? "hash" : "set");
+            return ERR_INVALID_TYPE;
+        }
+        if (view.Header().type != type)
+        {
+            return ERR_INVALID_TYPE;
+        }
+        return 0;
     }
 
     int Ardb::GetScript(const std::string& funacname, std::string& funcbody)
@@ -777,5 +1088,123 @@ namespace ardb
         return NULL;
     }
 
+    static const uint32 kMaxL1CacheDirtyKeys = 1024;
+
+    /*
+     * Returns the loaded cache entry a read could be served from, a miss starts loading the key if the
+     * '<type>-read-load-cache' option is enabled.
+     */
+    CacheItem* Ardb::GetReadCache(const DBID& db, const Slice& key, KeyType type)
+    {
+        if (NULL == m_level1_cahce || GetDBContext().l1_cache_sync)
+        {
+            return NULL;
+        }
+        CacheItem* cache = GetLoadedCache(db, key, type, false, false);
+        m_level1_cahce->Stat(type, NULL != cache);
+        if (NULL == cache)
+        {
+            bool load = false;
+            switch (type)
+            {
+                case ZSET_META:
+                {
+                    load = m_config.zset_read_load_cache;
+                    break;
+                }
+                case HASH_META:
+                {
+                    load = m_config.hash_read_load_cache;
+                    break;
+                }
+                case SET_META:
+                {
+                    load = m_config.set_read_load_cache;
+                    break;
+                }
+                case STRING_META:
+                {
+                    load = m_config.string_read_load_cache;
+                    break;
+                }
+                default:
+                {
+                    break;
+                }
+            }
+            if (load)
+            {
+                m_level1_cahce->Load(db, key);
+            }
+        }
+        return cache;
+    }
+
+    /*
+     * Returns the loaded cache entry a write-through operation updates in place after its write, the entry is
+     * created if 'create' is set. Any other entry of the key is dropped since it can not be updated in place.
+     * The caller holds the key lock and a L1CacheSyncGuard.
+     */
+    CacheItem* Ardb::GetWriteCache(const DBID& db, const Slice& key, KeyType type, bool create)
+    {
+        if (NULL == m_level1_cahce)
+        {
+            return NULL;
+        }
+        CacheItem* cache = GetLoadedCache(db, key, type, false, false);
+        if (NULL == cache && create)
+        {
+            cache = m_level1_cahce->CreateCacheEntry(db, key, type);
+        }
+        if (NULL == cache)
+        {
+            m_level1_cahce->Invalidate(db, key, false);
+        }
+        return cache;
+    }
+
+    void Ardb::InvalidateL1Cache(const DBID& db, const Slice& key)
+    {
+        if (NULL == m_level1_cahce)
+        {
+            return;
+        }
+        DBContext& ctx = GetDBContext();
+        if (ctx.l1_cache_sync)
+        {
+            return;
+        }
+        m_level1_cahce->Invalidate(db, key, true);
+        /*
+         * Threads never clearing their context(e.g. the expire thread) are bounded by the limit
+         */
+        if (ctx.l1_cache_dirty_keys.size() >= kMaxL1CacheDirtyKeys)
+        {
+            return;
+        }
+        if (ctx.l1_cache_dirty_keys.empty() || ctx.l1_cache_dirty_keys.back().db != db
+                || ctx.l1_cache_dirty_keys.back().key.compare(0, std::string::npos, key.data(), key.size()) != 0)
+        {
+            ctx.l1_cache_dirty_keys.push_back(DBItemKey(db, key));
+        }
+    }
+
+    /*
+     * Keys written in a batch are invalidated before the batch is committed, a load racing with the batch
+     * may cache the old value, so they are invalidated again once the command is done.
+     */
+    void Ardb::ClearDBContext()
+    {
+        DBContext& ctx = GetDBContext();
+        if (NULL != m_level1_cahce)
+        {
+            for (uint32 i = 0; i < ctx.l1_cache_dirty_keys.size(); i++)
+            {
+                m_level1_cahce->Invalidate(ctx.l1_cache_dirty_keys[i].db, ctx.l1_cache_dirty_keys[i].key, true);
+            }
+        }
+        ctx.Clear();
+    }
+
 }
 
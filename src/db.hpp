@@ -47,7 +47,10 @@
 #include "util/thread/lock_guard.hpp"
 #include "channel/all_includes.hpp"
 #include "cache/level1_cache.hpp"
+#include "cache/meta_cache.hpp"
 #include "geo/geohash_helper.hpp"
+#include "util/histogram.hpp"
+#include "util/timing_wheel.hpp"
 
 #define ARDB_OK 0
 #define ERR_INVALID_ARGS -3
@@ -84,6 +87,8 @@ namespace ardb
             }
     };
 
+    typedef void CheckpointPauseFunc(bool pause, void* data);
+
     struct KeyValueEngine
     {
             virtual int Get(const Slice& key, std::string* value, bool fill_cache) = 0;
@@ -93,6 +98,21 @@ namespace ardb
             virtual int CommitBatchWrite() = 0;
             virtual int DiscardBatchWrite() = 0;
             virtual Iterator* Find(const Slice& findkey, bool cache) = 0;
+            /*
+             * Read a batch of keys from one consistent view, values[i]/errs[i] correspond to keys[i],
+             * errs[i] is 0 if found.
+             */
+            virtual int MultiGet(const std::vector<Slice>& keys, std::vector<std::string>* values, std::vector<int>* errs,
+                    bool fill_cache)
+            {
+                values->resize(keys.size());
+                errs->resize(keys.size());
+                for (uint32 i = 0; i < keys.size(); i++)
+                {
+                    (*errs)[i] = Get(keys[i], &((*values)[i]), fill_cache);
+                }
+                return 0;
+            }
 
             virtual const std::string Stats()
             {
@@ -101,6 +121,45 @@ namespace ardb
             virtual void CompactRange(const Slice& begin, const Slice& end)
             {
             }
+            /*
+             * Key layout the engine was opened with, engines ordering keys bytewise
+             * must return ARDB_KEY_FORMAT_MEMCMP or later.
+             */
+            virtual uint8 GetKeyFormat()
+            {
+                return ARDB_KEY_FORMAT_LEGACY;
+            }
+            /*
+             * Engines with a merge operator resolving ardb merge operands (see ardb_merge_value) on read
+             * and compaction, a read-modify-write could then be written without the read.
+             */
+            virtual bool SupportMerge()
+            {
+                return false;
+            }
+            virtual int Merge(const Slice& key, const Slice& operand)
+            {
+                return -1;
+            }
+            /*
+             * Engines whose iterators created by one thread read from one snapshot and may then be used by
+             * other threads, a dump is only saved in parallel segments by such engines.
+             */
+            virtual bool SupportParallelIterators()
+            {
+                return false;
+            }
+            /*
+             * Write an engine-native copy of the current data into the empty dir, files of a previous
+             * checkpoint in base_dir (may be empty) which are unchanged may be reused instead of copied.
+             * The engine fixes the state it copies between pause(true, data) & pause(false, data), which
+             * may be called again when it has to retry.
+             */
+            virtual int Checkpoint(const std::string& dir, const std::string& base_dir, CheckpointPauseFunc* pause,
+                    void* data)
+            {
+                return -1;
+            }
             virtual ~KeyValueEngine()
             {
             }
@@ -159,16 +218,44 @@ namespace ardb
             void* on_key_update_data;
             RedisCommandFrameArray propagate_cmds;
             std::string last_error;
+            /*
+             * Set while the current thread keeps the L1 cache entries of the keys it writes in sync by itself
+             */
+            bool l1_cache_sync;
+            /*
+             * Keys whose L1 cache entries were invalidated by the current command
+             */
+            std::vector<DBItemKey> l1_cache_dirty_keys;
+            /*
+             * Set while an expired key found by GetRawMeta is deleted, whose metas are read again meanwhile
+             */
+            bool deleting_expired;
             void Clear()
             {
                 data_changed = false;
                 propagate_cmds.clear();
                 last_error.clear();
+                l1_cache_dirty_keys.clear();
             }
             DBContext() :
                     data_changed(false), on_key_update(NULL), on_key_update_data(
-                    NULL)
+                    NULL), l1_cache_sync(false), deleting_expired(false)
+            {
+            }
+    };
+
+    struct L1CacheSyncGuard
+    {
+            DBContext& ctx;
+            bool prev;
+            L1CacheSyncGuard(DBContext& c) :
+                    ctx(c), prev(c.l1_cache_sync)
+            {
+                ctx.l1_cache_sync = true;
+            }
+            ~L1CacheSyncGuard()
             {
+                ctx.l1_cache_sync = prev;
             }
     };
 
@@ -189,6 +276,7 @@ namespace ardb
     };
 
     typedef void ExpireKeyCallback(const DBID& db, const Slice& key, void* data);
+    typedef void ExpireKeysCallback(const DBID& db, const SliceArray& keys, void* data);
 
     struct ArdbConfig
     {
@@ -196,32 +284,46 @@ namespace ardb
             int64 hash_max_ziplist_value;
             int64 list_max_ziplist_entries;
             int64 list_max_ziplist_value;
+            int64 list_max_segment_entries;
+            int64 list_max_segment_size;
             int64 zset_max_ziplist_entries;
             int64 zset_max_ziplist_value;
             int64 set_max_ziplist_entries;
             int64 set_max_ziplist_value;
 
             int64 L1_cache_memory_limit;
+            int64 meta_cache_memory_limit;
 
             bool check_type_before_set_string;
 
             bool read_fill_cache;
             bool zset_write_fill_cache;
             bool zset_read_load_cache;
-//            bool string_write_fill_cache;
-//            bool hash_write_fill_cache;
-//            bool set_write_fill_cache;
+            bool string_write_fill_cache;
+            bool string_read_load_cache;
+            bool hash_write_fill_cache;
+            bool hash_read_load_cache;
+            bool set_write_fill_cache;
+            bool set_read_load_cache;
 //            bool list_write_fill_cache;
 
             int64 hll_sparse_max_bytes;
             int64 area_geohash_step;
+            bool bitset_compress_chunks;
+
+            bool lazy_free;
+            int64 lazy_free_min_elements;
+            int64 lazy_free_max_deletes_per_sec;
 
             ArdbConfig() :
                     hash_max_ziplist_entries(128), hash_max_ziplist_value(64), list_max_ziplist_entries(128), list_max_ziplist_value(
-                            64), zset_max_ziplist_entries(128), zset_max_ziplist_value(64), set_max_ziplist_entries(
-                            128), set_max_ziplist_value(64), L1_cache_memory_limit(0), check_type_before_set_string(
-                            false), read_fill_cache(true), zset_write_fill_cache(false), zset_read_load_cache(false), hll_sparse_max_bytes(
-                            3000), area_geohash_step(15)
+                            64), list_max_segment_entries(512), list_max_segment_size(8192), zset_max_ziplist_entries(
+                            128), zset_max_ziplist_value(64), set_max_ziplist_entries(128), set_max_ziplist_value(64), L1_cache_memory_limit(0), meta_cache_memory_limit(0), check_type_before_set_string(
+                            false), read_fill_cache(true), zset_write_fill_cache(false), zset_read_load_cache(false), string_write_fill_cache(
+                            false), string_read_load_cache(false), hash_write_fill_cache(false), hash_read_load_cache(
+                            false), set_write_fill_cache(false), set_read_load_cache(false), hll_sparse_max_bytes(
+                            3000), area_geohash_step(15), bitset_compress_chunks(true), lazy_free(false), lazy_free_min_elements(64), lazy_free_max_deletes_per_sec(
+                            100000)
             {
             }
     };
@@ -260,11 +362,14 @@ namespace ardb
             int NextKey(const DBID& db, const std::string& key, std::string& nextkey);
             int LastKey(const DBID& db, std::string& prevkey);
 
-            ListMetaValue* GetListMeta(const DBID& db, const Slice& key, int& err, bool& create);
+            ListMetaValue* GetListMeta(const DBID& db, const Slice& key, int& err, bool& create, bool convert = true);
             SetMetaValue* GetSetMeta(const DBID& db, const Slice& key, int& err, bool& create);
+            SetMetaValue* PrepareSetMeta(CommonMetaValue* meta, int& err, bool& create);
             HashMetaValue* GetHashMeta(const DBID& db, const Slice& key, int& err, bool& create);
             ZSetMetaValue* GetZSetMeta(const DBID& db, const Slice& key, uint8 sort_func, int& err, bool& create);
-            CommonMetaValue* GetMeta(const DBID& db, const Slice& key, bool onlyHead);
+            CommonMetaValue* GetMeta(const DBID& db, const Slice& key, bool onlyHead, bool check_expire = true);
+            int GetRawMeta(const DBID& db, const Slice& key, std::string& raw, bool check_expire = true);
+            int GetZipMeta(const DBID& db, const Slice& key, KeyType type, std::string& raw, ZipMetaView& view);
 
             int RenameList(const DBID& db1, const Slice& key1, const DBID& db2, const Slice& key2, ListMetaValue* meta);
             int RenameHash(const DBID& db1, const Slice& key1, const DBID& db2, const Slice& key2, HashMetaValue* meta);
@@ -290,20 +395,31 @@ namespace ardb
             int ZGetNodeValue(const DBID& db, const Slice& key, const Slice& value, ValueData& score, ValueData& attr);
             CacheItem* GetLoadedCache(const DBID& db, const Slice& key, KeyType type, bool evict_non_loaded,
                     bool create_if_not_exist);
+            CacheItem* GetReadCache(const DBID& db, const Slice& key, KeyType type);
+            CacheItem* GetWriteCache(const DBID& db, const Slice& key, KeyType type, bool create);
+            void SAddCache(const DBID& db, const Slice& key, bool created, const ValueData& element);
             int ZNodeIterate(const DBID& db, const Slice& key, const std::string& start, bool reverse,
                     ValueVisitCallback* cb, void* cbdata);
 
             int GetType(const DBID& db, const Slice& key, KeyType& type);
             int SetMeta(KeyObject& key, CommonMetaValue& meta);
             int SetMeta(const DBID& db, const Slice& key, CommonMetaValue& meta);
+            int SetRawMeta(KeyObject& key, const Slice& raw);
+            int MergeRawValue(KeyObject& key, const Slice& operand);
+            void UpdateMetaCache(const KeyObject& key, const Slice* raw);
             int DelMeta(const DBID& db, const Slice& key, CommonMetaValue* meta);
             int SetExpiration(const DBID& db, const Slice& key, uint64 expire);
+            /*
+             * The expiration of the key even if it's passed, the key is not deleted here
+             */
             int GetExpiration(const DBID& db, const Slice& key, uint64& expire);
 
             int GetValueByPattern(const DBID& db, const Slice& pattern, ValueData& subst, ValueData& value);
             int MatchValueByPattern(const DBID& db, const Slice& key_pattern, const Slice& value_pattern,
                     ValueData& subst, ValueData& value);
             int GetRawValue(const KeyObject& key, std::string& v);
+            int GetRawValues(const std::vector<const KeyObject*>& keys, std::vector<std::string>& values,
+                    std::vector<int>& errs);
             int SetRawValue(KeyObject& key, Buffer& v);
             int DelValue(KeyObject& key);
             Iterator* FindValue(KeyObject& key, bool cache = false);
@@ -311,8 +427,24 @@ namespace ardb
 
             int ListPush(const DBID& db, const Slice& key, const Slice& value, bool athead, bool onlyexist);
             int ListPop(const DBID& db, const Slice& key, bool athead, std::string& value);
+            int GetListSegment(const DBID& db, const Slice& key, uint64 id, ListSegmentValue& segment);
+            int SetListSegment(const DBID& db, const Slice& key, uint64 id, ListSegmentValue& segment);
+            int DelListSegment(const DBID& db, const Slice& key, uint64 id);
+            bool IsListSegmentFull(const ListSegmentValue& segment);
+            int NewListSegment(const DBID& db, const Slice& key, ListMetaValue& meta, ListSegmentValue& segment,
+                    ListSegmentRef& ref);
+            int GetListIndexChunk(const DBID& db, const Slice& key, const ListMetaValue& meta, size_t pos,
+                    ListIndexChunkValue& chunk);
+            int SetListIndexChunk(const DBID& db, const Slice& key, ListMetaValue& meta, size_t pos,
+                    ListIndexChunkValue& chunk);
+            int LocateListSegment(const DBID& db, const Slice& key, const ListMetaValue& meta, uint32 index,
+                    size_t& chunk_pos, ListIndexChunkValue& chunk, size_t& pos, uint32& offset);
+            int ListAppendValues(const DBID& db, const Slice& key, ListMetaValue& meta, const ValueDataDeque& values);
+            int ConvertListToSegments(const DBID& db, const Slice& key, ListMetaValue& meta);
 
             void FindSetMinMaxValue(const DBID& db, const Slice& key, SetMetaValue* meta);
+            uint32 CountSetMembers(const DBID& db, const Slice& key, ValueData& min, ValueData& max);
+            void RecountSet(const DBID& db, const Slice& key, SetMetaValue* meta);
 
             int BitsAnd(const DBID& db, SliceArray& keys, BitSetElementValueMap*& result, BitSetElementValueMap*& tmp);
             int BitsOr(const DBID& db, SliceArray& keys, BitSetElementValueMap*& result, bool isXor);
@@ -338,6 +470,43 @@ namespace ardb
                     {
                     }
             };
+            /*
+             * Ordered cursor over the members of one set, ziped or not, used to merge sets without
+             * loading them into memory.
+             */
+            class SetCursor
+            {
+                private:
+                    Ardb* m_db;
+                    DBID m_dbid;
+                    Slice m_key;
+                    SetMetaValue* m_meta;
+                    Iterator* m_iter;
+                    ValueSet::iterator m_zit;
+                    ValueData m_value;
+                    bool m_valid;
+                    void Load();
+                public:
+                    SetCursor(Ardb* db, const DBID& dbid, const Slice& key, SetMetaValue* meta);
+                    bool Valid()
+                    {
+                        return m_valid;
+                    }
+                    const ValueData& Value()
+                    {
+                        return m_value;
+                    }
+                    SetMetaValue* Meta()
+                    {
+                        return m_meta;
+                    }
+                    void Next();
+                    void Seek(const ValueData& target);
+                    ~SetCursor();
+            };
+            friend class SetCursor;
+            typedef std::vector<SetCursor*> SetCursorArray;
+            int OpenSetCursors(const DBID& db, SliceArray& keys, SetCursorArray& cursors, bool all_exist);
             int SetRange(const DBID& db, const Slice& key, SetMetaValue* meta, const ValueData& value_begin,
                     const ValueData& value_end, int32 limit, bool with_begin, const std::string& pattern,
                     ValueDataArray& values);
@@ -357,124 +526,43 @@ namespace ardb
                 m_err_cause = cause;
             }
 
-            struct Barrier: public ThreadMutexLock
-            {
-                    volatile uint32 in_lock;
-                    volatile uint32 wait_num;
-                    volatile pthread_t pid;
-                    Barrier() :
-                            in_lock(0), wait_num(0), pid(0)
-                    {
-                    }
-            };
-
+            /*
+             * Striped key lock manager, keys are hash partitioned into stripes which own their
+             * lock table and waiters, so writers on different stripes never share a lock.
+             * A thread may lock the same key again before unlocking it.
+             */
             struct KeyLocker
             {
-                    typedef TreeSet<DBItemStackKey>::Type DBItemKeySet;
-                    typedef TreeMap<DBItemStackKey, Barrier*>::Type ThreadMutexLockTable;
-                    typedef std::list<Barrier*> ThreadMutexLockList;
-                    SpinRWLock m_barrier_lock;
-                    typedef ReadLockGuard<SpinRWLock> SpinReadLockGuard;
-                    typedef WriteLockGuard<SpinRWLock> SpinWriteLockGuard;
-                    ThreadMutexLockList m_barrier_pool;
-                    ThreadMutexLockTable m_barrier_table;
-                    bool m_enable;
-                    KeyLocker(uint32 thread_num) :
-                            m_enable(thread_num > 1)
-                    {
-                        for (uint32 i = 0; m_enable && i < thread_num; i++)
-                        {
-                            Barrier* lock = new Barrier;
-                            m_barrier_pool.push_back(lock);
-                        }
-                    }
-                    ~KeyLocker()
-                    {
-                        ThreadMutexLockList::iterator it = m_barrier_pool.begin();
-                        while (it != m_barrier_pool.end())
-                        {
-                            delete *it;
-                            it++;
-                        }
-                    }
-                    Barrier* AddLockKey(const DBID& db, const Slice& key)
+                    struct LockEntry
                     {
-                        if (!m_enable)
-                        {
-                            return NULL;
-                        }
-                        while (true)
-                        {
-                            Barrier* barrier = NULL;
+                            pthread_t owner;
+                            uint32 depth;
+                            uint64 hold_start;
+                            LockEntry() :
+                                    owner(0), depth(0), hold_start(0)
                             {
-                                SpinWriteLockGuard guard(m_barrier_lock);
-                                /*
-                                 * Merge find/insert operations into one 'insert' invocation
-                                 */
-                                std::pair<ThreadMutexLockTable::iterator, bool> insert = m_barrier_table.insert(
-                                        std::make_pair(DBItemStackKey(db, key), (Barrier*) NULL));
-                                if (!insert.second && NULL != insert.first->second)
-                                {
-                                    barrier = insert.first->second;
-                                    if (barrier->pid == pthread_self())
-                                    {
-                                        barrier->in_lock++;
-                                        return barrier;
-                                    }
-                                }
-                                else if (!m_barrier_pool.empty())
-                                {
-                                    barrier = m_barrier_pool.front();
-                                    m_barrier_pool.pop_front();
-                                    barrier->in_lock++;
-                                    barrier->pid = pthread_self();
-                                    insert.first->second = barrier;
-                                    return barrier;
-                                }
                             }
-                            if (NULL != barrier)
-                            {
-                                LockGuard<ThreadMutexLock> guard(*barrier);
-                                if (barrier->in_lock > 0)
-                                {
-                                    barrier->wait_num++;
-                                    barrier->Wait();
-                                    barrier->wait_num--;
-                                }
-                            }
-                        }
-                        return NULL;
-                    }
-                    void ClearLockKey(const DBID& db, const Slice& key, Barrier* barrier)
+                    };
+                    typedef TreeMap<DBItemStackKey, LockEntry>::Type LockEntryTable;
+                    struct Stripe: public ThreadMutexLock
                     {
-                        if (!m_enable)
-                        {
-                            return;
-                        }
-                        if (NULL != barrier)
-                        {
-                            LockGuard<ThreadMutexLock> guard(*barrier);
-                            barrier->in_lock--;
-                            if (0 == barrier->in_lock)
-                            {
-                                barrier->pid = 0;
-                                if (barrier->wait_num > 0)
-                                {
-                                    barrier->NotifyAll();
-                                }
-                            }
-                            else
+                            LockEntryTable entries;
+                            uint32 waiters;
+                            Stripe() :
+                                    waiters(0)
                             {
-                                return;
                             }
-                        }
-                        if (NULL != barrier)
-                        {
-                            SpinWriteLockGuard guard(m_barrier_lock);
-                            m_barrier_table.erase(DBItemStackKey(db, key));
-                            m_barrier_pool.push_back(barrier);
-                        }
-                    }
+                    };
+                    Stripe* m_stripes;
+                    uint32 m_stripe_mask;
+                    bool m_enable;
+                    Histogram m_wait_hist;
+                    Histogram m_hold_hist;
+                    KeyLocker(uint32 thread_num);
+                    ~KeyLocker();
+                    Stripe& GetStripe(const DBID& db, const Slice& key);
+                    bool Lock(const DBID& db, const Slice& key);
+                    void Unlock(const DBID& db, const Slice& key);
             };
 
             struct KeyLockerGuard
@@ -482,21 +570,83 @@ namespace ardb
                     KeyLocker& locker;
                     const DBID& db;
                     const Slice& key;
-                    Barrier* barrier;
+                    bool locked;
                     KeyLockerGuard(KeyLocker& loc, const DBID& id, const Slice& k) :
-                            locker(loc), db(id), key(k), barrier(NULL)
+                            locker(loc), db(id), key(k), locked(false)
                     {
-                        barrier = locker.AddLockKey(db, key);
+                        locked = locker.Lock(db, key);
                     }
                     ~KeyLockerGuard()
                     {
-                        locker.ClearLockKey(db, key, barrier);
+                        if (locked)
+                        {
+                            locker.Unlock(db, key);
+                        }
                     }
             };
             KeyLocker m_key_locker;
             L1Cache* m_level1_cahce;
+            MetaCache* m_meta_cache;
             ArdbConfig m_config;
 
+            /*
+             * Lazy free: DEL of a big collection replaces its meta by a tombstone and returns at once,
+             * the elements are reaped in background batches. Any element write to a key which is still
+             * being reaped finishes the reaping first, so old elements never leak into a new key.
+             */
+            struct LazyFreeKey
+            {
+                    KeyType type;
+                    uint64 reaped;
+                    LazyFreeKey(KeyType t = KEY_META) :
+                            type(t), reaped(0)
+                    {
+                    }
+            };
+            typedef TreeMap<DBItemKey, LazyFreeKey>::Type LazyFreeKeyTable;
+            LazyFreeKeyTable m_lazy_free_keys;
+            SpinMutexLock m_lazy_free_keys_lock;
+            ThreadMutex m_lazy_free_reap_mutex;
+            volatile uint32 m_lazy_free_key_count;
+            bool IsLazyFreeCandidate(CommonMetaValue* meta);
+            int LazyFreeDel(const DBID& db, const Slice& key, CommonMetaValue* meta);
+            bool PeekLazyFreeKey(DBItemKey& key, KeyType& type);
+            void AddLazyFreeKey(const DBID& db, const Slice& key, KeyType type);
+            void CheckLazyFreeKey(const KeyObject& key);
+            int ReapLazyFreeKey(const DBID& db, const Slice& key, KeyType type, uint32 max_deletes, uint32& deleted);
+            void FinishLazyFreeKey(const DBID& db, const Slice& key, KeyType type);
+            void LoadLazyFreeKeys();
+
+            /*
+             * Expire wheel: the expiration index is loaded into an in-memory timing wheel(ms ticks) up to
+             * 'm_expire_horizon', an expiration set below the horizon is added to the wheel by SetExpiration
+             * or RawSet.
+             * So the index is read once a while for the next seconds instead of being scanned every cycle.
+             * Entries are not removed when a key is deleted or its expiration changed, they are checked
+             * against the meta of the key when they fire.
+             */
+            struct ExpireWheelKey
+            {
+                    DBID db;
+                    uint64 expireat;
+                    std::string key;
+                    ExpireWheelKey(const DBID& id = 0, const Slice& k = Slice(), uint64 ts = 0) :
+                            db(id), expireat(ts), key(k.data(), k.size())
+                    {
+                    }
+            };
+            typedef TimingWheel<ExpireWheelKey> ExpireTimingWheel;
+            ExpireTimingWheel m_expire_wheel;
+            SpinMutexLock m_expire_wheel_lock;
+            ThreadMutex m_expire_mutex;
+            volatile uint64 m_expire_horizon;
+            volatile uint64 m_expire_lag;
+            volatile uint64 m_expired_keys;
+            void AddExpireWheelKey(const DBID& db, const Slice& key, uint64 expireat);
+            void LoadExpireWheel(uint64 now);
+            int ExpireWheelKeys(const std::deque<ExpireWheelKey>& keys, uint64& lag, ExpireKeysCallback* cb,
+                    void* data);
+
             friend class L1Cache;
         public:
             Ardb(KeyValueEngineFactory* factory, uint32 multi_thread_num = 1);
@@ -507,10 +657,23 @@ namespace ardb
             {
                 return m_config;
             }
+            const Histogram& GetKeyLockWaitHistogram()
+            {
+                return m_key_locker.m_wait_hist;
+            }
+            const Histogram& GetKeyLockHoldHistogram()
+            {
+                return m_key_locker.m_hold_hist;
+            }
             L1Cache* GetL1Cache()
             {
                 return m_level1_cahce;
             }
+            MetaCache* GetMetaCache()
+            {
+                return m_meta_cache;
+            }
+            void ClearMetaCache();
 
             int RawSet(const Slice& key, const Slice& value);
             int RawDel(const Slice& key);
@@ -527,6 +690,7 @@ namespace ardb
             int PSetEx(const DBID& db, const Slice& key, const Slice& value, uint32_t ms);
             int Get(const DBID& db, const Slice& key, std::string& value);
             int MGet(const DBID& db, SliceArray& keys, StringArray& values);
+            int MGet(const DBID& db, const SliceArray& keys, StringArray& values, std::vector<int>& errs);
             int Del(const DBID& db, const Slice& key);
             int Del(const DBID& db, const SliceArray& keys);
             bool Exists(const DBID& db, const Slice& key);
@@ -555,6 +719,12 @@ namespace ardb
             int Incr(const DBID& db, const Slice& key, int64_t& value);
             int Incrby(const DBID& db, const Slice& key, int64_t increment, int64_t& value);
             int IncrbyFloat(const DBID& db, const Slice& key, double increment, double& value);
+            /*
+             * Variants for callers discarding the result (replication apply), on engines supporting merge
+             * they write a merge operand instead of reading and rewriting the value.
+             */
+            int MergeIncrby(const DBID& db, const Slice& key, int64_t increment);
+            int MergeAppend(const DBID& db, const Slice& key, const Slice& value);
             int GetRange(const DBID& db, const Slice& key, int start, int end, std::string& valueobj);
             int SetRange(const DBID& db, const Slice& key, int start, const Slice& value);
             int GetSet(const DBID& db, const Slice& key, const Slice& value, std::string& valueobj);
@@ -577,6 +747,7 @@ namespace ardb
             int HMIncrby(const DBID& db, const Slice& key, const SliceArray& fields, const Int64Array& increments,
                     Int64Array& vs);
             int HIncrbyFloat(const DBID& db, const Slice& key, const Slice& field, double increment, double& value);
+            int MergeHIncrby(const DBID& db, const Slice& key, const Slice& field, int64_t increment);
             int HMGet(const DBID& db, const Slice& key, const SliceArray& fields, ValueDataArray& values);
             int HMSet(const DBID& db, const Slice& key, const SliceArray& fields, const SliceArray& values);
             int HGetAll(const DBID& db, const Slice& key, StringArray& fields, StringArray& values);
@@ -665,6 +836,7 @@ namespace ardb
             int SInterCount(const DBID& db, SliceArray& keys, uint32& count);
             int SInterStore(const DBID& db, const Slice& dst, SliceArray& keys);
             bool SIsMember(const DBID& db, const Slice& key, const Slice& value);
+            int SMIsMember(const DBID& db, const Slice& key, const SliceArray& values, std::vector<int>& exists);
             int SRem(const DBID& db, const Slice& key, const Slice& value);
             int SRem(const DBID& db, const Slice& key, const SliceArray& values);
             int SMove(const DBID& db, const Slice& src, const Slice& dst, const Slice& value);
@@ -674,6 +846,7 @@ namespace ardb
             int SUnion(const DBID& db, SliceArray& keys, ValueDataArray& values);
             int SUnionStore(const DBID& db, const Slice& dst, SliceArray& keys);
             int SClear(const DBID& db, const Slice& key);
+            int SCheck(const DBID& db, const Slice& key, bool repair, uint32& stored, uint32& counted);
 
             int GeoAdd(const DBID& db, const Slice& key, const GeoAddOptions& options);
             int GeoSearch(const DBID& db, const Slice& key, const GeoSearchOptions& options, ValueDataDeque& results);
@@ -687,6 +860,16 @@ namespace ardb
             int CacheEvict(const DBID& db, const Slice& key);
             int CacheStatus(const DBID& db, const Slice& key, std::string& status);
 
+            /*
+             * Deletes at most 'max_deletes' elements of lazily deleted keys, returns the number deleted.
+             */
+            uint32 ReapLazyFreeKeys(uint32 max_deletes);
+            uint32 GetLazyFreePendingKeys()
+            {
+                return m_lazy_free_key_count;
+            }
+            void TrackRawTombstone(const Slice& key, const Slice& value);
+
             int Type(const DBID& db, const Slice& key);
             int Sort(const DBID& db, const Slice& key, const StringArray& args, ValueDataArray& values);
             int FlushDB(const DBID& db);
@@ -720,6 +903,8 @@ namespace ardb
             {
                 return GetDBContext().last_error;
             }
+            void ClearDBContext();
+            void InvalidateL1Cache(const DBID& db, const Slice& key);
 
             bool DBExist(const DBID& db, DBID& nextdb);
             void GetAllDBIDSet(DBIDSet& dbs);
@@ -728,6 +913,32 @@ namespace ardb
              */
             int CheckExpireKey(const DBID& db, uint64 maxexec, uint32 maxcheckitems, ExpireKeyCallback* cb = NULL,
                     void* data = NULL);
+            /*
+             * Deletes the expired keys of all DBs in batches of 'batch_size' for at most 'maxexec' ms, 'cb' is
+             * called once per batch & DB with the deleted keys. Returns the number of keys deleted.
+             */
+            int ExpireKeys(uint32 batch_size, uint64 maxexec, ExpireKeysCallback* cb = NULL, void* data = NULL);
+            /*
+             * Number of loaded expirations which are due
+             */
+            uint32 GetExpireBacklog();
+            /*
+             * Drop the loaded expirations & load them again from the index, after raw writes which
+             * may have added index entries below the horizon in batches not committed yet.
+             */
+            void ResetExpireWheel();
+            /*
+             * How long after their expiration keys were deleted by the last ExpireKeys in ms, or the oldest
+             * due expiration is still waiting
+             */
+            uint64 GetExpireLag()
+            {
+                return m_expire_lag;
+            }
+            uint64 GetExpiredKeys()
+            {
+                return m_expired_keys;
+            }
     };
 }
 
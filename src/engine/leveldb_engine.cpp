@@ -31,6 +31,7 @@
 #include "data_format.hpp"
 #include "leveldb/env.h"
 #include <string.h>
+#include <algorithm>
 
 #define LEVELDB_SLICE(slice) leveldb::Slice(slice.data(), slice.size())
 #define ARDB_SLICE(slice) Slice(slice.data(), slice.size())
@@ -58,12 +59,12 @@ namespace ardb
 
     void LevelDBComparator::FindShortestSeparator(std::string* start, const leveldb::Slice& limit) const
     {
-        //DO nothing
+        ardb_shortest_separator(start, ARDB_SLICE(limit));
     }
 
     void LevelDBComparator::FindShortSuccessor(std::string* key) const
     {
-        //DO nothing
+        ardb_short_successor(key);
     }
 
     LevelDBEngineFactory::LevelDBEngineFactory(const Properties& props)
@@ -147,7 +148,7 @@ namespace ardb
     }
 
     LevelDBEngine::LevelDBEngine() :
-            m_db(NULL)
+            m_db(NULL), m_key_format(ARDB_KEY_FORMAT_LEGACY)
     {
 
     }
@@ -161,7 +162,11 @@ namespace ardb
     {
         m_cfg = cfg;
         m_options.create_if_missing = true;
-        m_options.comparator = &m_comparator;
+        m_key_format = detect_key_format(cfg.path, "CURRENT");
+        if (m_key_format == ARDB_KEY_FORMAT_LEGACY)
+        {
+            m_options.comparator = &m_comparator;
+        }
         if (cfg.block_cache_size > 0)
         {
             leveldb::Cache* cache = leveldb::NewLRUCache(cfg.block_cache_size);
@@ -219,6 +224,10 @@ namespace ardb
                 break;
             }
         } while (1);
+        if (status.ok())
+        {
+            save_key_format(cfg.path, m_key_format);
+        }
         return status.ok() ? 0 : -1;
     }
 
@@ -261,6 +270,81 @@ namespace ardb
         m_db->CompactRange(start, endpos);
     }
 
+    /*
+     * LevelDB can not pause file deletions. While writes are paused the live files & the sizes of the
+     * manifest & logs are recorded, then the tables are hard linked & the others copied up to the
+     * recorded sizes, the copied logs replace a memtable flush. A file deleted by a compaction
+     * meanwhile makes it retry.
+     */
+    int LevelDBEngine::Checkpoint(const std::string& dir, const std::string& base_dir, CheckpointPauseFunc* pause,
+            void* data)
+    {
+        for (uint32 retry = 0; retry < 10; retry++)
+        {
+            std::deque<std::string> files;
+            std::vector<int64> sizes;
+            pause(true, data);
+            int ret = list_subfiles(m_db_path, files);
+            for (uint32 i = 0; i < files.size() && 0 == ret; i++)
+            {
+                sizes.push_back(file_size(m_db_path + "/" + files[i]));
+                if (files[i] == "CURRENT")
+                {
+                    /*
+                     * Rewritten when a new manifest is started, keep the one naming the recorded manifest
+                     */
+                    ret = file_copy(m_db_path + "/" + files[i], dir + "/" + files[i]);
+                }
+            }
+            pause(false, data);
+            for (uint32 i = 0; i < files.size() && 0 == ret; i++)
+            {
+                const std::string& name = files[i];
+                if (name == "LOCK" || name == "CURRENT" || has_prefix(name, "LOG"))
+                {
+                    continue;
+                }
+                std::string src = m_db_path + "/" + name;
+                if (has_suffix(name, ".ldb") || has_suffix(name, ".sst"))
+                {
+                    if (!base_dir.empty() && file_size(base_dir + "/" + name) == file_size(src))
+                    {
+                        src = base_dir + "/" + name;
+                    }
+                    ret = file_link_or_copy(src, dir + "/" + name);
+                }
+                else
+                {
+                    ret = file_copy(src, dir + "/" + name, sizes[i]);
+                }
+                if (0 != ret && !is_file_exist(src))
+                {
+                    /*
+                     * Deleted by a compaction, retry with the new live files
+                     */
+                    ret = 1;
+                }
+            }
+            if (ret < 0)
+            {
+                ERROR_LOG("Failed to checkpoint %s into %s", m_db_path.c_str(), dir.c_str());
+                return -1;
+            }
+            if (0 == ret)
+            {
+                return 0;
+            }
+            files.clear();
+            list_subfiles(dir, files);
+            for (uint32 i = 0; i < files.size(); i++)
+            {
+                unlink((dir + "/" + files[i]).c_str());
+            }
+        }
+        ERROR_LOG("Failed to checkpoint %s while files keep changing.", m_db_path.c_str());
+        return -1;
+    }
+
     void LevelDBEngine::ContextHolder::Put(const Slice& key, const Slice& value)
     {
         batch.Put(LEVELDB_SLICE(key), LEVELDB_SLICE(value));
@@ -305,6 +389,82 @@ namespace ardb
         leveldb::Status s = m_db->Get(options, LEVELDB_SLICE(key), value);
         return s.ok() ? 0 : -1;
     }
+    struct LevelDBKeyIndexLess
+    {
+            const leveldb::Comparator* cmp;
+            const std::vector<Slice>& keys;
+            LevelDBKeyIndexLess(const leveldb::Comparator* c, const std::vector<Slice>& ks) :
+                    cmp(c), keys(ks)
+            {
+            }
+            bool operator()(uint32 a, uint32 b) const
+            {
+                return cmp->Compare(LEVELDB_SLICE(keys[a]), LEVELDB_SLICE(keys[b])) < 0;
+            }
+    };
+
+    /*
+     * LevelDB has no native multi get, read all keys from one snapshot with a single iterator
+     * visiting the keys in comparator order. A seek is skipped when the iterator already sits
+     * at or after the next key, so neighbour keys cost a key comparison instead of a seek.
+     */
+    int LevelDBEngine::MultiGet(const std::vector<Slice>& keys, std::vector<std::string>* values,
+            std::vector<int>* errs, bool fill_cache)
+    {
+        values->resize(keys.size());
+        errs->assign(keys.size(), -1);
+        if (keys.size() <= 1)
+        {
+            for (uint32 i = 0; i < keys.size(); i++)
+            {
+                (*errs)[i] = Get(keys[i], &((*values)[i]), fill_cache);
+            }
+            return 0;
+        }
+        std::vector<uint32> order(keys.size());
+        for (uint32 i = 0; i < keys.size(); i++)
+        {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), LevelDBKeyIndexLess(m_options.comparator, keys));
+
+        leveldb::ReadOptions options;
+        options.fill_cache = fill_cache;
+        ContextHolder& holder = m_context.GetValue();
+        const leveldb::Snapshot* snapshot = holder.snapshot;
+        if (NULL == snapshot)
+        {
+            snapshot = m_db->GetSnapshot();
+        }
+        options.snapshot = snapshot;
+        leveldb::Iterator* iter = m_db->NewIterator(options);
+        bool positioned = false;
+        for (uint32 i = 0; i < order.size(); i++)
+        {
+            leveldb::Slice target = LEVELDB_SLICE(keys[order[i]]);
+            if (positioned && !iter->Valid())
+            {
+                break;
+            }
+            if (!positioned || m_options.comparator->Compare(iter->key(), target) < 0)
+            {
+                iter->Seek(target);
+                positioned = true;
+            }
+            if (iter->Valid() && m_options.comparator->Compare(iter->key(), target) == 0)
+            {
+                (*values)[order[i]].assign(iter->value().data(), iter->value().size());
+                (*errs)[order[i]] = 0;
+            }
+        }
+        delete iter;
+        if (snapshot != holder.snapshot)
+        {
+            m_db->ReleaseSnapshot(snapshot);
+        }
+        return 0;
+    }
+
     int LevelDBEngine::Del(const Slice& key)
     {
         leveldb::Status s = leveldb::Status::OK();
@@ -354,13 +514,81 @@ namespace ardb
         }
     }
 
+    /*
+     * LevelDB exports no table properties, read the index block handle from every table's footer:
+     * metaindex handle & index handle as varint64 pairs padded to 40 bytes, then 8 bytes magic.
+     */
+    /*
+     * Only the footers of the tables not seen before are read, the sizes of deleted tables are dropped.
+     */
+    void LevelDBEngine::IndexBlockStats(uint64& sst_count, uint64& index_bytes)
+    {
+        static const uint64 kTableMagicNumber = 0xdb4775248b80fb57ull;
+        static const uint32 kFooterLength = 48;
+        static const uint32 kBlockTrailerSize = 5;
+        sst_count = 0;
+        index_bytes = 0;
+        std::deque<std::string> files;
+        list_subfiles(m_db_path, files);
+        LockGuard<ThreadMutex> guard(m_index_block_sizes_mutex);
+        IndexBlockSizeTable sizes;
+        for (uint32 i = 0; i < files.size(); i++)
+        {
+            uint64 number;
+            if ((!has_suffix(files[i], ".ldb") && !has_suffix(files[i], ".sst"))
+                    || !string_touint64(files[i].substr(0, files[i].size() - 4), number))
+            {
+                continue;
+            }
+            IndexBlockSizeTable::iterator found = m_index_block_sizes.find(number);
+            if (found != m_index_block_sizes.end())
+            {
+                sizes[number] = found->second;
+                continue;
+            }
+            std::string path = m_db_path + "/" + files[i];
+            FILE* fp = fopen(path.c_str(), "rb");
+            if (NULL == fp)
+            {
+                continue;
+            }
+            char footer[kFooterLength];
+            if (0 == fseek(fp, -(long) kFooterLength, SEEK_END) && fread(footer, kFooterLength, 1, fp) == 1)
+            {
+                Buffer buf(footer, 0, kFooterLength);
+                uint64 meta_offset, meta_size, index_offset, index_size, magic;
+                memcpy(&magic, footer + kFooterLength - 8, 8);
+                if (magic == kTableMagicNumber && BufferHelper::ReadVarUInt64(buf, meta_offset)
+                        && BufferHelper::ReadVarUInt64(buf, meta_size) && BufferHelper::ReadVarUInt64(buf, index_offset)
+                        && BufferHelper::ReadVarUInt64(buf, index_size))
+                {
+                    //a table still being written has no footer yet and is read again next time
+                    sizes[number] = index_size + kBlockTrailerSize;
+                }
+            }
+            fclose(fp);
+        }
+        m_index_block_sizes.swap(sizes);
+        IndexBlockSizeTable::iterator it = m_index_block_sizes.begin();
+        while (it != m_index_block_sizes.end())
+        {
+            sst_count++;
+            index_bytes += it->second;
+            it++;
+        }
+    }
+
     const std::string LevelDBEngine::Stats()
     {
         std::string str, version_info;
         version_info.append("LevelDB version:").append(stringfromll(leveldb::kMajorVersion)).append(".").append(
                 stringfromll(leveldb::kMinorVersion)).append("\r\n");
         m_db->GetProperty("leveldb.stats", &str);
-
+        uint64 sst_count, index_bytes;
+        IndexBlockStats(sst_count, index_bytes);
+        str.append("sst_index_block_bytes:").append(stringfromll(index_bytes)).append("\r\n");
+        str.append("sst_index_block_bytes_per_sst:").append(stringfromll(sst_count == 0 ? 0 : index_bytes / sst_count)).append(
+                "\r\n");
         return version_info + str;
     }
 
@@ -125,6 +125,7 @@ namespace ardb
         private:
             leveldb::DB* m_db;
             LevelDBComparator m_comparator;
+            uint8 m_key_format;
             struct ContextHolder
             {
                     leveldb::WriteBatch batch;
@@ -165,6 +166,13 @@ namespace ardb
             leveldb::Options m_options;
             friend class LevelDBEngineFactory;
             int FlushWriteBatch(ContextHolder& holder);
+            /*
+             * Index block bytes of the tables by file number, a table never changes once written
+             */
+            typedef TreeMap<uint64, uint64>::Type IndexBlockSizeTable;
+            IndexBlockSizeTable m_index_block_sizes;
+            ThreadMutex m_index_block_sizes_mutex;
+            void IndexBlockStats(uint64& sst_count, uint64& index_bytes);
         public:
             LevelDBEngine();
             ~LevelDBEngine();
@@ -176,8 +184,22 @@ namespace ardb
             int CommitBatchWrite();
             int DiscardBatchWrite();
             Iterator* Find(const Slice& findkey, bool cache);
+            int MultiGet(const std::vector<Slice>& keys, std::vector<std::string>* values, std::vector<int>* errs,
+                    bool fill_cache);
             const std::string Stats();
             void CompactRange(const Slice& begin, const Slice& end);
+            int Checkpoint(const std::string& dir, const std::string& base_dir, CheckpointPauseFunc* pause, void* data);
+            /*
+             * iterators read from the snapshot of the thread creating them
+             */
+            bool SupportParallelIterators()
+            {
+                return true;
+            }
+            uint8 GetKeyFormat()
+            {
+                return m_key_format;
+            }
             void ReleaseContextSnapshot();
     };
 
@@ -30,8 +30,10 @@
 #include "lmdb_engine.hpp"
 #include "data_format.hpp"
 #include "util/helpers.hpp"
+#include "util/atomic.hpp"
 #include <string.h>
 #include <unistd.h>
+#include <algorithm>
 
 namespace ardb
 {
@@ -40,7 +42,7 @@ namespace ardb
         return ardb_compare_keys((const char*) a->mv_data, a->mv_size, (const char*) b->mv_data, b->mv_size);
     }
     LMDBEngineFactory::LMDBEngineFactory(const Properties& props) :
-            m_env(NULL), m_env_opened(false)
+            m_env(NULL), m_env_opened(false), m_key_format(ARDB_KEY_FORMAT_LEGACY)
     {
         ParseConfig(props, m_cfg);
     }
@@ -57,6 +59,21 @@ namespace ardb
         conf_get_int64(props, "lmdb.database_max_size", cfg.max_db_size);
         conf_get_int64(props, "lmdb.batch_commit_watermark", cfg.batch_commit_watermark);
         conf_get_bool(props, "lmdb.readahead", cfg.readahead);
+        std::string durability;
+        conf_get_string(props, "lmdb.durability", durability);
+        if (!strcasecmp(durability.c_str(), "sync"))
+        {
+            cfg.durability = LMDB_SYNC;
+        }
+        else if (!strcasecmp(durability.c_str(), "async"))
+        {
+            cfg.durability = LMDB_ASYNC;
+        }
+        else if (!durability.empty() && strcasecmp(durability.c_str(), "nosync"))
+        {
+            WARN_LOG("Invalid lmdb.durability:%s, use 'nosync' instead.", durability.c_str());
+        }
+        conf_get_int64(props, "lmdb.max_commit_window", cfg.max_commit_window);
     }
 
     KeyValueEngine* LMDBEngineFactory::CreateDB(const std::string& name)
@@ -74,6 +91,7 @@ namespace ardb
             char tmp[m_cfg.path.size() + name.size() + 10];
             sprintf(tmp, "%s/%s", m_cfg.path.c_str(), name.c_str());
             m_cfg.path = tmp;
+            m_key_format = detect_key_format(m_cfg.path, "data.mdb");
             make_dir(m_cfg.path);
             int env_opt = MDB_NOSYNC | MDB_NOMETASYNC | MDB_WRITEMAP | MDB_MAPASYNC ;
             if(!m_cfg.readahead)
@@ -86,11 +104,12 @@ namespace ardb
                 ERROR_LOG("Failed to open mdb:%s", mdb_strerror(rc));
                 return NULL;
             }
+            save_key_format(m_cfg.path, m_key_format);
             m_env_opened = true;
         }
         LMDBEngine* engine = new LMDBEngine();
         LMDBConfig cfg = m_cfg;
-        if (engine->Init(cfg, m_env, name) != 0)
+        if (engine->Init(cfg, m_env, name, m_key_format) != 0)
         {
             DELETE(engine);
             return NULL;
@@ -115,7 +134,8 @@ namespace ardb
     }
 
     LMDBEngine::LMDBEngine() :
-            m_env(NULL), m_dbi(0),m_running(false),m_background(NULL)
+            m_env(NULL), m_dbi(0), m_key_format(ARDB_KEY_FORMAT_LEGACY), m_queue_depth(0), m_queued_writes(0), m_committed_queued_writes(0), m_inline_writer(0), m_group_active(
+                    false), m_unsynced(false), m_running(false), m_background(NULL), m_commit_window(0)
     {
     }
 
@@ -124,6 +144,96 @@ namespace ardb
         Close();
     }
 
+    /*
+     * Entries are copied in key order from a read transaction begun while writes are paused, appended
+     * into a new environment by write transactions of kCheckpointTxnEntries entries. The environment is
+     * one file, there is nothing to reuse from a previous checkpoint.
+     */
+    static const uint32 kCheckpointTxnEntries = 10000;
+    int LMDBEngine::Checkpoint(const std::string& dir, const std::string& base_dir, CheckpointPauseFunc* pause,
+            void* data)
+    {
+        MDB_txn* txn = NULL;
+        pause(true, data);
+        int rc = mdb_txn_begin(m_env, NULL, MDB_RDONLY, &txn);
+        pause(false, data);
+        if (rc != MDB_SUCCESS)
+        {
+            ERROR_LOG("Failed to create txn for checkpoint for reason:%s", mdb_strerror(rc));
+            return -1;
+        }
+        MDB_envinfo info;
+        mdb_env_info(m_env, &info);
+        MDB_env* env = NULL;
+        MDB_txn* dest_txn = NULL;
+        MDB_cursor* cursor = NULL;
+        MDB_dbi dbi;
+        mdb_env_create(&env);
+        rc = mdb_env_set_mapsize(env, info.me_mapsize);
+        if (MDB_SUCCESS == rc)
+        {
+            rc = mdb_env_open(env, dir.c_str(), MDB_NOSYNC, 0664);
+        }
+        if (MDB_SUCCESS == rc)
+        {
+            rc = mdb_txn_begin(env, NULL, 0, &dest_txn);
+        }
+        if (MDB_SUCCESS == rc)
+        {
+            rc = mdb_open(dest_txn, NULL, MDB_CREATE, &dbi);
+        }
+        if (MDB_SUCCESS == rc && m_key_format == ARDB_KEY_FORMAT_LEGACY)
+        {
+            mdb_set_compare(dest_txn, dbi, LMDBCompareFunc);
+        }
+        if (MDB_SUCCESS == rc)
+        {
+            rc = mdb_cursor_open(txn, m_dbi, &cursor);
+        }
+        MDB_val k, v;
+        MDB_cursor_op op = MDB_FIRST;
+        uint32 count = 0;
+        while (MDB_SUCCESS == rc && MDB_SUCCESS == (rc = mdb_cursor_get(cursor, &k, &v, op)))
+        {
+            op = MDB_NEXT;
+            rc = mdb_put(dest_txn, dbi, &k, &v, MDB_APPEND);
+            if (MDB_SUCCESS == rc && ++count % kCheckpointTxnEntries == 0)
+            {
+                rc = mdb_txn_commit(dest_txn);
+                dest_txn = NULL;
+                if (MDB_SUCCESS == rc)
+                {
+                    rc = mdb_txn_begin(env, NULL, 0, &dest_txn);
+                }
+            }
+        }
+        if (MDB_NOTFOUND == rc)
+        {
+            rc = mdb_txn_commit(dest_txn);
+            dest_txn = NULL;
+        }
+        if (MDB_SUCCESS == rc)
+        {
+            rc = mdb_env_sync(env, 1);
+        }
+        if (NULL != cursor)
+        {
+            mdb_cursor_close(cursor);
+        }
+        if (NULL != dest_txn)
+        {
+            mdb_txn_abort(dest_txn);
+        }
+        mdb_txn_abort(txn);
+        mdb_env_close(env);
+        if (rc != MDB_SUCCESS)
+        {
+            ERROR_LOG("Failed to copy mdb into %s:%s", dir.c_str(), mdb_strerror(rc));
+            return -1;
+        }
+        return file_copy(m_db_path + "/" + ARDB_KEY_FORMAT_FILE, dir + "/" + ARDB_KEY_FORMAT_FILE);
+    }
+
     const std::string LMDBEngine::Stats()
     {
         MDB_stat stat;
@@ -140,7 +250,13 @@ namespace ardb
             stat_info.append("branch pages:").append(stringfromll(stat.ms_branch_pages)).append("\r\n");
             stat_info.append("leaf pages:").append(stringfromll(stat.ms_leaf_pages)).append("\r\n");
             stat_info.append("overflow oages:").append(stringfromll(stat.ms_overflow_pages)).append("\r\n");
-            stat_info.append("data items:").append(stringfromll(stat.ms_entries));
+            stat_info.append("data items:").append(stringfromll(stat.ms_entries)).append("\r\n");
+            const char* durability[] = { "sync", "async", "nosync" };
+            stat_info.append("durability:").append(durability[m_cfg.durability]).append("\r\n");
+            stat_info.append("commit window(us):").append(stringfromll(m_commit_window)).append("\r\n");
+            stat_info.append("write queue depth:").append(m_queue_depth_hist.ToString()).append("\r\n");
+            stat_info.append("commit ops:").append(m_commit_ops_hist.ToString()).append("\r\n");
+            stat_info.append("commit latency(us):").append(m_commit_latency_hist.ToString());
             return stat_info;
         }
         else
@@ -150,78 +266,171 @@ namespace ardb
 
     }
 
+    /*
+     * Wait until a write operation is queued or the timeout expires.
+     */
+    void LMDBEngine::WaitWriteOperations(uint64 timeout_us)
+    {
+        m_queue_cond.Lock();
+        if (0 == m_queue_depth && m_running)
+        {
+            m_queue_cond.Wait(timeout_us, MICROS);
+        }
+        m_queue_cond.Unlock();
+    }
+
+    int LMDBEngine::ApplyWriteOperation(MDB_txn* txn, WriteOperation* op)
+    {
+        int rc = 0;
+        if (op->type == PUT_OP)
+        {
+            PutOperation* pop = (PutOperation*) op;
+            MDB_val k, v;
+            k.mv_data = const_cast<char*>(pop->key.data());
+            k.mv_size = pop->key.size();
+            v.mv_data = const_cast<char*>(pop->value.data());
+            v.mv_size = pop->value.size();
+            rc = mdb_put(txn, m_dbi, &k, &v, 0);
+            if (0 != rc)
+            {
+                ERROR_LOG("Write error:%s", mdb_strerror(rc));
+            }
+        }
+        else if (op->type == DEL_OP)
+        {
+            DelOperation* pop = (DelOperation*) op;
+            MDB_val k;
+            k.mv_data = const_cast<char*>(pop->key.data());
+            k.mv_size = pop->key.size();
+            mdb_del(txn, m_dbi, &k, NULL);
+        }
+        DELETE(op);
+        return rc;
+    }
+
+    /*
+     * Commit the write txn of 'count' operations and flush it as the durability mode requires.
+     */
+    int LMDBEngine::FinishCommit(MDB_txn* txn, int count)
+    {
+        uint64 start = get_current_epoch_micros();
+        int rc = mdb_txn_commit(txn);
+        if (0 != rc)
+        {
+            ERROR_LOG("Failed to commit %d writes for reason:%s", count, mdb_strerror(rc));
+        }
+        else if (count > 0)
+        {
+            if (m_cfg.durability == LMDB_SYNC)
+            {
+                rc = mdb_env_sync(m_env, 1);
+                if (0 != rc)
+                {
+                    ERROR_LOG("Failed to sync for reason:%s", mdb_strerror(rc));
+                }
+            }
+            else if (m_cfg.durability == LMDB_ASYNC)
+            {
+                m_unsynced = true;
+            }
+        }
+        uint64 cost = get_current_epoch_micros() - start;
+        m_commit_ops_hist.Add(count);
+        m_commit_latency_hist.Add(cost);
+        return rc;
+    }
+
+    /*
+     * Group commit: operations queued by all writers go into one write txn, the txn is committed
+     * (and flushed in sync mode) once, then all writers waiting on it are notified.
+     * While writers of several threads share a group the txn is held open a little longer for more of
+     * them, the window follows the last commit latency up to 'max_commit_window' microseconds.
+     */
     void LMDBEngine::Run()
     {
-        while (m_running)
+        std::vector<CheckPointOperation*> waiters;
+        uint64 last_sync = get_current_epoch_micros();
+        while (m_running || m_queue_depth > 0)
         {
+            if (m_unsynced && get_current_epoch_micros() - last_sync >= 1000000)
+            {
+                m_unsynced = false;
+                mdb_env_sync(m_env, 1);
+                last_sync = get_current_epoch_micros();
+            }
+            if (0 == m_queue_depth)
+            {
+                WaitWriteOperations(m_unsynced ? 1000000 : 100000);
+                continue;
+            }
+            m_queue_depth_hist.Add(m_queue_depth);
+            m_group_active = true;
             MDB_txn* txn;
             int rc = mdb_txn_begin(m_env, NULL, 0, &txn);
             if (rc != 0)
             {
+                m_group_active = false;
+                ERROR_LOG("Failed to create txn for write for reason:%s", mdb_strerror(rc));
                 Thread::Sleep(10, MILLIS);
                 continue;
             }
-            WriteOperation* op = NULL;
+            uint64 start = get_current_epoch_micros();
             int count = 0;
-            while (m_write_queue.Pop(op))
+            int err = 0;
+            while (count < m_cfg.batch_commit_watermark)
             {
-                switch (op->type)
+                WriteOperation* op = NULL;
+                if (!m_write_queue.Pop(op))
                 {
-                    case PUT_OP:
-                    {
-                        PutOperation* pop = (PutOperation*) op;
-                        MDB_val k, v;
-                        k.mv_data = const_cast<char*>(pop->key.data());
-                        k.mv_size = pop->key.size();
-                        v.mv_data = const_cast<char*>(pop->value.data());
-                        v.mv_size = pop->value.size();
-                        int rc = mdb_put(txn, m_dbi, &k, &v, 0);
-                        if(0 != rc)
-                        {
-                            ERROR_LOG("Write error:%s", mdb_strerror(rc));
-                        }
-                        DELETE(op);
-                        break;
-                    }
-                    case DEL_OP:
+                    if (m_queue_depth > 0)
                     {
-                        DelOperation* pop = (DelOperation*) op;
-                        MDB_val k;
-                        k.mv_data = const_cast<char*>(pop->key.data());
-                        k.mv_size = pop->key.size();
-                        mdb_del(txn, m_dbi, &k, NULL);
-                        DELETE(op);
-                        break;
+                        //a writer is still linking its operation
+                        continue;
                     }
-                    case CKP_OP:
+                    uint64 waited = get_current_epoch_micros() - start;
+                    if (waiters.size() > 1 && waited < m_commit_window)
                     {
-                        mdb_txn_commit(txn);
-                        txn = NULL;
-                        CheckPointOperation* cop = (CheckPointOperation*) op;
-                        cop->Notify();
-                        break;
-                    }
-                    default:
-                    {
-                        break;
+                        WaitWriteOperations(m_commit_window - waited);
+                        if (m_queue_depth > 0)
+                        {
+                            continue;
+                        }
                     }
+                    break;
                 }
-                count++;
-                if (count == m_cfg.batch_commit_watermark || NULL == txn)
+                atomic_sub_uint32(&m_queue_depth, 1);
+                if (op->type == CKP_OP)
                 {
-                    break;
+                    waiters.push_back((CheckPointOperation*) op);
+                    continue;
                 }
+                rc = ApplyWriteOperation(txn, op);
+                if (0 != rc)
+                {
+                    err = rc;
+                }
+                count++;
             }
-            if (NULL != txn)
+            uint64 commit_start = get_current_epoch_micros();
+            rc = FinishCommit(txn, count);
+            if (0 != rc)
             {
-                mdb_txn_commit(txn);
+                err = rc;
             }
-            if (count == 0)
+            m_committed_queued_writes += count;
+            uint64 commit_cost = get_current_epoch_micros() - commit_start;
+            m_commit_window = waiters.size() > 1 ? std::min((uint64) m_cfg.max_commit_window, commit_cost) : 0;
+            m_group_active = false;
+            for (uint32 i = 0; i < waiters.size(); i++)
             {
-                m_queue_cond.Lock();
-                m_queue_cond.Wait(5);
-                m_queue_cond.Unlock();
+                waiters[i]->err = 0 == err ? 0 : -1;
+                waiters[i]->Notify();
             }
+            waiters.clear();
+        }
+        if (m_unsynced)
+        {
+            mdb_env_sync(m_env, 1);
         }
     }
 
@@ -245,6 +454,7 @@ namespace ardb
     void LMDBEngine::Close()
     {
         m_running = false;
+        NotifyBackgroundThread();
         DELETE(m_background);
         if (0 != m_dbi)
         {
@@ -253,9 +463,11 @@ namespace ardb
         }
     }
 
-    int LMDBEngine::Init(const LMDBConfig& cfg, MDB_env *env, const std::string& name)
+    int LMDBEngine::Init(const LMDBConfig& cfg, MDB_env *env, const std::string& name, uint8 key_format)
     {
         m_env = env;
+        m_key_format = key_format;
+        m_db_path = cfg.path;
         MDB_txn *txn;
         int rc = mdb_txn_begin(env, NULL, 0, &txn);
         rc = mdb_open(txn, NULL, MDB_CREATE, &m_dbi);
@@ -264,7 +476,10 @@ namespace ardb
             ERROR_LOG("Failed to open mdb:%s for reason:%s\n", name.c_str(), mdb_strerror(rc));
             return -1;
         }
-        mdb_set_compare(txn, m_dbi, LMDBCompareFunc);
+        if (m_key_format == ARDB_KEY_FORMAT_LEGACY)
+        {
+            mdb_set_compare(txn, m_dbi, LMDBCompareFunc);
+        }
         mdb_txn_commit(txn);
         m_running = true;
         m_background = new Thread(this);
@@ -284,11 +499,7 @@ namespace ardb
         holder.batch_write--;
         if (holder.batch_write == 0)
         {
-            CheckPointOperation* ck = new CheckPointOperation(holder.cond);
-            m_write_queue.Push(ck);
-            NotifyBackgroundThread();
-            ck->Wait();
-            DELETE(ck);
+            return CommitWrites(holder);
         }
         return 0;
     }
@@ -298,11 +509,12 @@ namespace ardb
         holder.batch_write--;
         if (holder.batch_write == 0)
         {
-            CheckPointOperation* ck = new CheckPointOperation(holder.cond);
-            m_write_queue.Push(ck);
-            NotifyBackgroundThread();
-            ck->Wait();
-            DELETE(ck);
+            for (uint32 i = 0; i < holder.batch.size(); i++)
+            {
+                DELETE(holder.batch[i]);
+            }
+            holder.batch.clear();
+            holder.queued = false;
         }
         return 0;
     }
@@ -325,36 +537,150 @@ namespace ardb
         m_queue_cond.Unlock();
     }
 
+    /*
+     * The depth is counted before the operation is linked, so the write thread never sleeps while an
+     * operation is being queued.
+     */
+    void LMDBEngine::PushWriteOperation(WriteOperation* op)
+    {
+        uint32 depth = atomic_add_uint32(&m_queue_depth, 1);
+        if (op->type != CKP_OP)
+        {
+            atomic_add_uint64(&m_queued_writes, 1);
+        }
+        m_write_queue.Push(op);
+        if (op->type == CKP_OP || depth >= (uint32) m_cfg.batch_commit_watermark)
+        {
+            NotifyBackgroundThread();
+        }
+    }
+
+    void LMDBEngine::QueueWrites(LMDBContext& holder)
+    {
+        for (uint32 i = 0; i < holder.batch.size(); i++)
+        {
+            PushWriteOperation(holder.batch[i]);
+        }
+        holder.queued = holder.queued || !holder.batch.empty();
+        holder.batch.clear();
+    }
+
+    /*
+     * Block until all operations queued by the current thread are committed.
+     */
+    int LMDBEngine::WaitWriteCommitted()
+    {
+        LMDBContext& holder = m_ctx_local.GetValue();
+        CheckPointOperation* ck = new CheckPointOperation(holder.cond);
+        PushWriteOperation(ck);
+        ck->Wait();
+        int err = ck->err;
+        DELETE(ck);
+        return err;
+    }
+
+    /*
+     * An uncontended writer commits in its own thread. Writers arriving while another commit is running
+     * queue their operations for the write thread's next group, as do threads holding a read txn which
+     * can not begin a write txn.
+     */
+    bool LMDBEngine::BeginInlineWrite(LMDBContext& holder, MDB_txn*& txn)
+    {
+        if (NULL != holder.readonly_txn || 0 != m_queue_depth || m_group_active
+                || !atomic_cmp_set_uint32(&m_inline_writer, 0, 1))
+        {
+            return false;
+        }
+        int rc = mdb_txn_begin(m_env, NULL, 0, &txn);
+        if (0 != rc)
+        {
+            m_inline_writer = 0;
+            ERROR_LOG("Failed to create txn for write for reason:%s", mdb_strerror(rc));
+            return false;
+        }
+        return true;
+    }
+
+    int LMDBEngine::EndInlineWrite(MDB_txn* txn, int count, int err)
+    {
+        int rc = FinishCommit(txn, count);
+        m_inline_writer = 0;
+        return 0 == err && 0 == rc ? 0 : -1;
+    }
+
+    int LMDBEngine::CommitWrites(LMDBContext& holder)
+    {
+        if (holder.queued)
+        {
+            /*
+             * the rest follows the part queued at the watermark, & it's done once the write thread commits it
+             */
+            QueueWrites(holder);
+            holder.queued = false;
+            return WaitWriteCommitted();
+        }
+        if (holder.batch.empty())
+        {
+            return 0;
+        }
+        MDB_txn* txn;
+        if (BeginInlineWrite(holder, txn))
+        {
+            int count = holder.batch.size();
+            int err = 0;
+            for (uint32 i = 0; i < holder.batch.size(); i++)
+            {
+                int rc = ApplyWriteOperation(txn, holder.batch[i]);
+                if (0 != rc)
+                {
+                    err = rc;
+                }
+            }
+            holder.batch.clear();
+            return EndInlineWrite(txn, count, err);
+        }
+        QueueWrites(holder);
+        holder.queued = false;
+        return WaitWriteCommitted();
+    }
+
+    int LMDBEngine::Write(WriteOperation* op)
+    {
+        LMDBContext& holder = m_ctx_local.GetValue();
+        holder.batch.push_back(op);
+        if (holder.batch_write > 0)
+        {
+            if (holder.batch.size() >= (uint32) m_cfg.batch_commit_watermark)
+            {
+                QueueWrites(holder);
+            }
+            return 0;
+        }
+        return CommitWrites(holder);
+    }
+
     int LMDBEngine::Put(const Slice& key, const Slice& value)
     {
         LMDBContext& holder = m_ctx_local.GetValue();
-        MDB_txn *txn = holder.readonly_txn;
-        if (NULL == txn || holder.batch_write == 0)
+        MDB_txn* txn;
+        if (0 == holder.batch_write && holder.batch.empty() && BeginInlineWrite(holder, txn))
         {
             MDB_val k, v;
             k.mv_data = const_cast<char*>(key.data());
             k.mv_size = key.size();
             v.mv_data = const_cast<char*>(value.data());
             v.mv_size = value.size();
-            mdb_txn_begin(m_env, NULL, 0, &txn);
-            mdb_put(txn, m_dbi, &k, &v, 0);
-            mdb_txn_commit(txn);
-            return 0;
+            int rc = mdb_put(txn, m_dbi, &k, &v, 0);
+            if (0 != rc)
+            {
+                ERROR_LOG("Write error:%s", mdb_strerror(rc));
+            }
+            return EndInlineWrite(txn, 1, rc);
         }
         PutOperation* op = new PutOperation;
         op->key.assign((const char*) key.data(), key.size());
         op->value.assign((const char*) value.data(), value.size());
-        m_write_queue.Push(op);
-        if (holder.batch_write == 0)
-        {
-            CheckPointOperation* ck = new CheckPointOperation(holder.cond);
-            m_write_queue.Push(ck);
-            NotifyBackgroundThread();
-            ck->Wait();
-            DELETE(ck);
-            return 0;
-        }
-        return 0;
+        return Write(op);
     }
     int LMDBEngine::Get(const Slice& key, std::string* value, bool fill_cache)
     {
@@ -384,33 +710,95 @@ namespace ardb
         }
         return rc;
     }
-    int LMDBEngine::Del(const Slice& key)
+    struct LMDBKeyIndexLess
     {
+            MDB_txn* txn;
+            MDB_dbi dbi;
+            const std::vector<Slice>& keys;
+            LMDBKeyIndexLess(MDB_txn* t, MDB_dbi d, const std::vector<Slice>& ks) :
+                    txn(t), dbi(d), keys(ks)
+            {
+            }
+            bool operator()(uint32 a, uint32 b) const
+            {
+                MDB_val ka, kb;
+                ka.mv_data = const_cast<char*>(keys[a].data());
+                ka.mv_size = keys[a].size();
+                kb.mv_data = const_cast<char*>(keys[b].data());
+                kb.mv_size = keys[b].size();
+                return mdb_cmp(txn, dbi, &ka, &kb) < 0;
+            }
+    };
+
+    /*
+     * One read txn for the whole batch, keys are looked up in tree order by a single cursor
+     * so consecutive lookups mostly touch pages already in cache.
+     */
+    int LMDBEngine::MultiGet(const std::vector<Slice>& keys, std::vector<std::string>* values,
+            std::vector<int>* errs, bool fill_cache)
+    {
+        values->resize(keys.size());
+        errs->assign(keys.size(), -1);
+        int rc;
         LMDBContext& holder = m_ctx_local.GetValue();
         MDB_txn *txn = holder.readonly_txn;
-        if (NULL == txn || holder.batch_write == 0)
+        if (NULL == holder.readonly_txn)
+        {
+            rc = mdb_txn_begin(m_env, NULL, MDB_RDONLY, &txn);
+            if (rc != 0)
+            {
+                ERROR_LOG("Failed to create txn for multi get for reason:%s", mdb_strerror(rc));
+                return -1;
+            }
+        }
+        MDB_cursor *cursor = NULL;
+        rc = mdb_cursor_open(txn, m_dbi, &cursor);
+        if (0 == rc)
+        {
+            std::vector<uint32> order(keys.size());
+            for (uint32 i = 0; i < keys.size(); i++)
+            {
+                order[i] = i;
+            }
+            std::sort(order.begin(), order.end(), LMDBKeyIndexLess(txn, m_dbi, keys));
+            for (uint32 i = 0; i < order.size(); i++)
+            {
+                MDB_val k, v;
+                k.mv_data = const_cast<char*>(keys[order[i]].data());
+                k.mv_size = keys[order[i]].size();
+                if (0 == mdb_cursor_get(cursor, &k, &v, MDB_SET) && NULL != v.mv_data)
+                {
+                    (*values)[order[i]].assign((const char*) v.mv_data, v.mv_size);
+                    (*errs)[order[i]] = 0;
+                }
+            }
+            mdb_cursor_close(cursor);
+        }
+        else
+        {
+            ERROR_LOG("Failed to create cursor for reason:%s", mdb_strerror(rc));
+        }
+        if (NULL == holder.readonly_txn)
+        {
+            mdb_txn_commit(txn);
+        }
+        return rc == 0 ? 0 : -1;
+    }
+    int LMDBEngine::Del(const Slice& key)
+    {
+        LMDBContext& holder = m_ctx_local.GetValue();
+        MDB_txn* txn;
+        if (0 == holder.batch_write && holder.batch.empty() && BeginInlineWrite(holder, txn))
         {
             MDB_val k;
             k.mv_data = const_cast<char*>(key.data());
             k.mv_size = key.size();
-            mdb_txn_begin(m_env, NULL, 0, &txn);
             mdb_del(txn, m_dbi, &k, NULL);
-            mdb_txn_commit(txn);
-            return 0;
+            return EndInlineWrite(txn, 1, 0);
         }
         DelOperation* op = new DelOperation;
         op->key.assign((const char*) key.data(), key.size());
-        m_write_queue.Push(op);
-        if (holder.batch_write == 0)
-        {
-            CheckPointOperation* ck = new CheckPointOperation(holder.cond);
-            m_write_queue.Push(ck);
-            NotifyBackgroundThread();
-            ck->Wait();
-            DELETE(ck);
-            return 0;
-        }
-        return 0;
+        return Write(op);
     }
 
     Iterator* LMDBEngine::Find(const Slice& findkey, bool cache)
@@ -439,7 +827,10 @@ namespace ardb
             CloseTransaction();
             return NULL;
         }
-        rc = mdb_cursor_get(cursor, &k, &data, MDB_SET_RANGE);
+        /*
+         * LMDB rejects an empty key, which is before all keys
+         */
+        rc = mdb_cursor_get(cursor, &k, &data, findkey.empty() ? MDB_FIRST : MDB_SET_RANGE);
         LMDBIterator* iter = new LMDBIterator(this, cursor, rc == 0);
         return iter;
     }
@@ -458,7 +849,7 @@ namespace ardb
     {
         m_key.mv_data = const_cast<char*>(target.data());
         m_key.mv_size = target.size();
-        int rc = mdb_cursor_get(m_cursor, &m_key, &m_value, MDB_SET_RANGE);
+        int rc = mdb_cursor_get(m_cursor, &m_key, &m_value, target.empty() ? MDB_FIRST : MDB_SET_RANGE);
         m_valid = rc == 0;
     }
 
@@ -38,6 +38,7 @@
 #include "util/thread/thread_mutex_lock.hpp"
 #include "util/thread/event_condition.hpp"
 #include "util/concurrent_queue.hpp"
+#include "util/histogram.hpp"
 #include <stack>
 
 namespace ardb
@@ -73,14 +74,28 @@ namespace ardb
             ~LMDBIterator();
     };
 
+    /*
+     * When a write returns relative to the disk flush of its commit:
+     * sync:   after the flush
+     * async:  after the commit, the write thread flushes at most one second later
+     * nosync: after the commit, flushing is left to the OS
+     */
+    enum LMDBDurability
+    {
+        LMDB_SYNC = 0, LMDB_ASYNC, LMDB_NOSYNC
+    };
+
     struct LMDBConfig
     {
             std::string path;
             int64 max_db_size;
             int64 batch_commit_watermark;
             bool readahead;
+            LMDBDurability durability;
+            int64 max_commit_window;
             LMDBConfig() :
-                    max_db_size(10 * 1024 * 1024 * 1024LL), batch_commit_watermark(1024),readahead(false)
+                    max_db_size(10 * 1024 * 1024 * 1024LL), batch_commit_watermark(1024),readahead(false), durability(
+                            LMDB_NOSYNC), max_commit_window(1000)
             {
             }
     };
@@ -121,12 +136,17 @@ namespace ardb
             }
     };
 
+    /*
+     * Completion a writer waits on, notified once every operation it queued before is committed
+     * (and flushed in sync mode), 'err' is the result of that commit.
+     */
     struct CheckPointOperation: public WriteOperation
     {
             EventCondition& cond;
             bool execed;
+            int err;
             CheckPointOperation(EventCondition& c) :
-                    WriteOperation(CKP_OP),cond(c),execed(false)
+                    WriteOperation(CKP_OP),cond(c),execed(false),err(0)
             {
             }
             void Notify()
@@ -146,14 +166,18 @@ namespace ardb
         private:
             MDB_env *m_env;
             MDB_dbi m_dbi;
+            uint8 m_key_format;
             struct LMDBContext
             {
                     MDB_txn *readonly_txn;
                     uint32 batch_write;
                     uint32 readonly_txn_ref;
                     EventCondition cond;
+                    std::vector<WriteOperation*> batch;
+                    //part of the batch is queued to the write thread already
+                    bool queued;
                     LMDBContext() :
-                            readonly_txn(NULL),batch_write(0),readonly_txn_ref(0)
+                            readonly_txn(NULL),batch_write(0),readonly_txn_ref(0),queued(false)
                     {
                     }
             };
@@ -163,17 +187,37 @@ namespace ardb
             LMDBConfig m_cfg;
 
             MPSCQueue<WriteOperation*> m_write_queue;
+            volatile uint32_t m_queue_depth;
+            volatile uint64_t m_queued_writes;
+            volatile uint64_t m_committed_queued_writes;
+            volatile uint32_t m_inline_writer;
+            volatile bool m_group_active;
+            volatile bool m_unsynced;
             ThreadMutexLock m_queue_cond;
             volatile bool m_running;
             Thread* m_background;
+            uint64 m_commit_window;
+            Histogram m_queue_depth_hist;
+            Histogram m_commit_ops_hist;
+            Histogram m_commit_latency_hist;
             friend class LMDBIterator;
             void Run();
             void CloseTransaction();
             void NotifyBackgroundThread();
+            void PushWriteOperation(WriteOperation* op);
+            void QueueWrites(LMDBContext& holder);
+            int WaitWriteCommitted();
+            void WaitWriteOperations(uint64 timeout_us);
+            int ApplyWriteOperation(MDB_txn* txn, WriteOperation* op);
+            int FinishCommit(MDB_txn* txn, int count);
+            bool BeginInlineWrite(LMDBContext& holder, MDB_txn*& txn);
+            int EndInlineWrite(MDB_txn* txn, int count, int err);
+            int CommitWrites(LMDBContext& holder);
+            int Write(WriteOperation* op);
         public:
             LMDBEngine();
             ~LMDBEngine();
-            int Init(const LMDBConfig& cfg, MDB_env *env, const std::string& name);
+            int Init(const LMDBConfig& cfg, MDB_env *env, const std::string& name, uint8 key_format);
             int Put(const Slice& key, const Slice& value);
             int Get(const Slice& key, std::string* value, bool fill_cache);
             int Del(const Slice& key);
@@ -181,7 +225,25 @@ namespace ardb
             int CommitBatchWrite();
             int DiscardBatchWrite();
             const std::string Stats();
+            int Checkpoint(const std::string& dir, const std::string& base_dir, CheckpointPauseFunc* pause, void* data);
             Iterator* Find(const Slice& findkey, bool cache);
+            int MultiGet(const std::vector<Slice>& keys, std::vector<std::string>* values, std::vector<int>* errs,
+                    bool fill_cache);
+            uint8 GetKeyFormat()
+            {
+                return m_key_format;
+            }
+            /*
+             * Write operations handed over to the write thread so far, & those of them it committed
+             */
+            uint64 QueuedWrites()
+            {
+                return m_queued_writes;
+            }
+            uint64 CommittedQueuedWrites()
+            {
+                return m_committed_queued_writes;
+            }
             void Close();
             void Clear();
 
@@ -193,6 +255,7 @@ namespace ardb
             LMDBConfig m_cfg;
             MDB_env *m_env;
             bool m_env_opened;
+            uint8 m_key_format;
             static void ParseConfig(const Properties& props, LMDBConfig& cfg);
         public:
             LMDBEngineFactory(const Properties& cfg);
@@ -31,6 +31,7 @@
 #include "data_format.hpp"
 #include "util/helpers.hpp"
 #include "rocksdb/env.h"
+#include "rocksdb/table_properties.h"
 #include <string.h>
 #include <stdarg.h>
 
@@ -60,10 +61,39 @@ namespace ardb
 
     void RocksDBComparator::FindShortestSeparator(std::string* start, const rocksdb::Slice& limit) const
     {
+        ardb_shortest_separator(start, ARDB_SLICE(limit));
     }
 
     void RocksDBComparator::FindShortSuccessor(std::string* key) const
     {
+        ardb_short_successor(key);
+    }
+
+    bool RocksDBMergeOperator::FullMerge(const rocksdb::Slice& key, const rocksdb::Slice* existing_value,
+            const std::deque<std::string>& operand_list, std::string* new_value, rocksdb::Logger* logger) const
+    {
+        Slice existing;
+        if (NULL != existing_value)
+        {
+            existing = ARDB_SLICE((*existing_value));
+        }
+        std::vector<Slice> operands(operand_list.size());
+        for (uint32 i = 0; i < operand_list.size(); i++)
+        {
+            operands[i] = operand_list[i];
+        }
+        if (!ardb_merge_value(NULL != existing_value ? &existing : NULL, operands, *new_value))
+        {
+            ERROR_LOG("Failed to merge %u operands.", operands.size());
+            return false;
+        }
+        return true;
+    }
+
+    bool RocksDBMergeOperator::PartialMerge(const rocksdb::Slice& key, const rocksdb::Slice& left_operand,
+            const rocksdb::Slice& right_operand, std::string* new_value, rocksdb::Logger* logger) const
+    {
+        return ardb_merge_operands(ARDB_SLICE(left_operand), ARDB_SLICE(right_operand), *new_value);
     }
 
     RocksDBEngineFactory::RocksDBEngineFactory(const Properties& props)
@@ -148,7 +178,7 @@ namespace ardb
     }
 
     RocksDBEngine::RocksDBEngine() :
-            m_db(NULL)
+            m_db(NULL), m_key_format(ARDB_KEY_FORMAT_LEGACY)
     {
 
     }
@@ -160,7 +190,11 @@ namespace ardb
     {
         m_cfg = cfg;
         m_options.create_if_missing = true;
-        m_options.comparator = &m_comparator;
+        m_key_format = detect_key_format(cfg.path, "CURRENT");
+        if (m_key_format == ARDB_KEY_FORMAT_LEGACY)
+        {
+            m_options.comparator = &m_comparator;
+        }
         if (cfg.block_cache_size > 0)
         {
             m_options.block_cache = rocksdb::NewLRUCache(cfg.block_cache_size);
@@ -197,6 +231,7 @@ namespace ardb
         m_options.IncreaseParallelism();
 
         m_options.info_log.reset(new RocksDBLogger);
+        m_options.merge_operator.reset(new RocksDBMergeOperator);
         make_dir(cfg.path);
         m_db_path = cfg.path;
         rocksdb::Status status = rocksdb::DB::Open(m_options, cfg.path.c_str(), &m_db);
@@ -223,6 +258,10 @@ namespace ardb
                 break;
             }
         } while (1);
+        if (status.ok())
+        {
+            save_key_format(cfg.path, m_key_format);
+        }
         return status.ok() ? 0 : -1;
     }
 
@@ -265,6 +304,72 @@ namespace ardb
         m_db->CompactRange(start, endpos);
     }
 
+    /*
+     * While writes are paused the live files & the sizes of the manifest & the alive logs are recorded
+     * without a memtable flush, the copied logs are replayed when the checkpoint is opened. File
+     * deletions stay disabled until all are copied.
+     */
+    int RocksDBEngine::Checkpoint(const std::string& dir, const std::string& base_dir, CheckpointPauseFunc* pause,
+            void* data)
+    {
+        rocksdb::Status s = m_db->DisableFileDeletions();
+        if (!s.ok())
+        {
+            ERROR_LOG("Failed to disable file deletions:%s", s.ToString().c_str());
+            return -1;
+        }
+        std::vector<std::string> live_files;
+        uint64_t manifest_size = 0;
+        rocksdb::VectorLogPtr logs;
+        pause(true, data);
+        s = m_db->GetLiveFiles(live_files, &manifest_size, false);
+        if (s.ok())
+        {
+            s = m_db->GetSortedWalFiles(logs);
+        }
+        pause(false, data);
+        int ret = s.ok() ? 0 : -1;
+        for (uint32 i = 0; i < live_files.size() && 0 == ret; i++)
+        {
+            std::string src = m_db_path + live_files[i];
+            std::string dest = dir + live_files[i];
+            if (has_prefix(live_files[i], "/MANIFEST"))
+            {
+                ret = file_copy(src, dest, manifest_size);
+            }
+            else if (live_files[i] == "/CURRENT")
+            {
+                ret = file_copy(src, dest);
+            }
+            else
+            {
+                if (!base_dir.empty() && file_size(base_dir + live_files[i]) == file_size(src))
+                {
+                    src = base_dir + live_files[i];
+                }
+                ret = file_link_or_copy(src, dest);
+            }
+        }
+        for (uint32 i = 0; i < logs.size() && 0 == ret; i++)
+        {
+            if (logs[i]->Type() == rocksdb::kAliveLogFile)
+            {
+                ret = file_copy(m_db_path + logs[i]->PathName(), dir + logs[i]->PathName(),
+                        logs[i]->SizeFileBytes());
+            }
+        }
+        if (0 == ret)
+        {
+            ret = file_copy(m_db_path + "/" + ARDB_KEY_FORMAT_FILE, dir + "/" + ARDB_KEY_FORMAT_FILE);
+        }
+        m_db->EnableFileDeletions(false);
+        if (0 != ret)
+        {
+            ERROR_LOG("Failed to checkpoint %s into %s", m_db_path.c_str(), dir.c_str());
+        }
+        return ret;
+    }
+
     void RocksDBEngine::ContextHolder::Put(const Slice& key, const Slice& value)
     {
         batch.Put(ROCKSDB_SLICE(key), ROCKSDB_SLICE(value));
@@ -276,6 +381,12 @@ namespace ardb
         count++;
     }
 
+    void RocksDBEngine::ContextHolder::Merge(const Slice& key, const Slice& operand)
+    {
+        batch.Merge(ROCKSDB_SLICE(key), ROCKSDB_SLICE(operand));
+        count++;
+    }
+
     int RocksDBEngine::Put(const Slice& key, const Slice& value)
     {
         rocksdb::Status s = rocksdb::Status::OK();
@@ -294,6 +405,24 @@ namespace ardb
         }
         return s.ok() ? 0 : -1;
     }
+    int RocksDBEngine::Merge(const Slice& key, const Slice& operand)
+    {
+        rocksdb::Status s = rocksdb::Status::OK();
+        ContextHolder& holder = m_context.GetValue();
+        if (!holder.EmptyRef())
+        {
+            holder.Merge(key, operand);
+            if (holder.count >= (uint32) m_cfg.batch_commit_watermark)
+            {
+                FlushWriteBatch(holder);
+            }
+        }
+        else
+        {
+            s = m_db->Merge(rocksdb::WriteOptions(), ROCKSDB_SLICE(key), ROCKSDB_SLICE(operand));
+        }
+        return s.ok() ? 0 : -1;
+    }
     int RocksDBEngine::Get(const Slice& key, std::string* value, bool fill_cache)
     {
         rocksdb::ReadOptions options;
@@ -304,6 +433,27 @@ namespace ardb
         rocksdb::Status s = m_db->Get(options, ROCKSDB_SLICE(key), value);
         return s.ok() ? 0 : -1;
     }
+    int RocksDBEngine::MultiGet(const std::vector<Slice>& keys, std::vector<std::string>* values,
+            std::vector<int>* errs, bool fill_cache)
+    {
+        rocksdb::ReadOptions options;
+        options.fill_cache = fill_cache;
+        options.verify_checksums = false;
+        ContextHolder& holder = m_context.GetValue();
+        options.snapshot = holder.snapshot;
+        std::vector<rocksdb::Slice> ks(keys.size());
+        for (uint32 i = 0; i < keys.size(); i++)
+        {
+            ks[i] = ROCKSDB_SLICE(keys[i]);
+        }
+        std::vector<rocksdb::Status> ss = m_db->MultiGet(options, ks, values);
+        errs->resize(keys.size());
+        for (uint32 i = 0; i < ss.size(); i++)
+        {
+            (*errs)[i] = ss[i].ok() ? 0 : -1;
+        }
+        return 0;
+    }
     int RocksDBEngine::Del(const Slice& key)
     {
         rocksdb::Status s = rocksdb::Status::OK();
@@ -358,6 +508,20 @@ namespace ardb
         std::string str, version_info;
 
         m_db->GetProperty("rocksdb.stats", &str);
+        rocksdb::TablePropertiesCollection props;
+        uint64 index_bytes = 0;
+        if (m_db->GetPropertiesOfAllTables(&props).ok())
+        {
+            rocksdb::TablePropertiesCollection::iterator it = props.begin();
+            while (it != props.end())
+            {
+                index_bytes += it->second->index_size;
+                it++;
+            }
+        }
+        str.append("sst_index_block_bytes:").append(stringfromll(index_bytes)).append("\r\n");
+        str.append("sst_index_block_bytes_per_sst:").append(stringfromll(props.empty() ? 0 : index_bytes / props.size())).append(
+                "\r\n");
         version_info.append("RocksDB version:").append(stringfromll(rocksdb::kMajorVersion)).append(".").append(
                 stringfromll(rocksdb::kMinorVersion)).append(".").append(stringfromll(ROCKSDB_PATCH)).append("\r\n");
         return version_info + str;
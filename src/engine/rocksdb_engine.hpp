@@ -34,6 +34,7 @@
 #include "rocksdb/comparator.h"
 #include "rocksdb/cache.h"
 #include "rocksdb/filter_policy.h"
+#include "rocksdb/merge_operator.h"
 
 #include "db.hpp"
 #include "util/config_helper.hpp"
@@ -103,6 +104,23 @@ namespace ardb
             void FindShortSuccessor(std::string* key) const;
     };
 
+    /*
+     * Resolves the merge operands written by Ardb::Merge* against ardb encoded values
+     */
+    class RocksDBMergeOperator: public rocksdb::MergeOperator
+    {
+        public:
+            bool FullMerge(const rocksdb::Slice& key, const rocksdb::Slice* existing_value,
+                    const std::deque<std::string>& operand_list, std::string* new_value,
+                    rocksdb::Logger* logger) const;
+            bool PartialMerge(const rocksdb::Slice& key, const rocksdb::Slice& left_operand,
+                    const rocksdb::Slice& right_operand, std::string* new_value, rocksdb::Logger* logger) const;
+            const char* Name() const
+            {
+                return "ArdbMergeOperator";
+            }
+    };
+
     struct RocksDBConfig
     {
             std::string path;
@@ -128,6 +146,7 @@ namespace ardb
         private:
             rocksdb::DB* m_db;
             RocksDBComparator m_comparator;
+            uint8 m_key_format;
             struct ContextHolder
             {
                     rocksdb::WriteBatch batch;
@@ -156,6 +175,7 @@ namespace ardb
                     }
                     void Put(const Slice& key, const Slice& value);
                     void Del(const Slice& key);
+                    void Merge(const Slice& key, const Slice& operand);
                     ContextHolder() :
                             ref(0), count(0), snapshot(NULL), snapshot_ref(0)
                     {
@@ -175,12 +195,31 @@ namespace ardb
             int Put(const Slice& key, const Slice& value);
             int Get(const Slice& key, std::string* value, bool fill_cache);
             int Del(const Slice& key);
+            bool SupportMerge()
+            {
+                return true;
+            }
+            int Merge(const Slice& key, const Slice& operand);
             int BeginBatchWrite();
             int CommitBatchWrite();
             int DiscardBatchWrite();
             Iterator* Find(const Slice& findkey, bool cache);
+            int MultiGet(const std::vector<Slice>& keys, std::vector<std::string>* values, std::vector<int>* errs,
+                    bool fill_cache);
             const std::string Stats();
             void CompactRange(const Slice& begin, const Slice& end);
+            int Checkpoint(const std::string& dir, const std::string& base_dir, CheckpointPauseFunc* pause, void* data);
+            /*
+             * iterators read from the snapshot of the thread creating them
+             */
+            bool SupportParallelIterators()
+            {
+                return true;
+            }
+            uint8 GetKeyFormat()
+            {
+                return m_key_format;
+            }
             void ReleaseContextSnapshot();
     };
 
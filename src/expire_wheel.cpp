@@ -0,0 +1,266 @@
+/*
+ *Copyright (c) 2013-2013, yinqiwen <yinqiwen@gmail.com>
+ *All rights reserved.
+ * 
+ *Redistribution and use in source and binary forms, with or without
+ *modification, are permitted provided that the following conditions are met:
+ * 
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Redis nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ * 
+ *THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS 
+ *BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ *THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "db.hpp"
+
+namespace ardb
+{
+    /*
+     * Expirations of the next 60s are loaded, loading stops at 10000 entries per load or 2000000 in the wheel.
+     */
+    static const uint64 kExpireLoadAhead = 60 * 1000 * 1000;
+    static const uint32 kExpireLoadLimit = 10000;
+    static const uint32 kExpireWheelLimit = 2000000;
+
+    static inline uint64 expire_tick(uint64 expireat)
+    {
+        return (expireat + 999) / 1000;
+    }
+
+    void Ardb::AddExpireWheelKey(const DBID& db, const Slice& key, uint64 expireat)
+    {
+        if (0 == expireat || expireat >= m_expire_horizon)
+        {
+            //loaded from the index later
+            return;
+        }
+        LockGuard<SpinMutexLock> guard(m_expire_wheel_lock);
+        if (expireat < m_expire_horizon)
+        {
+            m_expire_wheel.Add(expire_tick(expireat), ExpireWheelKey(db, key, expireat));
+        }
+    }
+
+    /*
+     * Loads the index entries from the horizon on, the horizon is moved ahead before reading so that
+     * expirations set meanwhile are added to the wheel, they may be loaded twice which is harmless.
+     */
+    void Ardb::LoadExpireWheel(uint64 now)
+    {
+        uint64 from = m_expire_horizon;
+        uint64 target = now + kExpireLoadAhead;
+        {
+            LockGuard<SpinMutexLock> guard(m_expire_wheel_lock);
+            m_expire_horizon = target;
+        }
+        DBIDSet dbs;
+        GetAllDBIDSet(dbs);
+        std::deque<ExpireWheelKey> loaded;
+        uint32 count = 0;
+        DBIDSet::iterator it = dbs.begin();
+        while (it != dbs.end())
+        {
+            DBID db = *it;
+            uint32 db_count = 0;
+            uint64 last = 0;
+            Slice empty;
+            ExpireKeyObject start(empty, from, db);
+            /*
+             * Not filling the block cache, the index is read once
+             */
+            Iterator* iter = FindValue(start, false);
+            while (NULL != iter && iter->Valid())
+            {
+                KeyObject* kk = decode_key(iter->Key(), NULL);
+                if (NULL == kk || kk->type != KEY_EXPIRATION_ELEMENT || kk->db != db)
+                {
+                    DELETE(kk);
+                    break;
+                }
+                ExpireKeyObject* ek = (ExpireKeyObject*) kk;
+                if (ek->expireat >= target)
+                {
+                    DELETE(kk);
+                    break;
+                }
+                /*
+                 * Stop between two expire times, every DB loads its first one at least so the horizon moves on.
+                 */
+                if (db_count > 0 && count >= kExpireLoadLimit && ek->expireat != last)
+                {
+                    target = ek->expireat;
+                    DELETE(kk);
+                    break;
+                }
+                loaded.push_back(ExpireWheelKey(db, ek->key, ek->expireat));
+                last = ek->expireat;
+                count++;
+                db_count++;
+                DELETE(kk);
+                iter->Next();
+            }
+            DELETE(iter);
+            it++;
+        }
+        LockGuard<SpinMutexLock> guard(m_expire_wheel_lock);
+        m_expire_horizon = target;
+        m_expire_wheel.Advance(now / 1000);
+        while (!loaded.empty())
+        {
+            ExpireWheelKey& key = loaded.front();
+            if (key.expireat < target)
+            {
+                m_expire_wheel.Add(expire_tick(key.expireat), key);
+            }
+            loaded.pop_front();
+        }
+    }
+
+    /*
+     * Deletes the keys whose meta still has the expiration of the entry in one write batch, 'lag' is set
+     * to the longest time a key is deleted after its expiration.
+     */
+    int Ardb::ExpireWheelKeys(const std::deque<ExpireWheelKey>& keys, uint64& lag, ExpireKeysCallback* cb,
+            void* data)
+    {
+        typedef TreeMap<DBID, SliceArray>::Type DBKeys;
+        DBKeys expired_keys;
+        int expired = 0;
+        uint64 now = get_current_epoch_micros();
+        {
+            BatchWriteGuard guard(GetEngine());
+            std::deque<ExpireWheelKey>::const_iterator it = keys.begin();
+            while (it != keys.end())
+            {
+                const ExpireWheelKey& key = *it;
+                it++;
+                CommonMetaValue* meta = GetMeta(key.db, key.key, true, false);
+                if (NULL == meta)
+                {
+                    continue;
+                }
+                uint64 expireat = meta->header.expireat;
+                DELETE(meta);
+                if (expireat != key.expireat)
+                {
+                    /*
+                     * Expiration changed, or the key was overwritten without dropping its index entry.
+                     */
+                    ExpireKeyObject stale(key.key, key.expireat, key.db);
+                    DelValue(stale);
+                    continue;
+                }
+                if (expireat > now)
+                {
+                    continue;
+                }
+                if (now - expireat > lag)
+                {
+                    lag = now - expireat;
+                }
+                Del(key.db, key.key);
+                expired_keys[key.db].push_back(key.key);
+                expired++;
+            }
+        }
+        if (NULL != cb)
+        {
+            DBKeys::iterator it = expired_keys.begin();
+            while (it != expired_keys.end())
+            {
+                cb(it->first, it->second, data);
+                it++;
+            }
+        }
+        return expired;
+    }
+
+    int Ardb::ExpireKeys(uint32 batch_size, uint64 maxexec, ExpireKeysCallback* cb, void* data)
+    {
+        LockGuard<ThreadMutex> guard(m_expire_mutex);
+        uint64 start = get_current_epoch_millis();
+        int expired = 0;
+        uint64 lag = 0;
+        while (true)
+        {
+            uint64 now = get_current_epoch_micros();
+            bool load = false;
+            {
+                LockGuard<SpinMutexLock> guard(m_expire_wheel_lock);
+                load = m_expire_horizon < now + kExpireLoadAhead / 2 && m_expire_wheel.Size() < kExpireWheelLimit
+                        && m_expire_wheel.ReadySize() < kExpireLoadLimit;
+            }
+            if (load)
+            {
+                LoadExpireWheel(now);
+            }
+            std::deque<ExpireWheelKey> batch;
+            {
+                LockGuard<SpinMutexLock> guard(m_expire_wheel_lock);
+                m_expire_wheel.Advance(now / 1000);
+                ExpireTimingWheel::Entry entry;
+                while (batch.size() < batch_size && m_expire_wheel.PopReady(entry))
+                {
+                    batch.push_back(entry.second);
+                }
+            }
+            if (batch.empty())
+            {
+                break;
+            }
+            expired += ExpireWheelKeys(batch, lag, cb, data);
+            if (get_current_epoch_millis() - start >= maxexec)
+            {
+                break;
+            }
+        }
+        uint64 now = get_current_epoch_micros();
+        {
+            LockGuard<SpinMutexLock> guard(m_expire_wheel_lock);
+            const ExpireTimingWheel::Entry* oldest = m_expire_wheel.PeekReady();
+            if (NULL != oldest && oldest->second.expireat < now && now - oldest->second.expireat > lag)
+            {
+                lag = now - oldest->second.expireat;
+            }
+            if (m_expire_horizon < now && now - m_expire_horizon > lag)
+            {
+                //not loaded up to now yet
+                lag = now - m_expire_horizon;
+            }
+        }
+        m_expire_lag = lag / 1000;
+        m_expired_keys += expired;
+        return expired;
+    }
+
+    void Ardb::ResetExpireWheel()
+    {
+        LockGuard<ThreadMutex> guard(m_expire_mutex);
+        LockGuard<SpinMutexLock> wheel_guard(m_expire_wheel_lock);
+        m_expire_horizon = 0;
+        m_expire_wheel.Clear(get_current_epoch_millis());
+    }
+
+    uint32 Ardb::GetExpireBacklog()
+    {
+        LockGuard<SpinMutexLock> guard(m_expire_wheel_lock);
+        m_expire_wheel.Advance(get_current_epoch_millis());
+        return m_expire_wheel.ReadySize();
+    }
+}
@@ -35,33 +35,33 @@ namespace ardb
 {
     int ArdbServer::HMSet(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
-        if ((cmd.GetArguments().size() - 1) % 2 != 0)
+        if ((cmd.GetArgumentCount() - 1) % 2 != 0)
         {
             fill_error_reply(ctx.reply, "wrong number of arguments for HMSet");
             return 0;
         }
         SliceArray fs;
         SliceArray vals;
-        for (uint32 i = 1; i < cmd.GetArguments().size(); i += 2)
+        for (uint32 i = 1; i < cmd.GetArgumentCount(); i += 2)
         {
-            fs.push_back(cmd.GetArguments()[i]);
-            vals.push_back(cmd.GetArguments()[i + 1]);
+            fs.push_back(cmd.GetArgumentSlice(i));
+            vals.push_back(cmd.GetArgumentSlice(i + 1));
         }
-        int ret = m_db->HMSet(ctx.currentDB, cmd.GetArguments()[0], fs, vals);
+        int ret = m_db->HMSet(ctx.currentDB, cmd.GetArgumentSlice(0), fs, vals);
         CHECK_ARDB_RETURN_VALUE(ctx.reply, ret);
         fill_status_reply(ctx.reply, "OK");
         return 0;
     }
     int ArdbServer::HSet(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
-        int ret = m_db->HSet(ctx.currentDB, cmd.GetArguments()[0], cmd.GetArguments()[1], cmd.GetArguments()[2]);
+        int ret = m_db->HSet(ctx.currentDB, cmd.GetArgumentSlice(0), cmd.GetArgumentSlice(1), cmd.GetArgumentSlice(2));
         CHECK_ARDB_RETURN_VALUE(ctx.reply, ret);
         fill_int_reply(ctx.reply, 1);
         return 0;
     }
     int ArdbServer::HSetNX(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
-        int ret = m_db->HSetNX(ctx.currentDB, cmd.GetArguments()[0], cmd.GetArguments()[1], cmd.GetArguments()[2]);
+        int ret = m_db->HSetNX(ctx.currentDB, cmd.GetArgumentSlice(0), cmd.GetArgumentSlice(1), cmd.GetArgumentSlice(2));
         CHECK_ARDB_RETURN_VALUE(ctx.reply, ret);
         fill_int_reply(ctx.reply, ret);
         return 0;
@@ -201,6 +201,11 @@ namespace ardb
             fill_error_reply(ctx.reply, "value is not an integer or out of range");
             return 0;
         }
+        if (ctx.reply_discarded)
+        {
+            m_db->MergeHIncrby(ctx.currentDB, cmd.GetArguments()[0], cmd.GetArguments()[1], increment);
+            return 0;
+        }
         int ret = m_db->HIncrby(ctx.currentDB, cmd.GetArguments()[0], cmd.GetArguments()[1], increment, val);
         CHECK_ARDB_RETURN_VALUE(ctx.reply, ret);
         fill_int_reply(ctx.reply, val);
@@ -355,18 +360,62 @@ namespace ardb
     }
     int Ardb::HSet(const DBID& db, const Slice& key, const Slice& field, const Slice& value)
     {
-        int err = 0;
+        KeyLockerGuard keyguard(m_key_locker, db, key);
+        L1CacheSyncGuard cache_guard(GetDBContext());
         bool createHash = false;
-        HashMetaValue* meta = GetHashMeta(db, key, err, createHash);
-        if (NULL == meta)
-        {
-            return err;
-        }
         CommonValueObject valueobject;
         valueobject.data.SetValue(value, true);
         HashKeyObject hk(key, field, db);
-        int ret = HSetValue(hk, meta, valueobject) == 0 ? 1 : 0;
-        DELETE(meta);
+        std::string raw;
+        ZipMetaView zip;
+        int err = GetZipMeta(db, key, HASH_META, raw, zip);
+        if (0 != err && ERR_NOT_EXIST != err)
+        {
+            return err;
+        }
+        int ret = 0;
+        std::string patched;
+        bool inserted = false;
+        /*
+         * splice the field into the raw zipped meta if it would stay zipped
+         */
+        if (0 == err && zip.IsIndexed() && zip.Count() < (uint32) m_config.hash_max_ziplist_entries
+                && (hk.field.type != BYTES_VALUE
+                        || valueobject.data.bytes_value.size() < (uint32) m_config.hash_max_ziplist_value)
+                && zip.Upsert(hk.field, &valueobject.data, patched, inserted))
+        {
+            KeyObject metakey(key, KEY_META, db);
+            ret = SetRawMeta(metakey, patched) == 0 ? 1 : 0;
+        }
+        else
+        {
+            HashMetaValue* meta = NULL;
+            if (0 == err)
+            {
+                meta = (HashMetaValue*) decode_meta(raw.data(), raw.size(), false);
+                if (NULL == meta)
+                {
+                    return ERR_INVALID_TYPE;
+                }
+            }
+            else
+            {
+                meta = new HashMetaValue;
+                createHash = true;
+            }
+            ret = HSetValue(hk, meta, valueobject) == 0 ? 1 : 0;
+            DELETE(meta);
+        }
+        if (ret > 0)
+        {
+            HashCache* cache = (HashCache*) GetWriteCache(db, key, HASH_META,
+                    createHash && m_config.hash_write_fill_cache);
+            if (NULL != cache)
+            {
+                cache->Set(hk.field, valueobject.data);
+                m_level1_cahce->Recycle(cache);
+            }
+        }
         return ret;
     }
 
@@ -425,17 +474,20 @@ namespace ardb
     int Ardb::HGetValue(HashKeyObject& key, HashMetaValue* meta, CommonValueObject& value)
     {
         int err = 0;
-        bool createHash = false;
-        bool createMeta = false;
         if (NULL == meta)
         {
-            meta = GetHashMeta(key.db, key.key, err, createHash);
-            createMeta = true;
-            if (NULL == meta || createHash)
+            std::string raw;
+            ZipMetaView zip;
+            err = GetZipMeta(key.db, key.key, HASH_META, raw, zip);
+            if (0 != err)
             {
-                DELETE(meta);
                 return err;
             }
+            if (zip.IsZiped())
+            {
+                return zip.Find(key.field, &value.data) ? 0 : ERR_NOT_EXIST;
+            }
+            return GetKeyValueObject(key, value);
         }
 
         if (meta->ziped)
@@ -455,15 +507,18 @@ namespace ardb
         {
             err = GetKeyValueObject(key, value);
         }
-        if (createMeta)
-        {
-            DELETE(meta);
-        }
         return err;
     }
 
     int Ardb::HIterate(const DBID& db, const Slice& key, ValueVisitCallback* cb, void* cbdata)
     {
+        HashCache* cache = (HashCache*) GetReadCache(db, key, HASH_META);
+        if (NULL != cache)
+        {
+            uint32 size = cache->Visit(cb, cbdata);
+            m_level1_cahce->Recycle(cache);
+            return size == 0 ? ERR_NOT_EXIST : 0;
+        }
         int err = 0;
         bool createHash = false;
         HashMetaValue* meta = GetHashMeta(db, key, err, createHash);
@@ -525,6 +580,18 @@ namespace ardb
     int Ardb::HGet(const DBID& db, const Slice& key, const Slice& field, std::string* value)
     {
         HashKeyObject hk(key, field, db);
+        HashCache* cache = (HashCache*) GetReadCache(db, key, HASH_META);
+        if (NULL != cache)
+        {
+            ValueData v;
+            int ret = cache->Get(hk.field, v);
+            m_level1_cahce->Recycle(cache);
+            if (0 == ret && NULL != value)
+            {
+                v.ToString(*value);
+            }
+            return ret;
+        }
         CommonValueObject valueObj;
         int ret = HGetValue(hk, NULL, valueObj);
         if (ret == 0)
@@ -544,6 +611,8 @@ namespace ardb
         {
             return ERR_INVALID_ARGS;
         }
+        KeyLockerGuard keyguard(m_key_locker, db, key);
+        L1CacheSyncGuard cache_guard(GetDBContext());
         int err = 0;
         bool createHash = false;
         HashMetaValue* meta = GetHashMeta(db, key, err, createHash);
@@ -552,51 +621,81 @@ namespace ardb
             DELETE(meta);
             return err;
         }
-        BatchWriteGuard guard(GetEngine());
-        SliceArray::const_iterator it = fields.begin();
-        SliceArray::const_iterator sit = values.begin();
-        while (it != fields.end())
         {
-            CommonValueObject valueobject;
-            valueobject.data.SetValue(*sit, true);
-            HashKeyObject hk(key, *it, db);
-            HSetValue(hk, meta, valueobject);
-            it++;
-            sit++;
+            BatchWriteGuard guard(GetEngine());
+            SliceArray::const_iterator it = fields.begin();
+            SliceArray::const_iterator sit = values.begin();
+            while (it != fields.end())
+            {
+                CommonValueObject valueobject;
+                valueobject.data.SetValue(*sit, true);
+                HashKeyObject hk(key, *it, db);
+                HSetValue(hk, meta, valueobject);
+                it++;
+                sit++;
+            }
         }
         DELETE(meta);
+        HashCache* cache = (HashCache*) GetWriteCache(db, key, HASH_META, createHash && m_config.hash_write_fill_cache);
+        if (NULL != cache)
+        {
+            for (uint32 i = 0; i < fields.size(); i++)
+            {
+                cache->Set(ValueData(fields[i]), ValueData(values[i]));
+            }
+            m_level1_cahce->Recycle(cache);
+        }
         return 0;
     }
 
     int Ardb::HMGet(const DBID& db, const Slice& key, const SliceArray& fields, ValueDataArray& values)
     {
         values.resize(fields.size());
-        int err = 0;
-        bool createHash = false;
-        HashMetaValue* meta = NULL;
-        if (NULL == meta)
+        HashCache* cache = (HashCache*) GetReadCache(db, key, HASH_META);
+        if (NULL != cache)
         {
-            meta = GetHashMeta(db, key, err, createHash);
-            if (NULL == meta || createHash)
+            for (uint32 i = 0; i < fields.size(); i++)
             {
-                DELETE(meta);
-                return err;
+                cache->Get(ValueData(fields[i]), values[i]);
+            }
+            m_level1_cahce->Recycle(cache);
+            return 0;
+        }
+        std::string raw;
+        ZipMetaView zip;
+        int err = GetZipMeta(db, key, HASH_META, raw, zip);
+        if (0 != err)
+        {
+            return err;
+        }
+        if (zip.IsZiped())
+        {
+            for (uint32 i = 0; i < fields.size(); i++)
+            {
+                zip.Find(ValueData(fields[i]), &values[i]);
             }
         }
-        SliceArray::const_iterator it = fields.begin();
-        int i = 0;
-        while (it != fields.end())
+        else
         {
-            HashKeyObject hk(key, *it, db);
-            CommonValueObject valueObj;
-            int ret = HGetValue(hk, NULL, valueObj);
-            if (ret == 0)
+            std::deque<HashKeyObject> hks;
+            std::vector<const KeyObject*> ks;
+            for (uint32 i = 0; i < fields.size(); i++)
             {
-                values[i] = valueObj.data;
-                //return 0;
+                hks.push_back(HashKeyObject(key, fields[i], db));
+                ks.push_back(&(hks.back()));
+            }
+            std::vector<std::string> raws;
+            std::vector<int> errs;
+            GetRawValues(ks, raws, errs);
+            for (uint32 i = 0; i < fields.size(); i++)
+            {
+                CommonValueObject valueObj;
+                Buffer buffer(const_cast<char*>(raws[i].data()), 0, raws[i].size());
+                if (0 == errs[i] && valueObj.Decode(buffer))
+                {
+                    values[i] = valueObj.data;
+                }
             }
-            it++;
-            i++;
         }
         return 0;
     }
@@ -687,6 +786,13 @@ namespace ardb
 
     int Ardb::HLen(const DBID& db, const Slice& key)
     {
+        HashCache* cache = (HashCache*) GetReadCache(db, key, HASH_META);
+        if (NULL != cache)
+        {
+            int len = cache->Size();
+            m_level1_cahce->Recycle(cache);
+            return len;
+        }
         int err = 0;
         bool createHash = false;
         HashMetaValue* meta = GetHashMeta(db, key, err, createHash);
@@ -765,6 +871,7 @@ namespace ardb
 
     int Ardb::HIncrby(const DBID& db, const Slice& key, const Slice& field, int64_t increment, int64_t& value)
     {
+        KeyLockerGuard keyguard(m_key_locker, db, key);
         int err = 0;
         bool createHash = false;
         HashMetaValue* meta = GetHashMeta(db, key, err, createHash);
@@ -796,6 +903,39 @@ namespace ardb
         return ret;
     }
 
+    int Ardb::MergeHIncrby(const DBID& db, const Slice& key, const Slice& field, int64_t increment)
+    {
+        int64_t value;
+        if (!GetEngine()->SupportMerge())
+        {
+            return HIncrby(db, key, field, increment, value);
+        }
+        KeyLockerGuard keyguard(m_key_locker, db, key);
+        int err = 0;
+        bool createHash = false;
+        HashMetaValue* meta = GetHashMeta(db, key, err, createHash);
+        if (NULL == meta)
+        {
+            return err;
+        }
+        if (meta->ziped)
+        {
+            DELETE(meta);
+            return HIncrby(db, key, field, increment, value);
+        }
+        BatchWriteGuard guard(GetEngine());
+        if (!meta->dirty)
+        {
+            meta->dirty = true;
+            SetMeta(db, key, *meta);
+        }
+        DELETE(meta);
+        HashKeyObject hk(key, field, db);
+        Buffer op;
+        encode_merge_operand(op, ARDB_MERGE_VALUE_INCRBY, ValueData((int64) increment));
+        return MergeRawValue(hk, Slice(op.GetRawReadBuffer(), op.ReadableBytes()));
+    }
+
     int Ardb::HMIncrby(const DBID& db, const Slice& key, const SliceArray& fields, const Int64Array& increments,
             Int64Array& vs)
     {
@@ -819,6 +959,7 @@ namespace ardb
 
     int Ardb::HIncrbyFloat(const DBID& db, const Slice& key, const Slice& field, double increment, double& value)
     {
+        KeyLockerGuard keyguard(m_key_locker, db, key);
         int err = 0;
         bool createHash = false;
         HashMetaValue* meta = GetHashMeta(db, key, err, createHash);
@@ -35,14 +35,34 @@
 namespace ardb
 {
     //=======================================ArdbServer=====================================================
+    /*
+     * Raw writes bypass the typed write paths, so the L1 cache entry and the cached meta of the decoded key
+     * are dropped here after the write.
+     */
+    static void InvalidateRawKey(Ardb* db, const Slice& rawkey)
+    {
+        KeyObject* k = decode_key(rawkey, NULL);
+        if (NULL != k)
+        {
+            db->InvalidateL1Cache(k->db, k->key);
+            if (k->type == KEY_META && NULL != db->GetMetaCache())
+            {
+                db->GetMetaCache()->Erase(k->db, k->key);
+            }
+            DELETE(k);
+        }
+    }
     int ArdbServer::RawSet(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
         m_db->RawSet(cmd.GetArguments()[0], cmd.GetArguments()[1]);
+        InvalidateRawKey(m_db, cmd.GetArguments()[0]);
+        m_db->TrackRawTombstone(cmd.GetArguments()[0], cmd.GetArguments()[1]);
         return 0;
     }
     int ArdbServer::RawDel(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
         m_db->RawDel(cmd.GetArguments()[0]);
+        InvalidateRawKey(m_db, cmd.GetArguments()[0]);
         return 0;
     }
     int ArdbServer::KeysCount(ArdbConnContext& ctx, RedisCommandFrame& cmd)
@@ -366,10 +386,17 @@ namespace ardb
             watcher.on_key_update(key.db, key.key, watcher.on_key_update_data);
         }
         watcher.data_changed = true;
+        InvalidateL1Cache(key.db, key.key);
         Buffer keybuf(key.key.size() + 16);
         encode_key(keybuf, key);
         Slice k(keybuf.GetRawReadBuffer(), keybuf.ReadableBytes());
-        return RawDel(k);
+        int ret = RawDel(k);
+        if (key.type == KEY_META)
+        {
+            Slice deleted;
+            UpdateMetaCache(key, 0 == ret ? &deleted : NULL);
+        }
+        return ret;
     }
 
     int Ardb::MSet(const DBID& db, SliceArray& keys, SliceArray& values)
@@ -386,7 +413,15 @@ namespace ardb
             KeyObject keyobject(*kit, KEY_META, db);
             StringMetaValue meta;
             meta.value.SetValue(*vit, false);
-            SetMeta(keyobject, meta);
+            if (NULL != m_meta_cache)
+            {
+                KeyLockerGuard keyguard(m_key_locker, db, *kit);
+                SetMeta(keyobject, meta);
+            }
+            else
+            {
+                SetMeta(keyobject, meta);
+            }
             kit++;
             vit++;
         }
@@ -399,24 +434,28 @@ namespace ardb
         {
             return ERR_INVALID_ARGS;
         }
+        /*
+         * check all keys before writing, so no meta written by the batch has to be discarded from the meta cache
+         */
         SliceArray::iterator kit = keys.begin();
-        SliceArray::iterator vit = values.begin();
-        BatchWriteGuard guard(GetEngine());
         while (kit != keys.end())
         {
-            if (!Exists(db, *kit))
-            {
-                KeyObject keyobject(*kit, KEY_META, db);
-                StringMetaValue meta;
-                meta.value.SetValue(*vit, false);
-                SetMeta(keyobject, meta);
-            }
-            else
+            if (Exists(db, *kit))
             {
-                guard.MarkFailed();
                 return -1;
             }
             kit++;
+        }
+        kit = keys.begin();
+        SliceArray::iterator vit = values.begin();
+        BatchWriteGuard guard(GetEngine());
+        while (kit != keys.end())
+        {
+            KeyObject keyobject(*kit, KEY_META, db);
+            StringMetaValue meta;
+            meta.value.SetValue(*vit, false);
+            SetMeta(keyobject, meta);
+            kit++;
             vit++;
         }
         return keys.size();
@@ -460,7 +499,46 @@ namespace ardb
         StringMetaValue smeta;
         smeta.value.SetValue(value, false);
         smeta.header.expireat = expireat;
-        return SetMeta(db, key, smeta);
+        if (NULL == m_level1_cahce || expireat > 0)
+        {
+            if (expireat > 0)
+            {
+                /*
+                 * indexed like SetExpiration so that the key is expired actively, an index entry of a
+                 * former expiration is dropped when it fires.
+                 */
+                ExpireKeyObject keyobject(key, expireat, db);
+                EmptyValueObject empty;
+                SetKeyValueObject(keyobject, empty);
+                AddExpireWheelKey(db, key, expireat);
+            }
+            if (NULL == m_meta_cache)
+            {
+                return SetMeta(db, key, smeta);
+            }
+            /*
+             * concurrent writers of a key must update the meta cache in the order they write the engine
+             */
+            KeyLockerGuard keyguard(m_key_locker, db, key);
+            return SetMeta(db, key, smeta);
+        }
+        KeyLockerGuard keyguard(m_key_locker, db, key);
+        L1CacheSyncGuard cache_guard(GetDBContext());
+        int ret = SetMeta(db, key, smeta);
+        if (0 == ret)
+        {
+            StringCache* cache = (StringCache*) GetWriteCache(db, key, STRING_META, m_config.string_write_fill_cache);
+            if (NULL != cache)
+            {
+                cache->Set(value);
+                m_level1_cahce->Recycle(cache);
+            }
+        }
+        else
+        {
+            m_level1_cahce->Invalidate(db, key, false);
+        }
+        return ret;
     }
 
     int Ardb::Set(const DBID& db, const Slice& key, const Slice& value)
@@ -484,6 +562,13 @@ namespace ardb
 
     int Ardb::Get(const DBID& db, const Slice& key, std::string& value)
     {
+        StringCache* cache = (StringCache*) GetReadCache(db, key, STRING_META);
+        if (NULL != cache)
+        {
+            cache->Get(value);
+            m_level1_cahce->Recycle(cache);
+            return 0;
+        }
         CommonMetaValue* meta = GetMeta(db, key, false);
         if (NULL != meta)
         {
@@ -502,13 +587,84 @@ namespace ardb
 
     int Ardb::MGet(const DBID& db, SliceArray& keys, StringArray& values)
     {
-        SliceArray::iterator it = keys.begin();
-        while (it != keys.end())
+        std::vector<int> errs;
+        return MGet(db, keys, values, errs);
+    }
+
+    /*
+     * All meta values not in the L1 cache are read by one engine MultiGet, errs[i] is what Get would
+     * return for keys[i].
+     */
+    int Ardb::MGet(const DBID& db, const SliceArray& keys, StringArray& values, std::vector<int>& errs)
+    {
+        errs.assign(keys.size(), ERR_NOT_EXIST);
+        std::vector<std::string> cached_values;
+        if (NULL != m_level1_cahce)
+        {
+            cached_values.resize(keys.size());
+            for (uint32 i = 0; i < keys.size(); i++)
+            {
+                StringCache* cache = (StringCache*) GetReadCache(db, keys[i], STRING_META);
+                if (NULL != cache)
+                {
+                    cache->Get(cached_values[i]);
+                    m_level1_cahce->Recycle(cache);
+                    errs[i] = 0;
+                }
+            }
+        }
+        std::deque<KeyObject> metakeys;
+        std::vector<const KeyObject*> ks;
+        for (uint32 i = 0; i < keys.size(); i++)
+        {
+            if (0 != errs[i])
+            {
+                metakeys.push_back(KeyObject(keys[i], KEY_META, db));
+                ks.push_back(&(metakeys.back()));
+            }
+        }
+        std::vector<std::string> raws;
+        std::vector<int> raw_errs;
+        if (!ks.empty())
+        {
+            GetRawValues(ks, raws, raw_errs);
+        }
+        uint32 raw_idx = 0;
+        for (uint32 i = 0; i < keys.size(); i++)
         {
             std::string v;
-            Get(db, *it, v);
+            CommonMetaValue* meta = NULL;
+            if (0 == errs[i])
+            {
+                values.push_back(cached_values[i]);
+                continue;
+            }
+            uint32 j = raw_idx++;
+            if (0 == raw_errs[j] && raws[j].size() > 1)
+            {
+                meta = decode_meta(raws[j].data(), raws[j].size(), false);
+            }
+            if (NULL != meta)
+            {
+                if (meta->header.expireat > 0 && meta->header.expireat < get_current_epoch_micros())
+                {
+                    /*
+                     * Let the single key path delete the expired key & propagate the 'del'
+                     */
+                    errs[i] = Get(db, keys[i], v);
+                }
+                else if (meta->header.type != STRING_META)
+                {
+                    errs[i] = ERR_INVALID_TYPE;
+                }
+                else
+                {
+                    ((StringMetaValue*) meta)->value.ToString(v);
+                    errs[i] = 0;
+                }
+                DELETE(meta);
+            }
             values.push_back(v);
-            it++;
         }
         return 0;
     }
@@ -520,6 +676,20 @@ namespace ardb
         {
             return -1;
         }
+        if (m_config.lazy_free && meta->header.type != STRING_META)
+        {
+            DELETE(meta);
+            meta = GetMeta(db, key, false);
+            if (NULL == meta)
+            {
+                return -1;
+            }
+            if (IsLazyFreeCandidate(meta) && 0 == LazyFreeDel(db, key, meta))
+            {
+                DELETE(meta);
+                return 0;
+            }
+        }
 
         switch (meta->header.type)
         {
@@ -601,7 +771,7 @@ namespace ardb
 
     int Ardb::GetExpiration(const DBID& db, const Slice& key, uint64& expire)
     {
-        CommonMetaValue* meta = GetMeta(db, key, true);
+        CommonMetaValue* meta = GetMeta(db, key, true, false);
         if (NULL != meta)
         {
             expire = meta->header.expireat;
@@ -634,6 +804,7 @@ namespace ardb
         {
             ExpireKeyObject keyobject(key, expire, db);
             EmptyValueObject empty;
+            AddExpireWheelKey(db, key, expire);
             return SetKeyValueObject(keyobject, empty);
         }
         return 0;
@@ -672,6 +843,15 @@ namespace ardb
                 ExpireKeyObject* ek = (ExpireKeyObject*) kk;
                 if (ek->expireat <= now)
                 {
+                    uint64 expireat = 0;
+                    if (0 != GetExpiration(db, ek->key, expireat) || expireat != ek->expireat)
+                    {
+                        //stale index entry of a former expiration
+                        DelValue(*ek);
+                        DELETE(kk);
+                        iter->Next();
+                        continue;
+                    }
                     if (NULL != cb)
                     {
                         cb(db, ek->key, data);
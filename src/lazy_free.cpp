@@ -0,0 +1,427 @@
+/*
+ *Copyright (c) 2013-2013, yinqiwen <yinqiwen@gmail.com>
+ *All rights reserved.
+ * 
+ *Redistribution and use in source and binary forms, with or without
+ *modification, are permitted provided that the following conditions are met:
+ * 
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Redis nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ * 
+ *THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS 
+ *BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ *THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "db.hpp"
+
+namespace ardb
+{
+    /*
+     * Keys reaped with fewer elements are not worth a compaction
+     */
+    static const uint64 kLazyFreeCompactThreshold = 10000;
+
+    static uint32 lazy_free_element_types(KeyType type, KeyType* element_types)
+    {
+        switch (type)
+        {
+            case HASH_META:
+            {
+                element_types[0] = HASH_FIELD;
+                return 1;
+            }
+            case SET_META:
+            {
+                element_types[0] = SET_ELEMENT;
+                return 1;
+            }
+            case LIST_META:
+            {
+                element_types[0] = LIST_ELEMENT;
+                element_types[1] = LIST_SEGMENT;
+                element_types[2] = LIST_SEGMENT_INDEX;
+                return 3;
+            }
+            case ZSET_META:
+            {
+                element_types[0] = ZSET_ELEMENT_NODE;
+                element_types[1] = ZSET_ELEMENT;
+                return 2;
+            }
+            case BITSET_META:
+            {
+                element_types[0] = BITSET_ELEMENT;
+                return 1;
+            }
+            default:
+            {
+                return 0;
+            }
+        }
+    }
+
+    /*
+     * The smallest element key of 'key' for the element type
+     */
+    static KeyObject* new_element_start_key(KeyType element_type, const DBID& db, const Slice& key)
+    {
+        Slice empty;
+        switch (element_type)
+        {
+            case HASH_FIELD:
+            {
+                return new HashKeyObject(key, empty, db);
+            }
+            case SET_ELEMENT:
+            {
+                return new SetKeyObject(key, empty, db);
+            }
+            case LIST_ELEMENT:
+            {
+                return new ListKeyObject(key, -FLT_MAX, db);
+            }
+            case LIST_SEGMENT:
+            {
+                return new ListSegmentKeyObject(key, 0, db);
+            }
+            case LIST_SEGMENT_INDEX:
+            {
+                return new ListIndexKeyObject(key, 0, db);
+            }
+            case ZSET_ELEMENT_NODE:
+            {
+                return new ZSetNodeKeyObject(key, empty, db);
+            }
+            case ZSET_ELEMENT:
+            {
+                return new ZSetKeyObject(key, empty, -DBL_MAX, db);
+            }
+            case BITSET_ELEMENT:
+            {
+                return new BitSetKeyObject(key, 0, db);
+            }
+            default:
+            {
+                return NULL;
+            }
+        }
+    }
+
+    static void encode_tombstone_key(Buffer& buf, const DBID& db, const Slice& key)
+    {
+        BufferHelper::WriteFixUInt32(buf, db, true);
+        buf.Write(key.data(), key.size());
+    }
+
+    static bool decode_tombstone_key(const Slice& tombstone, DBID& db, Slice& key)
+    {
+        Buffer buf(const_cast<char*>(tombstone.data()), 0, tombstone.size());
+        if (!BufferHelper::ReadFixUInt32(buf, db, true))
+        {
+            return false;
+        }
+        key = Slice(buf.GetRawReadBuffer(), buf.ReadableBytes());
+        return true;
+    }
+
+    bool Ardb::IsLazyFreeCandidate(CommonMetaValue* meta)
+    {
+        uint64 min_elements = m_config.lazy_free_min_elements > 0 ? m_config.lazy_free_min_elements : 0;
+        switch (meta->header.type)
+        {
+            case HASH_META:
+            {
+                HashMetaValue* hmeta = (HashMetaValue*) meta;
+                return !hmeta->ziped && (hmeta->dirty || hmeta->size >= min_elements);
+            }
+            case SET_META:
+            {
+                SetMetaValue* smeta = (SetMetaValue*) meta;
+                return !smeta->ziped && (smeta->dirty || smeta->size >= min_elements);
+            }
+            case LIST_META:
+            {
+                ListMetaValue* lmeta = (ListMetaValue*) meta;
+                return !lmeta->ziped && lmeta->size >= min_elements;
+            }
+            case ZSET_META:
+            {
+                ZSetMetaValue* zmeta = (ZSetMetaValue*) meta;
+                return zmeta->encoding != ZSET_ENCODING_ZIPLIST && zmeta->size >= min_elements;
+            }
+            case BITSET_META:
+            {
+                BitSetMetaValue* bmeta = (BitSetMetaValue*) meta;
+                return bmeta->min > 0 && bmeta->max - bmeta->min + 1 >= min_elements;
+            }
+            default:
+            {
+                return false;
+            }
+        }
+    }
+
+    void Ardb::AddLazyFreeKey(const DBID& db, const Slice& key, KeyType type)
+    {
+        LockGuard<SpinMutexLock> guard(m_lazy_free_keys_lock);
+        if (m_lazy_free_keys.insert(LazyFreeKeyTable::value_type(DBItemKey(db, key), LazyFreeKey(type))).second)
+        {
+            m_lazy_free_key_count++;
+        }
+    }
+
+    bool Ardb::PeekLazyFreeKey(DBItemKey& key, KeyType& type)
+    {
+        LockGuard<SpinMutexLock> guard(m_lazy_free_keys_lock);
+        if (m_lazy_free_keys.empty())
+        {
+            return false;
+        }
+        key = m_lazy_free_keys.begin()->first;
+        type = m_lazy_free_keys.begin()->second.type;
+        return true;
+    }
+
+    /*
+     * Writes a tombstone & drops the meta in one batch, returns -1 if the key is already being reaped,
+     * the caller clears it synchronously then.
+     */
+    int Ardb::LazyFreeDel(const DBID& db, const Slice& key, CommonMetaValue* meta)
+    {
+        KeyLockerGuard keyguard(m_key_locker, db, key);
+        {
+            LockGuard<SpinMutexLock> guard(m_lazy_free_keys_lock);
+            if (m_lazy_free_keys.find(DBItemKey(db, key)) != m_lazy_free_keys.end())
+            {
+                return -1;
+            }
+        }
+        if (NULL != m_level1_cahce)
+        {
+            m_level1_cahce->Evict(db, key);
+        }
+        Buffer tombstone;
+        encode_tombstone_key(tombstone, db, key);
+        Slice tombstone_str(tombstone.GetRawReadBuffer(), tombstone.ReadableBytes());
+        KeyObject tombstone_key(tombstone_str, KEY_TOMBSTONE, ARDB_GLOBAL_DB);
+        CommonValueObject type;
+        type.data.SetIntValue(meta->header.type);
+        BatchWriteGuard guard(GetEngine());
+        SetKeyValueObject(tombstone_key, type);
+        DelMeta(db, key, meta);
+        AddLazyFreeKey(db, key, meta->header.type);
+        return 0;
+    }
+
+    /*
+     * Called before any element write, a key recreated while its old elements are still being reaped
+     * has them reaped synchronously.
+     */
+    void Ardb::CheckLazyFreeKey(const KeyObject& key)
+    {
+        if (0 == m_lazy_free_key_count || key.db == ARDB_GLOBAL_DB || key.type <= LIST_META
+                || key.type >= KEY_EXPIRATION_ELEMENT)
+        {
+            return;
+        }
+        DBItemKey free_key(key.db, key.key);
+        KeyType type = KEY_META;
+        {
+            LockGuard<SpinMutexLock> guard(m_lazy_free_keys_lock);
+            LazyFreeKeyTable::iterator found = m_lazy_free_keys.find(free_key);
+            if (found == m_lazy_free_keys.end())
+            {
+                return;
+            }
+            type = found->second.type;
+        }
+        LockGuard<ThreadMutex> guard(m_lazy_free_reap_mutex);
+        uint32 deleted = 0;
+        if (ReapLazyFreeKey(key.db, key.key, type, UINT_MAX, deleted) < 0)
+        {
+            //reaped by the background reaper meanwhile
+            return;
+        }
+        WARN_LOG("Reaped %u elements of lazily deleted key %u:%s synchronously since it's written again.", deleted,
+                key.db, free_key.key.c_str());
+    }
+
+    /*
+     * Returns 1 if there are elements left, 0 if the key is finished, -1 if it is not pending any more.
+     * Must be called with 'm_lazy_free_reap_mutex' held.
+     */
+    int Ardb::ReapLazyFreeKey(const DBID& db, const Slice& key, KeyType type, uint32 max_deletes, uint32& deleted)
+    {
+        DBItemKey free_key(db, key);
+        {
+            LockGuard<SpinMutexLock> guard(m_lazy_free_keys_lock);
+            if (m_lazy_free_keys.find(free_key) == m_lazy_free_keys.end())
+            {
+                return -1;
+            }
+        }
+        KeyType element_types[3];
+        uint32 type_count = lazy_free_element_types(type, element_types);
+        uint32 batch_deleted = 0;
+        bool more = false;
+        for (uint32 i = 0; i < type_count && !more; i++)
+        {
+            KeyObject* start = new_element_start_key(element_types[i], db, key);
+            BatchWriteGuard guard(GetEngine());
+            Iterator* iter = FindValue(*start);
+            while (NULL != iter && iter->Valid())
+            {
+                if (deleted >= max_deletes)
+                {
+                    more = true;
+                    break;
+                }
+                KeyObject* k = decode_key(iter->Key(), start);
+                if (NULL == k || k->key.compare(key) != 0)
+                {
+                    DELETE(k);
+                    break;
+                }
+                DelValue(*k);
+                DELETE(k);
+                deleted++;
+                batch_deleted++;
+                iter->Next();
+            }
+            DELETE(iter);
+            DELETE(start);
+        }
+        uint64 reaped = 0;
+        {
+            LockGuard<SpinMutexLock> guard(m_lazy_free_keys_lock);
+            LazyFreeKey& entry = m_lazy_free_keys[free_key];
+            entry.reaped += batch_deleted;
+            reaped = entry.reaped;
+        }
+        if (more)
+        {
+            return 1;
+        }
+        FinishLazyFreeKey(db, key, type);
+        if (reaped >= kLazyFreeCompactThreshold)
+        {
+            std::string end_key(key.data(), key.size());
+            end_key.push_back(0);
+            for (uint32 i = 0; i < type_count; i++)
+            {
+                KeyObject* start = new_element_start_key(element_types[i], db, key);
+                KeyObject* end = new_element_start_key(element_types[i], db, end_key);
+                Buffer sbuf, ebuf;
+                encode_key(sbuf, *start);
+                encode_key(ebuf, *end);
+                GetEngine()->CompactRange(sbuf.AsString(), ebuf.AsString());
+                DELETE(start);
+                DELETE(end);
+            }
+        }
+        return 0;
+    }
+
+    void Ardb::FinishLazyFreeKey(const DBID& db, const Slice& key, KeyType type)
+    {
+        Buffer tombstone;
+        encode_tombstone_key(tombstone, db, key);
+        Slice tombstone_str(tombstone.GetRawReadBuffer(), tombstone.ReadableBytes());
+        KeyObject tombstone_key(tombstone_str, KEY_TOMBSTONE, ARDB_GLOBAL_DB);
+        DelValue(tombstone_key);
+        LockGuard<SpinMutexLock> guard(m_lazy_free_keys_lock);
+        if (m_lazy_free_keys.erase(DBItemKey(db, key)) > 0)
+        {
+            m_lazy_free_key_count--;
+        }
+    }
+
+    uint32 Ardb::ReapLazyFreeKeys(uint32 max_deletes)
+    {
+        uint32 deleted = 0;
+        DBItemKey key;
+        KeyType type;
+        while (deleted < max_deletes && PeekLazyFreeKey(key, type))
+        {
+            LockGuard<ThreadMutex> guard(m_lazy_free_reap_mutex);
+            /*
+             * small batches keep the reap mutex & write batches short
+             */
+            uint32 batch_max = deleted + 1024 < max_deletes ? deleted + 1024 : max_deletes;
+            if (0 == ReapLazyFreeKey(key.db, key.key, type, batch_max, deleted))
+            {
+                INFO_LOG("Finished reaping lazily deleted key %u:%s", key.db, key.key.c_str());
+            }
+        }
+        return deleted;
+    }
+
+    /*
+     * Tombstones survive restarts, they are rescanned at startup.
+     */
+    void Ardb::LoadLazyFreeKeys()
+    {
+        KeyObject start(Slice(), KEY_TOMBSTONE, ARDB_GLOBAL_DB);
+        Iterator* iter = FindValue(start, false);
+        while (NULL != iter && iter->Valid())
+        {
+            DBID db;
+            KeyType type;
+            if (!peek_dbkey_header(iter->Key(), db, type) || db != ARDB_GLOBAL_DB || type != KEY_TOMBSTONE)
+            {
+                break;
+            }
+            TrackRawTombstone(iter->Key(), iter->Value());
+            iter->Next();
+        }
+        DELETE(iter);
+        if (m_lazy_free_key_count > 0)
+        {
+            INFO_LOG("Loaded %u lazily deleted keys to reap.", m_lazy_free_key_count);
+        }
+    }
+
+    /*
+     * Tombstones may also arrive as raw key values, e.g. by a full sync from master.
+     */
+    void Ardb::TrackRawTombstone(const Slice& key, const Slice& value)
+    {
+        DBID tombstone_db;
+        KeyType tombstone_type;
+        if (!peek_dbkey_header(key, tombstone_db, tombstone_type) || tombstone_db != ARDB_GLOBAL_DB
+                || tombstone_type != KEY_TOMBSTONE)
+        {
+            return;
+        }
+        KeyObject* k = decode_key(key, NULL);
+        if (NULL == k)
+        {
+            return;
+        }
+        Buffer vbuf(const_cast<char*>(value.data()), 0, value.size());
+        CommonValueObject type;
+        DBID db;
+        Slice userkey;
+        if (type.Decode(vbuf) && decode_tombstone_key(k->key, db, userkey))
+        {
+            AddLazyFreeKey(db, userkey, (KeyType) type.data.NumberValue());
+        }
+        DELETE(k);
+    }
+}
+
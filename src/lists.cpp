@@ -259,9 +259,9 @@ namespace ardb
     int ArdbServer::LPush(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
         int count = 0;
-        for (uint32 i = 1; i < cmd.GetArguments().size(); i++)
+        for (uint32 i = 1; i < cmd.GetArgumentCount(); i++)
         {
-            count = m_db->LPush(ctx.currentDB, cmd.GetArguments()[0], cmd.GetArguments()[i]);
+            count = m_db->LPush(ctx.currentDB, cmd.GetArgumentSlice(0), cmd.GetArgumentSlice(i));
             CHECK_ARDB_RETURN_VALUE(ctx.reply, count);
         }
         if (count < 0)
@@ -271,7 +271,7 @@ namespace ardb
         fill_int_reply(ctx.reply, count);
         if (count > 0)
         {
-            WatchKey key(ctx.currentDB, cmd.GetArguments()[0]);
+            WatchKey key(ctx.currentDB, cmd.GetArgumentSlice(0).ToString());
             CheckBlockingConnectionsByListKey(key);
         }
         return 0;
@@ -369,9 +369,9 @@ namespace ardb
     int ArdbServer::RPush(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
         int count = 0;
-        for (uint32 i = 1; i < cmd.GetArguments().size(); i++)
+        for (uint32 i = 1; i < cmd.GetArgumentCount(); i++)
         {
-            count = m_db->RPush(ctx.currentDB, cmd.GetArguments()[0], cmd.GetArguments()[i]);
+            count = m_db->RPush(ctx.currentDB, cmd.GetArgumentSlice(0), cmd.GetArgumentSlice(i));
             CHECK_ARDB_RETURN_VALUE(ctx.reply, count);
         }
         if (count < 0)
@@ -381,7 +381,7 @@ namespace ardb
         fill_int_reply(ctx.reply, count);
         if (count > 0)
         {
-            WatchKey key(ctx.currentDB, cmd.GetArguments()[0]);
+            WatchKey key(ctx.currentDB, cmd.GetArgumentSlice(0).ToString());
             CheckBlockingConnectionsByListKey(key);
         }
         return 0;
@@ -527,9 +527,23 @@ namespace ardb
         return 0;
     }
 
-    ListMetaValue* Ardb::GetListMeta(const DBID& db, const Slice& key, int& err, bool& created)
+    /*
+     * Lists written with the score layout are converted to segments on first access, the key lock
+     * is taken here since readers(LINDEX/LRANGE) do not hold it.
+     */
+    ListMetaValue* Ardb::GetListMeta(const DBID& db, const Slice& key, int& err, bool& created, bool convert)
     {
         CommonMetaValue* meta = GetMeta(db, key, false);
+        if (convert && NULL != meta && meta->header.type == LIST_META && ((ListMetaValue*) meta)->IsScoreLayout())
+        {
+            KeyLockerGuard keyguard(m_key_locker, db, key);
+            DELETE(meta);
+            meta = GetMeta(db, key, false);
+            if (NULL != meta && meta->header.type == LIST_META && ((ListMetaValue*) meta)->IsScoreLayout())
+            {
+                ConvertListToSegments(db, key, *((ListMetaValue*) meta));
+            }
+        }
         if (NULL != meta && meta->header.type != LIST_META)
         {
             DELETE(meta);
@@ -549,6 +563,207 @@ namespace ardb
         return (ListMetaValue*) meta;
     }
 
+    int Ardb::GetListSegment(const DBID& db, const Slice& key, uint64 id, ListSegmentValue& segment)
+    {
+        ListSegmentKeyObject sk(key, id, db);
+        return GetKeyValueObject(sk, segment);
+    }
+
+    int Ardb::SetListSegment(const DBID& db, const Slice& key, uint64 id, ListSegmentValue& segment)
+    {
+        ListSegmentKeyObject sk(key, id, db);
+        return SetKeyValueObject(sk, segment);
+    }
+
+    int Ardb::DelListSegment(const DBID& db, const Slice& key, uint64 id)
+    {
+        ListSegmentKeyObject sk(key, id, db);
+        return DelValue(sk);
+    }
+
+    static uint32 list_segment_bytes(const ValueDataDeque& values)
+    {
+        uint32 bytes = 0;
+        ValueDataDeque::const_iterator it = values.begin();
+        while (it != values.end())
+        {
+            bytes += it->type == BYTES_VALUE ? it->bytes_value.size() : sizeof(int64);
+            it++;
+        }
+        return bytes;
+    }
+
+    bool Ardb::IsListSegmentFull(const ListSegmentValue& segment)
+    {
+        return segment.values.size() >= (uint32) m_config.list_max_segment_entries
+                || list_segment_bytes(segment.values) >= (uint32) m_config.list_max_segment_size;
+    }
+
+    static uint64 next_list_segment_id(ListMetaValue& meta)
+    {
+        if (meta.next_segment_id == 0)
+        {
+            meta.next_segment_id = 1;
+        }
+        return meta.next_segment_id++;
+    }
+
+    /*
+     * Saves 'segment' under a new id, the ref is left to the caller to put into an index chunk
+     */
+    int Ardb::NewListSegment(const DBID& db, const Slice& key, ListMetaValue& meta, ListSegmentValue& segment,
+            ListSegmentRef& ref)
+    {
+        ref.id = next_list_segment_id(meta);
+        ref.count = segment.values.size();
+        return SetListSegment(db, key, ref.id, segment);
+    }
+
+    int Ardb::GetListIndexChunk(const DBID& db, const Slice& key, const ListMetaValue& meta, size_t pos,
+            ListIndexChunkValue& chunk)
+    {
+        ListIndexKeyObject ik(key, meta.chunks.refs[pos].id, db);
+        return GetKeyValueObject(ik, chunk);
+    }
+
+    /*
+     * Saves the index chunk at 'pos' of the meta's chunks, or a new last one if 'pos' is past the end.
+     * An empty chunk is deleted and one over LIST_INDEX_CHUNK_SEGMENTS segments is split in half, the
+     * meta's chunks are updated but the meta is left to the caller.
+     */
+    int Ardb::SetListIndexChunk(const DBID& db, const Slice& key, ListMetaValue& meta, size_t pos,
+            ListIndexChunkValue& chunk)
+    {
+        ListSegmentArray& chunks = meta.chunks.refs;
+        ListSegmentArray& segments = chunk.segments.refs;
+        if (pos >= chunks.size())
+        {
+            if (segments.empty())
+            {
+                return 0;
+            }
+            pos = chunks.size();
+            chunks.push_back(ListSegmentRef(next_list_segment_id(meta)));
+        }
+        if (segments.empty())
+        {
+            ListIndexKeyObject ik(key, chunks[pos].id, db);
+            chunks.erase(chunks.begin() + pos);
+            meta.chunks.Reindex();
+            return DelValue(ik);
+        }
+        if (segments.size() > LIST_INDEX_CHUNK_SEGMENTS)
+        {
+            ListIndexChunkValue tail;
+            tail.segments.refs.assign(segments.begin() + segments.size() / 2, segments.end());
+            segments.resize(segments.size() / 2);
+            chunks.insert(chunks.begin() + pos + 1, ListSegmentRef(next_list_segment_id(meta)));
+            SetListIndexChunk(db, key, meta, pos + 1, tail);
+        }
+        chunk.segments.Reindex();
+        chunks[pos].count = chunk.segments.Count();
+        meta.chunks.Reindex();
+        ListIndexKeyObject ik(key, chunks[pos].id, db);
+        return SetKeyValueObject(ik, chunk);
+    }
+
+    /*
+     * Finds the segment holding the element at 'index' by a binary search of the meta's chunks then of
+     * the chunk's segments, 'chunk' is loaded with the index chunk at 'chunk_pos'.
+     */
+    int Ardb::LocateListSegment(const DBID& db, const Slice& key, const ListMetaValue& meta, uint32 index,
+            size_t& chunk_pos, ListIndexChunkValue& chunk, size_t& pos, uint32& offset)
+    {
+        uint32 chunk_offset;
+        if (!meta.chunks.Locate(index, chunk_pos, chunk_offset)
+                || 0 != GetListIndexChunk(db, key, meta, chunk_pos, chunk)
+                || !chunk.segments.Locate(chunk_offset, pos, offset))
+        {
+            return ERR_NOT_EXIST;
+        }
+        return 0;
+    }
+
+    /*
+     * Appends 'values' at the tail in new segments, the meta size is left to the caller
+     */
+    int Ardb::ListAppendValues(const DBID& db, const Slice& key, ListMetaValue& meta, const ValueDataDeque& values)
+    {
+        if (meta.next_segment_id == 0)
+        {
+            meta.next_segment_id = 1;
+        }
+        size_t pos = meta.chunks.refs.size();
+        ListIndexChunkValue chunk;
+        if (pos > 0 && !values.empty() && 0 == GetListIndexChunk(db, key, meta, pos - 1, chunk))
+        {
+            pos--;
+        }
+        ListSegmentValue segment;
+        ValueDataDeque::const_iterator it = values.begin();
+        while (it != values.end())
+        {
+            segment.values.push_back(*it);
+            it++;
+            if (IsListSegmentFull(segment) || it == values.end())
+            {
+                ListSegmentRef ref;
+                NewListSegment(db, key, meta, segment, ref);
+                chunk.segments.refs.push_back(ref);
+                segment.values.clear();
+                if (chunk.segments.refs.size() >= LIST_INDEX_CHUNK_SEGMENTS)
+                {
+                    SetListIndexChunk(db, key, meta, pos, chunk);
+                    pos = meta.chunks.refs.size();
+                    chunk.segments.refs.clear();
+                }
+            }
+        }
+        if (!chunk.segments.refs.empty())
+        {
+            SetListIndexChunk(db, key, meta, pos, chunk);
+        }
+        return 0;
+    }
+
+    int Ardb::ConvertListToSegments(const DBID& db, const Slice& key, ListMetaValue& meta)
+    {
+        BatchWriteGuard guard(GetEngine());
+        ListKeyObject lk(key, -FLT_MAX, db);
+        struct ConvertWalk: public WalkHandler
+        {
+                Ardb* ldb;
+                const DBID& ldbid;
+                const Slice& lkey;
+                ListMetaValue& lmeta;
+                ValueDataDeque values;
+                uint32 count;
+                int OnKeyValue(KeyObject* k, ValueObject* v, uint32 cursor)
+                {
+                    CommonValueObject* cv = (CommonValueObject*) v;
+                    values.push_back(cv->data);
+                    ldb->DelValue(*k);
+                    count++;
+                    if (values.size() >= (uint32) ldb->m_config.list_max_segment_entries * 16)
+                    {
+                        ldb->ListAppendValues(ldbid, lkey, lmeta, values);
+                        values.clear();
+                    }
+                    return 0;
+                }
+                ConvertWalk(Ardb* db, const DBID& dbid, const Slice& key, ListMetaValue& meta) :
+                        ldb(db), ldbid(dbid), lkey(key), lmeta(meta), count(0)
+                {
+                }
+        } walk(this, db, key, meta);
+        Walk(lk, false, true, &walk);
+        ListAppendValues(db, key, meta, walk.values);
+        meta.size = walk.count;
+        meta.min_score.SetIntValue(0);
+        meta.max_score.SetIntValue(0);
+        return SetMeta(db, key, meta);
+    }
+
     int Ardb::ListPush(const DBID& db, const Slice& key, const Slice& value, bool athead, bool onlyexist)
     {
         KeyLockerGuard keyguard(m_key_locker, db, key);
@@ -608,30 +823,16 @@ namespace ardb
         {
             BatchWriteGuard guard(GetEngine());
             lmeta->ziped = false;
-            ValueDataDeque::iterator it = lmeta->zipvs.begin();
-            int64 score = 0;
-            while (it != lmeta->zipvs.end())
-            {
-                ListKeyObject lk(key, score, db);
-                CommonValueObject element(*it);
-                SetKeyValueObject(lk, element);
-                score++;
-                it++;
-            }
-            lmeta->min_score.SetIntValue(0);
-            lmeta->max_score.SetIntValue(score - 1 >= 0 ? score : 0);
-            lmeta->size = lmeta->zipvs.size() + 1;
             if (athead)
             {
-                score = -1;
-                lmeta->min_score.SetIntValue(-1);
+                lmeta->zipvs.push_front(lv.data);
             }
             else
             {
-                lmeta->max_score.SetIntValue(score);
+                lmeta->zipvs.push_back(lv.data);
             }
-            ListKeyObject lk(key, score, db);
-            SetKeyValueObject(lk, lv);
+            ListAppendValues(db, key, *lmeta, lmeta->zipvs);
+            lmeta->size = lmeta->zipvs.size();
             lmeta->zipvs.clear();
             err = SetMeta(db, key, *lmeta);
             if (err == 0)
@@ -643,32 +844,61 @@ namespace ardb
         }
 
         /*
-         * save element
+         * save element into the head/tail segment, or a new one if that is full
          */
-        int64 score = 0;
-        if (!createList)
+        err = 0;
+        BatchWriteGuard guard(GetEngine());
+        ListIndexChunkValue chunk;
+        ListSegmentValue segment;
+        size_t chunk_pos = athead || lmeta->chunks.refs.empty() ? 0 : lmeta->chunks.refs.size() - 1;
+        if (!lmeta->chunks.refs.empty())
         {
-            lmeta->size++;
-            if (athead)
+            if (0 != GetListIndexChunk(db, key, *lmeta, chunk_pos, chunk) || chunk.segments.refs.empty())
             {
-                lmeta->min_score.Incrby(-1);
-                score = (int64) (lmeta->min_score.NumberValue());
+                ERROR_LOG("Failed to load list index chunk:%" PRIu64 " of key:%s", lmeta->chunks.refs[chunk_pos].id,
+                        key.data());
+                DELETE(lmeta);
+                return -1;
+            }
+            ListSegmentRef& ref = athead ? chunk.segments.refs.front() : chunk.segments.refs.back();
+            if (0 != GetListSegment(db, key, ref.id, segment))
+            {
+                ERROR_LOG("Failed to load list segment:%" PRIu64 " of key:%s", ref.id, key.data());
+                DELETE(lmeta);
+                return -1;
+            }
+            if (!IsListSegmentFull(segment))
+            {
+                if (athead)
+                {
+                    segment.values.push_front(lv.data);
+                }
+                else
+                {
+                    segment.values.push_back(lv.data);
+                }
+                ref.count++;
+                err = SetListSegment(db, key, ref.id, segment);
             }
             else
             {
-                lmeta->max_score.Incrby(1);
-                score = (int64) (lmeta->max_score.NumberValue());
+                segment.values.clear();
             }
         }
-        else
+        if (segment.values.empty())
         {
-            lmeta->size++;
-            score = 0;
+            ListSegmentRef ref;
+            segment.values.push_back(lv.data);
+            err = NewListSegment(db, key, *lmeta, segment, ref);
+            chunk.segments.refs.insert(athead ? chunk.segments.refs.begin() : chunk.segments.refs.end(), ref);
         }
-        BatchWriteGuard guard(GetEngine());
-        ListKeyObject lk(key, score, db);
-        if (0 == SetKeyValueObject(lk, lv))
+        if (0 == err)
+        {
+            err = SetListIndexChunk(db, key, *lmeta, chunk_pos, chunk);
+        }
+        if (0 == err)
         {
+            lmeta->size++;
             int ret = SetMeta(db, key, *lmeta);
             if (ret == 0)
             {
@@ -769,18 +999,8 @@ namespace ardb
                 BatchWriteGuard guard(GetEngine());
                 if (convert_to_nonzip)
                 {
-                    int64 score = 0;
-                    ValueDataDeque::iterator it = meta->zipvs.begin();
-                    while (it != meta->zipvs.end())
-                    {
-                        ListKeyObject lk(key, score, db);
-                        CommonValueObject element(*it);
-                        SetKeyValueObject(lk, element);
-                        score++;
-                        it++;
-                    }
-                    meta->min_score.SetIntValue(0);
-                    meta->max_score.SetIntValue(score - 1 >= 0 ? score : 0);
+                    meta->ziped = false;
+                    ListAppendValues(db, key, *meta, meta->zipvs);
                     meta->zipvs.clear();
                 }
                 SetMeta(db, key, *meta);
@@ -788,86 +1008,66 @@ namespace ardb
             DELETE(meta);
             return found ? 0 : ERR_NOT_EXIST;
         }
-        ListKeyObject lk(key, -FLT_MAX, db);
-        struct LInsertWalk: public WalkHandler
+
+        /*
+         * The new element goes into the pivot's segment, which is split in half once it grows
+         * over the segment limits. Nothing else in the list is touched.
+         */
+        ValueData cmp;
+        cmp.SetValue(pivot, true);
+        element.data.SetValue(value, true);
+        for (size_t c = 0; c < meta->chunks.refs.size(); c++)
         {
-                bool before_pivot;
-                ValueData pivot_score;
-                ValueData next_score;
-                bool found;
-                ValueData cmp_value;
-                int OnKeyValue(KeyObject* k, ValueObject* v, uint32 cursor)
+            ListIndexChunkValue chunk;
+            if (0 != GetListIndexChunk(db, key, *meta, c, chunk))
+            {
+                continue;
+            }
+            for (size_t i = 0; i < chunk.segments.refs.size(); i++)
+            {
+                ListSegmentValue segment;
+                if (0 != GetListSegment(db, key, chunk.segments.refs[i].id, segment))
                 {
-                    CommonValueObject* cv = (CommonValueObject*) v;
-                    ListKeyObject* sek = (ListKeyObject*) k;
-                    if (found && !before_pivot)
-                    {
-                        next_score = sek->score;
-                        return -1;
-                    }
-                    if (cv->data.Compare(cmp_value) == 0)
-                    {
-                        pivot_score = sek->score;
-                        found = true;
-                        if (before_pivot)
-                        {
-                            return -1;
-                        }
-                    }
-                    else
-                    {
-                        if (before_pivot)
-                        {
-                            next_score = sek->score;
-                        }
-                    }
-                    return 0;
+                    continue;
                 }
-                LInsertWalk(bool flag, const Slice& value) :
-                        before_pivot(flag), pivot_score(-FLT_MAX), next_score(-FLT_MAX), found(false)
+                ValueDataDeque::iterator it = segment.values.begin();
+                while (it != segment.values.end() && it->Compare(cmp) != 0)
                 {
-                    cmp_value.SetValue(value, true);
+                    it++;
                 }
-        } walk(before, pivot);
-        Walk(lk, false, true, &walk);
-        if (!walk.found)
-        {
-            DELETE(meta);
-            return ERR_NOT_EXIST;
-        }
-        ValueData score((int64) 0);
-        if (walk.next_score.type != EMPTY_VALUE)
-        {
-            double sv = (walk.next_score.NumberValue() + walk.pivot_score.NumberValue()) / 2;
-            if ((int64) sv < walk.next_score.NumberValue() && (int64) sv < walk.pivot_score.NumberValue())
-            {
-                score.SetIntValue((int64) sv);
-            }
-            else
-            {
-                score.SetDoubleValue(sv);
-            }
-        }
-        else
-        {
-            if (before)
-            {
-                walk.pivot_score.Incrby(-1);
-                score.SetIntValue((int64) walk.pivot_score.NumberValue());
-            }
-            else
-            {
-                walk.pivot_score.Incrby(1);
-                score.SetIntValue((int64) walk.pivot_score.NumberValue());
+                if (it == segment.values.end())
+                {
+                    continue;
+                }
+                if (!before)
+                {
+                    it++;
+                }
+                segment.values.insert(it, element.data);
+                BatchWriteGuard guard(GetEngine());
+                uint32 count = segment.values.size();
+                if (count > 1
+                        && (count > (uint32) m_config.list_max_segment_entries
+                                || list_segment_bytes(segment.values) > (uint32) m_config.list_max_segment_size))
+                {
+                    ListSegmentValue tail;
+                    ListSegmentRef ref;
+                    tail.values.assign(segment.values.begin() + count / 2, segment.values.end());
+                    segment.values.resize(count / 2);
+                    NewListSegment(db, key, *meta, tail, ref);
+                    chunk.segments.refs.insert(chunk.segments.refs.begin() + i + 1, ref);
+                }
+                chunk.segments.refs[i].count = segment.values.size();
+                SetListSegment(db, key, chunk.segments.refs[i].id, segment);
+                SetListIndexChunk(db, key, *meta, c, chunk);
+                meta->size++;
+                SetMeta(db, key, *meta);
+                DELETE(meta);
+                return 0;
             }
         }
-        BatchWriteGuard guard(GetEngine());
-        ListKeyObject nlk(key, score, db);
-        SetKeyValueObject(nlk, element);
-        meta->size++;
-        SetMeta(db, key, *meta);
         DELETE(meta);
-        return 0;
+        return ERR_NOT_EXIST;
     }
 
     int Ardb::ListPop(const DBID& db, const Slice& key, bool athead, std::string& value)
@@ -899,64 +1099,52 @@ namespace ardb
             return 0;
         }
 
-        ValueData score;
-        if (meta->size <= 0)
+        if (meta->chunks.refs.empty())
         {
             DELETE(meta);
             return ERR_NOT_EXIST;
         }
-        meta->size--;
+        size_t chunk_pos = athead ? 0 : meta->chunks.refs.size() - 1;
+        ListIndexChunkValue chunk;
+        if (0 != GetListIndexChunk(db, key, *meta, chunk_pos, chunk) || chunk.segments.refs.empty())
+        {
+            ERROR_LOG("Failed to load list index chunk:%" PRIu64 " of key:%s", meta->chunks.refs[chunk_pos].id,
+                    key.data());
+            DELETE(meta);
+            return -1;
+        }
+        size_t pos = athead ? 0 : chunk.segments.refs.size() - 1;
+        ListSegmentRef& ref = chunk.segments.refs[pos];
+        ListSegmentValue segment;
+        if (0 != GetListSegment(db, key, ref.id, segment) || segment.values.empty())
+        {
+            ERROR_LOG("Failed to load list segment:%" PRIu64 " of key:%s", ref.id, key.data());
+            DELETE(meta);
+            return -1;
+        }
         if (athead)
         {
-            score = meta->min_score;
+            segment.values.front().ToString(value);
+            segment.values.pop_front();
         }
         else
         {
-            score = meta->max_score;
+            segment.values.back().ToString(value);
+            segment.values.pop_back();
         }
-        if (meta->size == 0)
+        BatchWriteGuard guard(GetEngine());
+        meta->size--;
+        if (segment.values.empty())
         {
-            meta->min_score.SetIntValue(0);
-            meta->max_score.SetIntValue(0);
+            DelListSegment(db, key, ref.id);
+            chunk.segments.refs.erase(chunk.segments.refs.begin() + pos);
         }
-        ListKeyObject lk(key, score, db);
-        BatchWriteGuard guard(GetEngine());
-        struct LPopWalk: public WalkHandler
+        else
         {
-                Ardb* ldb;
-                std::string& pop_value;
-                ListMetaValue& lmeta;
-                bool reverse;
-                int OnKeyValue(KeyObject* k, ValueObject* v, uint32 cursor)
-                {
-                    CommonValueObject* cv = (CommonValueObject*) v;
-                    if (cursor == 0)
-                    {
-                        ListKeyObject* lk = (ListKeyObject*) k;
-                        cv->data.ToString(pop_value);
-                        ldb->DelValue(*lk);
-                        return 0;
-                    }
-                    else
-                    {
-                        ListKeyObject* lk = (ListKeyObject*) k;
-                        if (reverse)
-                        {
-                            lmeta.max_score = lk->score;
-                        }
-                        else
-                        {
-                            lmeta.min_score = lk->score;
-                        }
-                        return -1;
-                    }
-                }
-                LPopWalk(Ardb* db, std::string& v, ListMetaValue& meta, bool r) :
-                        ldb(db), pop_value(v), lmeta(meta), reverse(r)
-                {
-                }
-        } walk(this, value, *meta, !athead);
-        Walk(lk, !athead, true, &walk);
+            ref.count--;
+            SetListSegment(db, key, ref.id, segment);
+        }
+        SetListIndexChunk(db, key, *meta, chunk_pos, chunk);
         int ret = SetMeta(db, key, *meta);
         DELETE(meta);
         return ret;
@@ -1006,42 +1194,27 @@ namespace ardb
             DELETE(meta);
             return err;
         }
-        DELETE(meta);
-        ListKeyObject lk(key, -FLT_MAX, db);
-        bool reverse = false;
         if (index < 0)
         {
-            index = 0 - index;
-            lk.score = FLT_MAX;
-            reverse = true;
+            index += meta->size;
         }
-        struct LIndexWalk: public WalkHandler
+        size_t chunk_pos, pos;
+        uint32 offset;
+        ListIndexChunkValue chunk;
+        if (index < 0 || 0 != LocateListSegment(db, key, *meta, (uint32) index, chunk_pos, chunk, pos, offset))
         {
-                uint32 lcursor;
-                uint32 index;
-                std::string& found_value;
-                int OnKeyValue(KeyObject* k, ValueObject* v, uint32 cursor)
-                {
-                    CommonValueObject* cv = (CommonValueObject*) v;
-                    if (cursor == index)
-                    {
-                        cv->data.ToString(found_value);
-                        return -1;
-                    }
-                    lcursor++;
-                    return 0;
-                }
-                LIndexWalk(uint32 i, std::string& v) :
-                        lcursor(0), index(i), found_value(v)
-                {
-                }
-        } walk((uint32) index, v);
-        Walk(lk, reverse, true, &walk);
-        if (walk.lcursor == walk.index)
+            DELETE(meta);
+            return ERR_NOT_EXIST;
+        }
+        ListSegmentValue segment;
+        err = GetListSegment(db, key, chunk.segments.refs[pos].id, segment);
+        DELETE(meta);
+        if (0 != err || offset >= segment.values.size())
         {
-            return 0;
+            return ERR_NOT_EXIST;
         }
-        return ERR_NOT_EXIST;
+        segment.values[offset].ToString(v);
+        return 0;
     }
 
     int Ardb::LRange(const DBID& db, const Slice& key, int start, int end, ValueDataArray& values)
@@ -1069,6 +1242,7 @@ namespace ardb
         }
         if (start >= len)
         {
+            DELETE(meta);
             return 0;
         }
         if (end < 0)
@@ -1084,32 +1258,46 @@ namespace ardb
             DELETE(meta);
             return 0;
         }
-
-        ListKeyObject lk(key, meta->min_score, db);
-        struct LRangeWalk: public WalkHandler
+        if (end >= len)
         {
-                uint32 l_start;
-                uint32 l_stop;
-                ValueDataArray& found_values;
-                int OnKeyValue(KeyObject* k, ValueObject* v, uint32 cursor)
-                {
-                    CommonValueObject* cv = (CommonValueObject*) v;
-                    if (cursor >= l_start && cursor <= l_stop)
-                    {
-                        found_values.push_back(cv->data);
-                    }
-                    if (cursor >= l_stop)
-                    {
-                        return -1;
-                    }
-                    return 0;
-                }
-                LRangeWalk(int start, int stop, ValueDataArray& vs) :
-                        l_start(start), l_stop(stop), found_values(vs)
+            end = len - 1;
+        }
+        size_t chunk_pos, pos;
+        uint32 offset;
+        ListIndexChunkValue chunk;
+        if (start > end || 0 != LocateListSegment(db, key, *meta, (uint32) start, chunk_pos, chunk, pos, offset))
+        {
+            DELETE(meta);
+            return 0;
+        }
+        /*
+         * Only the segments covering [start, end] are read
+         */
+        uint32 remain = end - start + 1;
+        while (remain > 0)
+        {
+            if (pos >= chunk.segments.refs.size())
+            {
+                chunk_pos++;
+                if (chunk_pos >= meta->chunks.refs.size() || 0 != GetListIndexChunk(db, key, *meta, chunk_pos, chunk))
                 {
+                    break;
                 }
-        } walk(start, end, values);
-        Walk(lk, false, true, &walk);
+                pos = 0;
+                continue;
+            }
+            ListSegmentValue segment;
+            if (0 != GetListSegment(db, key, chunk.segments.refs[pos].id, segment))
+            {
+                break;
+            }
+            for (uint32 i = offset; i < segment.values.size() && remain > 0; i++, remain--)
+            {
+                values.push_back(segment.values[i]);
+            }
+            offset = 0;
+            pos++;
+        }
         DELETE(meta);
         return 0;
     }
@@ -1119,14 +1307,14 @@ namespace ardb
         KeyLockerGuard keyguard(m_key_locker, db, key);
         int err = 0;
         bool createList = false;
-        ListMetaValue* meta = GetListMeta(db, key, err, createList);
+        ListMetaValue* meta = GetListMeta(db, key, err, createList, false);
         if (NULL == meta || createList)
         {
             DELETE(meta);
             return err;
         }
         BatchWriteGuard guard(GetEngine());
-        if (!meta->ziped)
+        if (meta->IsScoreLayout())
         {
             ListKeyObject lk(key, -FLT_MAX, db);
             struct LClearWalk: public WalkHandler
@@ -1145,6 +1333,19 @@ namespace ardb
             } walk(this);
             Walk(lk, false, false, &walk);
         }
+        for (size_t c = 0; c < meta->chunks.refs.size(); c++)
+        {
+            ListIndexChunkValue chunk;
+            if (0 == GetListIndexChunk(db, key, *meta, c, chunk))
+            {
+                for (size_t i = 0; i < chunk.segments.refs.size(); i++)
+                {
+                    DelListSegment(db, key, chunk.segments.refs[i].id);
+                }
+            }
+            ListIndexKeyObject ik(key, meta->chunks.refs[c].id, db);
+            DelValue(ik);
+        }
         DelMeta(db, key, meta);
         DELETE(meta);
         return 0;
@@ -1161,14 +1362,12 @@ namespace ardb
             DELETE(meta);
             return err;
         }
-        ListKeyObject lk(key, meta->min_score, db);
         int total = count;
         bool fromhead = true;
         if (count < 0)
         {
             fromhead = false;
             total = 0 - count;
-            lk.score = meta->max_score;
         }
 
         if (meta->ziped)
@@ -1205,39 +1404,84 @@ namespace ardb
             return ret;
         }
 
-        struct LRemWalk: public WalkHandler
+        ValueData cmp;
+        cmp.SetValue(value, true);
+        int remcount = 0;
+        BatchWriteGuard guard(GetEngine());
+        size_t c = fromhead ? 0 : meta->chunks.refs.size();
+        while ((total == 0 || remcount < total) && (fromhead ? c < meta->chunks.refs.size() : c > 0))
         {
-                Ardb* z_db;
-                ValueData cmp_value;
-                int remcount;
-                int rem_total;
-                int OnKeyValue(KeyObject* k, ValueObject* v, uint32 cursor)
+            if (!fromhead)
+            {
+                c--;
+            }
+            ListIndexChunkValue chunk;
+            if (0 != GetListIndexChunk(db, key, *meta, c, chunk))
+            {
+                c += fromhead ? 1 : 0;
+                continue;
+            }
+            ListSegmentArray& refs = chunk.segments.refs;
+            bool changed = false;
+            for (size_t n = 0; n < refs.size() && (total == 0 || remcount < total); n++)
+            {
+                ListSegmentRef& ref = refs[fromhead ? n : refs.size() - 1 - n];
+                ListSegmentValue segment;
+                if (0 != GetListSegment(db, key, ref.id, segment))
                 {
-                    CommonValueObject* cv = (CommonValueObject*) v;
-                    ListKeyObject* sek = (ListKeyObject*) k;
-                    if (cv->data.Compare(cmp_value) == 0)
+                    continue;
+                }
+                uint32 before = segment.values.size();
+                for (uint32 j = 0; j < before && (total == 0 || remcount < total); j++)
+                {
+                    size_t idx = fromhead ? j - (before - segment.values.size()) : before - 1 - j;
+                    if (segment.values[idx].Compare(cmp) == 0)
                     {
-                        z_db->DelValue(*sek);
+                        segment.values.erase(segment.values.begin() + idx);
                         remcount++;
-                        if (rem_total == remcount)
-                        {
-                            return -1;
-                        }
                     }
-                    return 0;
                 }
-                LRemWalk(Ardb* db, const Slice& v, int total) :
-                        z_db(db), remcount(0), rem_total(total)
+                if (segment.values.size() == before)
                 {
-                    cmp_value.SetValue(v, true);
+                    continue;
                 }
-        } walk(this, value, total);
-        BatchWriteGuard guard(GetEngine());
-        Walk(lk, !fromhead, true, &walk);
-        meta->size -= walk.remcount;
-        SetMeta(db, key, *meta);
+                changed = true;
+                ref.count = segment.values.size();
+                if (segment.values.empty())
+                {
+                    DelListSegment(db, key, ref.id);
+                }
+                else
+                {
+                    SetListSegment(db, key, ref.id, segment);
+                }
+            }
+            size_t chunks = meta->chunks.refs.size();
+            if (changed)
+            {
+                ListSegmentArray left;
+                for (size_t i = 0; i < refs.size(); i++)
+                {
+                    if (refs[i].count > 0)
+                    {
+                        left.push_back(refs[i]);
+                    }
+                }
+                refs = left;
+                SetListIndexChunk(db, key, *meta, c, chunk);
+            }
+            if (fromhead && meta->chunks.refs.size() == chunks)
+            {
+                c++;
+            }
+        }
+        if (remcount > 0)
+        {
+            meta->size -= remcount;
+            SetMeta(db, key, *meta);
+        }
         DELETE(meta);
-        return walk.remcount;
+        return remcount;
     }
 
     int Ardb::LSet(const DBID& db, const Slice& key, int index, const Slice& value)
@@ -1255,7 +1499,7 @@ namespace ardb
         {
             index += meta->size;
         }
-        if ((uint32) index >= meta->size)
+        if (index < 0 || (uint32) index >= meta->size)
         {
             DELETE(meta);
             return ERR_NOT_EXIST;
@@ -1267,38 +1511,21 @@ namespace ardb
             DELETE(meta);
             return 0;
         }
-        DELETE(meta);
-        ListKeyObject lk(key, -FLT_MAX, db);
-        struct LSetWalk: public WalkHandler
-        {
-                Ardb* z_db;
-                const Slice& set_value;
-                uint32 lcursor;
-                uint32 dst_idx;
-                int OnKeyValue(KeyObject* k, ValueObject* v, uint32 cursor)
-                {
-                    ListKeyObject* sek = (ListKeyObject*) k;
-                    if (cursor == dst_idx)
-                    {
-                        CommonValueObject cv;
-                        cv.data.SetValue(set_value, true);
-                        z_db->SetKeyValueObject(*sek, cv);
-                        return -1;
-                    }
-                    lcursor++;
-                    return 0;
-                }
-                LSetWalk(Ardb* db, const Slice& v, uint32 index) :
-                        z_db(db), set_value(v), lcursor(0), dst_idx(index)
-                {
-                }
-        } walk(this, value, (uint32) index);
-        Walk(lk, false, false, &walk);
-        if (walk.lcursor != walk.dst_idx)
+        size_t chunk_pos, pos;
+        uint32 offset;
+        ListIndexChunkValue chunk;
+        ListSegmentValue segment;
+        if (0 != LocateListSegment(db, key, *meta, (uint32) index, chunk_pos, chunk, pos, offset)
+                || 0 != GetListSegment(db, key, chunk.segments.refs[pos].id, segment)
+                || offset >= segment.values.size())
         {
+            DELETE(meta);
             return ERR_NOT_EXIST;
         }
-        return 0;
+        segment.values[offset].SetValue(value, true);
+        err = SetListSegment(db, key, chunk.segments.refs[pos].id, segment);
+        DELETE(meta);
+        return err;
     }
 
     int Ardb::LTrim(const DBID& db, const Slice& key, int start, int stop)
@@ -1355,42 +1582,75 @@ namespace ardb
             DELETE(meta);
             return 0;
         }
+        if (stop >= len)
+        {
+            stop = len - 1;
+        }
+        if (start > stop)
+        {
+            DELETE(meta);
+            return LClear(db, key);
+        }
 
-        ListKeyObject lk(key, meta->min_score, db);
-        struct LTrimWalk: public WalkHandler
+        /*
+         * Chunks & segments outside [start, stop] are dropped whole, chunks inside are not even read,
+         * only the two boundary segments are rewritten. Chunks are visited from the tail so a dropped
+         * one doesn't move those not visited yet.
+         */
+        BatchWriteGuard guard(GetEngine());
+        ListSegmentRefs chunks = meta->chunks;
+        for (size_t c = chunks.refs.size(); c > 0; c--)
         {
-                Ardb* ldb;
-                uint32 lstart, lstop;
-                ListMetaValue& lmeta;
-                LTrimWalk(Ardb* db, int start, int stop, ListMetaValue& meta) :
-                        ldb(db), lstart(start), lstop(stop), lmeta(meta)
+            uint32 chunk_start = chunks.prefix[c - 1];
+            uint32 chunk_last = chunks.prefix[c] - 1;
+            if (chunks.refs[c - 1].count > 0 && chunk_start >= (uint32) start && chunk_last <= (uint32) stop)
+            {
+                continue;
+            }
+            ListIndexChunkValue chunk;
+            if (0 != GetListIndexChunk(db, key, *meta, c - 1, chunk))
+            {
+                ERROR_LOG("Invalid list index chunk:%" PRIu64 " of key:%s", chunks.refs[c - 1].id, key.data());
+                DELETE(meta);
+                return -1;
+            }
+            ListSegmentArray segments;
+            uint32 first = chunk_start;
+            for (size_t i = 0; i < chunk.segments.refs.size(); i++)
+            {
+                ListSegmentRef ref = chunk.segments.refs[i];
+                uint32 last = first + ref.count - 1;
+                uint32 seg_start = first;
+                first += ref.count;
+                if (ref.count == 0 || last < (uint32) start || seg_start > (uint32) stop)
                 {
+                    DelListSegment(db, key, ref.id);
+                    continue;
                 }
-                int OnKeyValue(KeyObject* k, ValueObject* v, uint32 cursor)
+                if (seg_start >= (uint32) start && last <= (uint32) stop)
                 {
-                    ListKeyObject* lek = (ListKeyObject*) k;
-                    if (cursor >= lstart && cursor <= lstop)
-                    {
-                        if (COMPARE_NUMBER(lek->score.NumberValue(), lmeta.min_score.NumberValue()) < 0)
-                        {
-                            lmeta.min_score = lek->score;
-                        }
-                        if (COMPARE_NUMBER(lek->score.NumberValue(), lmeta.max_score.NumberValue()) > 0)
-                        {
-                            lmeta.max_score = lek->score;
-                        }
-                        return 0;
-                    }
-                    else
-                    {
-                        lmeta.size--;
-                        ldb->DelValue(*lek);
-                    }
-                    return 0;
+                    segments.push_back(ref);
+                    continue;
                 }
-        } walk(this, start, stop, *meta);
-        BatchWriteGuard guard(GetEngine());
-        Walk(lk, false, false, &walk);
+                ListSegmentValue segment;
+                if (0 != GetListSegment(db, key, ref.id, segment) || segment.values.size() != ref.count)
+                {
+                    ERROR_LOG("Invalid list segment:%" PRIu64 " of key:%s", ref.id, key.data());
+                    DELETE(meta);
+                    return -1;
+                }
+                uint32 lo = seg_start < (uint32) start ? start - seg_start : 0;
+                uint32 hi = last > (uint32) stop ? stop - seg_start : ref.count - 1;
+                segment.values.erase(segment.values.begin() + hi + 1, segment.values.end());
+                segment.values.erase(segment.values.begin(), segment.values.begin() + lo);
+                ref.count = segment.values.size();
+                SetListSegment(db, key, ref.id, segment);
+                segments.push_back(ref);
+            }
+            chunk.segments.refs = segments;
+            SetListIndexChunk(db, key, *meta, c - 1, chunk);
+        }
+        meta->size = stop - start + 1;
         SetMeta(db, key, *meta);
         DELETE(meta);
         return 0;
@@ -1433,37 +1693,61 @@ namespace ardb
             meta->header.expireat = 0;
             SetMeta(db2, key2, *meta);
         }
-        else
+        else if (meta->IsScoreLayout())
         {
-            ListKeyObject lk(key1, meta->min_score, db1);
-            ListMetaValue lmeta;
-            lmeta.ziped = false;
-            struct LSetWalk: public WalkHandler
+            ListKeyObject lk(key1, -FLT_MAX, db1);
+            struct RenameWalk: public WalkHandler
             {
                     Ardb* z_db;
-                    DBID dstdb;
-                    const Slice& dst;
-                    ListMetaValue& lm;
+                    ValueDataDeque values;
                     int OnKeyValue(KeyObject* k, ValueObject* v, uint32 cursor)
                     {
                         CommonValueObject* cv = (CommonValueObject*) v;
-                        ListKeyObject* sek = (ListKeyObject*) k;
-                        sek->key = dst;
-                        sek->db = dstdb;
-                        z_db->SetKeyValueObject(*sek, *cv);
-                        lm.size++;
+                        values.push_back(cv->data);
+                        z_db->DelValue(*k);
                         return 0;
                     }
-                    LSetWalk(Ardb* db, const DBID& dbid, const Slice& v, ListMetaValue& l) :
-                            z_db(db), dstdb(dbid), dst(v), lm(l)
+                    RenameWalk(Ardb* db) :
+                            z_db(db)
                     {
                     }
-            } walk(this, db2, key2, lmeta);
+            } walk(this);
             Walk(lk, false, true, &walk);
+            ListMetaValue lmeta;
+            ListAppendValues(db2, key2, lmeta, walk.values);
+            lmeta.size = walk.values.size();
+            DelMeta(db1, key1, meta);
             SetMeta(db2, key2, lmeta);
-            LClear(db1, key1);
+        }
+        else
+        {
+            /*
+             * Segments & index chunks keep their ids, so the meta is valid for the new key as is
+             */
+            for (size_t c = 0; c < meta->chunks.refs.size(); c++)
+            {
+                ListIndexChunkValue chunk;
+                if (0 == GetListIndexChunk(db1, key1, *meta, c, chunk))
+                {
+                    for (size_t i = 0; i < chunk.segments.refs.size(); i++)
+                    {
+                        ListSegmentValue segment;
+                        if (0 == GetListSegment(db1, key1, chunk.segments.refs[i].id, segment))
+                        {
+                            SetListSegment(db2, key2, chunk.segments.refs[i].id, segment);
+                        }
+                        DelListSegment(db1, key1, chunk.segments.refs[i].id);
+                    }
+                    ListIndexKeyObject ik(key2, meta->chunks.refs[c].id, db2);
+                    SetKeyValueObject(ik, chunk);
+                }
+                ListIndexKeyObject ik(key1, meta->chunks.refs[c].id, db1);
+                DelValue(ik);
+            }
+            DelMeta(db1, key1, meta);
+            meta->header.expireat = 0;
+            SetMeta(db2, key2, *meta);
         }
         return 0;
     }
 }
-
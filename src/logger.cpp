@@ -29,10 +29,15 @@
 
 #include "logger.hpp"
 #include "util/helpers.hpp"
+#include "util/concurrent_queue.hpp"
+#include "util/thread/thread.hpp"
 #include "util/thread/thread_mutex.hpp"
+#include "util/thread/thread_mutex_lock.hpp"
 #include "util/thread/lock_guard.hpp"
 #include <stdarg.h>
 #include <stdio.h>
+#include <errno.h>
+#include <sys/uio.h>
 #include <sstream>
 namespace ardb
 {
@@ -46,8 +51,12 @@ namespace ardb
     static LogLevel kDeafultLevel = DEBUG_LOG_LEVEL;
     static FILE* kLogFile = stdout;
     static std::string kLogFilePath;
-    static const uint32 k_max_file_size = 100 * 1024 * 1024;
     static const uint32 k_max_rolling_index = 2;
+    static LoggerOptions kLogOptions;
+    //bytes of the current log file & the time it was opened, owned by the thread writing records
+    static uint64 kLogFileSize = 0;
+    static uint64 kLogFileOpenTime = 0;
+    static volatile uint64_t kDroppedRecords = 0;
 
     static ThreadMutex kLogMutex;
 
@@ -60,9 +69,13 @@ namespace ardb
             if (NULL == kLogFile)
             {
                 kLogFile = stdout;
-                WARN_LOG("Failed to open log file:%s, use stdout instead.");
+                WARN_LOG("Failed to open log file:%s, use stdout instead.", kLogFilePath.c_str());
                 return;
             }
+            fseek(kLogFile, 0, SEEK_END);
+            long file_size = ftell(kLogFile);
+            kLogFileSize = file_size > 0 ? file_size : 0;
+            kLogFileOpenTime = get_current_epoch_millis() / 1000;
         }
     }
 
@@ -97,6 +110,174 @@ namespace ardb
         rename(kLogFilePath.c_str(), path.c_str());
     }
 
+    static void rollover_logfile_if_needed()
+    {
+        if (kLogFilePath.empty() || kLogFile == stdout)
+        {
+            return;
+        }
+        bool rollover = kLogOptions.rotate_size > 0 && kLogFileSize >= kLogOptions.rotate_size;
+        if (!rollover && kLogOptions.rotate_interval > 0)
+        {
+            rollover = get_current_epoch_millis() / 1000 >= kLogFileOpenTime + kLogOptions.rotate_interval;
+        }
+        if (rollover)
+        {
+            rollover_default_logfile();
+            reopen_default_logfile();
+        }
+    }
+
+    /*
+     * Background writer of the asynchronous logger. Worker threads append formatted records to a
+     * lock free ring, the writer drains it in batches written by one writev call and owns the log
+     * file, including its rotation. It waits on a condition only when the ring is empty, so a
+     * producer signals it only if it is flagged as waiting.
+     */
+    class AsyncLogWriter: public Thread
+    {
+        private:
+            static const uint32 kMaxBatchRecords = 256;
+            MPSCRingQueue<std::string> m_ring;
+            ThreadMutexLock m_lock;
+            pthread_t m_tid;
+            volatile bool m_running;
+            volatile uint32 m_waiting;
+            volatile uint32 m_writing;
+            void Wakeup()
+            {
+                LockGuard<ThreadMutexLock> guard(m_lock);
+                m_lock.Notify();
+            }
+            void WriteBatch(std::vector<std::string>& batch, size_t count)
+            {
+                struct iovec iov[kMaxBatchRecords];
+                for (size_t i = 0; i < count; i++)
+                {
+                    iov[i].iov_base = (void*) batch[i].data();
+                    iov[i].iov_len = batch[i].size();
+                }
+                int fd = fileno(kLogFile);
+                struct iovec* next = iov;
+                size_t left = count;
+                while (left > 0)
+                {
+                    ssize_t n = writev(fd, next, left);
+                    if (n < 0)
+                    {
+                        if (errno == EINTR)
+                        {
+                            continue;
+                        }
+                        break;
+                    }
+                    kLogFileSize += n;
+                    //skip fully written records, then the written part of a partial one
+                    while (left > 0 && (size_t) n >= next->iov_len)
+                    {
+                        n -= next->iov_len;
+                        next++;
+                        left--;
+                    }
+                    if (left > 0)
+                    {
+                        next->iov_base = (char*) next->iov_base + n;
+                        next->iov_len -= n;
+                    }
+                }
+                for (size_t i = 0; i < count; i++)
+                {
+                    batch[i].clear();
+                }
+                rollover_logfile_if_needed();
+            }
+        public:
+            AsyncLogWriter(uint32 size) :
+                    m_ring(size), m_tid(pthread_self()), m_running(true), m_waiting(0), m_writing(0)
+            {
+            }
+            bool IsRunning()
+            {
+                return m_running;
+            }
+            bool Append(std::string& record, bool block)
+            {
+                while (!m_ring.TryPush(record))
+                {
+                    //the writer itself must never wait for its own ring
+                    if (!block || pthread_equal(m_tid, pthread_self()))
+                    {
+                        atomic_add_uint64(&kDroppedRecords, 1);
+                        return false;
+                    }
+                    Wakeup();
+                    usleep(100);
+                }
+                __memory_barrier();
+                if (m_waiting)
+                {
+                    Wakeup();
+                }
+                return true;
+            }
+            /*
+             * Waits until records appended before are written, at most 'timeout' ms
+             */
+            void Flush(uint32 timeout)
+            {
+                uint64 start = get_current_epoch_millis();
+                while ((m_ring.Size() > 0 || m_writing) && get_current_epoch_millis() < start + timeout)
+                {
+                    Wakeup();
+                    usleep(100);
+                }
+            }
+            uint64 Pending()
+            {
+                return m_ring.Size();
+            }
+            void Run()
+            {
+                m_tid = pthread_self();
+                std::vector<std::string> batch(kMaxBatchRecords);
+                while (true)
+                {
+                    m_writing = 1;
+                    size_t count = 0;
+                    while (count < kMaxBatchRecords && m_ring.Pop(batch[count]))
+                    {
+                        count++;
+                    }
+                    if (count > 0)
+                    {
+                        WriteBatch(batch, count);
+                        continue;
+                    }
+                    m_writing = 0;
+                    if (!m_running)
+                    {
+                        break;
+                    }
+                    rollover_logfile_if_needed();
+                    LockGuard<ThreadMutexLock> guard(m_lock);
+                    m_waiting = 1;
+                    __memory_barrier();
+                    if (m_running && m_ring.Size() == 0)
+                    {
+                        m_lock.Wait(100);
+                    }
+                    m_waiting = 0;
+                }
+            }
+            void StopWriter()
+            {
+                m_running = false;
+                Wakeup();
+                Join();
+            }
+    };
+    static AsyncLogWriter* kAsyncWriter = NULL;
+
     static void default_loghandler(LogLevel level, const char* filename, const char* function, int line,
                     const char* format, ...)
     {
@@ -144,22 +325,28 @@ namespace ardb
         char timetag[256];
         struct tm& tm = get_current_tm();
         sprintf(timetag, "%02u-%02u %02u:%02u:%02u", tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
-        LockGuard<ThreadMutex> guard(kLogMutex);
-        fprintf(kLogFile, "[%u] %s,%03u %s %s\n", getpid(), timetag, mills, levelstr, record.c_str());
-        fflush(kLogFile);
-        if (!kLogFilePath.empty() && kLogFile != stdout)
+        AsyncLogWriter* writer = kAsyncWriter;
+        if (NULL != writer && writer->IsRunning())
         {
-            long file_size = ftell(kLogFile);
-            if (file_size < 0)
-            {
-                reopen_default_logfile();
-            }
-            else if ((uint32) file_size >= k_max_file_size)
+            char header[512];
+            int header_len = snprintf(header, sizeof(header), "[%u] %s,%03u %s ", getpid(), timetag, mills, levelstr);
+            record.insert(0, header, header_len);
+            record.push_back('\n');
+            writer->Append(record, kLogOptions.block_on_full);
+            if (level <= FATAL_LOG_LEVEL)
             {
-                rollover_default_logfile();
-                reopen_default_logfile();
+                writer->Flush(1000);
             }
+            return;
+        }
+        LockGuard<ThreadMutex> guard(kLogMutex);
+        int written = fprintf(kLogFile, "[%u] %s,%03u %s %s\n", getpid(), timetag, mills, levelstr, record.c_str());
+        fflush(kLogFile);
+        if (written > 0)
+        {
+            kLogFileSize += written;
         }
+        rollover_logfile_if_needed();
     }
 
     static bool default_logchcker(LogLevel level)
@@ -202,21 +389,48 @@ namespace ardb
         }
     }
 
-    void ArdbLogger::InitDefaultLogger(const std::string& level, const std::string& logfile)
+    void ArdbLogger::InitDefaultLogger(const std::string& level, const std::string& logfile,
+                    const LoggerOptions& options)
     {
+        kLogOptions = options;
         if (!logfile.empty() && (logfile != "stdout" && logfile != "stderr"))
         {
             kLogFilePath = logfile;
             reopen_default_logfile();
         }
         SetLogLevel(level);
+        if (options.async && NULL == kAsyncWriter)
+        {
+            NEW(kAsyncWriter, AsyncLogWriter(options.buffer_size));
+            kAsyncWriter->Start();
+        }
+    }
+
+    uint64_t ArdbLogger::GetDroppedRecords()
+    {
+        return kDroppedRecords;
+    }
+
+    uint64_t ArdbLogger::GetPendingRecords()
+    {
+        return NULL != kAsyncWriter ? kAsyncWriter->Pending() : 0;
     }
 
     void ArdbLogger::DestroyDefaultLogger()
     {
+        if (NULL != kAsyncWriter)
+        {
+            /*
+             * The writer drains the ring before it exits. It's not released since a late record from
+             * another thread could still be on its way, the handler writes synchronously from now on.
+             */
+            kAsyncWriter->StopWriter();
+        }
+        LockGuard<ThreadMutex> guard(kLogMutex);
         if (kLogFile != stdout)
         {
             fclose(kLogFile);
+            kLogFile = stdout;
         }
     }
 
@@ -31,6 +31,7 @@
 #define LOGGER_MACROS_HPP_
 
 #include <string>
+#include <stdint.h>
 
 namespace ardb
 {
@@ -63,13 +64,36 @@ namespace ardb
             }
     };
 
+    /*
+     * Options of the default logger. Asynchronous records are formatted by the calling thread and
+     * appended to a bounded ring, a background thread writes them out in batches.
+     */
+    struct LoggerOptions
+    {
+            bool async;
+            //max pending records of the ring
+            uint32_t buffer_size;
+            //block the calling thread once the ring is full instead of dropping the record
+            bool block_on_full;
+            //roll the log file once it reaches the size, or every interval secs, 0 disables
+            uint64_t rotate_size;
+            uint32_t rotate_interval;
+            LoggerOptions() :
+                            async(true), buffer_size(8192), block_on_full(false), rotate_size(100 * 1024 * 1024), rotate_interval(
+                                            0)
+            {
+            }
+    };
+
     struct ArdbLogger
     {
             static ArdbLogHandler* GetLogHandler();
             static IsLogEnable* GetLogChecker();
             static void InstallLogHandler(LoggerSetting& setting);
             static void InitDefaultLogger(const std::string& level,
-                            const std::string& logfile);
+                            const std::string& logfile, const LoggerOptions& options = LoggerOptions());
+            static uint64_t GetDroppedRecords();
+            static uint64_t GetPendingRecords();
             static void SetLogLevel(const std::string& level);
             static void DestroyDefaultLogger();
             static FILE* GetLogStream();
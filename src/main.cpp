@@ -57,7 +57,9 @@ void usage()
     fprintf(stderr,
                     "       ./ardb-server (run the server with default conf)\n");
     fprintf(stderr, "       ./ardb-server /etc/ardb/16379.conf\n");
-    fprintf(stderr, "       ./ardb-server /etc/myardb.conf \n\n");
+    fprintf(stderr, "       ./ardb-server /etc/myardb.conf \n");
+    fprintf(stderr, "       ./ardb-server /etc/myardb.conf --slaveof 127.0.0.1:6379 "
+            "--restore-checkpoint /backup/checkpoint-1400000000 \n\n");
     exit(1);
 }
 
@@ -89,6 +91,12 @@ int main(int argc, char** argv)
                 return -1;
             }
         }
+        /* All other options are '--name value' pairs overriding the config file */
+        while (j + 1 < argc && argv[j][0] == '-' && argv[j][1] == '-')
+        {
+            conf_set(props, argv[j] + 2, argv[j + 1]);
+            j += 2;
+        }
     }
     else
     {
@@ -28,13 +28,68 @@
  */
 
 #include "ardb_server.hpp"
-#include <fnmatch.h>
 
 namespace ardb
 {
+    ArdbServer::PubSubShard& ArdbServer::GetPubSubShard(const std::string& channel)
+    {
+        return m_pubsub_shards[StringHash()(channel) % kPubSubShardCount];
+    }
+
+    void ArdbServer::AddSubscriber(ArdbConnContext& ctx, const std::string& channel, bool is_pattern)
+    {
+        if (is_pattern)
+        {
+            WriteLockGuard<SpinRWLock> guard(m_pattern_pubsub_lock);
+            ContextSet& set = m_pattern_pubsub_context_table[channel];
+            if (set.empty())
+            {
+                m_pattern_index.Add(channel);
+            }
+            set.insert(&ctx);
+        }
+        else
+        {
+            PubSubShard& shard = GetPubSubShard(channel);
+            WriteLockGuard<SpinRWLock> guard(shard.lock);
+            shard.table[channel].insert(&ctx);
+        }
+    }
+
+    void ArdbServer::RemoveSubscriber(ArdbConnContext& ctx, const std::string& channel, bool is_pattern)
+    {
+        if (is_pattern)
+        {
+            WriteLockGuard<SpinRWLock> guard(m_pattern_pubsub_lock);
+            PubSubContextTable::iterator found = m_pattern_pubsub_context_table.find(channel);
+            if (found != m_pattern_pubsub_context_table.end())
+            {
+                found->second.erase(&ctx);
+                if (found->second.empty())
+                {
+                    m_pattern_index.Remove(channel);
+                    m_pattern_pubsub_context_table.erase(found);
+                }
+            }
+        }
+        else
+        {
+            PubSubShard& shard = GetPubSubShard(channel);
+            WriteLockGuard<SpinRWLock> guard(shard.lock);
+            PubSubContextTable::iterator found = shard.table.find(channel);
+            if (found != shard.table.end())
+            {
+                found->second.erase(&ctx);
+                if (found->second.empty())
+                {
+                    shard.table.erase(found);
+                }
+            }
+        }
+    }
+
     int ArdbServer::Subscribe(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
-        LockGuard<ThreadMutex> guard(m_pubsub_mutex);
         ArgumentArray::const_iterator it = cmd.GetArguments().begin();
         while (it != cmd.GetArguments().end())
         {
@@ -44,7 +99,7 @@ namespace ardb
             r.elements.push_back(RedisReply(*it));
 
             ctx.GetPubSub().pubsub_channle_set.insert(*it);
-            m_pubsub_context_table[*it].insert(&ctx);
+            AddSubscriber(ctx, *it, false);
             r.elements.push_back(RedisReply(ctx.SubChannelSize()));
             ctx.conn->Write(r);
             it++;
@@ -54,32 +109,22 @@ namespace ardb
 
     void ArdbServer::ClearSubscribes(ArdbConnContext& ctx)
     {
-        LockGuard<ThreadMutex> guard(m_pubsub_mutex);
         PubSubChannelSet::iterator it = ctx.GetPubSub().pubsub_channle_set.begin();
         while (it != ctx.GetPubSub().pubsub_channle_set.end())
         {
-            PubSubContextTable::iterator found = m_pubsub_context_table.find(*it);
-            if (found != m_pubsub_context_table.end())
-            {
-                found->second.erase(&ctx);
-            }
+            RemoveSubscriber(ctx, *it, false);
             it++;
         }
         it = ctx.GetPubSub().pattern_pubsub_channle_set.begin();
         while (it != ctx.GetPubSub().pattern_pubsub_channle_set.end())
         {
-            PubSubContextTable::iterator found = m_pattern_pubsub_context_table.find(*it);
-            if (found != m_pattern_pubsub_context_table.end())
-            {
-                found->second.erase(&ctx);
-            }
+            RemoveSubscriber(ctx, *it, true);
             it++;
         }
         ctx.ClearPubSub();
     }
 
-    template<typename T>
-    static void unsubscribe(ArdbConnContext& ctx, const ArgumentArray& cmd, bool is_pattern, T& submap)
+    void ArdbServer::UnSubscribeChannels(ArdbConnContext& ctx, const ArgumentArray& cmd, bool is_pattern)
     {
         PubSubChannelSet& uset = is_pattern ? ctx.GetPubSub().pattern_pubsub_channle_set : ctx.GetPubSub().pubsub_channle_set;
         if (cmd.empty())
@@ -99,12 +144,7 @@ namespace ardb
                 uint32 i = 1;
                 while (it != uset.end())
                 {
-                    //uset->erase(*it);
-                    typename T::iterator found = submap.find(*it);
-                    if (found != submap.end())
-                    {
-                        found->second.erase(&ctx);
-                    }
+                    RemoveSubscriber(ctx, *it, is_pattern);
                     RedisReply r;
                     r.type = REDIS_REPLY_ARRAY;
                     r.elements.push_back(RedisReply(is_pattern ? "punsubscribe" : "unsubscribe"));
@@ -122,11 +162,7 @@ namespace ardb
             while (it != cmd.end())
             {
                 uset.erase(*it);
-                typename T::iterator found = submap.find(*it);
-                if (found != submap.end())
-                {
-                    found->second.erase(&ctx);
-                }
+                RemoveSubscriber(ctx, *it, is_pattern);
                 RedisReply r;
                 r.type = REDIS_REPLY_ARRAY;
                 r.elements.push_back(RedisReply(is_pattern ? "punsubscribe" : "unsubscribe"));
@@ -140,13 +176,11 @@ namespace ardb
 
     int ArdbServer::UnSubscribe(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
-        LockGuard<ThreadMutex> guard(m_pubsub_mutex);
-        unsubscribe(ctx, cmd.GetArguments(), false, m_pubsub_context_table);
+        UnSubscribeChannels(ctx, cmd.GetArguments(), false);
         return 0;
     }
     int ArdbServer::PSubscribe(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
-        LockGuard<ThreadMutex> guard(m_pubsub_mutex);
         ArgumentArray::const_iterator it = cmd.GetArguments().begin();
         while (it != cmd.GetArguments().end())
         {
@@ -155,7 +189,7 @@ namespace ardb
             r.elements.push_back(RedisReply("psubscribe"));
             r.elements.push_back(RedisReply(*it));
             ctx.GetPubSub().pattern_pubsub_channle_set.insert(*it);
-            m_pattern_pubsub_context_table[*it].insert(&ctx);
+            AddSubscriber(ctx, *it, true);
             r.elements.push_back(RedisReply(ctx.SubChannelSize()));
             ctx.conn->Write(r);
             it++;
@@ -164,77 +198,126 @@ namespace ardb
     }
     int ArdbServer::PUnSubscribe(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
-        LockGuard<ThreadMutex> guard(m_pubsub_mutex);
-        unsubscribe(ctx, cmd.GetArguments(), true, m_pattern_pubsub_context_table);
+        UnSubscribeChannels(ctx, cmd.GetArguments(), true);
         return 0;
     }
 
-    static void async_write_message(Channel* ch, void * data)
+    /*
+     * Subscribers of a message served by the same channel service, they share one reply which is
+     * written by that service's own thread.
+     */
+    struct PubSubDelivery
     {
-        RedisReply* r = (RedisReply*) data;
-        ch->Write(*r);
-        DELETE(r);
-    }
+            ChannelService* service;
+            std::vector<uint32> conn_ids;
+            RedisReply reply;
+            PubSubDelivery() :
+                    service(NULL)
+            {
+            }
+    };
+    typedef std::map<ChannelService*, PubSubDelivery*> PubSubDeliveryTable;
 
-    static void publish_message(ContextSet& set, const std::string& message, const std::string& channel)
+    static int collect_subscribers(const ContextSet& set, PubSubDeliveryTable& deliveries)
     {
-        ContextSet::iterator it = set.begin();
+        ContextSet::const_iterator it = set.begin();
         while (it != set.end())
         {
-            NEW2(r, RedisReply, RedisReply);
-            r->type = REDIS_REPLY_ARRAY;
-            r->elements.push_back(RedisReply("message"));
-            r->elements.push_back(RedisReply(channel));
-            r->elements.push_back(RedisReply(message));
             Channel* ch = (*it)->conn;
-            ch->GetService().AsyncIO(ch->GetID(), async_write_message, r);
+            PubSubDelivery*& delivery = deliveries[&(ch->GetService())];
+            if (NULL == delivery)
+            {
+                NEW(delivery, PubSubDelivery);
+                delivery->service = &(ch->GetService());
+            }
+            delivery->conn_ids.push_back(ch->GetID());
             it++;
         }
+        return set.size();
     }
 
-    static void publish_pattern_message(ContextSet& set, const std::string& message, const std::string& pattern,
-            const std::string& channel)
+    static void async_write_message(Channel* ch, void * data)
     {
-        ContextSet::iterator it = set.begin();
-        while (it != set.end())
+        PubSubDelivery* delivery = (PubSubDelivery*) data;
+        for (size_t i = 0; i < delivery->conn_ids.size(); i++)
         {
-            NEW2(r, RedisReply, RedisReply);
-            r->type = REDIS_REPLY_ARRAY;
-            r->elements.push_back(RedisReply("pmessage"));
-            r->elements.push_back(RedisReply(pattern));
-            r->elements.push_back(RedisReply(channel));
-            r->elements.push_back(RedisReply(message));
-            Channel* ch = (*it)->conn;
-            ch->GetService().AsyncIO(ch->GetID(), async_write_message, r);
+            Channel* conn = delivery->service->GetChannel(delivery->conn_ids[i]);
+            if (NULL != conn)
+            {
+                conn->Write(delivery->reply);
+            }
+        }
+        DELETE(delivery);
+    }
+
+    static void publish_message(PubSubDeliveryTable& deliveries, const RedisReply& reply)
+    {
+        PubSubDeliveryTable::iterator it = deliveries.begin();
+        while (it != deliveries.end())
+        {
+            PubSubDelivery* delivery = it->second;
+            delivery->reply = reply;
+            delivery->service->AsyncIO(delivery->conn_ids[0], async_write_message, delivery);
             it++;
         }
+        deliveries.clear();
     }
 
     int ArdbServer::Publish(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
-        LockGuard<ThreadMutex> guard(m_pubsub_mutex);
         const std::string& channel = cmd.GetArguments()[0];
         const std::string& message = cmd.GetArguments()[1];
-        PubSubContextTable::iterator found = m_pubsub_context_table.find(channel);
         int size = 0;
-        if (found != m_pubsub_context_table.end())
+        PubSubDeliveryTable deliveries;
+        {
+            PubSubShard& shard = GetPubSubShard(channel);
+            ReadLockGuard<SpinRWLock> guard(shard.lock);
+            PubSubContextTable::iterator found = shard.table.find(channel);
+            if (found != shard.table.end())
+            {
+                size += collect_subscribers(found->second, deliveries);
+            }
+        }
+        if (!deliveries.empty())
         {
-            size = found->second.size();
-            publish_message(found->second, message, channel);
+            RedisReply r;
+            r.type = REDIS_REPLY_ARRAY;
+            r.elements.push_back(RedisReply("message"));
+            r.elements.push_back(RedisReply(channel));
+            r.elements.push_back(RedisReply(message));
+            publish_message(deliveries, r);
         }
-        PubSubContextTable::iterator it = m_pattern_pubsub_context_table.begin();
-        while (it != m_pattern_pubsub_context_table.end())
+
+        std::vector<std::string> patterns;
+        std::vector<PubSubDeliveryTable> pattern_deliveries;
         {
-            if (fnmatch(it->first.c_str(), channel.c_str(), 0) == 0)
+            ReadLockGuard<SpinRWLock> guard(m_pattern_pubsub_lock);
+            if (!m_pattern_pubsub_context_table.empty())
             {
-                publish_pattern_message(it->second, message, it->first, channel);
-                size += it->second.size();
+                m_pattern_index.Match(channel, patterns);
+                pattern_deliveries.resize(patterns.size());
+                for (size_t i = 0; i < patterns.size(); i++)
+                {
+                    PubSubContextTable::iterator found = m_pattern_pubsub_context_table.find(patterns[i]);
+                    if (found != m_pattern_pubsub_context_table.end())
+                    {
+                        size += collect_subscribers(found->second, pattern_deliveries[i]);
+                    }
+                }
             }
-            it++;
+        }
+        for (size_t i = 0; i < patterns.size(); i++)
+        {
+            RedisReply r;
+            r.type = REDIS_REPLY_ARRAY;
+            r.elements.push_back(RedisReply("pmessage"));
+            r.elements.push_back(RedisReply(patterns[i]));
+            r.elements.push_back(RedisReply(channel));
+            r.elements.push_back(RedisReply(message));
+            publish_message(pattern_deliveries[i], r);
         }
         ctx.reply.integer = size;
         ctx.reply.type = REDIS_REPLY_INTEGER;
         return 0;
     }
 }
-
@@ -6,16 +6,40 @@
  */
 #include "backup.hpp"
 #include "ardb_server.hpp"
+#include <algorithm>
 
 namespace ardb
 {
+	static bool is_table_file(const std::string& name)
+	{
+		return has_suffix(name, ".ldb") || has_suffix(name, ".sst");
+	}
 
 	Backup::Backup(ArdbServer* server) :
-			m_is_saving(false), m_server(server), m_last_save(0)
+			m_is_saving(false), m_server(server), m_last_save(0), m_repl_mark(0)
 	{
 
 	}
-	int Backup::Save()
+
+	std::string Backup::LastCheckpoint()
+	{
+		std::deque<std::string> dirs;
+		list_subdirs(m_server->m_cfg.backup_dir, dirs);
+		std::sort(dirs.begin(), dirs.end());
+		while (!dirs.empty())
+		{
+			std::string path = m_server->m_cfg.backup_dir + "/" + dirs.back();
+			if (has_prefix(dirs.back(), ARDB_CHECKPOINT_PREFIX)
+					&& is_file_exist(path + "/" + ARDB_CHECKPOINT_META))
+			{
+				return path;
+			}
+			dirs.pop_back();
+		}
+		return "";
+	}
+
+	int Backup::Save(bool incremental, std::string& path)
 	{
 		if (m_is_saving)
 		{
@@ -26,67 +50,194 @@ namespace ardb
 			ERROR_LOG("Empty bakup dir for backup.");
 			return -1;
 		}
-		//m_server->m_db->CloseAll();
 		m_is_saving = true;
-		int ret = 0;
-		char cmd[m_server->m_cfg.data_base_path.size() + 256];
-		make_dir(m_server->m_cfg.backup_dir);
-
-		char dest[m_server->m_cfg.backup_dir.size() + 256];
-		char shasumfile[m_server->m_cfg.backup_dir.size() + 256];
+		std::string engine_name = m_server->m_engine.GetName();
+		std::string base;
+		if (incremental)
+		{
+			base = LastCheckpoint();
+			if (base.empty())
+			{
+				INFO_LOG("No checkpoint to take an incremental one from, take a full checkpoint.");
+			}
+		}
 		uint32 now = time(NULL);
-		sprintf(dest, "%s/dbsave-%u.tar", m_server->m_cfg.backup_dir.c_str(), now);
-		sprintf(shasumfile, "%s/dbsave-%u.sha", m_server->m_cfg.backup_dir.c_str(), now);
-		std::string source = m_server->m_cfg.data_base_path;
-		if (0 == chdir(m_server->m_cfg.data_base_path.c_str()))
+		char name[256];
+		sprintf(name, "%s%u", ARDB_CHECKPOINT_PREFIX, now);
+		path = m_server->m_cfg.backup_dir + "/" + name;
+		for (uint32 i = 1; is_dir_exist(path); i++)
 		{
-			source = "*";
+			sprintf(name, "%s%u.%u", ARDB_CHECKPOINT_PREFIX, now, i);
+			path = m_server->m_cfg.backup_dir + "/" + name;
 		}
-		sprintf(cmd, "tar cf %s %s;", dest, source.c_str());
-		ret = system(cmd);
-		if (0 != chdir(m_server->m_cfg.home.c_str()))
+		make_dir(path + "/" + engine_name);
+		struct BGTask: public Thread
 		{
-			WARN_LOG("Failed to change dir to home:%s", m_server->m_cfg.home.c_str());
+				Backup* backup;
+				std::string path;
+				std::string base;
+				uint32 now;
+				BGTask(Backup* b, const std::string& p, const std::string& bs, uint32 t) :
+						backup(b), path(p), base(bs), now(t)
+				{
+				}
+				void Run()
+				{
+					backup->DoSave(path, base, now);
+					backup->m_is_saving = false;
+					delete this;
+				}
+		};
+		BGTask* task = new BGTask(this, path, base, now);
+		task->Start();
+		return 0;
+	}
+
+	/*
+	 * Called by the engine around fixing the data it copies. No more commands are applied while paused,
+	 * a mark offered then follows exactly the commands fed so far, the master thread records the
+	 * replication state at it later and the checkpoint waits for it once writes go on. A slave applying
+	 * commands in parallel feeds them after applying, a slave restored from its checkpoint may still
+	 * replay some commands already in the checkpoint, like after a full resync.
+	 */
+	void Backup::PauseWrites(bool pause, void* data)
+	{
+		Backup* backup = (Backup*) data;
+		ArdbServer* server = backup->m_server;
+		if (!pause)
+		{
+			server->m_write_pause_lock.Unlock(WRITE_LOCK);
+			return;
 		}
-		if (-1 == ret)
+		server->m_write_pause_lock.Lock(WRITE_LOCK);
+		backup->m_repl_mark = server->m_master_serv.OfferMark();
+	}
+
+	int Backup::DoSave(const std::string& path, const std::string& base, uint32 now)
+	{
+		std::string engine_name = m_server->m_engine.GetName();
+		uint64 start = get_current_epoch_millis();
+		int ret = m_server->m_db->GetEngine()->Checkpoint(path + "/" + engine_name,
+				base.empty() ? "" : base + "/" + engine_name, PauseWrites, this);
+		ReplMark mark;
+		if (0 == ret && m_server->m_repl_backlog.IsInited()
+				&& !m_server->m_master_serv.WaitMark(m_repl_mark, 10000, mark))
 		{
-			ERROR_LOG( "Failed to create backup data archive:%s", dest);
+			ERROR_LOG("Failed to record the replication offset of checkpoint:%s", path.c_str());
+			ret = -1;
 		}
-		else
+		if (0 == ret)
 		{
-			std::string sha1sum_str;
-			ret = sha1sum_file(dest, sha1sum_str);
-			if (-1 == ret)
+			std::string meta;
+			meta.append("engine ").append(engine_name).append("\n");
+			meta.append("time ").append(stringfromll(now)).append("\n");
+			if (!base.empty())
 			{
-				ERROR_LOG( "Failed to compute sha1sum for data archive:%s", dest);
+				meta.append("base ").append(get_basename(base)).append("\n");
 			}
-			else
+			if (m_server->m_repl_backlog.IsInited())
 			{
-				INFO_LOG("Save file SHA1sum is %s", sha1sum_str.c_str());
-				file_write_content(shasumfile, sha1sum_str);
-				m_last_save = now;
+				meta.append("server-key ").append(mark.server_key).append("\n");
+				meta.append("repl-offset ").append(stringfromll(mark.offset)).append("\n");
+				meta.append("repl-cksm ").append(stringfromll(mark.cksm)).append("\n");
+				meta.append("repl-db ").append(stringfromll(mark.db)).append("\n");
 			}
+			/*
+			 * Written last, a checkpoint without it is incomplete
+			 */
+			ret = file_write_content(path + "/" + ARDB_CHECKPOINT_META, meta);
+		}
+		if (0 == ret)
+		{
+			INFO_LOG("Saved %s checkpoint:%s in %llums", base.empty() ? "full" : "incremental", path.c_str(),
+					get_current_epoch_millis() - start);
+			m_last_save = now;
+		}
+		else
+		{
+			ERROR_LOG("Failed to save checkpoint:%s", path.c_str());
 		}
-		m_is_saving = false;
 		return ret;
 	}
-	int Backup::BGSave()
+
+	int Backup::Restore(const std::string& checkpoint, const std::string& data_dir, const std::string& engine_name)
 	{
-		struct BGTask: public Thread
+		Properties meta;
+		std::string checkpoint_engine;
+		if (!parse_conf_file(checkpoint + "/" + ARDB_CHECKPOINT_META, meta, " ")
+				|| !conf_get_string(meta, "engine", checkpoint_engine))
 		{
-				Backup* serv;
-				BGTask(Backup* s) :
-						serv(s)
-				{
-				}
-				void Run()
-				{
-					serv->Save();
-					delete this;
-				}
-		};
-		BGTask* task = new BGTask(this);
-		task->Start();
+			ERROR_LOG("Invalid checkpoint:%s", checkpoint.c_str());
+			return -1;
+		}
+		if (checkpoint_engine != engine_name)
+		{
+			ERROR_LOG("Checkpoint:%s is taken by engine %s, not %s.", checkpoint.c_str(), checkpoint_engine.c_str(),
+					engine_name.c_str());
+			return -1;
+		}
+		std::string src = checkpoint + "/" + engine_name;
+		std::string dest = data_dir + "/" + engine_name;
+		std::deque<std::string> files;
+		if (0 != list_subfiles(src, files))
+		{
+			ERROR_LOG("Invalid checkpoint:%s", checkpoint.c_str());
+			return -1;
+		}
+		if (is_dir_exist(dest))
+		{
+			char moved[dest.size() + 64];
+			sprintf(moved, "%s.before-restore-%u", dest.c_str(), (uint32) time(NULL));
+			if (0 != rename(dest.c_str(), moved))
+			{
+				ERROR_LOG("Failed to move data dir:%s away", dest.c_str());
+				return -1;
+			}
+			INFO_LOG("Moved data dir:%s to %s", dest.c_str(), moved);
+		}
+		make_dir(dest);
+		for (uint32 i = 0; i < files.size(); i++)
+		{
+			/*
+			 * Only immutable tables could be shared with the checkpoint
+			 */
+			int ret = is_table_file(files[i]) ?
+					file_link_or_copy(src + "/" + files[i], dest + "/" + files[i]) :
+					file_copy(src + "/" + files[i], dest + "/" + files[i]);
+			if (0 != ret)
+			{
+				ERROR_LOG("Failed to restore %s from checkpoint:%s", files[i].c_str(), checkpoint.c_str());
+				return -1;
+			}
+		}
+		INFO_LOG("Restored data dir:%s from checkpoint:%s", dest.c_str(), checkpoint.c_str());
+		return 0;
+	}
+
+	int Backup::RestoreReplState(const std::string& checkpoint, ReplBacklog& backlog)
+	{
+		Properties meta;
+		std::string server_key;
+		int64 offset = 0, cksm = 0, db = 0;
+		if (!parse_conf_file(checkpoint + "/" + ARDB_CHECKPOINT_META, meta, " "))
+		{
+			return -1;
+		}
+		if (!conf_get_string(meta, "server-key", server_key) || server_key.size() != SERVER_KEY_SIZE
+				|| !conf_get_int64(meta, "repl-offset", offset))
+		{
+			WARN_LOG("Checkpoint:%s has no replication state, a slave restored from it needs a full resync.",
+					checkpoint.c_str());
+			return -1;
+		}
+		conf_get_int64(meta, "repl-cksm", cksm);
+		conf_get_int64(meta, "repl-db", db);
+		backlog.SetServerkey(server_key);
+		backlog.SetReplOffset(offset);
+		backlog.SetChecksum((uint64) cksm);
+		backlog.SetCurrentDBID((DBID) db);
+		INFO_LOG("Restored replication state serverkey:%s offset:%lld from checkpoint:%s", server_key.c_str(),
+				offset, checkpoint.c_str());
 		return 0;
 	}
 }
@@ -13,23 +13,48 @@
 #include <string>
 #include <time.h>
 
+#define ARDB_CHECKPOINT_PREFIX "checkpoint-"
+#define ARDB_CHECKPOINT_META "CHECKPOINT"
+
 namespace ardb
 {
 	class ArdbServer;
+	class ReplBacklog;
+	/*
+	 * A checkpoint is a dir 'checkpoint-<time>' in the backup dir holding an engine-native copy of
+	 * the data dir & a CHECKPOINT file with the replication state it was taken at, so that an
+	 * instance restored from it can partial resync with the master from that offset.
+	 */
 	class Backup
 	{
 		private:
-			bool m_is_saving;
+			volatile bool m_is_saving;
 			ArdbServer* m_server;
 			uint32 m_last_save;
+			uint64 m_repl_mark;
+			std::string LastCheckpoint();
+			int DoSave(const std::string& path, const std::string& base, uint32 now);
+			static void PauseWrites(bool pause, void* data);
 		public:
 			Backup(ArdbServer* server);
-			int Save();
-			int BGSave();
+			/*
+			 * Start taking a checkpoint into path in the background, an incremental one reuses the
+			 * unchanged tables of the last checkpoint.
+			 */
+			int Save(bool incremental, std::string& path);
 			uint32 LastSave()
 			{
 				return m_last_save;
 			}
+			/*
+			 * Replace the engine data in data_dir by the checkpoint, must be called before the engine is opened.
+			 */
+			static int Restore(const std::string& checkpoint, const std::string& data_dir,
+					const std::string& engine_name);
+			/*
+			 * Continue replication from the state recorded in the checkpoint.
+			 */
+			static int RestoreReplState(const std::string& checkpoint, ReplBacklog& backlog);
 	};
 }
 
@@ -7,25 +7,33 @@
 #include "master.hpp"
 #include "rdb.hpp"
 #include "ardb_server.hpp"
+#include "util/atomic.hpp"
 #include <fcntl.h>
 #include <sys/stat.h>
 
 #define REPL_INSTRUCTION_ADD_SLAVE 0
 #define REPL_INSTRUCTION_FEED_CMD 1
 #define REPL_INSTRUCTION_DELETE_SLAVES 2
+#define REPL_INSTRUCTION_MARK 3
 
 #define SOFT_SIGNAL_REPL_INSTRUCTION 1
 
 #define MAX_SEND_CACHE_SIZE 4096
 
+/*
+ * Bytes of key/values a full resync scan reads at a time
+ */
+#define MAX_SYNC_CHUNK_SIZE (1024 * 1024)
+
 namespace ardb
 {
     /*
      * Master
      */
     Master::Master(ArdbServer* server) :
-            m_server(server), m_notify_channel(NULL), m_backlog(server->m_repl_backlog), m_dumping_db(false), m_dumpdb_offset(
-                    -1),m_repl_no_slaves_since(0),m_backlog_enable(true), m_thread(NULL), m_thread_running(false)
+            m_server(server), m_notify_channel(NULL), m_offered_marks(0), m_done_marks(0), m_backlog(server->m_repl_backlog), m_dumping_db(false), m_dumpdb_offset(
+                    -1), m_sync_iter(NULL), m_sync_offset(0), m_sync_db(ARDB_GLOBAL_DB), m_sync_cksm(0), m_sync_scheduled(
+                    false), m_repl_no_slaves_since(0),m_backlog_enable(true), m_thread(NULL), m_thread_running(false)
     {
     }
 
@@ -227,6 +235,16 @@ namespace ardb
                     }
                     break;
                 }
+                case REPL_INSTRUCTION_MARK:
+                {
+                    LockGuard<ThreadMutex> guard(m_mark_mutex);
+                    m_mark.server_key = m_backlog.GetServerKey();
+                    m_mark.offset = m_backlog.GetReplEndOffset();
+                    m_mark.cksm = m_backlog.GetChecksum();
+                    m_mark.db = m_backlog.GetCurrentDBID();
+                    m_done_marks++;
+                    break;
+                }
                 default:
                 {
                     break;
@@ -234,6 +252,31 @@ namespace ardb
             }
         }
     }
+
+    uint64 Master::OfferMark()
+    {
+        uint64 seq = atomic_add_uint64(&m_offered_marks, 1);
+        ReplicationInstruction inst(NULL, REPL_INSTRUCTION_MARK);
+        OfferReplInstruction(inst);
+        return seq;
+    }
+
+    bool Master::WaitMark(uint64 seq, uint64 timeout_ms, ReplMark& mark)
+    {
+        uint64 start = get_current_epoch_millis();
+        while (m_thread_running && m_done_marks < seq && get_current_epoch_millis() - start < timeout_ms)
+        {
+            Thread::Sleep(1);
+        }
+        LockGuard<ThreadMutex> guard(m_mark_mutex);
+        if (m_done_marks < seq)
+        {
+            return false;
+        }
+        mark = m_mark;
+        return true;
+    }
+
     static void DumpRDBRoutine(void* cb)
     {
         ChannelService* serv = (ChannelService*) cb;
@@ -242,78 +285,200 @@ namespace ardb
 
     void Master::FullResyncArdbSlave(SlaveConnection& slave)
     {
+        /*
+         * Slaves requesting a full resync before the next scan starts all share it, the others
+         * wait until the running scan finished.
+         */
+        if (NULL != m_sync_iter || m_sync_scheduled)
+        {
+            return;
+        }
+        struct SyncScanTask: public Runnable
+        {
+                Master* serv;
+                SyncScanTask(Master* s) :
+                        serv(s)
+                {
+                }
+                void Run()
+                {
+                    serv->StartSyncScan();
+                }
+        };
+        m_sync_scheduled = true;
+        m_channel_service.GetTimer().ScheduleHeapTask(new SyncScanTask(this), m_server->m_cfg.repl_diskless_sync_delay,
+                -1, SECONDS);
+    }
+
+    void Master::StartSyncScan()
+    {
+        m_sync_scheduled = false;
         /*
          * Save dbid first. After full resynced, the first syncing
          * command MUST be SELECT to make sure that slave/master have
          * the same db syncing from cache.
          */
+        m_sync_db = m_backlog.GetCurrentDBID();
+        m_sync_cksm = m_backlog.GetChecksum();
+        m_sync_offset = m_backlog.GetReplEndOffset();
+        uint32 count = 0;
+        SlaveConnTable::iterator it = m_slave_table.begin();
+        while (it != m_slave_table.end())
+        {
+            SlaveConnection* slave = it->second;
+            if (!slave->isRedisSlave && slave->state == SLAVE_STATE_WAITING_DUMP_DATA)
+            {
+                Buffer msg;
+                msg.Printf("+FULLRESYNC %s %lld\r\n", m_backlog.GetServerKey(), m_sync_offset);
+                slave->conn->Write(msg);
+                slave->sync_offset = m_sync_offset;
+                slave->state = SLAVE_STATE_SYNING_DUMP_DATA;
+                count++;
+            }
+            it++;
+        }
+        if (0 == count)
+        {
+            return;
+        }
+        INFO_LOG("[Master]Start streaming snapshot to %u slaves at offset:%lld", count, m_sync_offset);
+        m_sync_iter = m_server->m_db->NewIterator();
+        ContinueSyncScan();
+    }
+
+    static bool sync_scan_accept(const SlaveConnection& slave, const DBID& db)
+    {
+        if (db == ARDB_GLOBAL_DB)
+        {
+            return true;
+        }
+        if (!slave.include_dbs.empty() && slave.include_dbs.count(db) == 0)
+        {
+            return false;
+        }
+        return slave.exclude_dbs.count(db) == 0;
+    }
 
-        DBID currentDB = m_backlog.GetCurrentDBID();
-        uint64 cksm = m_backlog.GetChecksum();
-        slave.sync_offset = m_backlog.GetReplEndOffset();
-        struct DBVisitor: public RawValueVisitor
+    /*
+     * Stream the next chunk of the snapshot to all slaves of the scan as __SET__ commands followed by
+     * '__SYNCCHUNK__ <count> <crc64>', return false while a slave still has the previous chunk to send.
+     */
+    bool Master::ContinueSyncScan()
+    {
+        if (NULL == m_sync_iter)
         {
-                SlaveConnection& conn;
-                uint64 count;
-                DBVisitor(SlaveConnection& c) :
-                        conn(c), count(0)
+            return true;
+        }
+        std::vector<SlaveConnection*> slaves;
+        SlaveConnTable::iterator it = m_slave_table.begin();
+        while (it != m_slave_table.end())
+        {
+            SlaveConnection* slave = it->second;
+            if (!slave->isRedisSlave && slave->state == SLAVE_STATE_SYNING_DUMP_DATA)
+            {
+                if (slave->conn->WritableBytes() > 0)
+                {
+                    return false;
+                }
+                slaves.push_back(slave);
+            }
+            it++;
+        }
+        if (slaves.empty())
+        {
+            FinishSyncScan();
+            return true;
+        }
+        std::vector<Buffer*> chunks(slaves.size());
+        std::vector<SyncChunk> sync_chunks(slaves.size());
+        for (size_t i = 0; i < slaves.size(); i++)
+        {
+            NEW(chunks[i], Buffer);
+        }
+        size_t chunk_size = 0;
+        while (m_sync_iter->Valid() && chunk_size < MAX_SYNC_CHUNK_SIZE)
+        {
+            Slice key = m_sync_iter->Key();
+            Slice value = m_sync_iter->Value();
+            DBID db;
+            KeyType type;
+            bool with_db = peek_dbkey_header(key, db, type);
+            Buffer encoded;
+            for (size_t i = 0; i < slaves.size(); i++)
+            {
+                if (with_db && !sync_scan_accept(*slaves[i], db))
                 {
+                    continue;
                 }
-                int OnRawKeyValue(const Slice& key, const Slice& value)
+                if (!encoded.Readable())
                 {
                     ArgumentArray args;
                     args.push_back("__SET__");
                     args.push_back(std::string(key.data(), key.size()));
                     args.push_back(std::string(value.data(), value.size()));
                     RedisCommandFrame cmd(args);
-                    conn.conn->Write(cmd);
-                    count++;
-                    if (count % 10000 == 0)
-                    {
-                        conn.conn->GetService().Continue();
-                    }
-                    return 0;
+                    RedisCommandEncoder::Encode(encoded, cmd);
                 }
-        } visitor(slave);
-
-        if (slave.include_dbs.empty() && slave.exclude_dbs.empty())
-        {
-            m_server->m_db->VisitAllDB(&visitor);
+                chunks[i]->Write(encoded.GetRawReadBuffer(), encoded.ReadableBytes());
+                sync_chunks[i].Add(key, value);
+            }
+            chunk_size += key.size() + value.size();
+            m_sync_iter->Next();
         }
-        else
+        for (size_t i = 0; i < slaves.size(); i++)
         {
-            DBIDSet visit_dbs = slave.include_dbs;
-            if (slave.include_dbs.empty())
+            uint32 conn_id = slaves[i]->conn->GetID();
+            if (sync_chunks[i].count > 0)
+            {
+                sync_chunks[i].WriteTrailer(*chunks[i]);
+                slaves[i]->conn->Write(*chunks[i]);
+            }
+            //the write may have closed the slave
+            if (m_slave_table.count(conn_id) > 0)
             {
-                m_server->m_db->GetAllDBIDSet(visit_dbs);
+                slaves[i]->conn->EnableWriting();
             }
-            if (!slave.exclude_dbs.empty())
+            DELETE(chunks[i]);
+        }
+        if (NULL != m_sync_iter && !m_sync_iter->Valid())
+        {
+            FinishSyncScan();
+        }
+        return true;
+    }
+
+    void Master::FinishSyncScan()
+    {
+        DELETE(m_sync_iter);
+        SlaveConnection* waiting = NULL;
+        SlaveConnTable::iterator it = m_slave_table.begin();
+        while (it != m_slave_table.end())
+        {
+            SlaveConnection* slave = it->second;
+            if (!slave->isRedisSlave && slave->state == SLAVE_STATE_SYNING_DUMP_DATA)
             {
-                DBIDSet::iterator it = slave.exclude_dbs.begin();
-                while (it != slave.exclude_dbs.end())
+                if (m_sync_db != ARDB_GLOBAL_DB)
                 {
-                    visit_dbs.erase(*it);
-                    it++;
+                    Buffer select;
+                    select.Printf("select %u\r\n", m_sync_db);
+                    slave->conn->Write(select);
                 }
+                Buffer msg;
+                msg.Printf("FULLSYNCED %llu %llu\r\n", m_sync_offset, m_sync_cksm);
+                slave->conn->Write(msg);
+                SendCacheToSlave(*slave);
             }
-            DBIDSet::iterator it = visit_dbs.begin();
-            while (it != visit_dbs.end())
+            else if (!slave->isRedisSlave && slave->state == SLAVE_STATE_WAITING_DUMP_DATA)
             {
-                m_server->m_db->VisitDB(*it, &visitor);
-                it++;
+                waiting = slave;
             }
-            m_server->m_db->VisitDB(ARDB_GLOBAL_DB, &visitor);
+            it++;
         }
-        if (currentDB != ARDB_GLOBAL_DB)
+        INFO_LOG("[Master]Finish streaming snapshot at offset:%lld", m_sync_offset);
+        if (NULL != waiting)
         {
-            Buffer select;
-            select.Printf("select %u\r\n", currentDB);
-            slave.conn->Write(select);
+            FullResyncArdbSlave(*waiting);
         }
-        Buffer msg;
-        msg.Printf("FULLSYNCED %llu %llu\r\n", slave.sync_offset, cksm);
-        slave.conn->Write(msg);
-        SendCacheToSlave(slave);
     }
 
     void Master::FullResyncRedisSlave(SlaveConnection& slave)
@@ -449,10 +614,16 @@ namespace ardb
                     RedisCommandEncoder::Encode(buf, select);
                     offset -= buf.ReadableBytes();
                 }
-                msg.Printf("+FULLRESYNC %s %lld\r\n", m_backlog.GetServerKey(), offset);
+                if (slave.isRedisSlave)
+                {
+                    msg.Printf("+FULLRESYNC %s %lld\r\n", m_backlog.GetServerKey(), offset);
+                }
                 slave.state = SLAVE_STATE_WAITING_DUMP_DATA;
             }
-            slave.conn->Write(msg);
+            if (msg.Readable())
+            {
+                slave.conn->Write(msg);
+            }
         }
         if (slave.state == SLAVE_STATE_WAITING_DUMP_DATA)
         {
@@ -485,6 +656,27 @@ namespace ardb
         {
             DELETE(found->second);
             m_slave_table.erase(found);
+            if (NULL != m_sync_iter)
+            {
+                /*
+                 * The closed slave may be the one the scan waits for, let the others drive it.
+                 */
+                bool scanning = false;
+                SlaveConnTable::iterator it = m_slave_table.begin();
+                while (it != m_slave_table.end())
+                {
+                    if (!it->second->isRedisSlave && it->second->state == SLAVE_STATE_SYNING_DUMP_DATA)
+                    {
+                        it->second->conn->EnableWriting();
+                        scanning = true;
+                    }
+                    it++;
+                }
+                if (!scanning)
+                {
+                    FinishSyncScan();
+                }
+            }
         }
         LockGuard<ThreadMutex> guard(m_port_table_mutex);
         m_slave_port_table.erase(conn_id);
@@ -497,6 +689,15 @@ namespace ardb
         {
             SlaveConnection* slave = found->second;
             DEBUG_LOG("[Master]Slave sync from %lld to %llu at state:%u", slave->sync_offset, m_backlog.GetReplEndOffset(), slave->state);
+            if (slave->state == SLAVE_STATE_SYNING_DUMP_DATA && !slave->isRedisSlave)
+            {
+                if (!ContinueSyncScan())
+                {
+                    //wait for the slowest slave of the scan
+                    slave->conn->DisableWriting();
+                }
+                return;
+            }
             if (slave->state == SLAVE_STATE_SYNING_CACHE_DATA)
             {
                 if ((uint64) slave->sync_offset == m_backlog.GetReplEndOffset())
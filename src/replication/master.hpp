@@ -61,6 +61,21 @@ namespace ardb
             }
     };
 
+    /*
+     * The backlog position right after the commands fed before a mark instruction
+     */
+    struct ReplMark
+    {
+            std::string server_key;
+            uint64 offset;
+            uint64 cksm;
+            DBID db;
+            ReplMark() :
+                    offset(0), cksm(0), db(0)
+            {
+            }
+    };
+
     struct RedisReplCommand
     {
             RedisCommandFrame cmd;
@@ -98,6 +113,10 @@ namespace ardb
             ArdbServer* m_server;
             SoftSignalChannel* m_notify_channel;
             MPSCQueue<ReplicationInstruction> m_inst_queue;
+            volatile uint64_t m_offered_marks;
+            volatile uint64_t m_done_marks;
+            ReplMark m_mark;
+            ThreadMutex m_mark_mutex;
             typedef TreeMap<uint32, SlaveConnection*>::Type SlaveConnTable;
             typedef TreeMap<uint32, uint32>::Type SlavePortTable;
             SlaveConnTable m_slave_table;
@@ -108,6 +127,16 @@ namespace ardb
             bool m_dumping_db;
             int64 m_dumpdb_offset;
 
+            /*
+             * Snapshot scan streamed to the ardb slaves in full resync, shared by every slave
+             * waiting when it starts
+             */
+            Iterator* m_sync_iter;
+            int64 m_sync_offset;
+            DBID m_sync_db;
+            uint64 m_sync_cksm;
+            bool m_sync_scheduled;
+
             time_t m_repl_no_slaves_since;
             volatile bool m_backlog_enable;
 
@@ -121,6 +150,9 @@ namespace ardb
 
             void FullResyncRedisSlave(SlaveConnection& slave);
             void FullResyncArdbSlave(SlaveConnection& slave);
+            void StartSyncScan();
+            bool ContinueSyncScan();
+            void FinishSyncScan();
             void SyncSlave(SlaveConnection& slave);
 
             void ChannelClosed(ChannelHandlerContext& ctx, ChannelStateEvent& e);
@@ -146,6 +178,15 @@ namespace ardb
             }
             void PrintSlaves(std::string& str);
             void DisconnectAllSlaves();
+            /*
+             * Offers a mark after the commands fed so far and returns its sequence, the caller doesn't
+             * wait for the master thread here.
+             */
+            uint64 OfferMark();
+            /*
+             * Waits until the master thread processed the mark of 'seq' and copies it, false on timeout.
+             */
+            bool WaitMark(uint64 seq, uint64 timeout_ms, ReplMark& mark);
             ~Master();
     };
 }
@@ -29,6 +29,8 @@
 
 #include "rdb.hpp"
 #include "util/helpers.hpp"
+#include "util/atomic.hpp"
+#include "util/thread/thread.hpp"
 
 extern "C"
 {
@@ -56,7 +58,11 @@ extern "C"
 
 #define REDIS_RDB_VERSION 6
 
-#define ARDB_RDB_VERSION 1
+#define ARDB_RDB_VERSION 3
+/*
+ * Single dump files & segments keep the layout of version 2, only segment manifests need version 3
+ */
+#define ARDB_RDB_SINGLE_FILE_VERSION 2
 
 /* Defines related to the dump file format. To store 32 bits lengths for short
  * keys requires a lot of space, so we check the most significant 2 bits of
@@ -108,6 +114,8 @@ extern "C"
 
 #define ARDB_RDB_TYPE_CHUNK 1
 #define ARDB_RDB_TYPE_SNAPPY_CHUNK 2
+#define ARDB_RDB_TYPE_KEY_FORMAT 3
+#define ARDB_RDB_TYPE_SEGMENT 4
 #define ARDB_RDB_TYPE_EOF 255
 
 namespace ardb
@@ -194,7 +202,16 @@ namespace ardb
         {
             return ret;
         }
-        return DoLoad();
+        ret = DoLoad();
+        /*
+         * ardb dump files are loaded by raw writes which bypass the meta cache & the expire wheel
+         */
+        if (NULL != m_db)
+        {
+            m_db->ClearMetaCache();
+            m_db->ResetExpireWheel();
+        }
+        return ret;
     }
 
     int DataDumpFile::Write(const void* buf, size_t buflen)
@@ -280,7 +297,7 @@ namespace ardb
         Close();
         m_last_save = time(NULL);
         m_is_saving = false;
-        return 0;
+        return ret;
     }
     int DataDumpFile::BGSave(const std::string& file)
     {
@@ -564,7 +581,7 @@ namespace ardb
                 {
                     value = stringfromll(vlong);
                 }
-                m_db->LPush(m_current_db, key, value);
+                m_db->RPush(m_current_db, key, value);
             }
             iter = ziplistNext(data, iter);
         }
@@ -715,7 +732,7 @@ namespace ardb
                         }
                         else
                         {
-                            m_db->LPush(m_current_db, key, str);
+                            m_db->RPush(m_current_db, key, str);
                         }
                     }
                     else
@@ -996,6 +1013,7 @@ namespace ardb
                 return WriteType(REDIS_RDB_TYPE_SET);
             }
             case LIST_ELEMENT:
+            case LIST_META:
             {
                 return WriteType(REDIS_RDB_TYPE_LIST);
             }
@@ -1343,7 +1361,11 @@ namespace ardb
                             case LIST_META:
                             {
                                 ListMetaValue* mmeta = (ListMetaValue*) meta;
-                                if (!mmeta->ziped)
+                                /*
+                                 * Segment keys are ordered by id instead of list order, segmented lists are
+                                 * dumped here through LRANGE
+                                 */
+                                if (!mmeta->ziped && (mmeta->next_segment_id == 0 || mmeta->size == 0))
                                 {
                                     return 0;
                                 }
@@ -1484,6 +1506,26 @@ namespace ardb
                                     it++;
                                 }
                             }
+                            else
+                            {
+                                DUMP_CHECK_WRITE(r.WriteLen(mmeta->size));
+                                uint32 written = 0;
+                                while (written < mmeta->size)
+                                {
+                                    ValueDataArray vs;
+                                    db->LRange(key->db, key->key, written, written + 1023, vs);
+                                    if (vs.empty())
+                                    {
+                                        ERROR_LOG("List:%s is shorter than its length:%u", currentKey.c_str(),
+                                                mmeta->size);
+                                        return -1;
+                                    }
+                                    for (uint32 i = 0; i < vs.size() && written < mmeta->size; i++, written++)
+                                    {
+                                        DUMP_CHECK_WRITE(r.WriteStringObject(vs[i]));
+                                    }
+                                }
+                            }
                             break;
                         }
                         case ZSET_META:
@@ -1550,14 +1592,16 @@ namespace ardb
     /*
      * Ardb dump file, used for backup data & import data
      */
-    ArdbDumpFile::ArdbDumpFile()
+    ArdbDumpFile::ArdbDumpFile() :
+            m_key_format(ARDB_KEY_FORMAT_LEGACY), m_segments(1), m_key_count(0), m_file_cksm(0), m_cksm_mismatch(
+                    false)
     {
     }
 
-    int ArdbDumpFile::WriteMagicHeader()
+    int ArdbDumpFile::WriteMagicHeader(int version)
     {
         char magic[10];
-        snprintf(magic, sizeof(magic), "ARDB%04d", ARDB_RDB_VERSION);
+        snprintf(magic, sizeof(magic), "ARDB%04d", version);
         return Write(magic, 8);
     }
 
@@ -1578,6 +1622,7 @@ namespace ardb
         }
         BufferHelper::WriteVarSlice(m_write_buffer, key);
         BufferHelper::WriteVarSlice(m_write_buffer, value);
+        m_key_count++;
         if (m_write_buffer.ReadableBytes() >= 1024 * 1024)
         {
             return FlushWriteBuffer();
@@ -1631,9 +1676,35 @@ namespace ardb
         return 0;
     }
 
+    int ArdbDumpFile::WriteChecksum()
+    {
+        RETURN_NEGATIVE_EXPR(FlushWriteBuffer());
+        RETURN_NEGATIVE_EXPR(WriteType(REDIS_RDB_OPCODE_EOF));
+        m_file_cksm = m_cksm;
+        uint64 cksm = m_cksm;
+        memrev64ifbe(&cksm);
+        RETURN_NEGATIVE_EXPR(Write(&cksm, sizeof(cksm)));
+        return FlushWriteBuffer();
+    }
+
     int ArdbDumpFile::DoSave()
     {
-        RETURN_NEGATIVE_EXPR(WriteMagicHeader());
+        m_key_count = 0;
+        if (m_segments > 1)
+        {
+            /*
+             * An LMDB iterator is a cursor of the read txn of its thread, which can't be used by another
+             * thread, so LMDB saves a single file.
+             */
+            if (m_db->GetEngine()->SupportParallelIterators())
+            {
+                return SaveSegments();
+            }
+            INFO_LOG("Storage engine can't save dump segments in parallel, save a single file.");
+        }
+        RETURN_NEGATIVE_EXPR(WriteMagicHeader(ARDB_RDB_SINGLE_FILE_VERSION));
+        RETURN_NEGATIVE_EXPR(WriteType(ARDB_RDB_TYPE_KEY_FORMAT));
+        RETURN_NEGATIVE_EXPR(WriteType(get_key_format()));
         struct VisitorTask: public RawValueVisitor
         {
                 ArdbDumpFile& r;
@@ -1648,13 +1719,202 @@ namespace ardb
                 }
         } visitor(*this);
         m_db->VisitAllDB(&visitor);
-        FlushWriteBuffer();
-        WriteType(REDIS_RDB_OPCODE_EOF);
-        uint64 cksm = m_cksm;
-        memrev64ifbe(&cksm);
-        Write(&cksm, sizeof(cksm));
-        FlushWriteBuffer();
-        return 0;
+        return WriteChecksum();
+    }
+
+    int ArdbDumpFile::SaveSegments()
+    {
+        /*
+         * Split points are the start of every (db, type) and 16 buckets of the first key byte in it,
+         * each thread takes the next unsaved range until all are saved into its own segment.
+         */
+        static const uint8 kTypes[] = { KEY_META, STRING_META, BITSET_META, SET_META, ZSET_META, HASH_META,
+                LIST_META, SET_ELEMENT, ZSET_ELEMENT_NODE, ZSET_ELEMENT, HASH_FIELD, LIST_ELEMENT, LIST_SEGMENT,
+                LIST_SEGMENT_INDEX, BITSET_ELEMENT, KEY_EXPIRATION_ELEMENT, SCRIPT, KEY_TOMBSTONE, KEY_END };
+        std::vector<std::string> bounds;
+        DBIDSet dbs;
+        m_db->GetAllDBIDSet(dbs);
+        dbs.insert(ARDB_GLOBAL_DB);
+        DBIDSet::iterator dit = dbs.begin();
+        while (dit != dbs.end())
+        {
+            for (uint32 i = 0; i < arraysize(kTypes); i++)
+            {
+                Buffer bound;
+                encode_key_boundary(bound, *dit, kTypes[i], Slice());
+                bounds.push_back(bound.AsString());
+                if (kTypes[i] == KEY_EXPIRATION_ELEMENT || kTypes[i] == KEY_END)
+                {
+                    continue;
+                }
+                for (uint32 c = 0x10; c < 0x100; c += 0x10)
+                {
+                    char prefix = (char) c;
+                    Buffer prefix_bound;
+                    encode_key_boundary(prefix_bound, *dit, kTypes[i], Slice(&prefix, 1));
+                    bounds.push_back(prefix_bound.AsString());
+                }
+            }
+            dit++;
+        }
+
+        struct SegmentTask: public Thread
+        {
+                ArdbDumpFile segment;
+                Iterator* iter;
+                const std::vector<std::string>& bounds;
+                volatile uint32_t& next_range;
+                int err;
+                volatile bool done;
+                SegmentTask(Iterator* it, const std::vector<std::string>& b, volatile uint32_t& next) :
+                        iter(it), bounds(b), next_range(next), err(0), done(false)
+                {
+                }
+                int SaveRanges()
+                {
+                    while (true)
+                    {
+                        uint32 range = atomic_add_uint32(&next_range, 1) - 1;
+                        if (range > bounds.size())
+                        {
+                            return 0;
+                        }
+                        if (range == 0)
+                        {
+                            iter->SeekToFirst();
+                        }
+                        else
+                        {
+                            iter->Seek(bounds[range - 1]);
+                        }
+                        while (iter->Valid())
+                        {
+                            if (range < bounds.size() && compare_encoded_keys(iter->Key(), bounds[range]) >= 0)
+                            {
+                                break;
+                            }
+                            RETURN_NEGATIVE_EXPR(segment.SaveRawKeyValue(iter->Key(), iter->Value()));
+                            iter->Next();
+                        }
+                    }
+                }
+                void Run()
+                {
+                    err = SaveRanges();
+                    if (0 == err)
+                    {
+                        err = segment.WriteChecksum();
+                    }
+                    segment.Close();
+                    done = true;
+                }
+        };
+        /*
+         * All iterators are created & deleted by this thread, so they read from the same engine snapshot
+         * (see KeyValueEngine::SupportParallelIterators).
+         */
+        std::vector<SegmentTask*> tasks;
+        volatile uint32_t next_range = 0;
+        int ret = 0;
+        for (uint32 i = 0; i < m_segments && 0 == ret; i++)
+        {
+            Iterator* iter = m_db->GetEngine()->Find(Slice(), false);
+            if (NULL == iter)
+            {
+                ret = -1;
+                break;
+            }
+            SegmentTask* task = new SegmentTask(iter, bounds, next_range);
+            tasks.push_back(task);
+            task->segment.Init(m_db);
+            char path[m_file_path.size() + 32];
+            sprintf(path, "%s.%u", m_file_path.c_str(), i);
+            ret = task->segment.OpenWriteFile(path);
+            if (0 == ret)
+            {
+                ret = task->segment.WriteMagicHeader(ARDB_RDB_SINGLE_FILE_VERSION);
+            }
+            if (0 == ret)
+            {
+                ret = task->segment.WriteType(ARDB_RDB_TYPE_KEY_FORMAT);
+            }
+            if (0 == ret)
+            {
+                ret = task->segment.WriteType(get_key_format());
+            }
+        }
+        if (0 == ret)
+        {
+            for (uint32 i = 0; i < tasks.size(); i++)
+            {
+                tasks[i]->Start();
+            }
+            for (uint32 i = 0; i < tasks.size(); i++)
+            {
+                while (!tasks[i]->done)
+                {
+                    if (NULL != m_routine_cb)
+                    {
+                        m_routine_cb(m_routine_cbdata);
+                    }
+                    Thread::Sleep(10);
+                }
+                tasks[i]->Join();
+            }
+        }
+        if (0 == ret)
+        {
+            ret = WriteMagicHeader(ARDB_RDB_VERSION);
+        }
+        if (0 == ret)
+        {
+            ret = WriteType(ARDB_RDB_TYPE_KEY_FORMAT);
+        }
+        if (0 == ret)
+        {
+            ret = WriteType(get_key_format());
+        }
+        for (uint32 i = 0; i < tasks.size(); i++)
+        {
+            ArdbDumpFile& segment = tasks[i]->segment;
+            if (0 == ret && 0 != tasks[i]->err)
+            {
+                ERROR_LOG("Failed to save dump segment:%s", segment.GetPath().c_str());
+                ret = -1;
+            }
+            if (0 == ret)
+            {
+                std::string name = get_basename(segment.GetPath());
+                Buffer seg(16);
+                BufferHelper::WriteFixUInt64(seg, segment.m_key_count);
+                BufferHelper::WriteFixUInt64(seg, segment.m_file_cksm);
+                ret = WriteType(ARDB_RDB_TYPE_SEGMENT);
+                if (0 == ret)
+                {
+                    ret = WriteLen(name.size());
+                }
+                if (0 == ret)
+                {
+                    ret = Write(name.data(), name.size());
+                }
+                if (0 == ret)
+                {
+                    ret = Write(seg.GetRawReadBuffer(), seg.ReadableBytes());
+                }
+                m_key_count += segment.m_key_count;
+            }
+            DELETE(tasks[i]->iter);
+            DELETE(tasks[i]);
+        }
+        if (0 == ret)
+        {
+            ret = WriteChecksum();
+        }
+        if (0 == ret)
+        {
+            INFO_LOG("Saved %llu keys into %u dump segments.", m_key_count, m_segments);
+        }
+        return ret;
     }
 
     int ArdbDumpFile::ReadType()
@@ -1667,12 +1927,34 @@ namespace ardb
 
     int ArdbDumpFile::LoadBuffer(Buffer& buffer)
     {
+        /*
+         * Each chunk is written in one batch, so that concurrent segment loads do not contend on every key
+         */
+        BatchWriteGuard guard(m_db->GetEngine());
         while (buffer.Readable())
         {
             Slice key, value;
             RETURN_NEGATIVE_EXPR(BufferHelper::ReadVarSlice(buffer, key));
             RETURN_NEGATIVE_EXPR(BufferHelper::ReadVarSlice(buffer, value));
-            m_db->RawSet(key, value);
+            m_key_count++;
+            if (m_key_format == get_key_format())
+            {
+                m_db->RawSet(key, value);
+                continue;
+            }
+            /*
+             * Dump file written by an instance with another key layout, re-encode every key.
+             */
+            KeyObject* k = decode_key(key, NULL, m_key_format);
+            if (NULL == k)
+            {
+                ERROR_LOG("Failed to decode key with key format:%u", m_key_format);
+                return -1;
+            }
+            Buffer keybuf(k->key.size() + 16);
+            encode_key(keybuf, *k);
+            DELETE(k);
+            m_db->RawSet(Slice(keybuf.GetRawReadBuffer(), keybuf.ReadableBytes()), value);
         }
         return 0;
     }
@@ -1685,6 +1967,7 @@ namespace ardb
         uint32 len = 0;
         uint32 rawlen, compressedlen;
         std::string origin;
+        ArdbDumpSegmentArray segments;
 
         if (!Read(buf, 8, true))
             goto eoferr;
@@ -1696,11 +1979,17 @@ namespace ardb
             return -1;
         }
         rdbver = atoi(buf + 4);
-        if (rdbver < 1 || rdbver > REDIS_RDB_VERSION)
+        if (rdbver < 1 || rdbver > ARDB_RDB_VERSION)
         {
             WARN_LOG("Can't handle RDB format version %d", rdbver);
             return -1;
         }
+        /*
+         * Dump files before version 2 have no key format opcode & always use legacy keys
+         */
+        m_key_format = ARDB_KEY_FORMAT_LEGACY;
+        m_key_count = 0;
+        m_cksm_mismatch = false;
 
         while (true)
         {
@@ -1711,6 +2000,32 @@ namespace ardb
             if (type == ARDB_RDB_TYPE_EOF)
                 break;
 
+            if (type == ARDB_RDB_TYPE_KEY_FORMAT)
+            {
+                if ((type = ReadType()) == -1)
+                    goto eoferr;
+                m_key_format = (uint8) type;
+                continue;
+            }
+
+            if (type == ARDB_RDB_TYPE_SEGMENT)
+            {
+                ArdbDumpSegment segment;
+                if (0 != ReadLen(len) || len > sizeof(buf) - 16 || !Read(buf, len + 16, true))
+                {
+                    goto eoferr;
+                }
+                uint64_t count = 0, cksm = 0;
+                Buffer segbuf(buf, len, len + 16);
+                BufferHelper::ReadFixUInt64(segbuf, count);
+                BufferHelper::ReadFixUInt64(segbuf, cksm);
+                segment.name.assign(buf, len);
+                segment.count = count;
+                segment.cksm = cksm;
+                segments.push_back(segment);
+                continue;
+            }
+
             /* Handle SELECT DB opcode as a special case */
             if (type == ARDB_RDB_TYPE_CHUNK)
             {
@@ -1723,7 +2038,9 @@ namespace ardb
                     goto eoferr;
                 }
                 Buffer readbuf(newbuf, 0, len);
-                RETURN_NEGATIVE_EXPR(LoadBuffer(readbuf));
+                int err = LoadBuffer(readbuf);
+                DELETE_A(newbuf);
+                RETURN_NEGATIVE_EXPR(err);
             }
             else if (type == ARDB_RDB_TYPE_SNAPPY_CHUNK)
             {
@@ -1770,11 +2087,17 @@ namespace ardb
             else if (cksum != expected)
             {
                 ERROR_LOG("Wrong RDB checksum.(%llu-%llu)", cksum, expected);
+                m_cksm_mismatch = true;
                 //exit(1);
             }
+            m_file_cksm = cksum;
         }
 
         Close();
+        if (!segments.empty())
+        {
+            return LoadSegments(segments);
+        }
         INFO_LOG("Ardb dump file load finished.");
         return 0;
         eoferr: Close();
@@ -1782,6 +2105,71 @@ namespace ardb
         return -1;
     }
 
+    int ArdbDumpFile::LoadSegments(const ArdbDumpSegmentArray& segments)
+    {
+        struct LoadTask: public Thread
+        {
+                ArdbDumpFile segment;
+                std::string path;
+                int err;
+                volatile bool done;
+                LoadTask(Ardb* db, const std::string& p) :
+                        path(p), err(0), done(false)
+                {
+                    segment.Init(db);
+                }
+                void Run()
+                {
+                    err = segment.Load(path, NULL, NULL);
+                    done = true;
+                }
+        };
+        std::string dir = m_file_path;
+        size_t pos = dir.rfind('/');
+        dir = (pos == std::string::npos) ? "" : dir.substr(0, pos + 1);
+        std::vector<LoadTask*> tasks;
+        for (uint32 i = 0; i < segments.size(); i++)
+        {
+            LoadTask* task = new LoadTask(m_db, dir + segments[i].name);
+            tasks.push_back(task);
+            task->Start();
+        }
+        int ret = 0;
+        m_key_count = 0;
+        for (uint32 i = 0; i < tasks.size(); i++)
+        {
+            while (!tasks[i]->done)
+            {
+                if (NULL != m_routine_cb)
+                {
+                    m_routine_cb(m_routine_cbdata);
+                }
+                Thread::Sleep(10);
+            }
+            tasks[i]->Join();
+            ArdbDumpFile& segment = tasks[i]->segment;
+            if (0 != tasks[i]->err)
+            {
+                ERROR_LOG("Failed to load dump segment:%s", tasks[i]->path.c_str());
+                ret = -1;
+            }
+            else if (segment.m_key_count != segments[i].count || segment.m_file_cksm != segments[i].cksm
+                    || segment.m_cksm_mismatch)
+            {
+                ERROR_LOG("Dump segment:%s does not match its manifest entry.(%llu-%llu keys)",
+                        tasks[i]->path.c_str(), segment.m_key_count, segments[i].count);
+                m_cksm_mismatch = true;
+            }
+            m_key_count += segment.m_key_count;
+            DELETE(tasks[i]);
+        }
+        if (0 == ret)
+        {
+            INFO_LOG("Ardb dump file load finished with %llu keys from %u segments.", m_key_count, segments.size());
+        }
+        return ret;
+    }
+
     ArdbDumpFile::~ArdbDumpFile()
     {
     }
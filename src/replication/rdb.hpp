@@ -30,6 +30,7 @@
 #ifndef RDB_HPP_
 #define RDB_HPP_
 #include <string>
+#include <vector>
 #include "common.hpp"
 #include "buffer/buffer_helper.hpp"
 #include "db.hpp"
@@ -122,22 +123,54 @@ namespace ardb
             ~RedisDumpFile();
     };
 
+    /*
+     * A dump saved with more than one segment is a manifest listing segment files '<path>.<index>'.
+     * Every segment is a complete dump file of disjoint key ranges with its own checksum, segments
+     * are written by parallel iterators sharing one snapshot and loaded in parallel.
+     */
+    struct ArdbDumpSegment
+    {
+            std::string name;
+            uint64 count;
+            uint64 cksm;
+            ArdbDumpSegment() :
+                    count(0), cksm(0)
+            {
+            }
+    };
+    typedef std::vector<ArdbDumpSegment> ArdbDumpSegmentArray;
+
     class ArdbDumpFile: public DataDumpFile
     {
         private:
             Buffer m_write_buffer;
+            uint8 m_key_format;
+            uint32 m_segments;
+            uint64 m_key_count;
+            uint64 m_file_cksm;
+            bool m_cksm_mismatch;
             int WriteLen(uint32 len);
             int ReadLen(uint32& len);
-            int WriteMagicHeader();
+            int WriteMagicHeader(int version);
             int WriteType(uint8 type);
             int SaveRawKeyValue(const Slice& key, const Slice& value);
             int ReadType();
             int LoadBuffer(Buffer& buffer);
             int FlushWriteBuffer();
+            int WriteChecksum();
+            int SaveSegments();
+            int LoadSegments(const ArdbDumpSegmentArray& segments);
             int DoLoad();
             int DoSave();
         public:
             ArdbDumpFile();
+            /*
+             * Number of segments, thus of threads, used to save a dump, 1 writes a single dump file.
+             */
+            void SetSegments(uint32 segments)
+            {
+                m_segments = segments > 0 ? segments : 1;
+            }
             ~ArdbDumpFile();
     };
 
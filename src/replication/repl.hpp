@@ -25,9 +25,62 @@
 #define REDIS_DB_CLIENT_TYPE 1
 #define ARDB_DB_CLIENT_TYPE 2
 
+#include "common.hpp"
+#include "slice.hpp"
+#include "channel/all_includes.hpp"
+#include "util/string_helper.hpp"
+#include "redis/crc64.h"
+
+using namespace ardb::codec;
+
 namespace ardb
 {
-
+    /*
+     * A chunk of the snapshot streamed to an ardb slave in full resync: the '__SET__ <key> <value>'
+     * commands of the chunk are followed by '__SYNCCHUNK__ <count> <crc64>' of their keys & values,
+     * the slave checks every chunk against it.
+     */
+    struct SyncChunk
+    {
+            uint32 count;
+            uint64 cksm;
+            SyncChunk() :
+                    count(0), cksm(0)
+            {
+            }
+            void Add(const Slice& key, const Slice& value)
+            {
+                cksm = crc64(cksm, (const unsigned char*) key.data(), key.size());
+                cksm = crc64(cksm, (const unsigned char*) value.data(), value.size());
+                count++;
+            }
+            void Clear()
+            {
+                count = 0;
+                cksm = 0;
+            }
+            void WriteTrailer(Buffer& buf)
+            {
+                buf.Printf("__SYNCCHUNK__ %u %llu\r\n", count, cksm);
+            }
+            /*
+             * Checks the '__SYNCCHUNK__' command ending the chunk, the next chunk starts if it matches.
+             */
+            bool Verify(const RedisCommandFrame& trailer)
+            {
+                uint32 expected_count = 0;
+                uint64 expected_cksm = 0;
+                const ArgumentArray& args = trailer.GetArguments();
+                if (args.size() != 2 || !string_touint32(args[0], expected_count)
+                        || !string_touint64(args[1], expected_cksm) || expected_count != count
+                        || expected_cksm != cksm)
+                {
+                    return false;
+                }
+                Clear();
+                return true;
+            }
+    };
 }
 
 #endif /* REPL_HPP_ */
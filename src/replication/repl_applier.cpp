@@ -0,0 +1,249 @@
+/*
+ *Copyright (c) 2013-2013, yinqiwen <yinqiwen@gmail.com>
+ *All rights reserved.
+ *
+ *Redistribution and use in source and binary forms, with or without
+ *modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Redis nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ *BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ *THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "repl_applier.hpp"
+#include "ardb_server.hpp"
+#include "util/atomic.hpp"
+
+/*
+ * Max commands dispatched but not applied yet, the slave connection stops reading beyond it.
+ */
+#define REPL_APPLY_MAX_PENDING 10000
+
+namespace ardb
+{
+    ReplApplier::Worker::Worker(ReplApplier* applier) :
+            m_applier(applier), m_ctx(NULL), m_running(true)
+    {
+        NEW(m_ctx, ArdbConnContext);
+        m_ctx->is_slave_conn = true;
+    }
+
+    void ReplApplier::Worker::Push(ReplApplyTask* task)
+    {
+        LockGuard<ThreadMutexLock> guard(m_queue_cond);
+        m_queue.push_back(task);
+        m_queue_cond.Notify();
+    }
+
+    void ReplApplier::Worker::Run()
+    {
+        while (true)
+        {
+            ReplApplyTask* task = NULL;
+            m_queue_cond.Lock();
+            while (m_queue.empty() && m_running)
+            {
+                m_queue_cond.Wait();
+            }
+            if (!m_queue.empty())
+            {
+                task = m_queue.front();
+                m_queue.pop_front();
+            }
+            m_queue_cond.Unlock();
+            if (NULL == task)
+            {
+                return;
+            }
+            m_ctx->currentDB = task->db;
+            m_applier->m_serv->ProcessRedisCommand(*m_ctx, task->cmd, task->flags | ARDB_PROCESS_WITHOUT_REPLICATION);
+            m_ctx->reply.Clear();
+            m_applier->TaskDone(task);
+        }
+    }
+
+    void ReplApplier::Worker::Shutdown()
+    {
+        m_queue_cond.Lock();
+        m_running = false;
+        m_queue_cond.Notify();
+        m_queue_cond.Unlock();
+        Join();
+    }
+
+    ReplApplier::Worker::~Worker()
+    {
+        DELETE(m_ctx);
+    }
+
+    ReplApplier::ReplApplier(ArdbServer* serv) :
+            m_serv(serv), m_pending(0)
+    {
+    }
+
+    void ReplApplier::Start(uint32 threads)
+    {
+        if (threads <= 1 || !m_workers.empty())
+        {
+            return;
+        }
+        for (uint32 i = 0; i < threads; i++)
+        {
+            Worker* worker = new Worker(this);
+            worker->Start();
+            m_workers.push_back(worker);
+        }
+        INFO_LOG("[Slave]Apply replicated commands on %u threads.", threads);
+    }
+
+    void ReplApplier::Stop()
+    {
+        for (uint32 i = 0; i < m_workers.size(); i++)
+        {
+            m_workers[i]->Shutdown();
+            DELETE(m_workers[i]);
+        }
+        m_workers.clear();
+        LockGuard<ThreadMutex> guard(m_tasks_mutex);
+        while (!m_tasks.empty())
+        {
+            DELETE(m_tasks.front());
+            m_tasks.pop_front();
+        }
+    }
+
+    void ReplApplier::TaskDone(ReplApplyTask* task)
+    {
+        task->done = true;
+        if (atomic_sub_uint32(&m_pending, 1) < REPL_APPLY_MAX_PENDING / 2)
+        {
+            m_done_cond.Lock();
+            m_done_cond.NotifyAll();
+            m_done_cond.Unlock();
+        }
+    }
+
+    void ReplApplier::WaitPending(uint32 max_pending)
+    {
+        m_done_cond.Lock();
+        while (m_pending > max_pending)
+        {
+            m_done_cond.Wait(10, MILLIS);
+        }
+        m_done_cond.Unlock();
+    }
+
+    void ReplApplier::Dispatch(ReplApplyTask* task, const std::string& key)
+    {
+        uint32 hash = task->db;
+        for (size_t i = 0; i < key.size(); i++)
+        {
+            hash = hash * 31 + (uint8) key[i];
+        }
+        if (m_pending >= REPL_APPLY_MAX_PENDING)
+        {
+            WaitPending(REPL_APPLY_MAX_PENDING / 2);
+        }
+        {
+            LockGuard<ThreadMutex> guard(m_tasks_mutex);
+            m_tasks.push_back(task);
+        }
+        atomic_add_uint32(&m_pending, 1);
+        m_workers[hash % m_workers.size()]->Push(task);
+    }
+
+    void ReplApplier::Append(ReplApplyTask* task)
+    {
+        task->done = true;
+        LockGuard<ThreadMutex> guard(m_tasks_mutex);
+        m_tasks.push_back(task);
+    }
+
+    void ReplApplier::Barrier(Channel* conn)
+    {
+        WaitPending(0);
+        Feed(conn);
+    }
+
+    void ReplApplier::Feed(Channel* conn)
+    {
+        LockGuard<ThreadMutex> guard(m_tasks_mutex);
+        while (!m_tasks.empty() && m_tasks.front()->done)
+        {
+            ReplApplyTask* task = m_tasks.front();
+            m_tasks.pop_front();
+            if (m_serv->m_repl_backlog.IsInited() && (task->flags & ARDB_PROCESS_WITHOUT_REPLICATION) == 0)
+            {
+                m_serv->m_master_serv.FeedSlaves(conn, task->db, task->cmd);
+            }
+            else if (task->cmd.GetType() == REDIS_CMD_SELECT)
+            {
+                /*
+                 * A fed SELECT switches the backlog DB in the replication thread
+                 */
+                m_serv->m_repl_backlog.SetCurrentDBID(task->db);
+            }
+            DELETE(task);
+        }
+    }
+
+    void ReplApplier::Apply(ArdbConnContext& ctx, Channel* conn, RedisCommandFrame& cmd, int flags, bool dispatch)
+    {
+        if (!IsEnabled())
+        {
+            m_serv->ProcessRedisCommand(ctx, cmd, flags);
+            return;
+        }
+        ArdbServer::RedisCommandHandlerSetting* setting = m_serv->FindRedisCommandHandlerSetting(cmd);
+        bool in_transc = ctx.IsInTransaction();
+        if (NULL != setting && (setting->flags & ARDB_CMD_SINGLE_KEY) && !in_transc && cmd.GetArguments().size() > 0
+                && !(flags & ARDB_PROCESS_FEED_REPLICATION_ONLY) && dispatch)
+        {
+            ReplApplyTask* task = new ReplApplyTask(cmd, ctx.currentDB, flags);
+            Dispatch(task, cmd.GetArguments()[0]);
+        }
+        else
+        {
+            /*
+             * Commands which may touch more than one key wait for all dispatched commands, while
+             * SELECT/PING and commands queued into a transaction write nothing.
+             */
+            const char* name = cmd.GetCommand().c_str();
+            bool barrier = strcasecmp(name, "PING") && strcasecmp(name, "SELECT") && strcasecmp(name, "MULTI")
+                    && !(flags & ARDB_PROCESS_FEED_REPLICATION_ONLY);
+            if (in_transc && strcasecmp(name, "EXEC") && strcasecmp(name, "DISCARD"))
+            {
+                barrier = false;
+            }
+            if (barrier)
+            {
+                Barrier(conn);
+            }
+            m_serv->ProcessRedisCommand(ctx, cmd, flags | ARDB_PROCESS_WITHOUT_REPLICATION);
+            Append(new ReplApplyTask(cmd, ctx.currentDB, flags));
+        }
+        Feed(conn);
+    }
+
+    ReplApplier::~ReplApplier()
+    {
+        Stop();
+    }
+}
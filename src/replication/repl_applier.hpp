@@ -0,0 +1,127 @@
+/*
+ *Copyright (c) 2013-2013, yinqiwen <yinqiwen@gmail.com>
+ *All rights reserved.
+ *
+ *Redistribution and use in source and binary forms, with or without
+ *modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Redis nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ *BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ *THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef REPL_APPLIER_HPP_
+#define REPL_APPLIER_HPP_
+
+#include <deque>
+#include <vector>
+#include "channel/all_includes.hpp"
+#include "db.hpp"
+#include "util/thread/thread.hpp"
+#include "util/thread/thread_mutex_lock.hpp"
+#include "util/thread/lock_guard.hpp"
+
+using namespace ardb::codec;
+
+namespace ardb
+{
+    struct ArdbConnContext;
+    class ArdbServer;
+
+    struct ReplApplyTask
+    {
+            RedisCommandFrame cmd;
+            DBID db;
+            int flags;
+            volatile bool done;
+            ReplApplyTask(const RedisCommandFrame& c, const DBID& id, int f) :
+                    cmd(c), db(id), flags(f), done(false)
+            {
+            }
+    };
+
+    /*
+     * Applies the command stream of the master on several threads. Commands touching only the key of
+     * their first argument go to the worker owning hash(db, key), so commands of one key keep their
+     * order. Every other command is a barrier: it runs on the slave connection after all dispatched
+     * commands are applied. Commands are fed to the local backlog in stream order, and only once applied,
+     * so the replication offset never covers a command not yet written.
+     */
+    class ReplApplier
+    {
+        private:
+            class Worker: public Thread
+            {
+                private:
+                    ReplApplier* m_applier;
+                    ArdbConnContext* m_ctx;
+                    std::deque<ReplApplyTask*> m_queue;
+                    ThreadMutexLock m_queue_cond;
+                    volatile bool m_running;
+                public:
+                    Worker(ReplApplier* applier);
+                    void Push(ReplApplyTask* task);
+                    void Run();
+                    void Shutdown();
+                    ~Worker();
+            };
+            ArdbServer* m_serv;
+            std::vector<Worker*> m_workers;
+            std::deque<ReplApplyTask*> m_tasks;
+            ThreadMutex m_tasks_mutex;
+            ThreadMutexLock m_done_cond;
+            volatile uint32_t m_pending;
+            void TaskDone(ReplApplyTask* task);
+            void WaitPending(uint32 max_pending);
+        public:
+            ReplApplier(ArdbServer* serv);
+            void Start(uint32 threads);
+            void Stop();
+            bool IsEnabled()
+            {
+                return !m_workers.empty();
+            }
+            /*
+             * Queue the command to the worker of (db, key).
+             */
+            void Dispatch(ReplApplyTask* task, const std::string& key);
+            /*
+             * Queue an already applied command for feeding.
+             */
+            void Append(ReplApplyTask* task);
+            /*
+             * Wait until all dispatched commands are applied and fed.
+             */
+            void Barrier(Channel* conn);
+            /*
+             * Feed the applied commands at the head of the stream to the backlog.
+             */
+            void Feed(Channel* conn);
+            /*
+             * Apply a command of the master stream read by 'ctx', dispatched to the workers if 'dispatch'
+             * and it only touches one key, serially after all dispatched commands otherwise. Commands are
+             * all applied serially while the applier is not started.
+             */
+            void Apply(ArdbConnContext& ctx, Channel* conn, RedisCommandFrame& cmd, int flags, bool dispatch);
+            ~ReplApplier();
+    };
+}
+
+#endif /* REPL_APPLIER_HPP_ */
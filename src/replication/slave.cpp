@@ -44,13 +44,30 @@ namespace ardb
             m_serv(serv), m_client(NULL), m_slave_state(
             SLAVE_STATE_CLOSED), m_cron_inited(false), m_ping_recved_time(0), m_master_link_down_time(0), m_server_type(
             ARDB_DB_SERVER_TYPE), m_server_support_psync(false), m_actx(
-            NULL), m_rdb(NULL), m_backlog(serv->m_repl_backlog), m_routine_ts(0), m_cached_master_repl_offset(0)
+            NULL), m_applier(serv), m_rdb(NULL), m_backlog(serv->m_repl_backlog), m_routine_ts(0), m_cached_master_repl_offset(0)
     {
     }
 
     bool Slave::Init()
     {
         InitCron();
+        if (m_serv->m_cfg.repl_apply_threads > 1)
+        {
+            m_applier.Start(m_serv->m_cfg.repl_apply_threads);
+            struct FeedTask: public Runnable
+            {
+                    Slave* c;
+                    FeedTask(Slave* cc) :
+                            c(cc)
+                    {
+                    }
+                    void Run()
+                    {
+                        c->m_applier.Feed(c->m_client);
+                    }
+            };
+            m_serv->GetTimer().ScheduleHeapTask(new FeedTask(this), 10, 10, MILLIS);
+        }
         return 0;
     }
 
@@ -94,7 +111,7 @@ namespace ardb
 
     void Slave::HandleRedisCommand(Channel* ch, RedisCommandFrame& cmd)
     {
-        int flag = ARDB_PROCESS_REPL_WRITE;
+        int flag = ARDB_PROCESS_REPL_WRITE | ARDB_PROCESS_DISCARD_REPLY;
         if (m_slave_state == SLAVE_STATE_SYNCED || m_slave_state == SLAVE_STATE_LOADING_DUMP_DATA)
         {
             flag |= ARDB_PROCESS_FORCE_REPLICATION;
@@ -109,6 +126,7 @@ namespace ardb
         {
             if (!strcasecmp(cmd.GetCommand().c_str(), "FULLSYNCED"))
             {
+                m_applier.Barrier(ch);
                 uint64 offset, cksm;
                 string_touint64(cmd.GetArguments()[0], offset);
                 string_touint64(cmd.GetArguments()[1], cksm);
@@ -121,13 +139,27 @@ namespace ardb
                 m_serv->m_master_serv.DisconnectAllSlaves();
                 return;
             }
+            if (!strcasecmp(cmd.GetCommand().c_str(), "__SYNCCHUNK__"))
+            {
+                if (!m_sync_chunk.Verify(cmd))
+                {
+                    ERROR_LOG("[Slave]Snapshot chunk mismatch, received %u keys with checksum %llu, expected %s.",
+                            m_sync_chunk.count, m_sync_chunk.cksm, cmd.ToString().c_str());
+                    ch->Close();
+                }
+                return;
+            }
+            if (!strcasecmp(cmd.GetCommand().c_str(), "__SET__") && cmd.GetArguments().size() == 2)
+            {
+                m_sync_chunk.Add(cmd.GetArguments()[0], cmd.GetArguments()[1]);
+            }
         }
 
         if (!strcasecmp(cmd.GetCommand().c_str(), "PING"))
         {
             m_ping_recved_time = time(NULL);
         }
-        else if (!strcasecmp(cmd.GetCommand().c_str(), "SELECT"))
+        else if (!strcasecmp(cmd.GetCommand().c_str(), "SELECT") && !m_applier.IsEnabled())
         {
             DBID id = 0;
             string_touint32(cmd.GetArguments()[0], id);
@@ -149,8 +181,9 @@ namespace ardb
                 flag |= ARDB_PROCESS_FEED_REPLICATION_ONLY;
             }
         }
-        m_serv->ProcessRedisCommand(*m_actx, cmd, flag);
+        m_applier.Apply(*m_actx, ch, cmd, flag, m_slave_state != SLAVE_STATE_LOADING_DUMP_DATA);
     }
+
     void Slave::Routine()
     {
         uint32 now = time(NULL);
@@ -295,10 +328,12 @@ namespace ardb
                     /*
                      * Delete all data before receiving resyncing data
                      */
+                    m_applier.Barrier(ch);
                     if (m_serv->m_cfg.slave_cleardb_before_fullresync)
                     {
                         m_serv->m_db->FlushAll();
                     }
+                    m_sync_chunk.Clear();
                     m_cached_master_runid = ss[1];
                     m_cached_master_repl_offset = offset;
                     if (m_server_type == ARDB_DB_SERVER_TYPE)
@@ -353,6 +388,7 @@ namespace ardb
         {
             m_rdb->Flush();
             m_decoder.SwitchToCommandDecoder();
+            m_applier.Barrier(ch);
             m_slave_state = SLAVE_STATE_LOADING_DUMP_DATA;
             if (m_serv->m_cfg.slave_cleardb_before_fullresync && !m_server_support_psync)
             {
@@ -406,6 +442,7 @@ namespace ardb
     {
         INFO_LOG("[Slave]Replication connection closed.");
         m_master_link_down_time = time(NULL);
+        m_applier.Barrier(ctx.GetChannel());
         m_client = NULL;
         m_slave_state = 0;
         DELETE(m_actx);
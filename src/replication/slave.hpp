@@ -40,6 +40,7 @@
 #include "db.hpp"
 #include "rdb.hpp"
 #include "repl_backlog.hpp"
+#include "repl_applier.hpp"
 
 using namespace ardb::codec;
 
@@ -71,6 +72,11 @@ namespace ardb
 
             ArdbConnContext *m_actx;
 
+            /*
+             * Applies single key commands on worker threads when 'repl-apply-threads' > 1
+             */
+            ReplApplier m_applier;
+
             /**
              * Redis dump file
              */
@@ -79,6 +85,11 @@ namespace ardb
 
             time_t m_routine_ts;
 
+            /*
+             * Keys and crc64 of the snapshot chunk being received in a full resync
+             */
+            SyncChunk m_sync_chunk;
+
             std::string m_cached_master_runid;
             int64 m_cached_master_repl_offset;
 
@@ -116,6 +116,38 @@ namespace ardb
         return 0;
     }
 
+    int ArdbServer::BackupCheckpoint(ArdbConnContext& ctx, RedisCommandFrame& cmd)
+    {
+        bool incremental = false;
+        if (cmd.GetArguments().size() == 1)
+        {
+            if (!strcasecmp(cmd.GetArguments()[0].c_str(), "incremental"))
+            {
+                incremental = true;
+            }
+            else if (strcasecmp(cmd.GetArguments()[0].c_str(), "full"))
+            {
+                fill_error_reply(ctx.reply, "syntax error, expected FULL or INCREMENTAL");
+                return 0;
+            }
+        }
+        std::string path;
+        int ret = m_backup.Save(incremental, path);
+        if (ret == 0)
+        {
+            fill_str_reply(ctx.reply, path);
+        }
+        else if (ret > 0)
+        {
+            fill_error_reply(ctx.reply, "there is already a checkpoint in progress");
+        }
+        else
+        {
+            fill_error_reply(ctx.reply, "checkpoint error");
+        }
+        return 0;
+    }
+
     int ArdbServer::Import(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
         std::string file = m_cfg.backup_dir + "/dump.ardb";
@@ -185,6 +217,7 @@ namespace ardb
         {
             info.append("# Databases\r\n");
             info.append("data_dir:").append(m_cfg.data_base_path).append("\r\n");
+            info.append("key_format:").append(stringfromll(m_db->GetEngine()->GetKeyFormat())).append("\r\n");
             info.append(m_db->GetEngine()->Stats()).append("\r\n");
         }
         if (!strcasecmp(section.c_str(), "all") || !strcasecmp(section.c_str(), "disk"))
@@ -271,6 +304,13 @@ namespace ardb
             info.append("current_read_latency:").append(qps).append("us\r\n");
             sprintf(qps, "%.2f", DBCrons::GetSingleton().GetCompactGC().AverageWriteLatency());
             info.append("current_write_latency:").append(qps).append("us\r\n");
+            info.append("key_lock_wait_us:").append(m_db->GetKeyLockWaitHistogram().ToString()).append("\r\n");
+            info.append("key_lock_hold_us:").append(m_db->GetKeyLockHoldHistogram().ToString()).append("\r\n");
+            info.append("log_pending_records:").append(stringfromll(ArdbLogger::GetPendingRecords())).append("\r\n");
+            info.append("log_dropped_records:").append(stringfromll(ArdbLogger::GetDroppedRecords())).append("\r\n");
+            info.append("expired_keys:").append(stringfromll(m_db->GetExpiredKeys())).append("\r\n");
+            info.append("expire_backlog_keys:").append(stringfromll(m_db->GetExpireBacklog())).append("\r\n");
+            info.append("expire_lag_ms:").append(stringfromll(m_db->GetExpireLag())).append("\r\n");
             if (!DBCrons::GetSingleton().GetCompactGC().LastCompactTime().empty())
             {
                 info.append("last_compact_gc_time:").append(DBCrons::GetSingleton().GetCompactGC().LastCompactTime()).append(
@@ -292,11 +332,51 @@ namespace ardb
                         "\r\n");
                 info.append("L1_cache_estimate_memory:").append(
                         stringfromll(m_db->GetL1Cache()->GetEstimateMemorySize())).append("\r\n");
+                uint32 entries = m_db->GetL1Cache()->GetEntrySize();
+                info.append("L1_cache_overhead_per_entry:").append(
+                        stringfromll(entries > 0 ? m_db->GetL1Cache()->GetTableMemorySize() / entries : 0)).append(
+                        "\r\n");
+                const KeyType cache_types[] = { STRING_META, HASH_META, SET_META, ZSET_META };
+                const char* cache_type_names[] = { "string", "hash", "set", "zset" };
+                for (uint32 i = 0; i < arraysize(cache_types); i++)
+                {
+                    uint64 hits = m_db->GetL1Cache()->GetHits(cache_types[i]);
+                    uint64 misses = m_db->GetL1Cache()->GetMisses(cache_types[i]);
+                    char ratio[32];
+                    snprintf(ratio, sizeof(ratio), "%.4f", hits + misses > 0 ? (double) hits / (hits + misses) : 0);
+                    std::string prefix = std::string("L1_cache_") + cache_type_names[i];
+                    info.append(prefix).append("_hits:").append(stringfromll(hits)).append("\r\n");
+                    info.append(prefix).append("_misses:").append(stringfromll(misses)).append("\r\n");
+                    info.append(prefix).append("_hit_ratio:").append(ratio).append("\r\n");
+                }
             }
             else
             {
                 info.append("L1_cache_enable:no\r\n");
             }
+            if (NULL != m_db->GetMetaCache())
+            {
+                MetaCache* meta_cache = m_db->GetMetaCache();
+                uint64 hits = meta_cache->GetHits();
+                uint64 misses = meta_cache->GetMisses();
+                char ratio[32];
+                snprintf(ratio, sizeof(ratio), "%.4f", hits + misses > 0 ? (double) hits / (hits + misses) : 0);
+                info.append("meta_cache_enable:yes\r\n");
+                info.append("meta_cache_max_memory:").append(
+                        stringfromll(m_db->GetConfig().meta_cache_memory_limit)).append("\r\n");
+                info.append("meta_cache_entries:").append(stringfromll(meta_cache->GetEntrySize())).append("\r\n");
+                info.append("meta_cache_estimate_memory:").append(stringfromll(meta_cache->GetMemorySize())).append(
+                        "\r\n");
+                info.append("meta_cache_hits:").append(stringfromll(hits)).append("\r\n");
+                info.append("meta_cache_misses:").append(stringfromll(misses)).append("\r\n");
+                info.append("meta_cache_hit_ratio:").append(ratio).append("\r\n");
+            }
+            else
+            {
+                info.append("meta_cache_enable:no\r\n");
+            }
+            info.append("lazyfree_pending_objects:").append(stringfromll(m_db->GetLazyFreePendingKeys())).append(
+                    "\r\n");
         }
 
         if (!strcasecmp(section.c_str(), "all") || !strcasecmp(section.c_str(), "misc"))
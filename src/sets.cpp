@@ -37,17 +37,18 @@
 #define MAX_SET_DIFF_NUM  500000
 #define MAX_SET_OP_STORE_NUM 10000
 #define MAX_SET_QUERY_NUM 1000000
+#define MAX_SET_CURSOR_NEXT_STEPS 4
 
 namespace ardb
 {
     int ArdbServer::SAdd(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
         SliceArray values;
-        for (uint32 i = 1; i < cmd.GetArguments().size(); i++)
+        for (uint32 i = 1; i < cmd.GetArgumentCount(); i++)
         {
-            values.push_back(cmd.GetArguments()[i]);
+            values.push_back(cmd.GetArgumentSlice(i));
         }
-        int count = m_db->SAdd(ctx.currentDB, cmd.GetArguments()[0], values);
+        int count = m_db->SAdd(ctx.currentDB, cmd.GetArgumentSlice(0), values);
         CHECK_ARDB_RETURN_VALUE(ctx.reply, count);
         fill_int_reply(ctx.reply, count);
         return 0;
@@ -61,6 +62,27 @@ namespace ardb
         return 0;
     }
 
+    int ArdbServer::SCheck(ArdbConnContext& ctx, RedisCommandFrame& cmd)
+    {
+        bool repair = false;
+        if (cmd.GetArguments().size() == 2)
+        {
+            if (strcasecmp(cmd.GetArguments()[1].c_str(), "repair"))
+            {
+                fill_error_reply(ctx.reply, "Syntax error, try SCHECK key [REPAIR]");
+                return 0;
+            }
+            repair = true;
+        }
+        uint32 stored = 0, counted = 0;
+        int ret = m_db->SCheck(ctx.currentDB, cmd.GetArguments()[0], repair, stored, counted);
+        CHECK_ARDB_RETURN_VALUE(ctx.reply, ret);
+        ctx.reply.type = REDIS_REPLY_ARRAY;
+        ctx.reply.elements.push_back(RedisReply((uint64) stored));
+        ctx.reply.elements.push_back(RedisReply((uint64) counted));
+        return 0;
+    }
+
     int ArdbServer::SDiff(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
         SliceArray keys;
@@ -155,6 +177,20 @@ namespace ardb
         return 0;
     }
 
+    int ArdbServer::SMIsMember(ArdbConnContext& ctx, RedisCommandFrame& cmd)
+    {
+        SliceArray members;
+        for (uint32 i = 1; i < cmd.GetArguments().size(); i++)
+        {
+            members.push_back(cmd.GetArguments()[i]);
+        }
+        std::vector<int> exists;
+        int ret = m_db->SMIsMember(ctx.currentDB, cmd.GetArguments()[0], members, exists);
+        CHECK_ARDB_RETURN_VALUE(ctx.reply, ret);
+        fill_int_array_reply(ctx.reply, exists);
+        return 0;
+    }
+
     int ArdbServer::SMembers(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
         ValueDataArray vs;
@@ -396,7 +432,11 @@ namespace ardb
 
     SetMetaValue* Ardb::GetSetMeta(const DBID& db, const Slice& key, int& err, bool& create)
     {
-        CommonMetaValue* meta = GetMeta(db, key, false);
+        return PrepareSetMeta(GetMeta(db, key, false), err, create);
+    }
+
+    SetMetaValue* Ardb::PrepareSetMeta(CommonMetaValue* meta, int& err, bool& create)
+    {
         if (NULL != meta && meta->header.type != SET_META)
         {
             DELETE(meta);
@@ -426,6 +466,54 @@ namespace ardb
         }
         return (SetMetaValue*) meta;
     }
+    /*
+     * Walks all members of a non ziped set, 'min'/'max' are set to the first and last member
+     */
+    uint32 Ardb::CountSetMembers(const DBID& db, const Slice& key, ValueData& min, ValueData& max)
+    {
+        SetKeyObject sk(key, Slice(), db);
+        struct SCountWalk: public WalkHandler
+        {
+                ValueData& s_min;
+                ValueData& s_max;
+                uint32 count;
+                int OnKeyValue(KeyObject* k, ValueObject* v, uint32 cursor)
+                {
+                    SetKeyObject* sk = (SetKeyObject*) k;
+                    if (cursor == 0)
+                    {
+                        s_min = sk->value;
+                    }
+                    s_max = sk->value;
+                    count++;
+                    return 0;
+                }
+                SCountWalk(ValueData& min, ValueData& max) :
+                        s_min(min), s_max(max), count(0)
+                {
+                }
+        } walk(min, max);
+        Walk(sk, false, false, &walk);
+        return walk.count;
+    }
+
+    /*
+     * Sets written before the size was maintained by every mutation carry the 'dirty' flag, they are
+     * counted once here and kept exact afterwards. The caller holds the key lock.
+     */
+    void Ardb::RecountSet(const DBID& db, const Slice& key, SetMetaValue* meta)
+    {
+        if (meta->ziped || !meta->dirty)
+        {
+            return;
+        }
+        meta->min.Clear();
+        meta->max.Clear();
+        meta->size = CountSetMembers(db, key, meta->min, meta->max);
+        meta->dirty = false;
+        SetMeta(db, key, *meta);
+    }
+
     void Ardb::FindSetMinMaxValue(const DBID& db, const Slice& key, SetMetaValue* meta)
     {
         if (meta->ziped || !meta->dirty)
@@ -486,18 +574,58 @@ namespace ardb
         return count;
     }
 
+    /*
+     * Write-through of an element added by SADD, the caller holds the key lock and a L1CacheSyncGuard
+     */
+    void Ardb::SAddCache(const DBID& db, const Slice& key, bool created, const ValueData& element)
+    {
+        SetCache* cache = (SetCache*) GetWriteCache(db, key, SET_META, created && m_config.set_write_fill_cache);
+        if (NULL != cache)
+        {
+            cache->Add(element);
+            m_level1_cahce->Recycle(cache);
+        }
+    }
+
     int Ardb::SAdd(const DBID& db, const Slice& key, const Slice& value)
     {
         KeyLockerGuard guard(m_key_locker, db, key);
-        int err = 0;
+        L1CacheSyncGuard cache_guard(GetDBContext());
         bool createSet = false;
-        SetMetaValue* meta = GetSetMeta(db, key, err, createSet);
+        ValueData element(value);
+        std::string raw;
+        ZipMetaView zip;
+        int err = GetZipMeta(db, key, SET_META, raw, zip);
+        if (0 != err && ERR_NOT_EXIST != err)
+        {
+            return err;
+        }
+        /*
+         * splice the member into the raw zipped meta if it would stay zipped
+         */
+        std::string patched;
+        bool inserted = false;
+        if (0 == err && zip.IsIndexed() && zip.Count() + 1 < (uint32) m_config.set_max_ziplist_entries
+                && (element.type != BYTES_VALUE
+                        || element.bytes_value.size() < (uint32) m_config.set_max_ziplist_value)
+                && zip.Upsert(element, NULL, patched, inserted))
+        {
+            if (!inserted)
+            {
+                return 0;
+            }
+            KeyObject metakey(key, KEY_META, db);
+            SetRawMeta(metakey, patched);
+            SAddCache(db, key, false, element);
+            return 1;
+        }
+        SetMetaValue* meta = PrepareSetMeta(0 == err ? decode_meta(raw.data(), raw.size(), false) : NULL, err,
+                createSet);
         if (NULL == meta)
         {
             return err;
         }
         bool zip_save = meta->ziped;
-        ValueData element(value);
         if (zip_save)
         {
             if (!meta->zipvs.insert(element).second)
@@ -520,6 +648,7 @@ namespace ardb
             meta->dirty = false;
             SetMeta(db, key, *meta);
             DELETE(meta);
+            SAddCache(db, key, createSet, element);
             return 1;
         }
         /*
@@ -543,28 +672,50 @@ namespace ardb
             meta->dirty = false;
             SetMeta(db, key, *meta);
             DELETE(meta);
+            SAddCache(db, key, createSet, element);
             return 1;
         }
 
+        RecountSet(db, key, meta);
         SetKeyObject sk(key, element, db);
-        EmptyValueObject empty;
-        if (meta->dirty)
+        std::string exist;
+        if (0 == GetRawValue(sk, exist))
         {
-            SetKeyValueObject(sk, empty);
+            DELETE(meta);
+            return 0;
+        }
+        /*
+         * min/max are kept as bounds of the members: an add may extend them, a removal leaves them as is
+         */
+        meta->size++;
+        if (meta->min.type == EMPTY_VALUE || element.Compare(meta->min) < 0)
+        {
+            meta->min = element;
+        }
+        if (meta->max.type == EMPTY_VALUE || element.Compare(meta->max) > 0)
+        {
+            meta->max = element;
         }
-        else
         {
-            meta->dirty = true;
             BatchWriteGuard guard(GetEngine());
+            EmptyValueObject empty;
             SetKeyValueObject(sk, empty);
             SetMeta(db, key, *meta);
         }
         DELETE(meta);
-        return 0;
+        SAddCache(db, key, createSet, element);
+        return 1;
     }
 
     int Ardb::SCard(const DBID& db, const Slice& key)
     {
+        SetCache* cache = (SetCache*) GetReadCache(db, key, SET_META);
+        if (NULL != cache)
+        {
+            int size = cache->Size();
+            m_level1_cahce->Recycle(cache);
+            return size;
+        }
         int err = 0;
         bool createSet = false;
         SetMetaValue* meta = GetSetMeta(db, key, err, createSet);
@@ -575,30 +726,13 @@ namespace ardb
         if (meta->dirty)
         {
             KeyLockerGuard guard(m_key_locker, db, key);
-            meta->size = 0;
-            SetKeyObject sk(key, Slice(), db);
-            struct SMembersWalk: public WalkHandler
+            DELETE(meta);
+            meta = GetSetMeta(db, key, err, createSet);
+            if (NULL == meta)
             {
-                    SetMetaValue* smeta;
-                    int OnKeyValue(KeyObject* k, ValueObject* v, uint32 cursor)
-                    {
-                        SetKeyObject* sk = (SetKeyObject*) k;
-                        if (cursor == 0)
-                        {
-                            smeta->min = sk->value;
-                        }
-                        smeta->max = sk->value;
-                        smeta->size++;
-                        return 0;
-                    }
-                    SMembersWalk(SetMetaValue* m) :
-                            smeta(m)
-                    {
-                    }
-            } walk(meta);
-            Walk(sk, false, false, &walk);
-            meta->dirty = false;
-            SetMeta(db, key, *meta);
+                return err;
+            }
+            RecountSet(db, key, meta);
         }
         int size = meta->size;
         DELETE(meta);
@@ -607,19 +741,24 @@ namespace ardb
 
     bool Ardb::SIsMember(const DBID& db, const Slice& key, const Slice& value)
     {
-        int err = 0;
-        bool createSet = false;
-        SetMetaValue* meta = GetSetMeta(db, key, err, createSet);
-        if (NULL == meta || createSet)
+        SetCache* cache = (SetCache*) GetReadCache(db, key, SET_META);
+        if (NULL != cache)
         {
-            DELETE(meta);
-            return err;
+            bool exist = cache->Contains(ValueData(value));
+            m_level1_cahce->Recycle(cache);
+            return exist;
+        }
+        std::string raw;
+        ZipMetaView zip;
+        int err = GetZipMeta(db, key, SET_META, raw, zip);
+        if (0 != err)
+        {
+            return false;
         }
-        ValueData element(value);
         bool exist = false;
-        if (meta->ziped)
+        if (zip.IsZiped())
         {
-            exist = meta->zipvs.find(element) != meta->zipvs.end();
+            exist = zip.Find(ValueData(value), NULL);
         }
         else
         {
@@ -627,10 +766,56 @@ namespace ardb
             std::string empty;
             exist = (0 == GetRawValue(sk, empty));
         }
-        DELETE(meta);
         return exist;
     }
 
+    int Ardb::SMIsMember(const DBID& db, const Slice& key, const SliceArray& values, std::vector<int>& exists)
+    {
+        exists.assign(values.size(), 0);
+        SetCache* cache = (SetCache*) GetReadCache(db, key, SET_META);
+        if (NULL != cache)
+        {
+            for (uint32 i = 0; i < values.size(); i++)
+            {
+                exists[i] = cache->Contains(ValueData(values[i])) ? 1 : 0;
+            }
+            m_level1_cahce->Recycle(cache);
+            return 0;
+        }
+        std::string raw;
+        ZipMetaView zip;
+        int err = GetZipMeta(db, key, SET_META, raw, zip);
+        if (0 != err)
+        {
+            return ERR_NOT_EXIST == err ? 0 : err;
+        }
+        if (zip.IsZiped())
+        {
+            for (uint32 i = 0; i < values.size(); i++)
+            {
+                exists[i] = zip.Find(ValueData(values[i]), NULL) ? 1 : 0;
+            }
+        }
+        else
+        {
+            std::deque<SetKeyObject> sks;
+            std::vector<const KeyObject*> ks;
+            for (uint32 i = 0; i < values.size(); i++)
+            {
+                sks.push_back(SetKeyObject(key, values[i], db));
+                ks.push_back(&(sks.back()));
+            }
+            std::vector<std::string> raws;
+            std::vector<int> errs;
+            GetRawValues(ks, raws, errs);
+            for (uint32 i = 0; i < values.size(); i++)
+            {
+                exists[i] = 0 == errs[i] ? 1 : 0;
+            }
+        }
+        return 0;
+    }
+
     int Ardb::SRem(const DBID& db, const Slice& key, const SliceArray& values)
     {
         KeyLockerGuard keyguard(m_key_locker, db, key);
@@ -668,20 +853,42 @@ namespace ardb
             DELETE(meta);
             return erased;
         }
-        BatchWriteGuard guard(GetEngine());
+        RecountSet(db, key, meta);
+        ValueSet members;
         SliceArray::const_iterator it = values.begin();
         while (it != values.end())
         {
-            SetKeyObject sk(key, *it, db);
-            DelValue(sk);
+            members.insert(ValueData(*it));
             it++;
         }
-        if (!meta->dirty)
+        BatchWriteGuard guard(GetEngine());
+        int removed = 0;
+        ValueSet::iterator mit = members.begin();
+        while (mit != members.end())
         {
-            meta->dirty = true;
-            SetMeta(db, key, *meta);
+            SetKeyObject sk(key, *mit, db);
+            std::string exist;
+            if (0 == GetRawValue(sk, exist))
+            {
+                DelValue(sk);
+                removed++;
+            }
+            mit++;
+        }
+        if (removed > 0)
+        {
+            meta->size -= removed;
+            if (meta->size > 0)
+            {
+                SetMeta(db, key, *meta);
+            }
+            else
+            {
+                DelMeta(db, key, meta);
+            }
         }
-        return values.size();
+        DELETE(meta);
+        return removed;
     }
 
     int Ardb::SRem(const DBID& db, const Slice& key, const Slice& value)
@@ -962,6 +1169,21 @@ namespace ardb
 
     int Ardb::SMembers(const DBID& db, const Slice& key, ValueDataArray& values)
     {
+        SetCache* cache = (SetCache*) GetReadCache(db, key, SET_META);
+        if (NULL != cache)
+        {
+            int err = 0;
+            if (cache->Size() >= MAX_SET_QUERY_NUM)
+            {
+                err = ERR_TOO_LARGE_RESPONSE;
+            }
+            else
+            {
+                cache->Members(values);
+            }
+            m_level1_cahce->Recycle(cache);
+            return err;
+        }
         int err = 0;
         bool createSet = false;
         SetMetaValue* meta = GetSetMeta(db, key, err, createSet);
@@ -1140,316 +1362,278 @@ namespace ardb
         return 0;
     }
 
-    int Ardb::SDiff(const DBID& db, SliceArray& keys, SetOperationCallback* callback, uint32 max_subset_num)
+    Ardb::SetCursor::SetCursor(Ardb* db, const DBID& dbid, const Slice& key, SetMetaValue* meta) :
+            m_db(db), m_dbid(dbid), m_key(key), m_meta(meta), m_iter(NULL), m_valid(false)
     {
-        if (keys.size() < 2)
+        if (m_meta->ziped)
         {
-            return ERR_INVALID_ARGS;
+            m_zit = m_meta->zipvs.begin();
         }
-        SetMetaValueArray metas;
-        SliceArray::iterator kit = keys.begin();
-        while (kit != keys.end())
+        else
         {
-            int err = 0;
-            bool createSet = false;
-            SetMetaValue* meta = GetSetMeta(db, *kit, err, createSet);
-            if (NULL == meta)
+            SetKeyObject sk(m_key, Slice(), m_dbid);
+            m_iter = m_db->FindValue(sk, false);
+        }
+        Load();
+    }
+
+    void Ardb::SetCursor::Load()
+    {
+        m_valid = false;
+        if (m_meta->ziped)
+        {
+            if (m_zit != m_meta->zipvs.end())
             {
-                delete_pointer_container(metas);
-                return err;
+                m_value = *m_zit;
+                m_valid = true;
             }
-            FindSetMinMaxValue(db, *kit, meta);
-            metas.push_back(meta);
-            kit++;
+            return;
         }
-        std::vector<ValueData> fromObjs;
-        for (uint32 i = 0; i < keys.size(); i++)
+        if (NULL == m_iter || !m_iter->Valid())
         {
-            fromObjs.push_back(metas[i]->min);
+            return;
         }
-        bool isfirst = true;
-        std::string empty_pattern;
-        while (true)
+        SetKeyObject sk(m_key, Slice(), m_dbid);
+        KeyObject* kk = decode_key(m_iter->Key(), &sk);
+        if (NULL != kk)
         {
-            ValueDataArray base;
-            ValueDataArray next;
-            ValueDataArray* cmp = &base;
-            ValueDataArray* result = &next;
-            SetRange(db, keys[0], metas[0], fromObjs[0], metas[0]->max, max_subset_num, isfirst, empty_pattern, *cmp);
-            if (cmp->empty())
-            {
-                return 0;
-            }
-            fromObjs[0] = *(cmp->rbegin());
-            for (uint32 i = 1; i < keys.size(); i++)
-            {
-                ValueDataArray tmp;
-                SetRange(db, keys[i], metas[i], fromObjs[i], fromObjs[0], -1, isfirst, empty_pattern, tmp);
-                if (!tmp.empty())
-                {
-                    fromObjs[i] = *(tmp.rbegin());
-                }
-                else
-                {
-                    fromObjs[i] = fromObjs[0];
-                }
-                result->clear();
-                result->resize(cmp->size());
-                ValueDataArray::iterator ret = std::set_difference(cmp->begin(), cmp->end(), tmp.begin(), tmp.end(),
-                        result->begin());
-                if (ret == result->begin())
-                {
-                    cmp->clear();
-                    break;
-                }
-                else
-                {
-                    result->resize(ret - result->begin());
-                    ValueDataArray* p = cmp;
-                    cmp = result;
-                    result = p;
-                }
-            }
-            isfirst = false;
-            if (!cmp->empty())
-            {
-                callback->OnSubset(*cmp);
-            }
+            m_value = ((SetKeyObject*) kk)->value;
+            m_valid = true;
         }
-        delete_pointer_container(metas);
-        return 0;
+        DELETE(kk);
     }
 
-    int Ardb::SUnion(const DBID& db, SliceArray& keys, SetOperationCallback* callback, uint32 max_subset_num)
+    void Ardb::SetCursor::Next()
     {
-        if (keys.size() < 2)
+        if (!m_valid)
         {
-            return ERR_INVALID_ARGS;
+            return;
+        }
+        if (m_meta->ziped)
+        {
+            m_zit++;
+        }
+        else
+        {
+            m_iter->Next();
+        }
+        Load();
+    }
+
+    /*
+     * Move to the first member not less than 'target'. Members close ahead are reached by a few steps,
+     * farther ones by seeking the engine iterator.
+     */
+    void Ardb::SetCursor::Seek(const ValueData& target)
+    {
+        if (!m_valid || m_value.Compare(target) >= 0)
+        {
+            return;
         }
-        SetMetaValueArray metas;
-        ValueData min;
-        ValueData max;
-        SliceArray::iterator kit = keys.begin();
-        while (kit != keys.end())
+        if (m_meta->ziped)
+        {
+            m_zit = m_meta->zipvs.lower_bound(target);
+            Load();
+            return;
+        }
+        for (uint32 i = 0; i < MAX_SET_CURSOR_NEXT_STEPS; i++)
+        {
+            Next();
+            if (!m_valid || m_value.Compare(target) >= 0)
+            {
+                return;
+            }
+        }
+        SetKeyObject sk(m_key, target, m_dbid);
+        m_db->FindValue(m_iter, sk);
+        Load();
+    }
+
+    Ardb::SetCursor::~SetCursor()
+    {
+        DELETE(m_iter);
+        DELETE(m_meta);
+    }
+
+    /*
+     * Open a cursor on each set, with 'all_exist' no cursor is returned once a set is missing or empty.
+     */
+    int Ardb::OpenSetCursors(const DBID& db, SliceArray& keys, SetCursorArray& cursors, bool all_exist)
+    {
+        for (uint32 i = 0; i < keys.size(); i++)
         {
             int err = 0;
             bool createSet = false;
-            SetMetaValue* meta = GetSetMeta(db, *kit, err, createSet);
-            if (NULL == meta)
+            SetMetaValue* meta = GetSetMeta(db, keys[i], err, createSet);
+            if (NULL == meta || (all_exist && (createSet || meta->size == 0)))
             {
-                delete_pointer_container(metas);
+                DELETE(meta);
+                delete_pointer_container(cursors);
+                cursors.clear();
                 return err;
             }
-            FindSetMinMaxValue(db, *kit, meta);
-            metas.push_back(meta);
+            cursors.push_back(new SetCursor(this, db, keys[i], meta));
+        }
+        return 0;
+    }
 
-            if (min.type == EMPTY_VALUE || min.Compare(meta->min) < 0)
-            {
-                min = meta->min;
-            }
-            if (max.type == EMPTY_VALUE || max.Compare(meta->max) > 0)
-            {
-                max = meta->max;
-            }
-            kit++;
+    int Ardb::SDiff(const DBID& db, SliceArray& keys, SetOperationCallback* callback, uint32 max_subset_num)
+    {
+        if (keys.size() < 2)
+        {
+            return ERR_INVALID_ARGS;
         }
-        std::vector<ValueData> fromObjs;
-        std::set<uint32> readySetKeyIdxs;
-        for (uint32 i = 0; i < keys.size(); i++)
+        SetCursorArray cursors;
+        int err = OpenSetCursors(db, keys, cursors, false);
+        if (0 != err)
         {
-            fromObjs.push_back(metas[i]->min);
-            readySetKeyIdxs.insert(i);
+            return err;
         }
-
-        bool isfirst = true;
-        std::string empty_pattern;
-        while (!readySetKeyIdxs.empty())
-        {
-            ValueDataArray base;
-            ValueDataArray next;
-            ValueDataArray* cmp = &base;
-            ValueDataArray* result = &next;
-            uint32 firtidx = *(readySetKeyIdxs.begin());
-            std::string str1, str2;
-            SetRange(db, keys[firtidx], metas[firtidx], fromObjs[firtidx], metas[firtidx]->max, max_subset_num, isfirst,
-                    empty_pattern, *cmp);
-            if (!cmp->empty())
-            {
-                fromObjs[firtidx] = *(cmp->rbegin());
-            }
-            else
+        ValueDataArray subset;
+        SetCursor* base = cursors[0];
+        while (base->Valid())
+        {
+            bool found = false;
+            for (uint32 i = 1; i < cursors.size() && !found; i++)
             {
-                fromObjs[firtidx] = metas[firtidx]->max;
+                cursors[i]->Seek(base->Value());
+                found = cursors[i]->Valid() && cursors[i]->Value().Compare(base->Value()) == 0;
             }
-            std::set<uint32>::iterator iit = readySetKeyIdxs.begin();
-            iit++;
-            std::set<uint32> finishedidxs;
-            while (iit != readySetKeyIdxs.end())
+            if (!found)
             {
-                uint32 idx = *iit;
-                ValueDataArray tmp;
-                SetRange(db, keys[idx], metas[idx], fromObjs[idx], fromObjs[firtidx], -1, isfirst, empty_pattern, tmp);
-                if (!tmp.empty())
-                {
-                    fromObjs[idx] = *(tmp.rbegin());
-                }
-                else
-                {
-                    fromObjs[idx] = fromObjs[firtidx];
-                }
-                result->clear();
-                result->resize(cmp->size() + tmp.size());
-                ValueDataArray::iterator ret = std::set_union(cmp->begin(), cmp->end(), tmp.begin(), tmp.end(),
-                        result->begin());
-                if (ret != result->begin())
-                {
-                    result->resize(ret - result->begin());
-                    ValueDataArray* p = cmp;
-                    cmp = result;
-                    result = p;
-                }
-                else
-                {
-
-                }
-                if (fromObjs[idx] >= metas[idx]->max)
+                subset.push_back(base->Value());
+                if (subset.size() >= max_subset_num)
                 {
-                    finishedidxs.insert(idx);
+                    callback->OnSubset(subset);
+                    subset.clear();
                 }
-                iit++;
-            }
-
-            isfirst = false;
-            if (!cmp->empty())
-            {
-                callback->OnSubset(*cmp);
-            }
-            if (fromObjs[firtidx] >= metas[firtidx]->max)
-            {
-                finishedidxs.insert(firtidx);
-            }
-            std::set<uint32>::iterator eit = finishedidxs.begin();
-            while (eit != finishedidxs.end())
-            {
-                readySetKeyIdxs.erase(*eit);
-                eit++;
             }
+            base->Next();
+        }
+        if (!subset.empty())
+        {
+            callback->OnSubset(subset);
         }
-        delete_pointer_container(metas);
+        delete_pointer_container(cursors);
         return 0;
     }
 
-    int Ardb::SInter(const DBID& db, SliceArray& keys, SetOperationCallback* callback, uint32 max_subset_num)
+    /*
+     * K-way merge of the sets, every distinct member is emitted once.
+     */
+    int Ardb::SUnion(const DBID& db, SliceArray& keys, SetOperationCallback* callback, uint32 max_subset_num)
     {
         if (keys.size() < 2)
         {
             return ERR_INVALID_ARGS;
         }
-        int32 min_size = -1;
-        SetMetaValueArray metas;
-        uint32 min_idx = 0;
-        uint32 idx = 0;
-        ValueData min;
-        ValueData max;
-        SliceArray::iterator kit = keys.begin();
-        while (kit != keys.end())
+        SetCursorArray cursors;
+        int err = OpenSetCursors(db, keys, cursors, false);
+        if (0 != err)
         {
-            int err = 0;
-            bool createSet = false;
-            SetMetaValue* meta = GetSetMeta(db, *kit, err, createSet);
-            if (NULL == meta || createSet)
-            {
-                DELETE(meta);
-                delete_pointer_container(metas);
-                return err;
-            }
-            FindSetMinMaxValue(db, *kit, meta);
-            if (!createSet)
+            return err;
+        }
+        ValueDataArray subset;
+        while (true)
+        {
+            SetCursor* min = NULL;
+            for (uint32 i = 0; i < cursors.size(); i++)
             {
-                if (min_size == -1 || min_size > (int32) meta->size)
+                if (cursors[i]->Valid() && (NULL == min || cursors[i]->Value().Compare(min->Value()) < 0))
                 {
-                    min_size = meta->size;
-                    min_idx = idx;
+                    min = cursors[i];
                 }
             }
-            if (meta->size == 0)
+            if (NULL == min)
             {
-                delete_pointer_container(metas);
-                return 0;
+                break;
             }
-            if (min.type == EMPTY_VALUE || min.Compare(meta->min) < 0)
+            subset.push_back(min->Value());
+            for (uint32 i = 0; i < cursors.size(); i++)
             {
-                min = meta->min;
+                if (cursors[i]->Valid() && cursors[i]->Value().Compare(subset.back()) == 0)
+                {
+                    cursors[i]->Next();
+                }
             }
-            if (max.type == EMPTY_VALUE || max.Compare(meta->max) > 0)
+            if (subset.size() >= max_subset_num)
             {
-                max = meta->max;
+                callback->OnSubset(subset);
+                subset.clear();
             }
-            metas.push_back(meta);
-            kit++;
-            idx++;
         }
-        std::vector<ValueData> fromObjs;
-        for (uint32 i = 0; i < keys.size(); i++)
+        if (!subset.empty())
         {
-            fromObjs.push_back(min);
+            callback->OnSubset(subset);
         }
-        bool isfirst = true;
-        std::string empty_pattern;
-        while (true)
+        delete_pointer_container(cursors);
+        return 0;
+    }
+
+    /*
+     * Leapfrog join driven by the smallest set: the other sets seek to its current member, a set landing
+     * past it moves the smallest set forward to that member, so large sets are mostly skipped by seeks.
+     */
+    int Ardb::SInter(const DBID& db, SliceArray& keys, SetOperationCallback* callback, uint32 max_subset_num)
+    {
+        if (keys.size() < 2)
+        {
+            return ERR_INVALID_ARGS;
+        }
+        SetCursorArray cursors;
+        int err = OpenSetCursors(db, keys, cursors, true);
+        if (0 != err || cursors.empty())
         {
-            ValueDataArray base;
-            ValueDataArray next;
-            ValueDataArray* cmp = &base;
-            ValueDataArray* result = &next;
-            /*
-             * Use the smallest set as the base set
-             */
-            SetRange(db, keys[min_idx], metas[min_idx], fromObjs[min_idx], max, max_subset_num, isfirst, empty_pattern,
-                    *cmp);
-            if (cmp->empty())
+            return err;
+        }
+        uint32 min_idx = 0;
+        for (uint32 i = 1; i < cursors.size(); i++)
+        {
+            if (cursors[i]->Meta()->size < cursors[min_idx]->Meta()->size)
             {
-                delete_pointer_container(metas);
-                return 0;
+                min_idx = i;
             }
-            fromObjs[min_idx] = *(cmp->rbegin());
-            for (uint32 i = 0; i < keys.size(); i++)
+        }
+        std::swap(cursors[0], cursors[min_idx]);
+        ValueDataArray subset;
+        SetCursor* base = cursors[0];
+        bool exhausted = false;
+        while (base->Valid() && !exhausted)
+        {
+            bool matched = true;
+            for (uint32 i = 1; i < cursors.size(); i++)
             {
-                if (i != min_idx)
+                SetCursor* cursor = cursors[i];
+                cursor->Seek(base->Value());
+                if (!cursor->Valid())
                 {
-                    result->clear();
-                    result->resize(cmp->size());
-                    ValueDataArray tmp;
-                    SetRange(db, keys[i], metas[i], fromObjs[i], fromObjs[min_idx], -1, isfirst, empty_pattern, tmp);
-                    if (tmp.empty())
-                    {
-                        return 0;
-                    }
-                    fromObjs[i] = *(tmp.rbegin());
-                    result->resize(cmp->size());
-                    ValueDataArray::iterator ret = std::set_intersection(cmp->begin(), cmp->end(), tmp.begin(),
-                            tmp.end(), result->begin());
-                    if (ret == result->begin())
-                    {
-                        break;
-                    }
-                    else
-                    {
-                        result->resize(ret - result->begin());
-
-                        ValueDataArray* p = cmp;
-                        cmp = result;
-                        result = p;
-                    }
+                    matched = false;
+                    exhausted = true;
+                    break;
+                }
+                if (cursor->Value().Compare(base->Value()) != 0)
+                {
+                    matched = false;
+                    base->Seek(cursor->Value());
+                    break;
                 }
             }
-            isfirst = false;
-            if (!cmp->empty())
+            if (matched)
             {
-                callback->OnSubset(*cmp);
+                subset.push_back(base->Value());
+                if (subset.size() >= max_subset_num)
+                {
+                    callback->OnSubset(subset);
+                    subset.clear();
+                }
+                base->Next();
             }
         }
-        delete_pointer_container(metas);
+        if (!subset.empty())
+        {
+            callback->OnSubset(subset);
+        }
+        delete_pointer_container(cursors);
         return 0;
     }
 
@@ -1521,13 +1705,10 @@ namespace ardb
 
     int Ardb::SMove(const DBID& db, const Slice& src, const Slice& dst, const Slice& value)
     {
-        SetKeyObject sk(src, value, db);
-        std::string sv;
-        if (0 != GetRawValue(sk, sv))
+        if (SRem(db, src, value) <= 0)
         {
             return 0;
         }
-        SRem(db, src, value);
         SAdd(db, dst, value);
         return 1;
     }
@@ -1560,10 +1741,11 @@ namespace ardb
             DELETE(meta);
             return 0;
         }
-        Slice empty;
-        SetKeyObject sk(key, meta->dirty ? Slice() : meta->min, db);
+        RecountSet(db, key, meta);
+        SetKeyObject sk(key, meta->min, db);
         Iterator* iter = FindValue(sk);
         BatchWriteGuard guard(GetEngine());
+        bool popped = false;
         if (iter != NULL && iter->Valid())
         {
             Slice tmpkey = iter->Key();
@@ -1574,14 +1756,37 @@ namespace ardb
                 sek->value.ToString(value);
                 DelValue(*sek);
                 DELETE(kk);
+                popped = true;
+                iter->Next();
             }
         }
-        if (!meta->dirty)
+        if (popped && iter->Valid())
         {
-            meta->dirty = true;
-            SetMeta(db, key, *meta);
+            KeyObject* kk = decode_key(iter->Key(), &sk);
+            if (NULL != kk)
+            {
+                meta->min = ((SetKeyObject*) kk)->value;
+                DELETE(kk);
+            }
         }
         DELETE(iter);
+        if (popped)
+        {
+            meta->size--;
+        }
+        else
+        {
+            ERROR_LOG("Set:%s has no member left while its size is %u", key.data(), meta->size);
+            meta->size = 0;
+        }
+        if (meta->size > 0)
+        {
+            SetMeta(db, key, *meta);
+        }
+        else
+        {
+            DelMeta(db, key, meta);
+        }
         DELETE(meta);
         return 0;
     }
@@ -1734,6 +1939,47 @@ namespace ardb
         return callback.meta.size;
     }
 
+    int Ardb::SCheck(const DBID& db, const Slice& key, bool repair, uint32& stored, uint32& counted)
+    {
+        KeyLockerGuard keyguard(m_key_locker, db, key);
+        int err = 0;
+        bool createSet = false;
+        SetMetaValue* meta = GetSetMeta(db, key, err, createSet);
+        if (NULL == meta || createSet)
+        {
+            DELETE(meta);
+            return err;
+        }
+        if (meta->ziped)
+        {
+            stored = counted = meta->zipvs.size();
+            DELETE(meta);
+            return 0;
+        }
+        ValueData min, max;
+        stored = meta->size;
+        counted = CountSetMembers(db, key, min, max);
+        if (repair && (meta->dirty || stored != counted))
+        {
+            WARN_LOG("Repair size of set:%s from %u%s to %u", key.data(), stored, meta->dirty ? "(dirty)" : "",
+                    counted);
+            meta->size = counted;
+            meta->min = min;
+            meta->max = max;
+            meta->dirty = false;
+            if (counted > 0)
+            {
+                SetMeta(db, key, *meta);
+            }
+            else
+            {
+                DelMeta(db, key, meta);
+            }
+        }
+        DELETE(meta);
+        return 0;
+    }
+
     int Ardb::RenameSet(const DBID& db1, const Slice& key1, const DBID& db2, const Slice& key2, SetMetaValue* meta)
     {
         BatchWriteGuard guard(GetEngine());
@@ -501,25 +501,22 @@ namespace ardb
         if (options.store_dst != NULL && !values.empty())
         {
             BatchWriteGuard guard(GetEngine());
-            LClear(db, options.store_dst);
+            Slice dst(options.store_dst);
+            LClear(db, dst);
+            ValueDataDeque store_values;
             ValueDataArray::iterator it = values.begin();
-            int64 score = 0;
-
             while (it != values.end())
             {
                 if (it->type != EMPTY_VALUE)
                 {
-                    ListKeyObject lk(options.store_dst, score, db);
-                    SetKeyValueObject(lk, *it);
-                    score++;
+                    store_values.push_back(*it);
                 }
                 it++;
             }
             ListMetaValue meta;
-            meta.min_score.SetIntValue(0);
-            meta.max_score.SetIntValue(score - 1);
-            meta.size = score;
-            SetMeta(db, options.store_dst, meta);
+            ListAppendValues(db, dst, meta, store_values);
+            meta.size = store_values.size();
+            SetMeta(db, dst, meta);
         }
         return 0;
     }
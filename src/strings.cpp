@@ -34,8 +34,13 @@ namespace ardb
 {
     int ArdbServer::Append(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
-        const std::string& key = cmd.GetArguments()[0];
-        const std::string& value = cmd.GetArguments()[1];
+        Slice key = cmd.GetArgumentSlice(0);
+        Slice value = cmd.GetArgumentSlice(1);
+        if (ctx.reply_discarded)
+        {
+            m_db->MergeAppend(ctx.currentDB, key, value);
+            return 0;
+        }
         int ret = m_db->Append(ctx.currentDB, key, value);
         CHECK_ARDB_RETURN_VALUE(ctx.reply, ret);
         if (ret > 0)
@@ -44,7 +49,7 @@ namespace ardb
         }
         else
         {
-            fill_error_reply(ctx.reply, "failed to append key:%s", key.c_str());
+            fill_error_reply(ctx.reply, "failed to append key:%s", key.ToString().c_str());
         }
         return 0;
     }
@@ -52,12 +57,12 @@ namespace ardb
     int ArdbServer::PSetEX(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
         uint32 mills;
-        if (!string_touint32(cmd.GetArguments()[1], mills))
+        if (!string_touint32(cmd.GetArgumentSlice(1).ToString(), mills))
         {
             fill_error_reply(ctx.reply, "value is not an integer or out of range");
             return 0;
         }
-        int ret = m_db->PSetEx(ctx.currentDB, cmd.GetArguments()[0], cmd.GetArguments()[2], mills);
+        int ret = m_db->PSetEx(ctx.currentDB, cmd.GetArgumentSlice(0), cmd.GetArgumentSlice(2), mills);
         CHECK_ARDB_RETURN_VALUE(ctx.reply, ret);
         fill_status_reply(ctx.reply, "OK");
         return 0;
@@ -65,17 +70,17 @@ namespace ardb
 
     int ArdbServer::MSetNX(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
-        if (cmd.GetArguments().size() % 2 != 0)
+        if (cmd.GetArgumentCount() % 2 != 0)
         {
             fill_error_reply(ctx.reply, "wrong number of arguments for MSETNX");
             return 0;
         }
         SliceArray keys;
         SliceArray vals;
-        for (uint32 i = 0; i < cmd.GetArguments().size(); i += 2)
+        for (uint32 i = 0; i < cmd.GetArgumentCount(); i += 2)
         {
-            keys.push_back(cmd.GetArguments()[i]);
-            vals.push_back(cmd.GetArguments()[i + 1]);
+            keys.push_back(cmd.GetArgumentSlice(i));
+            vals.push_back(cmd.GetArgumentSlice(i + 1));
         }
         int count = m_db->MSetNX(ctx.currentDB, keys, vals);
         CHECK_ARDB_RETURN_VALUE(ctx.reply, count);
@@ -85,17 +90,17 @@ namespace ardb
 
     int ArdbServer::MSet(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
-        if (cmd.GetArguments().size() % 2 != 0)
+        if (cmd.GetArgumentCount() % 2 != 0)
         {
             fill_error_reply(ctx.reply, "wrong number of arguments for MSET");
             return 0;
         }
         SliceArray keys;
         SliceArray vals;
-        for (uint32 i = 0; i < cmd.GetArguments().size(); i += 2)
+        for (uint32 i = 0; i < cmd.GetArgumentCount(); i += 2)
         {
-            keys.push_back(cmd.GetArguments()[i]);
-            vals.push_back(cmd.GetArguments()[i + 1]);
+            keys.push_back(cmd.GetArgumentSlice(i));
+            vals.push_back(cmd.GetArgumentSlice(i + 1));
         }
         int ret = m_db->MSet(ctx.currentDB, keys, vals);
         CHECK_ARDB_RETURN_VALUE(ctx.reply, ret);
@@ -146,6 +151,11 @@ namespace ardb
             fill_error_reply(ctx.reply, "value is not an integer or out of range");
             return 0;
         }
+        if (ctx.reply_discarded)
+        {
+            m_db->MergeIncrby(ctx.currentDB, cmd.GetArguments()[0], increment);
+            return 0;
+        }
         int ret = m_db->Incrby(ctx.currentDB, cmd.GetArguments()[0], increment, val);
         CHECK_ARDB_RETURN_VALUE(ctx.reply, ret);
         if (ret == 0)
@@ -162,6 +172,11 @@ namespace ardb
     int ArdbServer::Incr(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
         int64_t val;
+        if (ctx.reply_discarded)
+        {
+            m_db->MergeIncrby(ctx.currentDB, cmd.GetArguments()[0], 1);
+            return 0;
+        }
         int ret = m_db->Incr(ctx.currentDB, cmd.GetArguments()[0], val);
         CHECK_ARDB_RETURN_VALUE(ctx.reply, ret);
         if (ret == 0)
@@ -178,7 +193,7 @@ namespace ardb
     int ArdbServer::GetSet(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
         std::string v;
-        int ret = m_db->GetSet(ctx.currentDB, cmd.GetArguments()[0], cmd.GetArguments()[1], v);
+        int ret = m_db->GetSet(ctx.currentDB, cmd.GetArgumentSlice(0), cmd.GetArgumentSlice(1), v);
         CHECK_ARDB_RETURN_VALUE(ctx.reply, ret);
         if (ret < 0)
         {
@@ -208,10 +223,10 @@ namespace ardb
 
     int ArdbServer::Set(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
-        const std::string& key = cmd.GetArguments()[0];
-        const std::string& value = cmd.GetArguments()[1];
+        Slice key = cmd.GetArgumentSlice(0);
+        Slice value = cmd.GetArgumentSlice(1);
         int ret = 0;
-        if (cmd.GetArguments().size() == 2)
+        if (cmd.GetArgumentCount() == 2)
         {
             ret = m_db->Set(ctx.currentDB, key, value);
         }
@@ -219,13 +234,15 @@ namespace ardb
         {
             uint32 i = 0;
             uint64 px = 0, ex = 0;
-            for (i = 2; i < cmd.GetArguments().size(); i++)
+            for (i = 2; i < cmd.GetArgumentCount(); i++)
             {
-                std::string tmp = string_tolower(cmd.GetArguments()[i]);
+                std::string tmp = string_tolower(cmd.GetArgumentSlice(i).ToString());
                 if (tmp == "ex" || tmp == "px")
                 {
                     int64 iv;
-                    if (!raw_toint64(cmd.GetArguments()[i + 1].c_str(), cmd.GetArguments()[i + 1].size(), iv) || iv < 0)
+                    if (i + 1 >= cmd.GetArgumentCount()
+                            || !raw_toint64(cmd.GetArgumentSlice(i + 1).data(), cmd.GetArgumentSlice(i + 1).size(), iv)
+                            || iv < 0)
                     {
                         fill_error_reply(ctx.reply, "value is not an integer or out of range");
                         return 0;
@@ -247,13 +264,13 @@ namespace ardb
             }
             bool hasnx = false, hasxx = false;
             bool syntaxerror = false;
-            if (i < cmd.GetArguments().size() - 1)
+            if (i < cmd.GetArgumentCount() - 1)
             {
                 syntaxerror = true;
             }
-            if (i == cmd.GetArguments().size() - 1)
+            if (i == cmd.GetArgumentCount() - 1)
             {
-                std::string cmp = string_tolower(cmd.GetArguments()[i]);
+                std::string cmp = string_tolower(cmd.GetArgumentSlice(i).ToString());
                 if (cmp != "nx" && cmp != "xx")
                 {
                     syntaxerror = true;
@@ -312,9 +329,21 @@ namespace ardb
 
     int ArdbServer::Get(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
-        const std::string& key = cmd.GetArguments()[0];
+        Slice key = cmd.GetArgumentSlice(0);
         std::string value;
-        int ret = m_db->Get(ctx.currentDB, key, value);
+        int ret = 0;
+        if (!ctx.prefetched_gets.empty() && Slice(ctx.prefetched_gets.front().key) == key
+                && ctx.prefetched_gets.front().db == ctx.currentDB)
+        {
+            value.swap(ctx.prefetched_gets.front().value);
+            ret = ctx.prefetched_gets.front().err;
+            ctx.prefetched_gets.pop_front();
+        }
+        else
+        {
+            ctx.prefetched_gets.clear();
+            ret = m_db->Get(ctx.currentDB, key, value);
+        }
         CHECK_ARDB_RETURN_VALUE(ctx.reply, ret);
         if (0 == ret)
         {
@@ -343,6 +372,11 @@ namespace ardb
             fill_error_reply(ctx.reply, "value is not an integer or out of range");
             return 0;
         }
+        if (ctx.reply_discarded)
+        {
+            m_db->MergeIncrby(ctx.currentDB, cmd.GetArguments()[0], 0 - decrement);
+            return 0;
+        }
         int ret = m_db->Decrby(ctx.currentDB, cmd.GetArguments()[0], decrement, val);
         CHECK_ARDB_RETURN_VALUE(ctx.reply, ret);
         if (ret == 0)
@@ -359,6 +393,11 @@ namespace ardb
     int ArdbServer::Decr(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
         int64_t val;
+        if (ctx.reply_discarded)
+        {
+            m_db->MergeIncrby(ctx.currentDB, cmd.GetArguments()[0], -1);
+            return 0;
+        }
         int ret = m_db->Decr(ctx.currentDB, cmd.GetArguments()[0], val);
         CHECK_ARDB_RETURN_VALUE(ctx.reply, ret);
         if (ret == 0)
@@ -375,19 +414,19 @@ namespace ardb
     int ArdbServer::SetEX(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
         uint32 secs;
-        if (!string_touint32(cmd.GetArguments()[1], secs))
+        if (!string_touint32(cmd.GetArgumentSlice(1).ToString(), secs))
         {
             fill_error_reply(ctx.reply, "value is not an integer or out of range");
             return 0;
         }
-        int ret = m_db->SetEx(ctx.currentDB, cmd.GetArguments()[0], cmd.GetArguments()[2], secs);
+        int ret = m_db->SetEx(ctx.currentDB, cmd.GetArgumentSlice(0), cmd.GetArgumentSlice(2), secs);
         CHECK_ARDB_RETURN_VALUE(ctx.reply, ret);
         fill_status_reply(ctx.reply, "OK");
         return 0;
     }
     int ArdbServer::SetNX(ArdbConnContext& ctx, RedisCommandFrame& cmd)
     {
-        int ret = m_db->SetNX(ctx.currentDB, cmd.GetArguments()[0], cmd.GetArguments()[1]);
+        int ret = m_db->SetNX(ctx.currentDB, cmd.GetArgumentSlice(0), cmd.GetArgumentSlice(1));
         fill_int_reply(ctx.reply, ret);
         return 0;
     }
@@ -466,6 +505,36 @@ namespace ardb
         return ret;
     }
 
+    int Ardb::MergeIncrby(const DBID& db, const Slice& key, int64_t increment)
+    {
+        if (!GetEngine()->SupportMerge())
+        {
+            int64_t value;
+            return Incrby(db, key, increment, value);
+        }
+        KeyLockerGuard keyguard(m_key_locker, db, key);
+        Buffer op;
+        encode_merge_operand(op, ARDB_MERGE_STRING_INCRBY, ValueData((int64) increment));
+        KeyObject k(key, KEY_META, db);
+        return MergeRawValue(k, Slice(op.GetRawReadBuffer(), op.ReadableBytes()));
+    }
+
+    int Ardb::MergeAppend(const DBID& db, const Slice& key, const Slice& value)
+    {
+        if (!GetEngine()->SupportMerge())
+        {
+            int ret = Append(db, key, value);
+            return ret < 0 ? ret : 0;
+        }
+        KeyLockerGuard keyguard(m_key_locker, db, key);
+        ValueData arg;
+        arg.SetValue(value, false);
+        Buffer op;
+        encode_merge_operand(op, ARDB_MERGE_STRING_APPEND, arg);
+        KeyObject k(key, KEY_META, db);
+        return MergeRawValue(k, Slice(op.GetRawReadBuffer(), op.ReadableBytes()));
+    }
+
     int Ardb::Decr(const DBID& db, const Slice& key, int64_t& value)
     {
         return Decrby(db, key, 1, value);
@@ -60,7 +60,7 @@ namespace ardb
             for (uint32 i = 0; i < ctx.GetTransc().transaction_cmds.size(); i++)
             {
                 RedisCommandFrame& cmd = ctx.GetTransc().transaction_cmds.at(i);
-                DoRedisCommand(ctx, FindRedisCommandHandlerSetting(cmd.GetCommand()), cmd);
+                DoRedisCommand(ctx, FindRedisCommandHandlerSetting(cmd), cmd);
                 r.elements.push_back(ctx.reply);
             }
             ctx.reply = r;
@@ -0,0 +1,263 @@
+ /*
+ *Copyright (c) 2013-2014, yinqiwen <yinqiwen@gmail.com>
+ *All rights reserved.
+ * 
+ *Redistribution and use in source and binary forms, with or without
+ *modification, are permitted provided that the following conditions are met:
+ * 
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Redis nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ * 
+ *THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS 
+ *BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ *THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util/bitops.hpp"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define ARDB_BITOPS_X86
+#include <immintrin.h>
+#endif
+
+namespace ardb
+{
+    enum BitsOpType
+    {
+        BITS_AND, BITS_OR, BITS_XOR
+    };
+
+    static inline uint64 load_word(const uint8* p)
+    {
+        uint64 v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static inline void store_word(uint8* p, uint64 v)
+    {
+        memcpy(p, &v, sizeof(v));
+    }
+
+    static inline uint64 popcount_word(uint64 x)
+    {
+        x = x - ((x >> 1) & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return (x * 0x0101010101010101ULL) >> 56;
+    }
+
+    static uint64 popcount_scalar(const uint8* p, size_t bytes)
+    {
+        uint64 bits = 0;
+        while (bytes >= 8)
+        {
+            bits += popcount_word(load_word(p));
+            p += 8;
+            bytes -= 8;
+        }
+        while (bytes--)
+        {
+            bits += popcount_word(*p++);
+        }
+        return bits;
+    }
+
+    template<BitsOpType OP>
+    static inline uint64 apply_word(uint64 a, uint64 b)
+    {
+        return OP == BITS_AND ? (a & b) : (OP == BITS_OR ? (a | b) : (a ^ b));
+    }
+
+    template<BitsOpType OP>
+    static void bitop_scalar(uint8* dst, const uint8* src, size_t bytes)
+    {
+        while (bytes >= 8)
+        {
+            store_word(dst, apply_word<OP>(load_word(dst), load_word(src)));
+            dst += 8;
+            src += 8;
+            bytes -= 8;
+        }
+        while (bytes--)
+        {
+            *dst = (uint8) apply_word<OP>(*dst, *src);
+            dst++;
+            src++;
+        }
+    }
+
+    static void not_scalar(uint8* dst, size_t bytes)
+    {
+        while (bytes >= 8)
+        {
+            store_word(dst, ~load_word(dst));
+            dst += 8;
+            bytes -= 8;
+        }
+        while (bytes--)
+        {
+            *dst = ~(*dst);
+            dst++;
+        }
+    }
+
+#ifdef ARDB_BITOPS_X86
+    __attribute__((target("popcnt")))
+    static uint64 popcount_popcnt(const uint8* p, size_t bytes)
+    {
+        uint64 bits = 0;
+        while (bytes >= 8)
+        {
+            bits += __builtin_popcountll(load_word(p));
+            p += 8;
+            bytes -= 8;
+        }
+        while (bytes--)
+        {
+            bits += __builtin_popcount(*p++);
+        }
+        return bits;
+    }
+
+    /*
+     * Nibble lookup popcount: each byte is counted by two table shuffles, the byte counts are summed
+     * into 64 bit lanes by SAD against zero.
+     */
+    __attribute__((target("avx2,popcnt")))
+    static uint64 popcount_avx2(const uint8* p, size_t bytes)
+    {
+        const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3,
+                1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i low_mask = _mm256_set1_epi8(0x0F);
+        __m256i acc = _mm256_setzero_si256();
+        while (bytes >= 32)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i*) p);
+            __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(v, low_mask));
+            __m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask));
+            acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+            p += 32;
+            bytes -= 32;
+        }
+        uint64 lanes[4];
+        _mm256_storeu_si256((__m256i*) lanes, acc);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3] + popcount_popcnt(p, bytes);
+    }
+
+    template<BitsOpType OP>
+    __attribute__((target("avx2")))
+    static void bitop_avx2(uint8* dst, const uint8* src, size_t bytes)
+    {
+        while (bytes >= 32)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i*) dst);
+            __m256i b = _mm256_loadu_si256((const __m256i*) src);
+            __m256i r = OP == BITS_AND ? _mm256_and_si256(a, b) :
+                        (OP == BITS_OR ? _mm256_or_si256(a, b) : _mm256_xor_si256(a, b));
+            _mm256_storeu_si256((__m256i*) dst, r);
+            dst += 32;
+            src += 32;
+            bytes -= 32;
+        }
+        bitop_scalar<OP>(dst, src, bytes);
+    }
+
+    __attribute__((target("avx2")))
+    static void not_avx2(uint8* dst, size_t bytes)
+    {
+        const __m256i ones = _mm256_set1_epi32(-1);
+        while (bytes >= 32)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i*) dst);
+            _mm256_storeu_si256((__m256i*) dst, _mm256_xor_si256(a, ones));
+            dst += 32;
+            bytes -= 32;
+        }
+        not_scalar(dst, bytes);
+    }
+#endif
+
+    struct BitsKernels
+    {
+            const char* name;
+            uint64 (*popcount)(const uint8* p, size_t bytes);
+            void (*bitand_)(uint8* dst, const uint8* src, size_t bytes);
+            void (*bitor_)(uint8* dst, const uint8* src, size_t bytes);
+            void (*bitxor_)(uint8* dst, const uint8* src, size_t bytes);
+            void (*bitnot_)(uint8* dst, size_t bytes);
+            BitsKernels() :
+                    name("scalar"), popcount(popcount_scalar), bitand_(bitop_scalar<BITS_AND>), bitor_(
+                            bitop_scalar<BITS_OR>), bitxor_(bitop_scalar<BITS_XOR>), bitnot_(not_scalar)
+            {
+#ifdef ARDB_BITOPS_X86
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+                {
+                    name = "avx2";
+                    popcount = popcount_avx2;
+                    bitand_ = bitop_avx2<BITS_AND>;
+                    bitor_ = bitop_avx2<BITS_OR>;
+                    bitxor_ = bitop_avx2<BITS_XOR>;
+                    bitnot_ = not_avx2;
+                }
+                else if (__builtin_cpu_supports("popcnt"))
+                {
+                    name = "popcnt";
+                    popcount = popcount_popcnt;
+                }
+#endif
+            }
+    };
+
+    static const BitsKernels& kernels()
+    {
+        static BitsKernels k;
+        return k;
+    }
+
+    uint64 bits_popcount(const void* s, size_t bytes)
+    {
+        return kernels().popcount((const uint8*) s, bytes);
+    }
+
+    void bits_and(void* dst, const void* src, size_t bytes)
+    {
+        kernels().bitand_((uint8*) dst, (const uint8*) src, bytes);
+    }
+
+    void bits_or(void* dst, const void* src, size_t bytes)
+    {
+        kernels().bitor_((uint8*) dst, (const uint8*) src, bytes);
+    }
+
+    void bits_xor(void* dst, const void* src, size_t bytes)
+    {
+        kernels().bitxor_((uint8*) dst, (const uint8*) src, bytes);
+    }
+
+    void bits_not(void* dst, size_t bytes)
+    {
+        kernels().bitnot_((uint8*) dst, bytes);
+    }
+
+    const char* bits_kernel_name()
+    {
+        return kernels().name;
+    }
+}
@@ -0,0 +1,377 @@
+/*
+ *Copyright (c) 2013-2013, yinqiwen <yinqiwen@gmail.com>
+ *All rights reserved.
+ * 
+ *Redistribution and use in source and binary forms, with or without
+ *modification, are permitted provided that the following conditions are met:
+ * 
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Redis nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ * 
+ *THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS 
+ *BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ *THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CLOCK_CACHE_HPP_
+#define CLOCK_CACHE_HPP_
+#include "common.hpp"
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+namespace ardb
+{
+    /*
+     * A hash table evicted by a CLOCK hand with 2-bit usage counters.
+     * New entries are admitted with a zero counter and every hit bumps it, so the hand evicts entries
+     * touched once(e.g. by a scan) before it could evict an entry touched repeatedly.
+     * Entries live in an array the hand walks over, an open addressed(linear probing) index maps keys
+     * to their position. Keeping the hand off the index keeps its load even, a hand sweeping the
+     * probing slots would leave long clusters just ahead of it. Erased positions are reused by later
+     * inserts, so a new entry usually lands just behind the hand and gets a full round before eviction.
+     * It's not thread safe, callers shard it and lock each shard.
+     */
+    template<typename K, typename V, typename HashFunc>
+    class ClockCache
+    {
+        public:
+            typedef std::pair<K, V> CacheEntry;
+        private:
+            struct Entry
+            {
+                    K key;
+                    V value;
+                    uint32 hash;
+                    uint8 ref;
+                    uint8 used;
+                    Entry() :
+                            hash(0), ref(0), used(0)
+                    {
+                    }
+            };
+            static const uint8 kMaxRef = 3;
+            static const size_t kMinCapacity = 16;
+            static const uint32 kEmptySlot = 0;
+            std::vector<Entry> m_entries;
+            std::vector<uint32> m_free_entries;
+            //entry position + 1, 0 for an empty slot
+            std::vector<uint32> m_index;
+            size_t m_size;
+            size_t m_hand;
+            HashFunc m_hash_func;
+
+            size_t Mask() const
+            {
+                return m_index.size() - 1;
+            }
+            bool Find(const K& key, uint32 hash, size_t& slot) const
+            {
+                if (m_index.empty())
+                {
+                    return false;
+                }
+                slot = hash & Mask();
+                while (m_index[slot] != kEmptySlot)
+                {
+                    const Entry& entry = m_entries[m_index[slot] - 1];
+                    if (entry.hash == hash && entry.key == key)
+                    {
+                        return true;
+                    }
+                    slot = (slot + 1) & Mask();
+                }
+                return false;
+            }
+            size_t SlotOf(size_t pos) const
+            {
+                size_t slot = m_entries[pos].hash & Mask();
+                while (m_index[slot] != pos + 1)
+                {
+                    slot = (slot + 1) & Mask();
+                }
+                return slot;
+            }
+            void Place(size_t pos)
+            {
+                size_t slot = m_entries[pos].hash & Mask();
+                while (m_index[slot] != kEmptySlot)
+                {
+                    slot = (slot + 1) & Mask();
+                }
+                m_index[slot] = pos + 1;
+            }
+            void Rehash(size_t capacity)
+            {
+                m_index.assign(capacity, (uint32) kEmptySlot);
+                for (size_t i = 0; i < m_entries.size(); i++)
+                {
+                    if (m_entries[i].used)
+                    {
+                        Place(i);
+                    }
+                }
+            }
+            /*
+             * Drops the erased positions once they are the majority, the hand keeps its place in the order
+             */
+            void Compact()
+            {
+                std::vector<Entry> entries;
+                entries.reserve(m_size);
+                size_t hand = 0;
+                for (size_t i = 0; i < m_entries.size(); i++)
+                {
+                    if (i == m_hand)
+                    {
+                        hand = entries.size();
+                    }
+                    if (m_entries[i].used)
+                    {
+                        entries.push_back(m_entries[i]);
+                    }
+                }
+                m_entries.swap(entries);
+                std::vector<uint32>().swap(m_free_entries);
+                m_hand = hand;
+                size_t capacity = m_index.size();
+                while (capacity > kMinCapacity && m_size * 8 < capacity)
+                {
+                    capacity /= 2;
+                }
+                Rehash(capacity);
+            }
+            /*
+             * Backward shift deletion keeps probe chains intact without tombstones
+             */
+            void EraseSlot(size_t slot)
+            {
+                size_t hole = slot;
+                size_t next = (slot + 1) & Mask();
+                while (m_index[next] != kEmptySlot)
+                {
+                    size_t home = m_entries[m_index[next] - 1].hash & Mask();
+                    if (((next - home) & Mask()) >= ((next - hole) & Mask()))
+                    {
+                        m_index[hole] = m_index[next];
+                        hole = next;
+                    }
+                    next = (next + 1) & Mask();
+                }
+                m_index[hole] = kEmptySlot;
+            }
+            void EraseAt(size_t slot)
+            {
+                size_t pos = m_index[slot] - 1;
+                EraseSlot(slot);
+                m_entries[pos] = Entry();
+                m_free_entries.push_back(pos);
+                m_size--;
+                if (pos == m_hand)
+                {
+                    m_hand++;
+                }
+                if (m_entries.size() > kMinCapacity && m_free_entries.size() * 2 > m_entries.size())
+                {
+                    Compact();
+                }
+            }
+        public:
+            ClockCache() :
+                    m_size(0), m_hand(0)
+            {
+            }
+            /*
+             * Bytes taken by the table for each entry, excluding memory the key & value own
+             */
+            static uint32 AverageBytesPerValue()
+            {
+                //index slots are kept between 1/8 and 3/4 full, at most half of the entries are erased ones
+                return sizeof(Entry) * 2 + sizeof(uint32) * 3;
+            }
+            size_t TableBytes() const
+            {
+                return m_entries.capacity() * sizeof(Entry) + m_free_entries.capacity() * sizeof(uint32)
+                        + m_index.size() * sizeof(uint32);
+            }
+            size_t Size() const
+            {
+                return m_size;
+            }
+            void Clear()
+            {
+                std::vector<Entry> empty_entries;
+                std::vector<uint32> empty_free, empty_index;
+                m_entries.swap(empty_entries);
+                m_free_entries.swap(empty_free);
+                m_index.swap(empty_index);
+                m_size = 0;
+                m_hand = 0;
+            }
+            bool Contains(const K& key) const
+            {
+                size_t slot;
+                return Find(key, m_hash_func(key), slot);
+            }
+            bool Peek(const K& key, V& value) const
+            {
+                size_t slot;
+                if (Find(key, m_hash_func(key), slot))
+                {
+                    value = m_entries[m_index[slot] - 1].value;
+                    return true;
+                }
+                return false;
+            }
+            bool Get(const K& key, V& value)
+            {
+                size_t slot;
+                if (Find(key, m_hash_func(key), slot))
+                {
+                    Entry& entry = m_entries[m_index[slot] - 1];
+                    if (entry.ref < kMaxRef)
+                    {
+                        entry.ref++;
+                    }
+                    value = entry.value;
+                    return true;
+                }
+                return false;
+            }
+            /*
+             * Returns false if the key exists already, the existing value is kept then
+             */
+            bool Insert(const K& key, const V& value)
+            {
+                uint32 hash = m_hash_func(key);
+                size_t slot;
+                if (Find(key, hash, slot))
+                {
+                    return false;
+                }
+                size_t pos = m_entries.size();
+                if (m_free_entries.empty())
+                {
+                    m_entries.push_back(Entry());
+                }
+                else
+                {
+                    pos = m_free_entries.back();
+                    m_free_entries.pop_back();
+                }
+                Entry& entry = m_entries[pos];
+                entry.key = key;
+                entry.value = value;
+                entry.hash = hash;
+                entry.used = 1;
+                m_size++;
+                if (m_size * 4 > m_index.size() * 3)
+                {
+                    Rehash(m_index.empty() ? kMinCapacity : m_index.size() * 2);
+                }
+                else
+                {
+                    Place(pos);
+                }
+                return true;
+            }
+            /*
+             * Replaces the value of an existing key, 'old' receives the replaced value
+             */
+            bool Update(const K& key, const V& value, V& old)
+            {
+                size_t slot;
+                if (!Find(key, m_hash_func(key), slot))
+                {
+                    return false;
+                }
+                Entry& entry = m_entries[m_index[slot] - 1];
+                if (entry.ref < kMaxRef)
+                {
+                    entry.ref++;
+                }
+                old = entry.value;
+                entry.value = value;
+                return true;
+            }
+            bool Erase(const K& key, V& value)
+            {
+                size_t slot;
+                if (!Find(key, m_hash_func(key), slot))
+                {
+                    return false;
+                }
+                value = m_entries[m_index[slot] - 1].value;
+                EraseAt(slot);
+                return true;
+            }
+            /*
+             * Advances the hand to the next entry whose counter is zero, counters of passed entries are
+             * decremented. The victim stays in the table.
+             */
+            bool PeekVictim(CacheEntry& entry)
+            {
+                if (m_size == 0)
+                {
+                    return false;
+                }
+                while (true)
+                {
+                    if (m_hand >= m_entries.size())
+                    {
+                        m_hand = 0;
+                    }
+                    Entry& e = m_entries[m_hand];
+                    if (!e.used)
+                    {
+                        m_hand++;
+                        continue;
+                    }
+                    if (e.ref == 0)
+                    {
+                        entry.first = e.key;
+                        entry.second = e.value;
+                        return true;
+                    }
+                    e.ref--;
+                    m_hand++;
+                }
+                return false;
+            }
+            bool PopVictim(CacheEntry& entry)
+            {
+                if (!PeekVictim(entry))
+                {
+                    return false;
+                }
+                EraseAt(SlotOf(m_hand));
+                return true;
+            }
+            void GetKeys(std::vector<K>& keys) const
+            {
+                for (size_t i = 0; i < m_entries.size(); i++)
+                {
+                    if (m_entries[i].used)
+                    {
+                        keys.push_back(m_entries[i].key);
+                    }
+                }
+            }
+    };
+}
+
+#endif /* CLOCK_CACHE_HPP_ */
@@ -41,6 +41,9 @@
 
 #ifndef CONCURRENT_QUEUE_HPP_
 #define CONCURRENT_QUEUE_HPP_
+#include "common.hpp"
+#include "util/atomic.hpp"
+#include <algorithm>
 
 #if defined __GNUC__ &&  __GNUC__ < 3 && __GNUC_MINOR__ < 9
 /* gcc version < 2.9 */
@@ -392,6 +395,110 @@ namespace ardb
 			SPSCQueue(SPSCQueue const&);
 			SPSCQueue& operator =(SPSCQueue const&);
 	};
+
+	/*
+	 * Bounded multi-producer/single-consumer ring based on Dmitry Vyukov's bounded MPMC queue.
+	 * Each cell carries a sequence telling whether it is free for the producer claiming position 'pos'(seq == pos)
+	 * or filled for the consumer reading it(seq == pos + 1). Producers only contend on the tail position.
+	 * Values are swapped in & out, so pushing a string moves its buffer instead of copying it.
+	 */
+	template<typename T>
+	class MPSCRingQueue
+	{
+		private:
+			struct Cell
+			{
+					uint64_t seq;
+					T value;
+			};
+			static const uint8 CACHE_LINE_SIZE = 64;
+			Cell* m_cells;
+			uint64_t m_mask;
+			char m_pad0[CACHE_LINE_SIZE];
+			volatile uint64_t m_tail;
+			char m_pad1[CACHE_LINE_SIZE];
+			uint64_t m_head;
+
+			MPSCRingQueue(MPSCRingQueue const&);
+			MPSCRingQueue& operator =(MPSCRingQueue const&);
+		public:
+			MPSCRingQueue(uint32 capacity) :
+					m_cells(NULL), m_mask(0), m_tail(0), m_head(0)
+			{
+				uint64_t size = 2;
+				while (size < capacity)
+				{
+					size <<= 1;
+				}
+				m_cells = new Cell[size];
+				m_mask = size - 1;
+				for (uint64_t i = 0; i < size; i++)
+				{
+					m_cells[i].seq = i;
+				}
+			}
+			uint64_t Capacity() const
+			{
+				return m_mask + 1;
+			}
+			/*
+			 * Returns false if the ring is full, 'value' is left untouched then
+			 */
+			bool TryPush(T& value)
+			{
+				uint64_t pos = m_tail;
+				Cell* cell = NULL;
+				for (;;)
+				{
+					cell = &m_cells[pos & m_mask];
+					uint64_t seq = load_consume(&cell->seq);
+					int64_t diff = (int64_t) seq - (int64_t) pos;
+					if (diff == 0)
+					{
+						if (atomic_cmp_set_uint64(&m_tail, pos, pos + 1))
+						{
+							break;
+						}
+						pos = m_tail;
+					}
+					else if (diff < 0)
+					{
+						return false;
+					}
+					else
+					{
+						pos = m_tail;
+					}
+				}
+				std::swap(cell->value, value);
+				store_release(&cell->seq, pos + 1);
+				return true;
+			}
+			bool Pop(T& value)
+			{
+				Cell* cell = &m_cells[m_head & m_mask];
+				if (load_consume(&cell->seq) != m_head + 1)
+				{
+					return false;
+				}
+				std::swap(value, cell->value);
+				store_release(&cell->seq, m_head + m_mask + 1);
+				m_head++;
+				return true;
+			}
+			/*
+			 * Approximate count of values pushed but not popped yet
+			 */
+			uint64_t Size() const
+			{
+				uint64_t tail = m_tail;
+				return tail > m_head ? tail - m_head : 0;
+			}
+			~MPSCRingQueue()
+			{
+				delete[] m_cells;
+			}
+	};
 }
 
 #endif /* X_HPP_ */
@@ -180,6 +180,64 @@ namespace ardb
         return 0;
     }
 
+    int file_copy(const std::string& src, const std::string& dest, int64 limit)
+    {
+        FILE *in, *out;
+        if ((in = fopen(src.c_str(), "rb")) == NULL)
+        {
+            return -1;
+        }
+        if ((out = fopen(dest.c_str(), "wb")) == NULL)
+        {
+            fclose(in);
+            return -1;
+        }
+        int ret = 0;
+        char buf[65536];
+        while (0 != limit)
+        {
+            size_t len = sizeof(buf);
+            if (limit > 0 && (int64) len > limit)
+            {
+                len = limit;
+            }
+            len = fread(buf, 1, len, in);
+            if (0 == len)
+            {
+                ret = ferror(in) ? -1 : 0;
+                break;
+            }
+            if (fwrite(buf, 1, len, out) != len)
+            {
+                ret = -1;
+                break;
+            }
+            if (limit > 0)
+            {
+                limit -= len;
+            }
+        }
+        fclose(in);
+        if (0 != fclose(out))
+        {
+            ret = -1;
+        }
+        return ret;
+    }
+
+    int file_link_or_copy(const std::string& src, const std::string& dest)
+    {
+        if (0 == link(src.c_str(), dest.c_str()))
+        {
+            return 0;
+        }
+        if (errno != EXDEV && errno != EPERM)
+        {
+            return -1;
+        }
+        return file_copy(src, dest);
+    }
+
     int file_read_full(const std::string& path, Buffer& content)
     {
         FILE *fp;
@@ -220,7 +278,7 @@ namespace ardb
                         std::string file_path = path;
                         file_path.append("/").append(ptr->d_name);
                         memset(&buf, 0, sizeof(buf));
-                        ret = stat(path.c_str(), &buf);
+                        ret = stat(file_path.c_str(), &buf);
                         if (ret == 0)
                         {
                             if (S_ISDIR(buf.st_mode))
@@ -258,7 +316,7 @@ namespace ardb
                         std::string file_path = path;
                         file_path.append("/").append(ptr->d_name);
                         memset(&buf, 0, sizeof(buf));
-                        ret = stat(path.c_str(), &buf);
+                        ret = stat(file_path.c_str(), &buf);
                         if (ret == 0)
                         {
                             if (S_ISREG(buf.st_mode))
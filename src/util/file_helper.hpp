@@ -47,6 +47,14 @@ namespace ardb
 
     int file_read_full(const std::string& path, Buffer& content);
     int file_write_content(const std::string& path, const std::string& content);
+    /*
+     * Copy at most limit bytes of src into dest, a negative limit copies the whole file.
+     */
+    int file_copy(const std::string& src, const std::string& dest, int64 limit = -1);
+    /*
+     * Hard link src as dest, or copy it when they are not on the same file system.
+     */
+    int file_link_or_copy(const std::string& src, const std::string& dest);
 
     int list_subdirs(const std::string& path, std::deque<std::string>& dirs);
     int list_subfiles(const std::string& path, std::deque<std::string>& fs);
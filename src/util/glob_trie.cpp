@@ -0,0 +1,385 @@
+/*
+ *Copyright (c) 2013-2013, yinqiwen <yinqiwen@gmail.com>
+ *All rights reserved.
+ * 
+ *Redistribution and use in source and binary forms, with or without
+ *modification, are permitted provided that the following conditions are met:
+ * 
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Redis nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ * 
+ *THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS 
+ *BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ *THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util/glob_trie.hpp"
+#include "util/thread/lock_guard.hpp"
+#include <fnmatch.h>
+#include <string.h>
+
+namespace ardb
+{
+    GlobPattern::GlobPattern(const std::string& pattern) :
+            m_pattern(pattern), m_fallback(false)
+    {
+        size_t i = 0;
+        while (i < pattern.size() && !m_fallback)
+        {
+            uint8 c = pattern[i];
+            switch (c)
+            {
+                case '*':
+                {
+                    if (m_tokens.empty() || m_tokens.back().type != TOKEN_STAR)
+                    {
+                        m_tokens.push_back(Token(TOKEN_STAR));
+                    }
+                    i++;
+                    break;
+                }
+                case '?':
+                {
+                    m_tokens.push_back(Token(TOKEN_ANY));
+                    i++;
+                    break;
+                }
+                case '[':
+                {
+                    int next = ParseClass(i);
+                    if (next < 0)
+                    {
+                        //an unterminated bracket matches itself
+                        m_tokens.push_back(Token(TOKEN_CHAR, c));
+                        i++;
+                    }
+                    else
+                    {
+                        i = next;
+                    }
+                    break;
+                }
+                case '\\':
+                {
+                    if (i + 1 < pattern.size())
+                    {
+                        i++;
+                        c = pattern[i];
+                    }
+                    m_tokens.push_back(Token(TOKEN_CHAR, c));
+                    i++;
+                    break;
+                }
+                default:
+                {
+                    m_tokens.push_back(Token(TOKEN_CHAR, c));
+                    i++;
+                    break;
+                }
+            }
+        }
+        for (size_t k = 0; k < m_tokens.size() && m_tokens[k].type == TOKEN_CHAR; k++)
+        {
+            m_prefix.push_back((char) m_tokens[k].ch);
+        }
+    }
+
+    /*
+     * Compiles the bracket expression at 'pos', returns the position after it or -1 if it is not terminated
+     */
+    int GlobPattern::ParseClass(size_t pos)
+    {
+        const std::string& p = m_pattern;
+        CharClass cls;
+        memset(cls.bits, 0, sizeof(cls.bits));
+        size_t i = pos + 1;
+        bool negate = false;
+        if (i < p.size() && (p[i] == '!' || p[i] == '^'))
+        {
+            negate = true;
+            i++;
+        }
+        bool first = true;
+        while (i < p.size())
+        {
+            uint8 lo = p[i];
+            if (lo == ']' && !first)
+            {
+                if (negate)
+                {
+                    for (size_t k = 0; k < sizeof(cls.bits); k++)
+                    {
+                        cls.bits[k] = ~cls.bits[k];
+                    }
+                }
+                m_classes.push_back(cls);
+                m_tokens.push_back(Token(TOKEN_CLASS, 0, m_classes.size() - 1));
+                return i + 1;
+            }
+            first = false;
+            if (lo == '[' && i + 1 < p.size() && (p[i + 1] == ':' || p[i + 1] == '=' || p[i + 1] == '.'))
+            {
+                m_fallback = true;
+                return p.size();
+            }
+            if (lo == '\\' && i + 1 < p.size())
+            {
+                i++;
+                lo = p[i];
+            }
+            i++;
+            uint8 hi = lo;
+            if (i + 1 < p.size() && p[i] == '-' && p[i + 1] != ']')
+            {
+                i++;
+                if (p[i] == '\\' && i + 1 < p.size())
+                {
+                    i++;
+                }
+                hi = p[i];
+                i++;
+            }
+            for (uint32 c = lo; c <= hi; c++)
+            {
+                cls.bits[c >> 3] |= (1 << (c & 7));
+            }
+        }
+        return -1;
+    }
+
+    bool GlobPattern::MatchToken(const Token& token, uint8 c) const
+    {
+        switch (token.type)
+        {
+            case TOKEN_CHAR:
+            {
+                return token.ch == c;
+            }
+            case TOKEN_ANY:
+            {
+                return true;
+            }
+            case TOKEN_CLASS:
+            {
+                return m_classes[token.cls].Contains(c);
+            }
+            default:
+            {
+                return false;
+            }
+        }
+    }
+
+    bool GlobPattern::Match(const std::string& str) const
+    {
+        if (str.size() < m_prefix.size() || str.compare(0, m_prefix.size(), m_prefix) != 0)
+        {
+            return false;
+        }
+        return MatchSuffix(str, m_prefix.size());
+    }
+
+    bool GlobPattern::MatchSuffix(const std::string& str, size_t offset) const
+    {
+        if (m_fallback)
+        {
+            return fnmatch(m_pattern.c_str(), str.c_str(), 0) == 0;
+        }
+        /*
+         * A star could always stretch further, so only the last star needs to be backtracked
+         */
+        size_t t = m_prefix.size();
+        size_t s = offset;
+        size_t star_token = m_tokens.size(), star_pos = 0;
+        while (s < str.size())
+        {
+            if (t < m_tokens.size() && m_tokens[t].type == TOKEN_STAR)
+            {
+                star_token = t++;
+                star_pos = s;
+                continue;
+            }
+            if (t < m_tokens.size() && MatchToken(m_tokens[t], str[s]))
+            {
+                t++;
+                s++;
+                continue;
+            }
+            if (star_token < m_tokens.size())
+            {
+                t = star_token + 1;
+                s = ++star_pos;
+                continue;
+            }
+            return false;
+        }
+        while (t < m_tokens.size() && m_tokens[t].type == TOKEN_STAR)
+        {
+            t++;
+        }
+        return t == m_tokens.size();
+    }
+
+    GlobTrie::GlobTrie(uint32 cache_limit, uint32 cache_max_key_size) :
+            m_cache_limit(cache_limit), m_cache_max_key_size(cache_max_key_size)
+    {
+    }
+
+    void GlobTrie::ClearCache()
+    {
+        LockGuard<SpinMutexLock> guard(m_cache_lock);
+        m_cache.Clear();
+    }
+
+    bool GlobTrie::Add(const std::string& pattern)
+    {
+        if (m_patterns.find(pattern) != m_patterns.end())
+        {
+            return false;
+        }
+        GlobPattern* p = NULL;
+        NEW(p, GlobPattern(pattern));
+        Node* node = &m_root;
+        const std::string& prefix = p->Prefix();
+        for (size_t i = 0; i < prefix.size(); i++)
+        {
+            Node*& child = node->children[(uint8) prefix[i]];
+            if (NULL == child)
+            {
+                NEW(child, Node);
+            }
+            node = child;
+        }
+        node->patterns.push_back(p);
+        m_patterns[pattern] = p;
+        ClearCache();
+        return true;
+    }
+
+    /*
+     * Returns true if the node becomes empty and could be released
+     */
+    bool GlobTrie::RemoveFromNode(Node* node, const GlobPattern* pattern, size_t depth)
+    {
+        const std::string& prefix = pattern->Prefix();
+        if (depth == prefix.size())
+        {
+            std::vector<GlobPattern*>::iterator it = std::find(node->patterns.begin(), node->patterns.end(), pattern);
+            if (it != node->patterns.end())
+            {
+                node->patterns.erase(it);
+            }
+        }
+        else
+        {
+            Node::ChildTable::iterator found = node->children.find((uint8) prefix[depth]);
+            if (found != node->children.end() && RemoveFromNode(found->second, pattern, depth + 1))
+            {
+                DELETE(found->second);
+                node->children.erase(found);
+            }
+        }
+        return node->patterns.empty() && node->children.empty();
+    }
+
+    bool GlobTrie::Remove(const std::string& pattern)
+    {
+        PatternTable::iterator found = m_patterns.find(pattern);
+        if (found == m_patterns.end())
+        {
+            return false;
+        }
+        GlobPattern* p = found->second;
+        RemoveFromNode(&m_root, p, 0);
+        m_patterns.erase(found);
+        DELETE(p);
+        ClearCache();
+        return true;
+    }
+
+    void GlobTrie::Match(const std::string& str, std::vector<std::string>& patterns)
+    {
+        bool cacheable = m_cache_limit > 0 && str.size() <= m_cache_max_key_size;
+        MatchResult result;
+        if (cacheable)
+        {
+            LockGuard<SpinMutexLock> guard(m_cache_lock);
+            if (m_cache.Get(str, result))
+            {
+                patterns.insert(patterns.end(), result.begin(), result.end());
+                return;
+            }
+        }
+        const Node* node = &m_root;
+        size_t depth = 0;
+        while (true)
+        {
+            for (size_t i = 0; i < node->patterns.size(); i++)
+            {
+                if (node->patterns[i]->MatchSuffix(str, depth))
+                {
+                    result.push_back(node->patterns[i]->Pattern());
+                }
+            }
+            if (depth >= str.size())
+            {
+                break;
+            }
+            Node::ChildTable::const_iterator found = node->children.find((uint8) str[depth]);
+            if (found == node->children.end())
+            {
+                break;
+            }
+            node = found->second;
+            depth++;
+        }
+        if (cacheable)
+        {
+            LockGuard<SpinMutexLock> guard(m_cache_lock);
+            if (m_cache.Size() >= m_cache_limit)
+            {
+                MatchCache::CacheEntry victim;
+                m_cache.PopVictim(victim);
+            }
+            m_cache.Insert(str, result);
+        }
+        patterns.insert(patterns.end(), result.begin(), result.end());
+    }
+
+    void GlobTrie::DestroyNode(Node* node)
+    {
+        Node::ChildTable::iterator it = node->children.begin();
+        while (it != node->children.end())
+        {
+            DestroyNode(it->second);
+            DELETE(it->second);
+            it++;
+        }
+        node->children.clear();
+    }
+
+    GlobTrie::~GlobTrie()
+    {
+        DestroyNode(&m_root);
+        PatternTable::iterator it = m_patterns.begin();
+        while (it != m_patterns.end())
+        {
+            DELETE(it->second);
+            it++;
+        }
+    }
+}
@@ -0,0 +1,157 @@
+/*
+ *Copyright (c) 2013-2013, yinqiwen <yinqiwen@gmail.com>
+ *All rights reserved.
+ * 
+ *Redistribution and use in source and binary forms, with or without
+ *modification, are permitted provided that the following conditions are met:
+ * 
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Redis nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ * 
+ *THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS 
+ *BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ *THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GLOB_TRIE_HPP_
+#define GLOB_TRIE_HPP_
+#include "common.hpp"
+#include "util/clock_cache.hpp"
+#include "util/thread/spin_mutex_lock.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+namespace ardb
+{
+    struct StringHash
+    {
+            uint32 operator()(const std::string& str) const
+            {
+                //FNV-1a
+                uint32 hash = 2166136261U;
+                for (size_t i = 0; i < str.size(); i++)
+                {
+                    hash = (hash ^ (uint8) str[i]) * 16777619U;
+                }
+                return hash;
+            }
+    };
+
+    /*
+     * A glob pattern compiled once, matches with the semantics of fnmatch(pattern, str, 0).
+     * The literal prefix before the first special char is kept apart, so a caller which has
+     * compared the prefix already could match the rest only.
+     */
+    class GlobPattern
+    {
+        private:
+            enum TokenType
+            {
+                TOKEN_CHAR = 0, TOKEN_ANY = 1, TOKEN_STAR = 2, TOKEN_CLASS = 3
+            };
+            struct Token
+            {
+                    uint8 type;
+                    uint8 ch;
+                    uint16 cls;
+                    Token(uint8 t = TOKEN_CHAR, uint8 c = 0, uint16 k = 0) :
+                            type(t), ch(c), cls(k)
+                    {
+                    }
+            };
+            struct CharClass
+            {
+                    uint8 bits[32];
+                    bool Contains(uint8 c) const
+                    {
+                        return (bits[c >> 3] & (1 << (c & 7))) != 0;
+                    }
+            };
+            std::string m_pattern;
+            std::string m_prefix;
+            std::vector<Token> m_tokens;
+            std::vector<CharClass> m_classes;
+            //patterns with char classes like [:alpha:] are left to fnmatch
+            bool m_fallback;
+            int ParseClass(size_t pos);
+            bool MatchToken(const Token& token, uint8 c) const;
+        public:
+            GlobPattern(const std::string& pattern);
+            const std::string& Pattern() const
+            {
+                return m_pattern;
+            }
+            const std::string& Prefix() const
+            {
+                return m_prefix;
+            }
+            bool Match(const std::string& str) const;
+            /*
+             * Matches str[offset..] against the pattern after its literal prefix
+             */
+            bool MatchSuffix(const std::string& str, size_t offset) const;
+    };
+
+    /*
+     * Glob patterns indexed by their literal prefix, a lookup walks the trie along the matched string
+     * and only tries the patterns whose prefix matched already. Lookup results are cached per string
+     * in a CLOCK evicted table, which is dropped whenever a pattern is added or removed.
+     * Add/Remove must not run concurrently with anything else, lookups could run concurrently.
+     */
+    class GlobTrie
+    {
+        private:
+            struct Node
+            {
+                    typedef std::map<uint8, Node*> ChildTable;
+                    ChildTable children;
+                    std::vector<GlobPattern*> patterns;
+            };
+            typedef std::vector<std::string> MatchResult;
+            typedef ClockCache<std::string, MatchResult, StringHash> MatchCache;
+            typedef std::map<std::string, GlobPattern*> PatternTable;
+            Node m_root;
+            PatternTable m_patterns;
+            MatchCache m_cache;
+            SpinMutexLock m_cache_lock;
+            uint32 m_cache_limit;
+            uint32 m_cache_max_key_size;
+            void DestroyNode(Node* node);
+            bool RemoveFromNode(Node* node, const GlobPattern* pattern, size_t depth);
+            void ClearCache();
+        public:
+            GlobTrie(uint32 cache_limit = 4096, uint32 cache_max_key_size = 256);
+            /*
+             * Returns false if the pattern exists already
+             */
+            bool Add(const std::string& pattern);
+            bool Remove(const std::string& pattern);
+            size_t Size() const
+            {
+                return m_patterns.size();
+            }
+            /*
+             * Appends all patterns matching str to 'patterns'
+             */
+            void Match(const std::string& str, std::vector<std::string>& patterns);
+            ~GlobTrie();
+    };
+}
+
+#endif /* GLOB_TRIE_HPP_ */
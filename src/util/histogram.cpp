@@ -0,0 +1,110 @@
+ /*
+ *Copyright (c) 2013-2014, yinqiwen <yinqiwen@gmail.com>
+ *All rights reserved.
+ * 
+ *Redistribution and use in source and binary forms, with or without
+ *modification, are permitted provided that the following conditions are met:
+ * 
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Redis nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ * 
+ *THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS 
+ *BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ *THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "util/histogram.hpp"
+#include "util/atomic.hpp"
+#include <string.h>
+#include <stdio.h>
+
+namespace ardb
+{
+    Histogram::Histogram() :
+            m_count(0), m_sum(0), m_max(0)
+    {
+        memset((void*) m_buckets, 0, sizeof(m_buckets));
+    }
+
+    void Histogram::Add(uint64 v)
+    {
+        uint32 idx = 0;
+        uint64 tmp = v;
+        while (tmp > 0 && idx < kBucketNum - 1)
+        {
+            tmp >>= 1;
+            idx++;
+        }
+        atomic_add_uint64(&(m_buckets[idx]), 1);
+        atomic_add_uint64(&m_count, 1);
+        atomic_add_uint64(&m_sum, v);
+        uint64 max = m_max;
+        while (v > max && !atomic_cmp_set_uint64(&m_max, max, v))
+        {
+            max = m_max;
+        }
+    }
+
+    void Histogram::Clear()
+    {
+        memset((void*) m_buckets, 0, sizeof(m_buckets));
+        m_count = 0;
+        m_sum = 0;
+        m_max = 0;
+    }
+
+    double Histogram::Average() const
+    {
+        uint64 count = m_count;
+        return count == 0 ? 0 : (double) m_sum / count;
+    }
+
+    uint64 Histogram::Percentile(double p) const
+    {
+        uint64 count = 0;
+        for (uint32 i = 0; i < kBucketNum; i++)
+        {
+            count += m_buckets[i];
+        }
+        if (0 == count)
+        {
+            return 0;
+        }
+        uint64 threshold = (uint64) (count * p / 100);
+        uint64 sum = 0;
+        for (uint32 i = 0; i < kBucketNum; i++)
+        {
+            sum += m_buckets[i];
+            if (sum > threshold)
+            {
+                uint64 upper = i == 0 ? 0 : ((1ULL << i) - 1);
+                return upper < m_max ? upper : m_max;
+            }
+        }
+        return m_max;
+    }
+
+    std::string Histogram::ToString() const
+    {
+        char buf[256];
+        snprintf(buf, sizeof(buf), "count=%llu,avg=%.2f,p50=%llu,p90=%llu,p99=%llu,p999=%llu,max=%llu",
+                (unsigned long long) Count(), Average(), (unsigned long long) Percentile(50),
+                (unsigned long long) Percentile(90), (unsigned long long) Percentile(99),
+                (unsigned long long) Percentile(99.9), (unsigned long long) Max());
+        return buf;
+    }
+}
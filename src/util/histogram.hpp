@@ -0,0 +1,69 @@
+ /*
+ *Copyright (c) 2013-2014, yinqiwen <yinqiwen@gmail.com>
+ *All rights reserved.
+ * 
+ *Redistribution and use in source and binary forms, with or without
+ *modification, are permitted provided that the following conditions are met:
+ * 
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Redis nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ * 
+ *THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS 
+ *BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ *THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HISTOGRAM_HPP_
+#define HISTOGRAM_HPP_
+#include "common.hpp"
+#include <string>
+
+namespace ardb
+{
+    /*
+     * Log2 bucketed histogram updated by atomic ops only, bucket i counts values in [2^(i-1), 2^i).
+     * Percentiles are reported as the upper bound of the bucket they fall in.
+     */
+    class Histogram
+    {
+        private:
+            static const uint32 kBucketNum = 40;
+            volatile uint64_t m_buckets[kBucketNum];
+            volatile uint64_t m_count;
+            volatile uint64_t m_sum;
+            volatile uint64_t m_max;
+        public:
+            Histogram();
+            void Add(uint64 v);
+            void Clear();
+            uint64 Count() const
+            {
+                return m_count;
+            }
+            uint64 Max() const
+            {
+                return m_max;
+            }
+            double Average() const;
+            uint64 Percentile(double p) const;
+            /*
+             * count=..,avg=..,p50=..,p90=..,p99=..,p999=..,max=..
+             */
+            std::string ToString() const;
+    };
+}
+#endif /* HISTOGRAM_HPP_ */
@@ -281,12 +281,14 @@ namespace ardb
 
     bool str_touint64(const char* str, uint64& value)
     {
-        int64 temp;
-        if (!str_toint64(str, temp))
+        RETURN_FALSE_IF_NULL(str);
+        char *endptr = NULL;
+        unsigned long long int val = strtoull(str, &endptr, 10);
+        if (NULL == endptr || 0 != *endptr)
         {
             return false;
         }
-        value = (uint64) temp;
+        value = val;
         return true;
     }
 
@@ -0,0 +1,96 @@
+/*
+ *Copyright (c) 2013-2014, yinqiwen <yinqiwen@gmail.com>
+ *All rights reserved.
+ *
+ *Redistribution and use in source and binary forms, with or without
+ *modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Redis nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ *BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ *THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STRIPED_RWLOCK_HPP_
+#define STRIPED_RWLOCK_HPP_
+#include "common.hpp"
+#include "spin_rwlock.hpp"
+#include "thread_local.hpp"
+#include "util/atomic.hpp"
+namespace ardb
+{
+    /*
+     * A read-write lock striped by thread: a reader locks the stripe of its thread only, so readers of
+     * different threads never write the same cache line, a writer locks every stripe in order.
+     * Like SpinRWLock a thread must not take the read lock twice, threads beyond the stripe count share stripes.
+     */
+    class StripedRWLock
+    {
+        private:
+            static const uint32 kStripes = 64;
+            struct Stripe
+            {
+                    SpinRWLock lock;
+                    char padding[64 - sizeof(SpinRWLock)];
+            };
+            Stripe m_stripes[kStripes];
+            volatile uint32_t m_thread_count;
+            ThreadLocal<uint32> m_thread_stripe;
+            static uint32* NewThreadStripe(void* data)
+            {
+                StripedRWLock* lock = (StripedRWLock*) data;
+                return new uint32((atomic_add_uint32(&lock->m_thread_count, 1) - 1) % kStripes);
+            }
+            SpinRWLock& ThreadStripe()
+            {
+                return m_stripes[m_thread_stripe.GetValue(NewThreadStripe, this)].lock;
+            }
+        public:
+            StripedRWLock() :
+                    m_thread_count(0)
+            {
+            }
+            bool Lock(LockMode mode)
+            {
+                if (READ_LOCK == mode)
+                {
+                    return ThreadStripe().Lock(READ_LOCK);
+                }
+                for (uint32 i = 0; i < kStripes; i++)
+                {
+                    m_stripes[i].lock.Lock(WRITE_LOCK);
+                }
+                return true;
+            }
+            bool Unlock(LockMode mode)
+            {
+                if (READ_LOCK == mode)
+                {
+                    return ThreadStripe().Unlock(READ_LOCK);
+                }
+                for (uint32 i = 0; i < kStripes; i++)
+                {
+                    m_stripes[i].lock.Unlock(WRITE_LOCK);
+                }
+                return true;
+            }
+    };
+}
+
+#endif /* STRIPED_RWLOCK_HPP_ */
@@ -0,0 +1,212 @@
+/*
+ *Copyright (c) 2013-2013, yinqiwen <yinqiwen@gmail.com>
+ *All rights reserved.
+ * 
+ *Redistribution and use in source and binary forms, with or without
+ *modification, are permitted provided that the following conditions are met:
+ * 
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Redis nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ * 
+ *THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS 
+ *BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ *THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TIMING_WHEEL_HPP_
+#define TIMING_WHEEL_HPP_
+#include "common.hpp"
+#include <deque>
+#include <utility>
+
+namespace ardb
+{
+    /*
+     * A hierarchical timing wheel of 4 levels with 64 slots each, times are in ticks of any unit.
+     * An entry goes to the lowest level whose range covers its distance from the current tick, each
+     * time a level wraps the next slot of the level above is cascaded down. Entries farther than the
+     * top level covers wait in its last slot and are cascaded again until they fit.
+     * Entries whose tick has passed are moved to a ready queue, Advance is O(min(ticks passed, entries
+     * pending) + entries moved): when more ticks passed than entries are pending they are placed again
+     * from the new tick instead of ticking through the gap.
+     * It's not thread safe.
+     */
+    template<typename T>
+    class TimingWheel
+    {
+        public:
+            typedef std::pair<uint64, T> Entry;
+            typedef std::deque<Entry> EntryQueue;
+        private:
+            static const uint32 kLevels = 4;
+            static const uint32 kSlotBits = 6;
+            static const uint64 kSlots = 1 << kSlotBits;
+            static const uint64 kSlotMask = kSlots - 1;
+            EntryQueue m_slots[kLevels][kSlots];
+            EntryQueue m_ready;
+            uint64 m_current;
+            size_t m_size;
+
+            void Place(const Entry& entry)
+            {
+                if (entry.first <= m_current)
+                {
+                    m_ready.push_back(entry);
+                    return;
+                }
+                uint64 distance = entry.first - m_current;
+                uint64 due = entry.first;
+                uint32 level = 0;
+                while (level < kLevels - 1 && distance >= (1ULL << (kSlotBits * (level + 1))))
+                {
+                    level++;
+                }
+                if (distance >= (1ULL << (kSlotBits * kLevels)))
+                {
+                    due = m_current + (1ULL << (kSlotBits * kLevels)) - 1;
+                }
+                m_slots[level][(due >> (kSlotBits * level)) & kSlotMask].push_back(entry);
+            }
+            void Cascade(uint32 level, uint64 index)
+            {
+                EntryQueue entries;
+                entries.swap(m_slots[level][index]);
+                typename EntryQueue::iterator it = entries.begin();
+                while (it != entries.end())
+                {
+                    Place(*it);
+                    it++;
+                }
+            }
+            void Tick()
+            {
+                m_current++;
+                uint32 level = 1;
+                while (level < kLevels && 0 == (m_current & ((1ULL << (kSlotBits * level)) - 1)))
+                {
+                    level++;
+                }
+                //cascade from the top so that entries moved down are cascaded again by the lower levels
+                while (--level > 0)
+                {
+                    Cascade(level, (m_current >> (kSlotBits * level)) & kSlotMask);
+                }
+                EntryQueue& slot = m_slots[0][m_current & kSlotMask];
+                while (!slot.empty())
+                {
+                    m_ready.push_back(slot.front());
+                    slot.pop_front();
+                }
+            }
+            void Rebase(uint64 now)
+            {
+                EntryQueue entries;
+                for (uint32 i = 0; i < kLevels; i++)
+                {
+                    for (uint32 j = 0; j < kSlots; j++)
+                    {
+                        EntryQueue& slot = m_slots[i][j];
+                        entries.insert(entries.end(), slot.begin(), slot.end());
+                        slot.clear();
+                    }
+                }
+                m_current = now;
+                typename EntryQueue::iterator it = entries.begin();
+                while (it != entries.end())
+                {
+                    Place(*it);
+                    it++;
+                }
+            }
+        public:
+            TimingWheel(uint64 now = 0) :
+                    m_current(now), m_size(0)
+            {
+            }
+            void Add(uint64 tick, const T& value)
+            {
+                Place(Entry(tick, value));
+                m_size++;
+            }
+            /*
+             * Moves the entries of the ticks up to 'now' to the ready queue
+             */
+            void Advance(uint64 now)
+            {
+                if (m_size == m_ready.size())
+                {
+                    //nothing pending, jump
+                    m_current = now > m_current ? now : m_current;
+                    return;
+                }
+                if (now > m_current && now - m_current > m_size - m_ready.size() + kLevels * kSlots)
+                {
+                    Rebase(now);
+                    return;
+                }
+                while (m_current < now)
+                {
+                    Tick();
+                }
+            }
+            bool PopReady(Entry& entry)
+            {
+                if (m_ready.empty())
+                {
+                    return false;
+                }
+                entry = m_ready.front();
+                m_ready.pop_front();
+                m_size--;
+                return true;
+            }
+            const Entry* PeekReady() const
+            {
+                return m_ready.empty() ? NULL : &(m_ready.front());
+            }
+            size_t ReadySize() const
+            {
+                return m_ready.size();
+            }
+            size_t Size() const
+            {
+                return m_size;
+            }
+            uint64 Current() const
+            {
+                return m_current;
+            }
+            /*
+             * Drops all entries and restarts from tick 'now'
+             */
+            void Clear(uint64 now)
+            {
+                for (uint32 i = 0; i < kLevels; i++)
+                {
+                    for (uint32 j = 0; j < kSlots; j++)
+                    {
+                        m_slots[i][j].clear();
+                    }
+                }
+                m_ready.clear();
+                m_current = now;
+                m_size = 0;
+            }
+    };
+}
+
+#endif /* TIMING_WHEEL_HPP_ */
@@ -1868,20 +1868,13 @@ namespace ardb
     {
         if (check_cache)
         {
-            ZSetCache* cache = (ZSetCache*) GetLoadedCache(db, key, ZSET_META, false, false);
+            ZSetCache* cache = (ZSetCache*) GetReadCache(db, key, ZSET_META);
             if (NULL != cache)
             {
                 cache->GetRange(range, options.withscores, options.withattr, cb, cbdata);
                 m_level1_cahce->Recycle(cache);
                 return 0;
             }
-            else
-            {
-                if (m_config.zset_read_load_cache && NULL != m_level1_cahce)
-                {
-                    m_level1_cahce->Load(db, key);
-                }
-            }
         }
         int err = 0;
         bool createZset = false;
@@ -61,6 +61,7 @@ int main(int argc, char** argv)
 	config.set_max_ziplist_entries = 16;
 	config.list_max_ziplist_entries = 16;
 	config.L1_cache_memory_limit = 1024*1024*1024;
+	config.meta_cache_memory_limit = 64*1024*1024;
 	db.Init(config);
 	test_all(db);
 	return 0;
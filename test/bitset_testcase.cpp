@@ -5,6 +5,7 @@
  *      Author: yinqiwen
  */
 #include "db.hpp"
+#include "util/bitops.hpp"
 #include <string>
 
 using namespace ardb;
@@ -61,6 +62,97 @@ void test_bitop(Ardb& db)
 	CHECK_FATAL( ret != 5000, "bitopcount or keys failed:%d", ret);
 	ret = db.BitOPCount(dbid, "xor", keys);
 	CHECK_FATAL( ret != 4000, "bitopcount xor keys failed:%d", ret);
+	/*
+	 * the stored chunks of the result begin with zero bytes
+	 */
+	ret = db.BitOP(dbid, "and", "mybits_and", keys);
+	CHECK_FATAL(ret != 1000 || db.BitCount(dbid, "mybits_and", 0, -1) != 1000, "bitop and keys failed:%d", ret);
+	CHECK_FATAL(db.GetBit(dbid, "mybits_and", 4500) != 1 || db.GetBit(dbid, "mybits_and", 3999) != 0,
+			"bitop and keys getbit failed");
+}
+
+void test_bitset_chunk_encoding(Ardb& db)
+{
+	/*
+	 * sparse bits, one long run and a random looking dense bitmap
+	 */
+	for (uint32 i = 0; i < 3; i++)
+	{
+		BitSetElementValue v;
+		v.vals.assign(BitSetElementValue::kBytes, 0);
+		for (uint32 k = 0; k < BitSetElementValue::kBits; k++)
+		{
+			bool bit = i == 0 ? (k % 700 == 3) : (i == 1 ? (k >= 1000 && k < 3000) : ((k * 7919) % 3 == 0));
+			if (bit)
+			{
+				v.vals[k >> 3] |= (0x80 >> (k & 7));
+			}
+		}
+		v.bitcount = bits_popcount(v.vals.data(), v.vals.size());
+		Buffer buf;
+		v.Encode(buf);
+		CHECK_FATAL(i < 2 && buf.ReadableBytes() > 64, "bitset chunk not compressed:%zu", buf.ReadableBytes());
+		BitSetElementValue d;
+		CHECK_FATAL(!d.Decode(buf) || d.vals != v.vals || d.bitcount != v.bitcount, "bitset chunk decode failed:%u", i);
+	}
+
+	/*
+	 * a raw chunk beginning with the tag value of a compact encoding, and a chunk written without the tag
+	 */
+	BitSetElementValue raw;
+	raw.vals.assign(BitSetElementValue::kBytes, 0);
+	for (uint32 k = 1; k < BitSetElementValue::kBytes; k++)
+	{
+		raw.vals[k] = (char) (k * 37 + 1);
+	}
+	raw.vals[1] = ARDB_BITSET_CHUNK_RUNS;
+	Buffer rawbuf;
+	raw.Encode(rawbuf);
+	BitSetElementValue rawd;
+	CHECK_FATAL(!rawd.Decode(rawbuf) || rawd.vals != raw.vals, "raw bitset chunk decode failed");
+	Buffer legacy;
+	encode_arg(legacy, raw.bitcount, raw.start, raw.limit, raw.vals);
+	BitSetElementValue legacyd;
+	CHECK_FATAL(!legacyd.Decode(legacy) || legacyd.vals != raw.vals, "untagged bitset chunk decode failed");
+
+	char a[77], b[77];
+	for (uint32 i = 0; i < sizeof(a); i++)
+	{
+		a[i] = (char) (i * 37);
+		b[i] = (char) (i * 11 + 5);
+	}
+	uint64 expected = 0;
+	for (uint32 i = 0; i < sizeof(a); i++)
+	{
+		expected += __builtin_popcount((uint8) (a[i] & b[i]));
+	}
+	bits_and(a, b, sizeof(a));
+	CHECK_FATAL(bits_popcount(a, sizeof(a)) != expected, "bits kernels(%s) failed:%" PRIu64, bits_kernel_name(),
+			bits_popcount(a, sizeof(a)));
+}
+
+void test_bitop_many_keys(Ardb& db)
+{
+	DBID dbid = 0;
+	SliceArray keys;
+	char names[100][16];
+	for (uint32 i = 0; i < 100; i++)
+	{
+		sprintf(names[i], "manybits%u", i);
+		db.Del(dbid, names[i]);
+		db.SetBit(dbid, names[i], 1, 1);
+		db.SetBit(dbid, names[i], i * 1000 + 7, 1);
+		keys.push_back(names[i]);
+	}
+	int ret = db.BitOPCount(dbid, "or", keys);
+	CHECK_FATAL(ret != 101, "bitopcount or 100 keys failed:%d", ret);
+	ret = db.BitOPCount(dbid, "xor", keys);
+	CHECK_FATAL(ret != 100, "bitopcount xor 100 keys failed:%d", ret);
+	ret = db.BitOPCount(dbid, "and", keys);
+	CHECK_FATAL(ret != 1, "bitopcount and 100 keys failed:%d", ret);
+	ret = db.BitOP(dbid, "or", "manybits_dst", keys);
+	CHECK_FATAL(ret != 101 || db.BitCount(dbid, "manybits_dst", 0, -1) != 101, "bitop or 100 keys failed:%d", ret);
+	CHECK_FATAL(db.GetBit(dbid, "manybits_dst", 99007) != 1, "bitop or 100 keys getbit failed");
 }
 
 void test_bitsets(Ardb& db)
@@ -68,5 +160,7 @@ void test_bitsets(Ardb& db)
 	test_bitcount(db);
 	test_setgetbit(db);
 	test_bitop(db);
+	test_bitset_chunk_encoding(db);
+	test_bitop_many_keys(db);
 }
 
@@ -39,6 +39,37 @@ void test_hash_nonzip_hgetset(Ardb& db)
     CHECK_FATAL(ret, "HExists myhash failed:%d", ret);
 }
 
+void test_hash_hmget(Ardb& db)
+{
+    DBID dbid = 0;
+    db.Del(dbid, "myhash");
+    db.HSet(dbid, "myhash", "field1", "value1");
+    SliceArray fields;
+    fields.push_back("field1");
+    fields.push_back("field2");
+    ValueDataArray vals;
+    db.HMGet(dbid, "myhash", fields, vals);
+    std::string str;
+    CHECK_FATAL(vals[0].ToString(str) != "value1", "HMGet failed:%s", str.c_str());
+    CHECK_FATAL(vals[1].type != EMPTY_VALUE, "HMGet failed");
+
+    for (uint32 i = 0; i < (uint32) (db.GetConfig().hash_max_ziplist_entries + 10); i++)
+    {
+        char tmp[16];
+        sprintf(tmp, "field%u", i);
+        db.HSet(dbid, "myhash", tmp, tmp);
+    }
+    fields.clear();
+    fields.push_back("field7");
+    fields.push_back("nofield");
+    fields.push_back("field3");
+    vals.clear();
+    db.HMGet(dbid, "myhash", fields, vals);
+    CHECK_FATAL(vals[0].ToString(str) != "field7", "HMGet failed:%s", str.c_str());
+    CHECK_FATAL(vals[1].type != EMPTY_VALUE, "HMGet failed");
+    CHECK_FATAL(vals[2].ToString(str) != "field3", "HMGet failed:%s", str.c_str());
+}
+
 void test_hash_zip_hexists(Ardb& db)
 {
     DBID dbid = 0;
@@ -201,6 +232,31 @@ void test_hash_hincr(Ardb& db)
     CHECK_FATAL(dv != 300.25, "hincrbyfloat myhash failed:%f", dv);
 }
 
+void test_hash_merge_hincr(Ardb& db)
+{
+    DBID dbid = 0;
+    db.HClear(dbid, "myhash");
+    for (uint32 i = 0; i < (uint32) (db.GetConfig().hash_max_ziplist_entries + 10); i++)
+    {
+        char tmp[16];
+        sprintf(tmp, "field%u", i);
+        db.HSet(dbid, "myhash", tmp, "1");
+    }
+    db.HSet(dbid, "myhash", "strfield", "abc");
+    db.MergeHIncrby(dbid, "myhash", "field1", 10);
+    db.MergeHIncrby(dbid, "myhash", "field1", -3);
+    db.MergeHIncrby(dbid, "myhash", "newfield", 5);
+    db.MergeHIncrby(dbid, "myhash", "strfield", 5);
+    std::string v1, v2, v3;
+    db.HGet(dbid, "myhash", "field1", &v1);
+    db.HGet(dbid, "myhash", "newfield", &v2);
+    db.HGet(dbid, "myhash", "strfield", &v3);
+    CHECK_FATAL(v1 != "8" || v2 != "5" || v3 != "abc", "merge hincr myhash failed:%s %s %s", v1.c_str(), v2.c_str(),
+            v3.c_str());
+    int len = db.HLen(dbid, "myhash");
+    CHECK_FATAL(len != db.GetConfig().hash_max_ziplist_entries + 12, "hlen after merge hincr failed:%d", len);
+}
+
 void test_hash_expire(Ardb& db)
 {
     DBID dbid = 0;
@@ -213,20 +269,80 @@ void test_hash_expire(Ardb& db)
     CHECK_FATAL(db.Exists(dbid, "myhash") == true, "Expire myhash failed");
 }
 
+void test_hash_l1_cache(Ardb& db)
+{
+    DBID dbid = 0;
+    if (db.GetL1Cache() == NULL)
+    {
+        return;
+    }
+    db.HClear(dbid, "myhash");
+    db.HSet(dbid, "myhash", "field1", "value1");
+    db.HSet(dbid, "myhash", "field2", "value2");
+    CHECK_FATAL(db.GetL1Cache()->SyncLoad(dbid, "myhash") != 0, "Load myhash failed");
+    db.HSet(dbid, "myhash", "field3", "value3");
+    CHECK_FATAL(!db.GetL1Cache()->IsCached(dbid, "myhash"), "HSet myhash dropped cache");
+    std::string v;
+    db.HGet(dbid, "myhash", "field3", &v);
+    CHECK_FATAL(v != "value3", "HGet cached myhash failed:%s", v.c_str());
+    CHECK_FATAL(db.HLen(dbid, "myhash") != 3, "HLen cached myhash failed:%d", db.HLen(dbid, "myhash"));
+    SliceArray fields;
+    fields.push_back("field1");
+    db.HDel(dbid, "myhash", fields);
+    CHECK_FATAL(db.GetL1Cache()->IsCached(dbid, "myhash"), "HDel myhash did not invalidate cache");
+    CHECK_FATAL(db.HExists(dbid, "myhash", "field1"), "HExists myhash failed");
+    CHECK_FATAL(db.HLen(dbid, "myhash") != 2, "HLen myhash failed:%d", db.HLen(dbid, "myhash"));
+}
+
+void test_hash_zip_patch(Ardb& db)
+{
+    DBID dbid = 0;
+    db.HClear(dbid, "myhash");
+    const char* fields[] = { "f3", "100", "f1", "-5", "2.5", "f2", "f10" };
+    uint32 count = sizeof(fields) / sizeof(fields[0]);
+    for (uint32 i = 0; i < count; i++)
+    {
+        db.HSet(dbid, "myhash", fields[i], "v");
+    }
+    for (uint32 i = 0; i < count; i++)
+    {
+        std::string value = std::string(fields[i]) + (i % 2 == 0 ? "longer_value" : "");
+        db.HSet(dbid, "myhash", fields[i], value);
+    }
+    for (uint32 i = 0; i < count; i++)
+    {
+        std::string v;
+        std::string expected = std::string(fields[i]) + (i % 2 == 0 ? "longer_value" : "");
+        CHECK_FATAL(db.HGet(dbid, "myhash", fields[i], &v) != 0 || v != expected, "HGet patched myhash %s failed:%s",
+                fields[i], v.c_str());
+    }
+    CHECK_FATAL(db.HExists(dbid, "myhash", "f4"), "HExists patched myhash failed");
+    CHECK_FATAL(db.HExists(dbid, "myhash", "99"), "HExists patched myhash failed");
+    StringArray keys, values;
+    db.HGetAll(dbid, "myhash", keys, values);
+    CHECK_FATAL(keys.size() != count, "HGetAll patched myhash failed:%zu", keys.size());
+    CHECK_FATAL(keys[0] != "-5" || keys[2] != "2.5" || keys[3] != "f1", "HGetAll patched myhash order failed:%s",
+            keys[0].c_str());
+}
+
 void test_hashs(Ardb& db)
 {
     test_hash_zip_hgetset(db);
     test_hash_nonzip_hgetset(db);
+    test_hash_hmget(db);
     test_hash_zip_hexists(db);
     test_hash_zip_hkeys(db);
     test_hash_zip_hvals(db);
     test_hash_zip_hgetall(db);
+    test_hash_zip_patch(db);
     test_hash_hlen(db);
     test_hash_nonzip_hgetall(db);
     test_hash_nonzip_hkeys(db);
     test_hash_nonzip_hvals(db);
     test_hash_hsetnx(db);
     test_hash_hincr(db);
+    test_hash_merge_hincr(db);
     test_hash_expire(db);
+    test_hash_l1_cache(db);
 }
 
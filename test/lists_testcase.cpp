@@ -6,6 +6,8 @@
  */
 #include "db.hpp"
 #include <string>
+#include <deque>
+#include <algorithm>
 
 using namespace ardb;
 
@@ -194,6 +196,87 @@ void test_lists_zip_lrem(Ardb& db)
     CHECK_FATAL(db.LLen(dbid, "mylist") != 3, "lrem mylist failed:%d", db.LLen(dbid, "mylist"));
 }
 
+static bool list_equals(Ardb& db, const DBID& dbid, const char* key, const std::deque<std::string>& model)
+{
+    ValueDataArray array;
+    db.LRange(dbid, key, 0, -1, array);
+    if (array.size() != model.size() || db.LLen(dbid, key) != (int) model.size())
+    {
+        return false;
+    }
+    for (uint32 i = 0; i < model.size(); i++)
+    {
+        std::string v;
+        if (array[i].ToString(v) != model[i] || db.LIndex(dbid, key, i, v) != 0 || v != model[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void test_lists_segments(Ardb& db)
+{
+    DBID dbid = 0;
+    ArdbConfig cfg = db.GetConfig();
+    ArdbConfig seg_cfg = cfg;
+    seg_cfg.list_max_segment_entries = 8;
+    db.Init(seg_cfg);
+    db.LClear(dbid, "seglist");
+    std::deque<std::string> model;
+    char value[32];
+    for (uint32 i = 0; i < 50; i++)
+    {
+        sprintf(value, "r%u", i);
+        db.RPush(dbid, "seglist", value);
+        model.push_back(value);
+        sprintf(value, "l%u", i);
+        db.LPush(dbid, "seglist", value);
+        model.push_front(value);
+    }
+    CHECK_FATAL(!list_equals(db, dbid, "seglist", model), "segmented list push mismatch");
+
+    std::string v;
+    db.LIndex(dbid, "seglist", -3, v);
+    CHECK_FATAL(v != model[model.size() - 3], "LIndex negative failed:%s", v.c_str());
+    ValueDataArray array;
+    db.LRange(dbid, "seglist", 13, 41, array);
+    CHECK_FATAL(array.size() != 29 || array[0].ToString(v) != model[13] || array[28].ToString(v) != model[41],
+            "LRange across segments failed:%zu", array.size());
+
+    //inserting into one segment splits it without touching the others
+    for (uint32 i = 0; i < 20; i++)
+    {
+        sprintf(value, "i%u", i);
+        db.LInsert(dbid, "seglist", i % 2 ? "before" : "after", "r10", value);
+        std::deque<std::string>::iterator it = std::find(model.begin(), model.end(), "r10");
+        model.insert(i % 2 ? it : it + 1, value);
+    }
+    for (uint32 i = 0; i < model.size(); i += 7)
+    {
+        sprintf(value, "s%u", i);
+        db.LSet(dbid, "seglist", i, value);
+        model[i] = value;
+    }
+    CHECK_FATAL(!list_equals(db, dbid, "seglist", model), "segmented list insert/set mismatch");
+
+    db.LRem(dbid, "seglist", -2, "i3");
+    model.erase(std::find(model.begin(), model.end(), "i3"));
+    for (uint32 i = 0; i < 10; i++)
+    {
+        db.LPop(dbid, "seglist", v);
+        model.pop_front();
+        db.RPop(dbid, "seglist", v);
+        model.pop_back();
+    }
+    db.LTrim(dbid, "seglist", 5, -9);
+    model.erase(model.end() - 8, model.end());
+    model.erase(model.begin(), model.begin() + 5);
+    CHECK_FATAL(!list_equals(db, dbid, "seglist", model), "segmented list rem/pop/trim mismatch");
+    db.LClear(dbid, "seglist");
+    db.Init(cfg);
+}
+
 void test_list_expire(Ardb& db)
 {
     DBID dbid = 0;
@@ -206,6 +289,72 @@ void test_list_expire(Ardb& db)
     CHECK_FATAL(db.Exists(dbid, "mylist") == true, "Expire mylist failed");
 }
 
+/*
+ * Lists of more than LIST_INDEX_CHUNK_SEGMENTS segments spread their segment index over several chunks
+ */
+void test_lists_index_chunks(Ardb& db)
+{
+    DBID dbid = 0;
+    ArdbConfig cfg = db.GetConfig();
+    ArdbConfig seg_cfg = cfg;
+    seg_cfg.list_max_segment_entries = 2;
+    db.Init(seg_cfg);
+    db.LClear(dbid, "chunklist");
+    db.LClear(dbid, "chunklist2");
+    std::deque<std::string> model;
+    char value[32];
+    for (uint32 i = 0; i < 600; i++)
+    {
+        sprintf(value, "r%u", i);
+        db.RPush(dbid, "chunklist", value);
+        model.push_back(value);
+        sprintf(value, "l%u", i);
+        db.LPush(dbid, "chunklist", value);
+        model.push_front(value);
+    }
+    CHECK_FATAL(!list_equals(db, dbid, "chunklist", model), "chunked list push mismatch");
+    std::string v;
+    for (uint32 i = 0; i < model.size(); i += 97)
+    {
+        sprintf(value, "s%u", i);
+        db.LSet(dbid, "chunklist", i, value);
+        model[i] = value;
+        CHECK_FATAL(db.LIndex(dbid, "chunklist", i - model.size(), v) != 0 || v != value, "LIndex %u failed", i);
+    }
+    for (uint32 i = 0; i < 300; i++)
+    {
+        sprintf(value, "i%u", i);
+        db.LInsert(dbid, "chunklist", "before", "r300", value);
+        model.insert(std::find(model.begin(), model.end(), "r300"), value);
+    }
+    CHECK_FATAL(!list_equals(db, dbid, "chunklist", model), "chunked list insert/set mismatch");
+
+    db.LRem(dbid, "chunklist", 0, "i7");
+    model.erase(std::find(model.begin(), model.end(), "i7"));
+    for (uint32 i = 0; i < 400; i++)
+    {
+        db.LPop(dbid, "chunklist", v);
+        model.pop_front();
+    }
+    db.LTrim(dbid, "chunklist", 250, -300);
+    model.erase(model.end() - 299, model.end());
+    model.erase(model.begin(), model.begin() + 250);
+    CHECK_FATAL(!list_equals(db, dbid, "chunklist", model), "chunked list rem/pop/trim mismatch");
+
+    db.Rename(dbid, "chunklist", "chunklist2");
+    CHECK_FATAL(db.Exists(dbid, "chunklist"), "renamed chunked list still exists");
+    CHECK_FATAL(!list_equals(db, dbid, "chunklist2", model), "renamed chunked list mismatch");
+    while (!model.empty())
+    {
+        db.RPop(dbid, "chunklist2", v);
+        CHECK_FATAL(v != model.back(), "RPop %s, expected %s", v.c_str(), model.back().c_str());
+        model.pop_back();
+    }
+    CHECK_FATAL(db.LLen(dbid, "chunklist2") != 0, "chunked list not empty:%d", db.LLen(dbid, "chunklist2"));
+    db.LClear(dbid, "chunklist2");
+    db.Init(cfg);
+}
+
 void test_lists(Ardb& db)
 {
     test_lists_zip_lpush(db);
@@ -219,6 +368,8 @@ void test_lists(Ardb& db)
     test_lists_nonzip_insert(db);
     test_lists_nonzip_ltrim(db);
     test_lists_nonzip_lrange(db);
+    test_lists_segments(db);
+    test_lists_index_chunks(db);
 
     test_list_expire(db);
 }
@@ -6,8 +6,15 @@
  */
 #include "test_common.hpp"
 #include "util/thread/spin_rwlock.hpp"
+#include "util/thread/striped_rwlock.hpp"
 #include "util/thread/lock_guard.hpp"
 #include "util/thread/thread.hpp"
+#include "util/glob_trie.hpp"
+#include "util/concurrent_queue.hpp"
+#include "util/timing_wheel.hpp"
+#include "replication/repl.hpp"
+#include "ardb_server.hpp"
+#include <fnmatch.h>
 
 struct WriteTask: public Runnable
 {
@@ -301,6 +308,838 @@ void test_keys(Ardb& db)
     CHECK_FATAL(ret.size() < 2, "keys *set* size error:%zu", ret.size());
 }
 
+void test_lazy_free(Ardb& db)
+{
+    DBID dbid = 0;
+    ArdbConfig cfg = db.GetConfig();
+    ArdbConfig lazy_cfg = cfg;
+    lazy_cfg.lazy_free = true;
+    lazy_cfg.lazy_free_min_elements = 32;
+    db.Init(lazy_cfg);
+    db.Del(dbid, "lazyhash");
+    db.Del(dbid, "lazyzset");
+    for (uint32 i = 0; i < 100; i++)
+    {
+        char field[64], value[64];
+        sprintf(field, "field_%u", i);
+        sprintf(value, "value_%u", i);
+        db.HSet(dbid, "lazyhash", field, value);
+        db.ZAdd(dbid, "lazyzset", ValueData((int64) i), field);
+    }
+    db.Del(dbid, "lazyhash");
+    db.Del(dbid, "lazyzset");
+    CHECK_FATAL(db.Exists(dbid, "lazyhash") || db.Exists(dbid, "lazyzset"), "Lazy deleted keys still exist");
+    CHECK_FATAL(db.GetLazyFreePendingKeys() != 2, "Invalid lazy free pending keys:%u", db.GetLazyFreePendingKeys());
+
+    //old elements are reaped before the key is written again
+    for (uint32 i = 0; i < 20; i++)
+    {
+        char field[64];
+        sprintf(field, "newfield_%u", i);
+        db.HSet(dbid, "lazyhash", field, "v");
+    }
+    StringArray fields, values;
+    db.HGetAll(dbid, "lazyhash", fields, values);
+    CHECK_FATAL(fields.size() != 20, "Invalid hash size after lazy free:%zu", fields.size());
+    CHECK_FATAL(db.GetLazyFreePendingKeys() != 1, "Invalid lazy free pending keys:%u", db.GetLazyFreePendingKeys());
+
+    uint32 deleted = db.ReapLazyFreeKeys(1000);
+    CHECK_FATAL(deleted != 200, "Invalid reaped elements:%u", deleted);
+    CHECK_FATAL(db.GetLazyFreePendingKeys() != 0, "Invalid lazy free pending keys:%u", db.GetLazyFreePendingKeys());
+    db.ZAdd(dbid, "lazyzset", ValueData((int64) 1), "v");
+    CHECK_FATAL(db.ZCard(dbid, "lazyzset") != 1, "Invalid zset size after lazy free:%d", db.ZCard(dbid, "lazyzset"));
+    db.Del(dbid, "lazyhash");
+    db.Del(dbid, "lazyzset");
+    db.Init(cfg);
+}
+
+/*
+ * A batch of exactly the commit watermark(1024 by default) is handed over to the write thread of
+ * LMDB by the last write, it must be committed when the batch ends.
+ */
+void test_batch_write_watermark(Ardb& db)
+{
+    DBID dbid = 0;
+#if defined __USE_LMDB__
+    LMDBEngine* engine = (LMDBEngine*) db.GetEngine();
+    uint64 queued = engine->QueuedWrites();
+#endif
+    {
+        BatchWriteGuard guard(db.GetEngine());
+        for (uint32 i = 0; i < 1024; i++)
+        {
+            char key[64];
+            sprintf(key, "watermark_key%u", i);
+            db.Set(dbid, key, "v");
+        }
+    }
+#if defined __USE_LMDB__
+    /*
+     * The write thread took the batch at the watermark, & committed it before the batch ended
+     */
+    uint64 handed = engine->QueuedWrites();
+    CHECK_FATAL(handed - queued < 1024, "Batch not handed over at the watermark:%" PRIu64, handed - queued);
+    CHECK_FATAL(engine->CommittedQueuedWrites() < handed, "Handed over batch not committed:%" PRIu64 "/%" PRIu64,
+            engine->CommittedQueuedWrites(), handed);
+#endif
+    for (uint32 i = 0; i < 1024; i++)
+    {
+        char key[64];
+        sprintf(key, "watermark_key%u", i);
+        CHECK_FATAL(!db.Exists(dbid, key), "Batch written key %s not readable", key);
+        db.Del(dbid, key);
+    }
+}
+
+void test_meta_cache(Ardb& db)
+{
+    DBID dbid = 0;
+    MetaCache* cache = db.GetMetaCache();
+    if (NULL == cache)
+    {
+        return;
+    }
+    db.Del(dbid, "metakey");
+    db.Del(dbid, "metakey2");
+    db.Set(dbid, "metakey", "v1");
+    uint64 hits = cache->GetHits();
+    std::string v;
+    db.Get(dbid, "metakey", v);
+    CHECK_FATAL(v != "v1", "Get metakey failed:%s", v.c_str());
+    CHECK_FATAL(cache->GetHits() != hits + 1, "Get metakey missed meta cache");
+    db.Set(dbid, "metakey", "v2");
+    db.Get(dbid, "metakey", v);
+    CHECK_FATAL(v != "v2", "Get updated metakey failed:%s", v.c_str());
+    db.Rename(dbid, "metakey", "metakey2");
+    CHECK_FATAL(db.Exists(dbid, "metakey"), "Renamed metakey still exists");
+    db.Get(dbid, "metakey2", v);
+    CHECK_FATAL(v != "v2", "Get renamed metakey2 failed:%s", v.c_str());
+    db.Del(dbid, "metakey2");
+    CHECK_FATAL(db.Exists(dbid, "metakey2"), "Deleted metakey2 still exists");
+    CHECK_FATAL(db.Get(dbid, "metakey2", v) != ERR_NOT_EXIST, "Get deleted metakey2 failed");
+
+    //a tiny cache keeps evicting entries while staying coherent
+    ArdbConfig cfg = db.GetConfig();
+    ArdbConfig small_cfg = cfg;
+    small_cfg.meta_cache_memory_limit = 16 * 1024;
+    db.Init(small_cfg);
+    for (uint32 i = 0; i < 1000; i++)
+    {
+        char key[64];
+        sprintf(key, "metakey_%u", i);
+        db.Set(dbid, key, key);
+    }
+    CHECK_FATAL(cache->GetMemorySize() > 16 * 1024, "Meta cache exceeds its limit:%llu",
+            (unsigned long long) cache->GetMemorySize());
+    for (uint32 i = 0; i < 1000; i++)
+    {
+        char key[64];
+        sprintf(key, "metakey_%u", i);
+        db.Get(dbid, key, v);
+        CHECK_FATAL(v != key, "Get %s failed:%s", key, v.c_str());
+        db.Del(dbid, key);
+    }
+    db.Init(cfg);
+}
+
+void test_glob_trie()
+{
+    const char* patterns[] = { "*", "news.*", "news.[a-c]*", "news.[!a-c]?", "new?.sports", "news.\\*", "n*s.*t*",
+            "news.[]x]", "news.[", "[[:alpha:]]*s", "news.sports", "a*b*c*d", "" };
+    const char* channels[] = { "news.sports", "news.a", "news.bb", "news.*", "news.]", "news.[", "news.xy", "newx.sports",
+            "nobody", "aXbYcZd", "abcd", "", "news." };
+    size_t pattern_count = sizeof(patterns) / sizeof(patterns[0]);
+    size_t channel_count = sizeof(channels) / sizeof(channels[0]);
+    GlobTrie trie;
+    for (size_t i = 0; i < pattern_count; i++)
+    {
+        CHECK_FATAL(!trie.Add(patterns[i]), "Add pattern %s failed", patterns[i]);
+    }
+    CHECK_FATAL(trie.Add(patterns[0]), "Add duplicate pattern succeed");
+    //the second round is served by the match cache
+    for (uint32 round = 0; round < 2; round++)
+    {
+        for (size_t i = 0; i < channel_count; i++)
+        {
+            std::vector<std::string> matched;
+            trie.Match(channels[i], matched);
+            std::set<std::string> matched_set(matched.begin(), matched.end());
+            for (size_t j = 0; j < pattern_count; j++)
+            {
+                bool expected = fnmatch(patterns[j], channels[i], 0) == 0;
+                CHECK_FATAL(expected != (matched_set.count(patterns[j]) > 0), "Pattern %s on %s mismatch fnmatch",
+                        patterns[j], channels[i]);
+            }
+        }
+    }
+    CHECK_FATAL(!trie.Remove("news.*"), "Remove pattern failed");
+    std::vector<std::string> matched;
+    trie.Match("news.a", matched);
+    CHECK_FATAL(std::find(matched.begin(), matched.end(), "news.*") != matched.end(), "Removed pattern still matched");
+    CHECK_FATAL(trie.Size() != pattern_count - 1, "Invalid trie size:%u", (uint32) trie.Size());
+}
+
+struct RingPushTask: public Runnable
+{
+        MPSCRingQueue<std::string>* ring;
+        uint32 id;
+        uint32 count;
+        void Run()
+        {
+            for (uint32 i = 0; i < count; i++)
+            {
+                char buf[64];
+                sprintf(buf, "%u:%u", id, i);
+                std::string record = buf;
+                while (!ring->TryPush(record))
+                {
+                    sched_yield();
+                }
+            }
+        }
+};
+
+void test_mpsc_ring()
+{
+    MPSCRingQueue<std::string> ring(100);
+    CHECK_FATAL(ring.Capacity() != 128, "Invalid ring capacity:%u", (uint32) ring.Capacity());
+    const uint32 producers = 4, count = 100000;
+    RingPushTask tasks[producers];
+    std::vector<Thread*> ts;
+    for (uint32 i = 0; i < producers; i++)
+    {
+        tasks[i].ring = &ring;
+        tasks[i].id = i;
+        tasks[i].count = count;
+        Thread* t = new Thread(&tasks[i]);
+        t->Start();
+        ts.push_back(t);
+    }
+    //records of each producer are popped in the order they were pushed
+    std::vector<uint32> next(producers, 0);
+    uint32 popped = 0;
+    std::string invalid_record;
+    while (popped < producers * count)
+    {
+        std::string record;
+        if (!ring.Pop(record))
+        {
+            sched_yield();
+            continue;
+        }
+        uint32 id, seq;
+        sscanf(record.c_str(), "%u:%u", &id, &seq);
+        if (invalid_record.empty() && (id >= producers || next[id] != seq))
+        {
+            invalid_record = record;
+        }
+        if (id < producers)
+        {
+            next[id]++;
+        }
+        popped++;
+    }
+    CHECK_FATAL(!invalid_record.empty(), "Invalid ring record:%s", invalid_record.c_str());
+    for (uint32 i = 0; i < producers; i++)
+    {
+        ts[i]->Join();
+        delete ts[i];
+    }
+    std::string record;
+    CHECK_FATAL(ring.Pop(record), "Ring should be empty");
+}
+
+void test_timing_wheel()
+{
+    TimingWheel<uint32> wheel(100);
+    for (uint32 i = 1; i <= 5000; i++)
+    {
+        wheel.Add(100 + (i * 7919) % 5000 + 1, i);
+    }
+    uint32 popped = 0;
+    for (uint64 now = 101; now < 5100 + 3; now += 3)
+    {
+        wheel.Advance(now);
+        TimingWheel<uint32>::Entry entry;
+        while (wheel.PopReady(entry))
+        {
+            CHECK_FATAL(entry.first > now, "Entry %" PRIu64 " popped at %" PRIu64, entry.first, now);
+            popped++;
+        }
+    }
+    CHECK_FATAL(popped != 5000 || wheel.Size() != 0, "Timing wheel lost entries:%u", popped);
+
+    /*
+     * An epoch ms tick added to a wheel started at 0 is reached without ticking through the gap
+     */
+    TimingWheel<uint32> epoch_wheel;
+    uint64 tick = get_current_epoch_millis();
+    epoch_wheel.Add(tick + 10, 1);
+    epoch_wheel.Add(tick + 100000, 2);
+    uint64 start = get_current_epoch_millis();
+    epoch_wheel.Advance(tick + 10);
+    CHECK_FATAL(epoch_wheel.ReadySize() != 1, "Timing wheel failed:%zu", epoch_wheel.ReadySize());
+    epoch_wheel.Advance(tick + 1000);
+    CHECK_FATAL(epoch_wheel.ReadySize() != 1, "Timing wheel failed:%zu", epoch_wheel.ReadySize());
+    epoch_wheel.Advance(tick + 100000);
+    CHECK_FATAL(epoch_wheel.ReadySize() != 2, "Timing wheel failed:%zu", epoch_wheel.ReadySize());
+    CHECK_FATAL(get_current_epoch_millis() - start > 1000, "Timing wheel advanced too slow");
+    epoch_wheel.Clear(tick);
+    CHECK_FATAL(epoch_wheel.Size() != 0 || epoch_wheel.Current() != tick, "Timing wheel clear failed");
+}
+
+static const uint32 kCheckpointWriters = 4;
+struct CheckpointWrites
+{
+        StripedRWLock lock;
+        volatile uint32 written[kCheckpointWriters];
+        uint32 recorded[kCheckpointWriters];
+        volatile bool stop;
+};
+
+struct CheckpointWriteTask: public Runnable
+{
+        Ardb* db;
+        CheckpointWrites* writes;
+        uint32 id;
+        void Run()
+        {
+            while (!writes->stop)
+            {
+                /*
+                 * Like a command & its feeding to the backlog, 'written' plays the replication offset
+                 */
+                ReadLockGuard<StripedRWLock> guard(writes->lock);
+                char key[64];
+                sprintf(key, "ckptkey_%u_%u", id, writes->written[id]);
+                db->Set(0, key, "v");
+                writes->written[id]++;
+            }
+        }
+};
+
+static void record_checkpoint_writes(bool pause, void* data)
+{
+    CheckpointWrites* writes = (CheckpointWrites*) data;
+    if (!pause)
+    {
+        writes->lock.Unlock(WRITE_LOCK);
+        return;
+    }
+    writes->lock.Lock(WRITE_LOCK);
+    for (uint32 i = 0; i < kCheckpointWriters; i++)
+    {
+        writes->recorded[i] = writes->written[i];
+    }
+}
+
+void test_checkpoint(Ardb& db)
+{
+    Properties props;
+    conf_set(props, "data-dir", "/tmp/ardb/checkpoint_test");
+    SelectedDBEngineFactory factory(props);
+    std::string dir = "/tmp/ardb/checkpoint_test/" + factory.GetName();
+    make_dir(dir);
+    CheckpointWrites writes;
+    writes.stop = false;
+    CheckpointWriteTask tasks[kCheckpointWriters];
+    std::vector<Thread*> ts;
+    for (uint32 i = 0; i < kCheckpointWriters; i++)
+    {
+        writes.written[i] = 0;
+        tasks[i].db = &db;
+        tasks[i].writes = &writes;
+        tasks[i].id = i;
+        Thread* t = new Thread(&tasks[i]);
+        t->Start();
+        ts.push_back(t);
+    }
+    usleep(50 * 1000);
+    int ret = db.GetEngine()->Checkpoint(dir, "", record_checkpoint_writes, &writes);
+    usleep(50 * 1000);
+    writes.stop = true;
+    for (uint32 i = 0; i < kCheckpointWriters; i++)
+    {
+        ts[i]->Join();
+        delete ts[i];
+    }
+    CHECK_FATAL(ret != 0, "Checkpoint failed:%d", ret);
+    /*
+     * The checkpoint has every write before the recorded offset and none after it
+     */
+    {
+        Ardb checkpoint(&factory);
+        ArdbConfig cfg;
+        CHECK_FATAL(!checkpoint.Init(cfg), "Open checkpoint failed");
+        for (uint32 i = 0; i < kCheckpointWriters; i++)
+        {
+            CHECK_FATAL(writes.recorded[i] == 0 || writes.recorded[i] == writes.written[i],
+                    "No writes around the checkpoint of writer %u", i);
+            uint32 j = 0;
+            for (; j <= writes.recorded[i]; j++)
+            {
+                char key[64];
+                sprintf(key, "ckptkey_%u_%u", i, j);
+                if (checkpoint.Exists(0, key) != (j < writes.recorded[i]))
+                {
+                    break;
+                }
+            }
+            CHECK_FATAL(j <= writes.recorded[i], "Checkpoint of writer %u doesn't match offset %u at %u", i,
+                    writes.recorded[i], j);
+        }
+    }
+    for (uint32 i = 0; i < kCheckpointWriters; i++)
+    {
+        for (uint32 j = 0; j < writes.written[i]; j++)
+        {
+            char key[64];
+            sprintf(key, "ckptkey_%u_%u", i, j);
+            db.Del(0, key);
+        }
+    }
+    std::deque<std::string> files;
+    list_subfiles(dir, files);
+    for (uint32 i = 0; i < files.size(); i++)
+    {
+        unlink((dir + "/" + files[i]).c_str());
+    }
+    rmdir(dir.c_str());
+}
+
+/*
+ * Keys of every type in two DBs, the first key bytes spread over the ranges a dump is split into
+ */
+static const uint32 kDumpStrings = 2000;
+static const uint32 kDumpElements = 1000;
+
+static void dump_string_key(char* key, uint32 i)
+{
+    sprintf(key, "%cdumpkey%u", (char) (0x21 + (i * 37) % 0xd0), i);
+}
+
+static void write_dump_keys(Ardb& db)
+{
+    for (DBID dbid = 0; dbid < 4; dbid += 3)
+    {
+        for (uint32 i = 0; i < kDumpStrings; i++)
+        {
+            char key[64], value[64];
+            dump_string_key(key, i);
+            sprintf(value, "v%u_%u", dbid, i);
+            db.Set(dbid, key, value);
+        }
+        for (uint32 i = 0; i < kDumpElements; i++)
+        {
+            char field[64], value[64];
+            sprintf(field, "f%u", i);
+            sprintf(value, "v%u_%u", dbid, i);
+            db.HSet(dbid, "dumphash", field, value);
+            db.RPush(dbid, "dumplist", value);
+            db.SAdd(dbid, "dumpset", value);
+            db.ZAdd(dbid, "dumpzset", ValueData((int64) i), value);
+        }
+    }
+}
+
+static void del_dump_keys(Ardb& db)
+{
+    for (DBID dbid = 0; dbid < 4; dbid += 3)
+    {
+        for (uint32 i = 0; i < kDumpStrings; i++)
+        {
+            char key[64];
+            dump_string_key(key, i);
+            db.Del(dbid, key);
+        }
+        db.Del(dbid, "dumphash");
+        db.Del(dbid, "dumplist");
+        db.Del(dbid, "dumpset");
+        db.Del(dbid, "dumpzset");
+    }
+}
+
+/*
+ * Returns the first key not as written by write_dump_keys, empty if all match
+ */
+static std::string check_dump_keys(Ardb& db)
+{
+    char err[256];
+    for (DBID dbid = 0; dbid < 4; dbid += 3)
+    {
+        for (uint32 i = 0; i < kDumpStrings; i++)
+        {
+            char key[64], expected[64];
+            dump_string_key(key, i);
+            sprintf(expected, "v%u_%u", dbid, i);
+            std::string value;
+            if (0 != db.Get(dbid, key, value) || value != expected)
+            {
+                sprintf(err, "string %u of db %u", i, dbid);
+                return err;
+            }
+        }
+        ValueDataArray list;
+        db.LRange(dbid, "dumplist", 0, -1, list);
+        if (list.size() != kDumpElements || db.SCard(dbid, "dumpset") != (int) kDumpElements
+                || db.ZCard(dbid, "dumpzset") != (int) kDumpElements)
+        {
+            sprintf(err, "collection sizes of db %u", dbid);
+            return err;
+        }
+        for (uint32 i = 0; i < kDumpElements; i++)
+        {
+            char field[64], expected[64];
+            sprintf(field, "f%u", i);
+            sprintf(expected, "v%u_%u", dbid, i);
+            std::string value, element;
+            ValueData score;
+            if (0 != db.HGet(dbid, "dumphash", field, &value) || value != expected
+                    || list[i].ToString(element) != expected || !db.SIsMember(dbid, "dumpset", expected)
+                    || 0 != db.ZScore(dbid, "dumpzset", expected, score) || score.NumberValue() != i)
+            {
+                sprintf(err, "element %u of db %u", i, dbid);
+                return err;
+            }
+        }
+    }
+    return "";
+}
+
+void test_dump_segments(Ardb& db)
+{
+    std::string file = "/tmp/ardb/segments.ardb";
+    write_dump_keys(db);
+    /*
+     * A manifest & its segment files, or a single file where iterators can't be shared by threads(LMDB)
+     */
+    bool segmented = db.GetEngine()->SupportParallelIterators();
+    ArdbDumpFile dump;
+    dump.Init(&db);
+    dump.SetSegments(4);
+    CHECK_FATAL(dump.Save(file, NULL, NULL) != 0, "Save segmented dump failed");
+    for (uint32 i = 0; i < 4; i++)
+    {
+        char segment[256];
+        sprintf(segment, "%s.%u", file.c_str(), i);
+        CHECK_FATAL(is_file_exist(segment) != segmented, "Invalid dump segment %s", segment);
+    }
+    del_dump_keys(db);
+    CHECK_FATAL(dump.Load(file, NULL, NULL) != 0, "Load segmented dump failed");
+    std::string mismatch = check_dump_keys(db);
+    CHECK_FATAL(!mismatch.empty(), "Segmented dump reloaded a wrong %s", mismatch.c_str());
+
+    ArdbDumpFile single;
+    single.Init(&db);
+    CHECK_FATAL(single.Save(file, NULL, NULL) != 0, "Save dump failed");
+    del_dump_keys(db);
+    CHECK_FATAL(single.Load(file, NULL, NULL) != 0, "Load dump failed");
+    mismatch = check_dump_keys(db);
+    CHECK_FATAL(!mismatch.empty(), "Dump reloaded a wrong %s", mismatch.c_str());
+
+    del_dump_keys(db);
+    unlink(file.c_str());
+    for (uint32 i = 0; i < 4; i++)
+    {
+        char segment[256];
+        sprintf(segment, "%s.%u", file.c_str(), i);
+        unlink(segment);
+    }
+}
+
+/*
+ * Replays the snapshot chunks as the slave does, returns the number of chunks passing the check or -1
+ * at the first corrupted one.
+ */
+static int replay_sync_chunks(Buffer& stream)
+{
+    SyncChunk chunk;
+    int chunks = 0;
+    RedisCommandFrame cmd;
+    while (stream.Readable() && RedisCommandDecoder::Decode(NULL, stream, cmd))
+    {
+        if (!strcasecmp(cmd.GetCommand().c_str(), "__SYNCCHUNK__"))
+        {
+            if (!chunk.Verify(cmd))
+            {
+                return -1;
+            }
+            chunks++;
+        }
+        else if (!strcasecmp(cmd.GetCommand().c_str(), "__SET__") && cmd.GetArguments().size() == 2)
+        {
+            chunk.Add(cmd.GetArguments()[0], cmd.GetArguments()[1]);
+        }
+        cmd.Clear();
+    }
+    return chunks;
+}
+
+static void write_sync_chunk(Buffer& stream, uint32 start, uint32 count, int skip, int corrupt)
+{
+    SyncChunk chunk;
+    for (uint32 i = start; i < start + count; i++)
+    {
+        char key[64], value[64];
+        sprintf(key, "synckey%u", i);
+        sprintf(value, "syncvalue%u", i);
+        chunk.Add(key, value);
+        if ((int) i == skip)
+        {
+            continue;
+        }
+        if ((int) i == corrupt)
+        {
+            value[0] = 'S';
+        }
+        ArgumentArray args;
+        args.push_back("__SET__");
+        args.push_back(key);
+        args.push_back(value);
+        RedisCommandFrame cmd(args);
+        RedisCommandEncoder::Encode(stream, cmd);
+    }
+    chunk.WriteTrailer(stream);
+}
+
+void test_sync_chunk()
+{
+    Buffer stream;
+    write_sync_chunk(stream, 0, 100, -1, -1);
+    write_sync_chunk(stream, 100, 1, -1, -1);
+    write_sync_chunk(stream, 101, 50, -1, -1);
+    int chunks = replay_sync_chunks(stream);
+    CHECK_FATAL(chunks != 3, "Sync chunks check failed:%d", chunks);
+
+    Buffer corrupted;
+    write_sync_chunk(corrupted, 0, 100, -1, -1);
+    write_sync_chunk(corrupted, 100, 100, -1, 150);
+    chunks = replay_sync_chunks(corrupted);
+    CHECK_FATAL(chunks != -1, "Corrupted sync chunk accepted:%d", chunks);
+
+    Buffer truncated;
+    write_sync_chunk(truncated, 0, 100, 42, -1);
+    chunks = replay_sync_chunks(truncated);
+    CHECK_FATAL(chunks != -1, "Sync chunk missing a key accepted:%d", chunks);
+
+    RedisCommandFrame trailer;
+    SyncChunk chunk;
+    chunk.Add("synckey", "syncvalue");
+    Buffer malformed;
+    malformed.Printf("__SYNCCHUNK__ 1\r\n");
+    RedisCommandDecoder::Decode(NULL, malformed, trailer);
+    CHECK_FATAL(chunk.Verify(trailer), "Malformed sync chunk trailer accepted");
+}
+
+/*
+ * Builds a master stream where single key commands of different workers are interleaved with
+ * MSET/RENAME/DEL and transactions touching keys of several workers.
+ */
+static void build_repl_stream(std::vector<RedisCommandFrame>& stream)
+{
+    for (uint32 i = 0; i < 2000; i++)
+    {
+        char key[64], other[64], field[64], value[64];
+        sprintf(key, "applykey%u", i % 16);
+        sprintf(other, "applykey%u", (i * 7 + 3) % 16);
+        sprintf(field, "field%u", i % 5);
+        sprintf(value, "%u", i);
+        ArgumentArray args;
+        switch (i % 11)
+        {
+            case 0:
+            case 1:
+            {
+                args.push_back("set");
+                args.push_back(key);
+                args.push_back(value);
+                break;
+            }
+            case 2:
+            {
+                args.push_back("append");
+                args.push_back(key);
+                args.push_back(value);
+                break;
+            }
+            case 3:
+            {
+                args.push_back("hset");
+                args.push_back(std::string("applyhash") + value[strlen(value) - 1]);
+                args.push_back(field);
+                args.push_back(value);
+                break;
+            }
+            case 4:
+            {
+                args.push_back("rpush");
+                args.push_back(std::string("applylist") + value[strlen(value) - 1]);
+                args.push_back(value);
+                break;
+            }
+            case 5:
+            {
+                args.push_back("mset");
+                args.push_back(key);
+                args.push_back(value);
+                args.push_back(other);
+                args.push_back(value);
+                break;
+            }
+            case 6:
+            {
+                args.push_back("rename");
+                args.push_back(key);
+                args.push_back(other);
+                break;
+            }
+            case 7:
+            {
+                args.push_back("incr");
+                args.push_back(std::string("applycounter") + value[strlen(value) - 1]);
+                break;
+            }
+            case 8:
+            {
+                args.push_back("del");
+                args.push_back(key);
+                args.push_back(std::string("applylist") + value[0]);
+                break;
+            }
+            case 9:
+            {
+                stream.push_back(RedisCommandFrame("multi"));
+                args.push_back("append");
+                args.push_back(key);
+                args.push_back(value);
+                stream.push_back(RedisCommandFrame(args));
+                args.clear();
+                args.push_back("hset");
+                args.push_back(std::string("applyhash") + value[0]);
+                args.push_back(key);
+                args.push_back(value);
+                stream.push_back(RedisCommandFrame(args));
+                args.clear();
+                args.push_back("rename");
+                args.push_back(other);
+                args.push_back(key);
+                stream.push_back(RedisCommandFrame(args));
+                args.clear();
+                args.push_back("exec");
+                break;
+            }
+            default:
+            {
+                args.push_back("lpop");
+                args.push_back(std::string("applylist") + value[strlen(value) - 1]);
+                break;
+            }
+        }
+        stream.push_back(RedisCommandFrame(args));
+    }
+}
+
+static std::string read_applied_key(ReplApplier& reader, ArdbConnContext& ctx, const char* cmd, const std::string& key)
+{
+    ArgumentArray args;
+    args.push_back(cmd);
+    args.push_back(key);
+    if (!strcmp(cmd, "lrange"))
+    {
+        args.push_back("0");
+        args.push_back("-1");
+    }
+    RedisCommandFrame frame(args);
+    reader.Apply(ctx, NULL, frame, 0, false);
+    Buffer buf;
+    RedisReplyEncoder::Encode(buf, ctx.reply);
+    ctx.reply.Clear();
+    return std::string(buf.GetRawReadBuffer(), buf.ReadableBytes());
+}
+
+static void del_applied_keys(ReplApplier& writer, ArdbConnContext& ctx)
+{
+    ArdbConnContext del_ctx;
+    del_ctx.currentDB = ctx.currentDB;
+    ArgumentArray args;
+    args.push_back("del");
+    for (uint32 i = 0; i < 16; i++)
+    {
+        char key[64];
+        sprintf(key, "applykey%u", i);
+        args.push_back(key);
+        sprintf(key, "%u", i % 10);
+        args.push_back(std::string("applyhash") + key);
+        args.push_back(std::string("applylist") + key);
+        args.push_back(std::string("applycounter") + key);
+    }
+    RedisCommandFrame frame(args);
+    writer.Apply(del_ctx, NULL, frame, ARDB_PROCESS_DISCARD_REPLY, false);
+}
+
+/*
+ * Applies the same stream partitioned by key on 4 threads into DB 0, and serially into DB 1
+ */
+void test_repl_apply()
+{
+    char cwd[1024];
+    CHECK_FATAL(NULL == getcwd(cwd, sizeof(cwd)), "getcwd failed");
+    Properties props;
+    conf_set(props, "home", cwd);
+    conf_set(props, "data-dir", "/tmp/ardb/repl_apply_test");
+    conf_set(props, "repl-dir", "/tmp/ardb/repl_apply_test/repl");
+    conf_set(props, "backup-dir", "/tmp/ardb/repl_apply_test/backup");
+    SelectedDBEngineFactory factory(props);
+    ArdbServer server(factory);
+    CHECK_FATAL(server.Init(props) != 0, "Init server failed");
+
+    std::vector<RedisCommandFrame> stream;
+    build_repl_stream(stream);
+    ReplApplier parallel(&server);
+    ReplApplier serial(&server);
+    parallel.Start(4);
+    ArdbConnContext parallel_ctx, serial_ctx;
+    parallel_ctx.currentDB = 0;
+    serial_ctx.currentDB = 1;
+    del_applied_keys(serial, parallel_ctx);
+    del_applied_keys(serial, serial_ctx);
+    int flags = ARDB_PROCESS_REPL_WRITE | ARDB_PROCESS_DISCARD_REPLY;
+    for (uint32 i = 0; i < stream.size(); i++)
+    {
+        RedisCommandFrame parallel_cmd = stream[i];
+        RedisCommandFrame serial_cmd = stream[i];
+        parallel.Apply(parallel_ctx, NULL, parallel_cmd, flags, true);
+        parallel_ctx.reply.Clear();
+        serial.Apply(serial_ctx, NULL, serial_cmd, flags, true);
+        serial_ctx.reply.Clear();
+    }
+    parallel.Barrier(NULL);
+    parallel.Stop();
+
+    uint32 mismatch = 0;
+    for (uint32 i = 0; i < 16; i++)
+    {
+        char key[64];
+        sprintf(key, "applykey%u", i);
+        mismatch += read_applied_key(serial, parallel_ctx, "get", key) != read_applied_key(serial, serial_ctx, "get", key);
+        sprintf(key, "%u", i % 10);
+        std::string hash = std::string("applyhash") + key;
+        std::string list = std::string("applylist") + key;
+        std::string counter = std::string("applycounter") + key;
+        mismatch += read_applied_key(serial, parallel_ctx, "hgetall", hash)
+                != read_applied_key(serial, serial_ctx, "hgetall", hash);
+        mismatch += read_applied_key(serial, parallel_ctx, "lrange", list)
+                != read_applied_key(serial, serial_ctx, "lrange", list);
+        mismatch += read_applied_key(serial, parallel_ctx, "get", counter)
+                != read_applied_key(serial, serial_ctx, "get", counter);
+    }
+    CHECK_FATAL(mismatch > 0, "%u keys applied in parallel differ from the serial apply", mismatch);
+    std::string probe = read_applied_key(serial, serial_ctx, "hgetall", "applyhash1");
+    CHECK_FATAL(probe.size() < 16, "Serial apply wrote nothing:%s", probe.c_str());
+    del_applied_keys(serial, parallel_ctx);
+    del_applied_keys(serial, serial_ctx);
+}
+
 void test_pthread_create_performance()
 {
     uint64 start = get_current_epoch_millis();
@@ -327,4 +1166,14 @@ void test_misc(Ardb& db)
     test_sort_set(db);
     test_sort_zset(db);
     test_keys(db);
+    test_lazy_free(db);
+    test_batch_write_watermark(db);
+    test_meta_cache(db);
+    test_glob_trie();
+    test_mpsc_ring();
+    test_timing_wheel();
+    test_checkpoint(db);
+    test_dump_segments(db);
+    test_sync_chunk();
+    test_repl_apply();
 }
@@ -7,7 +7,14 @@
 
 #include "db.hpp"
 #include "util/math_helper.hpp"
+#include "util/lru.hpp"
+#include "cache/level1_cache.hpp"
+#include "util/thread/thread.hpp"
+#include "util/bitops.hpp"
 #include <string>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
 
 using namespace ardb;
 
@@ -42,6 +49,54 @@ void test_string_performace(Ardb& db)
     printf("=====================String Performace Test End=====================\n");
 }
 
+struct ConcurrentSetTask: public Runnable
+{
+        Ardb* db;
+        uint32 id;
+        uint32 count;
+        void Run()
+        {
+            DBID dbid = 0;
+            for (uint32 i = 0; i < count; i++)
+            {
+                char field[64], value[128];
+                sprintf(field, "cstring_%u_%u", id, i);
+                sprintf(value, "value_%u", i);
+                db->Set(dbid, field, value);
+            }
+        }
+};
+
+void test_concurrent_write_performace(Ardb& db)
+{
+    printf("=====================Concurrent Write Performace Test Start=====================\n");
+    const uint32 thread_count = 8;
+    ConcurrentSetTask tasks[thread_count];
+    std::vector<Thread*> ts;
+    uint64 start = get_current_epoch_millis();
+    for (uint32 i = 0; i < thread_count; i++)
+    {
+        tasks[i].db = &db;
+        tasks[i].id = i;
+        tasks[i].count = PERF_LOOP_COUNT / thread_count;
+        Thread* t = new Thread(&tasks[i]);
+        t->Start();
+        ts.push_back(t);
+    }
+    for (uint32 i = 0; i < ts.size(); i++)
+    {
+        ts[i]->Join();
+        delete ts[i];
+    }
+    uint64 end = get_current_epoch_millis();
+    printf("Cost %llums to execute set %u times by %u threads, avg %.2f qps.\n", (end - start), PERF_LOOP_COUNT,
+            thread_count, PERF_LOOP_COUNT * 1000.0 / (end - start));
+    std::string v;
+    db.Get(0, "cstring_7_0", v);
+    CHECK_FATAL(v != "value_0", "Concurrent set failed:%s", v.c_str());
+    printf("=====================Concurrent Write Performace Test End=====================\n");
+}
+
 void test_nonzip_hash_performace(Ardb& db)
 {
     DBID dbid = 0;
@@ -73,6 +128,68 @@ void test_nonzip_hash_performace(Ardb& db)
     printf("=====================Hash(NotZiped) Performace Test End=====================\n");
 }
 
+void test_counter_performace(Ardb& db)
+{
+    DBID dbid = 0;
+    printf("=====================Counter Performace Test Start=====================\n");
+    printf("Storage engine %s merge.\n", db.GetEngine()->SupportMerge() ? "supports" : "does not support");
+    db.Del(dbid, "perfcountertest");
+    for (uint32 i = 0; i < (uint32) (db.GetConfig().hash_max_ziplist_entries + 1); i++)
+    {
+        char field[64];
+        sprintf(field, "field_%u", i);
+        db.HSet(dbid, "perfcountertest", field, "0");
+    }
+    uint64 start = get_current_epoch_millis();
+    for (uint32 i = 0; i < PERF_LOOP_COUNT; i++)
+    {
+        char field[64];
+        sprintf(field, "field_%u", i % 16);
+        int64 v;
+        db.HIncrby(dbid, "perfcountertest", field, 1, v);
+    }
+    uint64 end = get_current_epoch_millis();
+    printf("Cost %llums to execute hincrby %u times, avg %.2f qps.\n", (end - start), PERF_LOOP_COUNT,
+    PERF_LOOP_COUNT * 1000.0 / (end - start));
+    start = get_current_epoch_millis();
+    for (uint32 i = 0; i < PERF_LOOP_COUNT; i++)
+    {
+        char field[64];
+        sprintf(field, "field_%u", i % 16);
+        db.MergeHIncrby(dbid, "perfcountertest", field, 1);
+    }
+    end = get_current_epoch_millis();
+    printf("Cost %llums to execute merge hincrby %u times, avg %.2f qps.\n", (end - start), PERF_LOOP_COUNT,
+    PERF_LOOP_COUNT * 1000.0 / (end - start));
+    std::string v;
+    db.HGet(dbid, "perfcountertest", "field_0", &v);
+    int64 expected = (PERF_LOOP_COUNT / 16) * 2;
+    CHECK_FATAL(v != stringfromll(expected), "hincrby counter field_0 failed:%s", v.c_str());
+
+    start = get_current_epoch_millis();
+    for (uint32 i = 0; i < PERF_LOOP_COUNT; i++)
+    {
+        char key[64];
+        sprintf(key, "counter_%u", i % 16);
+        int64 v;
+        db.Incrby(dbid, key, 1, v);
+    }
+    end = get_current_epoch_millis();
+    printf("Cost %llums to execute incrby %u times, avg %.2f qps.\n", (end - start), PERF_LOOP_COUNT,
+    PERF_LOOP_COUNT * 1000.0 / (end - start));
+    start = get_current_epoch_millis();
+    for (uint32 i = 0; i < PERF_LOOP_COUNT; i++)
+    {
+        char key[64];
+        sprintf(key, "counter_%u", i % 16);
+        db.MergeIncrby(dbid, key, 1);
+    }
+    end = get_current_epoch_millis();
+    printf("Cost %llums to execute merge incrby %u times, avg %.2f qps.\n", (end - start), PERF_LOOP_COUNT,
+    PERF_LOOP_COUNT * 1000.0 / (end - start));
+    printf("=====================Counter Performace Test End=====================\n");
+}
+
 void test_zip_hash_performace(Ardb& db)
 {
     printf("=====================Hash(Ziped) Performace Test Start=====================\n");
@@ -305,15 +422,230 @@ void test_zip_zset_performace(Ardb& db)
     printf("=====================ZSet(Ziped) Performace Test End=====================\n");
 }
 
+struct LegacyKeyLess
+{
+        bool operator()(const std::string& a, const std::string& b) const
+        {
+            return ardb_compare_keys(a.data(), a.size(), b.data(), b.size()) < 0;
+        }
+};
+
+struct BytewiseKeyLess
+{
+        bool operator()(const std::string& a, const std::string& b) const
+        {
+            return a.compare(b) < 0;
+        }
+};
+
+/*
+ * Memtable inserts & compactions are dominated by key comparisons: sort two runs of keys,
+ * then merge them as a compaction would, once with each key format's comparator.
+ */
+template<typename Less>
+static uint64 key_compare_cost(std::vector<std::string> keys)
+{
+    uint64 start = get_current_epoch_millis();
+    size_t half = keys.size() / 2;
+    std::sort(keys.begin(), keys.begin() + half, Less());
+    std::sort(keys.begin() + half, keys.end(), Less());
+    std::vector<std::string> merged(keys.size());
+    std::merge(keys.begin(), keys.begin() + half, keys.begin() + half, keys.end(), merged.begin(), Less());
+    return get_current_epoch_millis() - start;
+}
+
+void test_key_compare_performace(Ardb& db)
+{
+    printf("=====================Key Compare Performace Test Start=====================\n");
+    std::vector<std::string> legacy_keys, memcmp_keys;
+    for (uint32 i = 0; i < PERF_LOOP_COUNT; i++)
+    {
+        char key[64], member[128];
+        sprintf(key, "perfkeytest_%u", i % 100);
+        sprintf(member, "member_%u", random_between_int32(0, PERF_LOOP_COUNT));
+        ZSetKeyObject zk(key, member, ValueData((int64) random_between_int32(0, 10000)), 0);
+        HashKeyObject hk(key, member, 0);
+        KeyObject& k = (i % 2 == 0) ? (KeyObject&) zk : (KeyObject&) hk;
+        Buffer legacy, memcmp;
+        encode_key(legacy, k, ARDB_KEY_FORMAT_LEGACY);
+        encode_key(memcmp, k, ARDB_KEY_FORMAT_MEMCMP);
+        legacy_keys.push_back(legacy.AsString());
+        memcmp_keys.push_back(memcmp.AsString());
+    }
+    uint64 legacy_cost = key_compare_cost<LegacyKeyLess>(legacy_keys);
+    uint64 memcmp_cost = key_compare_cost<BytewiseKeyLess>(memcmp_keys);
+    printf("Cost %" PRIu64 "ms to sort & merge %u keys with legacy key format.\n", legacy_cost, PERF_LOOP_COUNT);
+    printf("Cost %" PRIu64 "ms to sort & merge %u keys with memcomparable key format.\n", memcmp_cost, PERF_LOOP_COUNT);
+
+    std::sort(legacy_keys.begin(), legacy_keys.end(), LegacyKeyLess());
+    std::sort(memcmp_keys.begin(), memcmp_keys.end(), BytewiseKeyLess());
+    bool same_order = true;
+    for (uint32 i = 0; i < PERF_LOOP_COUNT && same_order; i++)
+    {
+        KeyObject* lk = decode_key(legacy_keys[i], NULL, ARDB_KEY_FORMAT_LEGACY);
+        KeyObject* mk = decode_key(memcmp_keys[i], NULL, ARDB_KEY_FORMAT_MEMCMP);
+        Buffer lbuf, mbuf;
+        encode_key(lbuf, *lk, ARDB_KEY_FORMAT_MEMCMP);
+        encode_key(mbuf, *mk, ARDB_KEY_FORMAT_MEMCMP);
+        same_order = lbuf.AsString() == mbuf.AsString();
+        DELETE(lk);
+        DELETE(mk);
+    }
+    CHECK_FATAL(!same_order, "Key formats give different order");
+    printf("=====================Key Compare Performace Test End=====================\n");
+}
+
+/*
+ * Zipfian(s=0.99) key picker, CDF precomputed over 'n' keys
+ */
+struct ZipfianPicker
+{
+        std::vector<double> cdf;
+        ZipfianPicker(uint32 n)
+        {
+            double sum = 0;
+            for (uint32 i = 1; i <= n; i++)
+            {
+                sum += 1.0 / pow((double) i, 0.99);
+                cdf.push_back(sum);
+            }
+            for (uint32 i = 0; i < n; i++)
+            {
+                cdf[i] /= sum;
+            }
+        }
+        uint32 Next()
+        {
+            //random_between_int32 reseeds with the current second, too coarse here
+            double r = (double) rand() / RAND_MAX;
+            return std::lower_bound(cdf.begin(), cdf.end(), r) - cdf.begin();
+        }
+};
+
+#define CACHE_PERF_KEY_SPACE 100000
+#define CACHE_PERF_CAPACITY  10000
+
+static void cache_perf_keys(std::vector<DBItemKey>& keys, ZipfianPicker& picker)
+{
+    /*
+     * zipfian gets with a scan over never seen keys every 10% of the run
+     */
+    uint32 scan_key = 0;
+    for (uint32 i = 0; i < PERF_LOOP_COUNT; i++)
+    {
+        if (i % (PERF_LOOP_COUNT / 10) == 0)
+        {
+            for (uint32 j = 0; j < CACHE_PERF_CAPACITY; j++)
+            {
+                char key[64];
+                sprintf(key, "scan_%u", scan_key++);
+                keys.push_back(DBItemKey(0, key));
+            }
+        }
+        char key[64];
+        sprintf(key, "hot_%u", picker.Next());
+        keys.push_back(DBItemKey(0, key));
+    }
+}
+
+void test_cache_performace(Ardb& db)
+{
+    printf("=====================Cache Performace Test Start=====================\n");
+    ZipfianPicker picker(CACHE_PERF_KEY_SPACE);
+    std::vector<DBItemKey> keys;
+    cache_perf_keys(keys, picker);
+
+    LRUCache<DBItemKey, int> lru(CACHE_PERF_CAPACITY);
+    uint32 lru_hits = 0;
+    uint64 start = get_current_epoch_millis();
+    for (uint32 i = 0; i < keys.size(); i++)
+    {
+        int v;
+        if (lru.Get(keys[i], v))
+        {
+            lru_hits++;
+        }
+        else
+        {
+            LRUCache<DBItemKey, int>::CacheEntry erased;
+            lru.Insert(keys[i], 1, erased);
+        }
+    }
+    uint64 end = get_current_epoch_millis();
+    printf("Cost %" PRIu64 "ms to access lru cache %zu times, hit ratio %.4f, %u bytes overhead per entry.\n",
+            (end - start), keys.size(), (double) lru_hits / keys.size(), LRUCache<DBItemKey, int>::AverageBytesPerValue());
+
+    ClockCache<DBItemKey, int, DBItemKeyHash> clock;
+    uint32 clock_hits = 0;
+    start = get_current_epoch_millis();
+    for (uint32 i = 0; i < keys.size(); i++)
+    {
+        int v;
+        if (clock.Get(keys[i], v))
+        {
+            clock_hits++;
+        }
+        else
+        {
+            if (clock.Size() >= CACHE_PERF_CAPACITY)
+            {
+                ClockCache<DBItemKey, int, DBItemKeyHash>::CacheEntry victim;
+                clock.PopVictim(victim);
+            }
+            clock.Insert(keys[i], 1);
+        }
+    }
+    end = get_current_epoch_millis();
+    printf("Cost %" PRIu64 "ms to access clock cache %zu times, hit ratio %.4f, %zu bytes overhead per entry.\n",
+            (end - start), keys.size(), (double) clock_hits / keys.size(), clock.TableBytes() / clock.Size());
+    printf("=====================Cache Performace Test End=====================\n");
+}
+
+void test_bitop_performace(Ardb& db)
+{
+    DBID dbid = 0;
+    printf("=====================Bitop Performace Test Start=====================\n");
+    printf("Bitset kernels:%s\n", bits_kernel_name());
+    SliceArray keys;
+    char names[100][32];
+    for (uint32 i = 0; i < 100; i++)
+    {
+        sprintf(names[i], "perfbittest%u", i);
+        db.Del(dbid, names[i]);
+        for (uint32 j = 0; j < 500; j++)
+        {
+            db.SetBit(dbid, names[i], j * 409 + i, 1);
+        }
+        keys.push_back(names[i]);
+    }
+    uint32 loop = PERF_LOOP_COUNT / 1000;
+    uint64 start = get_current_epoch_millis();
+    int64 count = 0;
+    for (uint32 i = 0; i < loop; i++)
+    {
+        count = db.BitOPCount(dbid, "or", keys);
+    }
+    uint64 end = get_current_epoch_millis();
+    CHECK_FATAL(count != 50000, "bitopcount or failed:%" PRId64, count);
+    printf("Cost %" PRIu64 "ms to execute bitopcount or over 100 keys %u times, avg %.2f qps.\n", (end - start), loop,
+            loop * 1000.0 / (end - start + 1));
+    printf("=====================Bitop Performace Test End=====================\n");
+}
+
 void test_performance(Ardb& db)
 {
     test_string_performace(db);
+    test_concurrent_write_performace(db);
     test_nonzip_hash_performace(db);
     test_zip_hash_performace(db);
+    test_counter_performace(db);
     test_nonzip_set_performace(db);
     test_zip_set_performace(db);
     test_nonzip_list_performace(db);
     test_zip_list_performace(db);
     test_nonzip_zset_performace(db);
     test_zip_zset_performace(db);
+    test_bitop_performace(db);
+    test_key_compare_performace(db);
+    test_cache_performace(db);
 }
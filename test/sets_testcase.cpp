@@ -66,6 +66,14 @@ void test_set_member(Ardb& db)
     members.clear();
     db.SMembers(dbid, "myset", members);
     CHECK_FATAL(members.size() != 103, "SMembers myset failed:");
+
+    SliceArray vs;
+    vs.push_back("value99");
+    vs.push_back("v0");
+    vs.push_back("v2");
+    std::vector<int> exists;
+    db.SMIsMember(dbid, "myset", vs, exists);
+    CHECK_FATAL(exists.size() != 3 || exists[0] != 1 || exists[1] != 0 || exists[2] != 1, "SMIsMember myset failed:");
 }
 
 void test_set_diff(Ardb& db)
@@ -178,6 +186,46 @@ void test_set_union(Ardb& db)
     CHECK_FATAL(db.SCard(dbid, "myset4") != 105, "SUnionStore myset2 failed:%d", db.SCard(dbid, "myset4"));
 }
 
+void test_set_merge_large(Ardb& db)
+{
+    DBID dbid = 0;
+    db.SClear(dbid, "bigset");
+    db.SClear(dbid, "smallset");
+    db.SClear(dbid, "midset");
+    for (uint32 i = 0; i < 20000; i++)
+    {
+        char value[16];
+        sprintf(value, "member%05u", i);
+        db.SAdd(dbid, "bigset", value);
+        if (i % 4 == 0)
+        {
+            db.SAdd(dbid, "midset", value);
+        }
+    }
+    db.SAdd(dbid, "smallset", "member00000");
+    db.SAdd(dbid, "smallset", "member00007");
+    db.SAdd(dbid, "smallset", "member12344");
+    db.SAdd(dbid, "smallset", "member19996");
+    db.SAdd(dbid, "smallset", "nomember");
+    SliceArray keys;
+    keys.push_back("bigset");
+    keys.push_back("smallset");
+    keys.push_back("midset");
+    ValueDataArray values;
+    db.SInter(dbid, keys, values);
+    std::string str;
+    CHECK_FATAL(values.size() != 3, "SInter large failed:%zu", values.size());
+    CHECK_FATAL(values[1].ToString(str) != "member12344", "SInter large failed:%s", str.c_str());
+    uint32 count = 0;
+    db.SUnionCount(dbid, keys, count);
+    CHECK_FATAL(count != 20001, "SUnionCount large failed:%u", count);
+    db.SDiffCount(dbid, keys, count);
+    CHECK_FATAL(count != 14999, "SDiffCount large failed:%u", count);
+    keys.pop_back();
+    CHECK_FATAL(db.SInterStore(dbid, "midset", keys) != 4, "SInterStore large failed");
+    CHECK_FATAL(db.SCard(dbid, "midset") != 4, "SInterStore large failed:%d", db.SCard(dbid, "midset"));
+}
+
 void test_set_expire(Ardb& db)
 {
     DBID dbid = 0;
@@ -190,14 +238,94 @@ void test_set_expire(Ardb& db)
     CHECK_FATAL(db.Exists(dbid, "myset") == true, "Expire myset failed");
 }
 
+void test_set_l1_cache(Ardb& db)
+{
+    DBID dbid = 0;
+    if (db.GetL1Cache() == NULL)
+    {
+        return;
+    }
+    db.SClear(dbid, "myset");
+    db.SAdd(dbid, "myset", "a");
+    db.SAdd(dbid, "myset", "b");
+    CHECK_FATAL(db.GetL1Cache()->SyncLoad(dbid, "myset") != 0, "Load myset failed");
+    db.SAdd(dbid, "myset", "c");
+    CHECK_FATAL(!db.GetL1Cache()->IsCached(dbid, "myset"), "SAdd myset dropped cache");
+    CHECK_FATAL(!db.SIsMember(dbid, "myset", "c"), "SIsMember cached myset failed");
+    CHECK_FATAL(db.SCard(dbid, "myset") != 3, "SCard cached myset failed:%d", db.SCard(dbid, "myset"));
+    db.SRem(dbid, "myset", "a");
+    CHECK_FATAL(db.GetL1Cache()->IsCached(dbid, "myset"), "SRem myset did not invalidate cache");
+    CHECK_FATAL(db.SIsMember(dbid, "myset", "a"), "SIsMember myset failed");
+}
+
+void test_set_zip_patch(Ardb& db)
+{
+    DBID dbid = 0;
+    db.SClear(dbid, "myset");
+    const char* members[] = { "c", "30", "a", "-1", "1.5", "b", "10" };
+    uint32 count = sizeof(members) / sizeof(members[0]);
+    for (uint32 i = 0; i < count; i++)
+    {
+        CHECK_FATAL(db.SAdd(dbid, "myset", members[i]) != 1, "SAdd myset %s failed", members[i]);
+        CHECK_FATAL(db.SAdd(dbid, "myset", members[i]) != 0, "SAdd myset %s twice failed", members[i]);
+    }
+    for (uint32 i = 0; i < count; i++)
+    {
+        CHECK_FATAL(!db.SIsMember(dbid, "myset", members[i]), "SIsMember myset %s failed", members[i]);
+    }
+    CHECK_FATAL(db.SIsMember(dbid, "myset", "d"), "SIsMember myset failed");
+    CHECK_FATAL(db.SIsMember(dbid, "myset", "20"), "SIsMember myset failed");
+    CHECK_FATAL(db.SCard(dbid, "myset") != (int) count, "SCard myset failed:%d", db.SCard(dbid, "myset"));
+    ValueDataArray vs;
+    db.SMembers(dbid, "myset", vs);
+    std::string str;
+    CHECK_FATAL(vs.size() != count, "SMembers myset failed:%zu", vs.size());
+    CHECK_FATAL(vs[0].ToString(str) != "-1", "SMembers myset order failed:%s", str.c_str());
+    CHECK_FATAL(vs[count - 1].ToString(str) != "c", "SMembers myset order failed:%s", str.c_str());
+}
+
+void test_set_exact_card(Ardb& db)
+{
+    DBID dbid = 0;
+    db.SClear(dbid, "myset");
+    db.SClear(dbid, "myset2");
+    int added = 0;
+    for (uint32 i = 0; i < 100; i++)
+    {
+        char value[16];
+        sprintf(value, "value%u", i % 60);
+        added += db.SAdd(dbid, "myset", value);
+    }
+    CHECK_FATAL(added != 60 || db.SCard(dbid, "myset") != 60, "sadd duplicates failed:%d %d", added,
+            db.SCard(dbid, "myset"));
+    SliceArray rems;
+    rems.push_back("value1");
+    rems.push_back("value1");
+    rems.push_back("nosuchvalue");
+    CHECK_FATAL(db.SRem(dbid, "myset", rems) != 1, "srem non members failed");
+    CHECK_FATAL(db.SMove(dbid, "myset", "myset2", "value2") != 1 || db.SMove(dbid, "myset", "myset2", "value2") != 0,
+            "smove failed");
+    std::string v;
+    db.SPop(dbid, "myset", v);
+    CHECK_FATAL(db.SCard(dbid, "myset") != 57 || db.SCard(dbid, "myset2") != 1, "scard after smove/spop failed:%d",
+            db.SCard(dbid, "myset"));
+    uint32 stored = 0, counted = 0;
+    db.SCheck(dbid, "myset", false, stored, counted);
+    CHECK_FATAL(stored != 57 || counted != 57, "scheck failed:%u %u", stored, counted);
+}
+
 void test_sets(Ardb& db)
 {
     test_set_saddrem(db);
     test_set_nonzip_saddrem(db);
+    test_set_exact_card(db);
     test_set_member(db);
+    test_set_zip_patch(db);
     test_set_diff(db);
     test_set_inter(db);
     test_set_union(db);
+    test_set_merge_large(db);
     test_set_expire(db);
+    test_set_l1_cache(db);
 }
 
@@ -5,6 +5,7 @@
  *      Author: yinqiwen
  */
 #include "db.hpp"
+#include "replication/rdb.hpp"
 #include <string>
 
 using namespace ardb;
@@ -110,6 +111,166 @@ void test_strings_expire(Ardb& db)
     CHECK_FATAL(db.Exists(dbid, "intkey1") == true, "Expire intkey failed");
 }
 
+static void count_expired_keys(const DBID& db, const SliceArray& keys, void* data)
+{
+    *(uint32*) data += keys.size();
+}
+
+void test_strings_expire_wheel(Ardb& db)
+{
+    DBID dbid = 0;
+    uint32 expired = 0;
+    db.ExpireKeys(256, 50, count_expired_keys, &expired);
+    expired = 0;
+    for (uint32 i = 0; i < 1000; i++)
+    {
+        char key[64];
+        sprintf(key, "wheelkey%u", i);
+        db.Set(dbid, key, "v", 0, 200, 0);
+    }
+    db.Set(dbid, "wheelkey_persist", "v");
+    db.Pexpire(dbid, "wheelkey_persist", 200);
+    db.Persist(dbid, "wheelkey_persist");
+    db.Set(dbid, "wheelkey_reset", "v");
+    db.Pexpire(dbid, "wheelkey_reset", 200);
+    db.Set(dbid, "wheelkey_reset", "v");
+    usleep(400 * 1000);
+    db.ExpireKeys(256, 1000, count_expired_keys, &expired);
+    CHECK_FATAL(expired != 1000, "Expire wheel failed:%u", expired);
+    CHECK_FATAL(db.Exists(dbid, "wheelkey0") == true, "Expire wheel failed");
+    CHECK_FATAL(db.Exists(dbid, "wheelkey999") == true, "Expire wheel failed");
+    CHECK_FATAL(db.Exists(dbid, "wheelkey_persist") == false, "Expire wheel failed");
+    CHECK_FATAL(db.Exists(dbid, "wheelkey_reset") == false, "Expire wheel failed");
+    CHECK_FATAL(db.GetExpireBacklog() != 0, "Expire wheel failed");
+    db.Del(dbid, "wheelkey_persist");
+    db.Del(dbid, "wheelkey_reset");
+}
+
+void test_strings_expire_import(Ardb& db)
+{
+    DBID dbid = 0;
+    uint32 expired = 0;
+    std::string file = "/tmp/ardb/expire_import.ardb";
+    for (uint32 i = 0; i < 100; i++)
+    {
+        char key[64];
+        sprintf(key, "importkey%u", i);
+        db.Set(dbid, key, "v", 0, 200, 0);
+    }
+    ArdbDumpFile dump;
+    dump.Init(&db);
+    CHECK_FATAL(dump.Save(file, NULL, NULL) != 0, "Save dump failed");
+    usleep(400 * 1000);
+    db.ExpireKeys(256, 1000, count_expired_keys, &expired);
+    CHECK_FATAL(db.Exists(dbid, "importkey0") == true, "Expire import failed");
+    /*
+     * The imported expirations are below the horizon loaded by the last ExpireKeys
+     */
+    expired = 0;
+    CHECK_FATAL(dump.Load(file, NULL, NULL) != 0, "Load dump failed");
+    db.ExpireKeys(256, 1000, count_expired_keys, &expired);
+    CHECK_FATAL(expired != 100, "Expire import failed:%u", expired);
+    CHECK_FATAL(db.Exists(dbid, "importkey99") == true, "Expire import failed");
+    unlink(file.c_str());
+}
+
+void test_strings_mget(Ardb& db)
+{
+    DBID dbid = 0;
+    db.Set(dbid, "mgetkey1", "v1");
+    db.Del(dbid, "mgetkey2");
+    db.Set(dbid, "mgetkey3", "v3");
+    db.SClear(dbid, "mgetset");
+    db.SAdd(dbid, "mgetset", "v4");
+    db.Set(dbid, "mgetkey4", "v5", 0, 100, 0);
+    usleep(200 * 1000);
+    SliceArray keys;
+    keys.push_back("mgetkey3");
+    keys.push_back("mgetkey2");
+    keys.push_back("mgetset");
+    keys.push_back("mgetkey1");
+    keys.push_back("mgetkey4");
+    StringArray values;
+    std::vector<int> errs;
+    db.MGet(dbid, keys, values, errs);
+    CHECK_FATAL(values.size() != 5, "MGet failed:%zu", values.size());
+    CHECK_FATAL(values[0] != "v3" || errs[0] != 0, "MGet failed:%s", values[0].c_str());
+    CHECK_FATAL(!values[1].empty() || errs[1] != ERR_NOT_EXIST, "MGet failed:%d", errs[1]);
+    CHECK_FATAL(errs[2] != ERR_INVALID_TYPE, "MGet failed:%d", errs[2]);
+    CHECK_FATAL(values[3] != "v1" || errs[3] != 0, "MGet failed:%s", values[3].c_str());
+    CHECK_FATAL(!values[4].empty() || errs[4] != ERR_NOT_EXIST, "MGet expired key failed:%d", errs[4]);
+}
+
+void test_strings_l1_cache(Ardb& db)
+{
+    DBID dbid = 0;
+    if (db.GetL1Cache() == NULL)
+    {
+        return;
+    }
+    db.Set(dbid, "cachekey", "v1");
+    CHECK_FATAL(db.GetL1Cache()->SyncLoad(dbid, "cachekey") != 0, "Load cachekey failed");
+    db.Set(dbid, "cachekey", "v2");
+    std::string v;
+    db.Get(dbid, "cachekey", v);
+    CHECK_FATAL(v != "v2" || !db.GetL1Cache()->IsCached(dbid, "cachekey"), "Get cached cachekey failed:%s", v.c_str());
+    db.Append(dbid, "cachekey", "v3");
+    db.Get(dbid, "cachekey", v);
+    CHECK_FATAL(v != "v2v3", "Get cached cachekey failed:%s", v.c_str());
+    db.Expire(dbid, "cachekey", 100);
+    CHECK_FATAL(db.GetL1Cache()->IsCached(dbid, "cachekey"), "Expire cachekey did not invalidate cache");
+    CHECK_FATAL(db.GetL1Cache()->SyncLoad(dbid, "cachekey") == 0, "Loaded cachekey with expire time");
+    db.Get(dbid, "cachekey", v);
+    CHECK_FATAL(v != "v2v3", "Get cachekey failed:%s", v.c_str());
+}
+
+void test_strings_merge(Ardb& db)
+{
+    DBID dbid = 0;
+    Buffer incr5, incr3, app;
+    encode_merge_operand(incr5, ARDB_MERGE_STRING_INCRBY, ValueData((int64) 5));
+    encode_merge_operand(incr3, ARDB_MERGE_STRING_INCRBY, ValueData((int64) 3));
+    ValueData tail;
+    tail.SetValue("12", false);
+    encode_merge_operand(app, ARDB_MERGE_STRING_APPEND, tail);
+    Slice s5(incr5.GetRawReadBuffer(), incr5.ReadableBytes());
+    Slice s3(incr3.GetRawReadBuffer(), incr3.ReadableBytes());
+    Slice sa(app.GetRawReadBuffer(), app.ReadableBytes());
+
+    std::vector<Slice> ops;
+    ops.push_back(s5);
+    ops.push_back(s3);
+    ops.push_back(sa);
+    std::string merged, combined;
+    CHECK_FATAL(!ardb_merge_value(NULL, ops, merged), "Merge operands failed");
+    StringMetaValue* meta = (StringMetaValue*) decode_meta(merged.data(), merged.size(), false);
+    std::string str;
+    CHECK_FATAL(NULL == meta || meta->value.ToString(str) != "812", "Merged value failed:%s", str.c_str());
+    DELETE(meta);
+
+    CHECK_FATAL(!ardb_merge_operands(s5, s3, combined), "Combine incrby operands failed");
+    CHECK_FATAL(ardb_merge_operands(s5, sa, str), "Combined incrby with append operand");
+    ops.clear();
+    ops.push_back(combined);
+    ops.push_back(s5);
+    Slice existing(merged);
+    ardb_merge_value(&existing, ops, merged);
+    meta = (StringMetaValue*) decode_meta(merged.data(), merged.size(), false);
+    CHECK_FATAL(NULL == meta || meta->value.ToString(str) != "825", "Merged value failed:%s", str.c_str());
+    DELETE(meta);
+
+    db.Del(dbid, "mergekey");
+    db.MergeIncrby(dbid, "mergekey", 10);
+    db.MergeIncrby(dbid, "mergekey", -3);
+    db.MergeAppend(dbid, "mergekey", "a");
+    std::string v;
+    db.Get(dbid, "mergekey", v);
+    CHECK_FATAL(v != "7a", "Merge mergekey failed:%s", v.c_str());
+    db.MergeIncrby(dbid, "mergekey", 1);
+    db.Get(dbid, "mergekey", v);
+    CHECK_FATAL(v != "7a", "Merge incrby on non integer mergekey failed:%s", v.c_str());
+}
+
 void test_strings(Ardb& db)
 {
     test_strings_append(db);
@@ -122,5 +283,10 @@ void test_strings(Ardb& db)
     test_strings_exists(db);
     test_strings_setnx(db);
     test_strings_expire(db);
+    test_strings_expire_wheel(db);
+    test_strings_expire_import(db);
+    test_strings_mget(db);
+    test_strings_l1_cache(db);
+    test_strings_merge(db);
 }
 